@@ -84,6 +84,7 @@
 /* coreMQTT-Agent network manager includes. */
 #include "core_mqtt_agent_manager_events.h"
 #include "core_mqtt_agent_manager.h"
+#include "core_mqtt_agent_futures.h"
 
 /* Public function include. */
 #include "ota_over_mqtt_demo.h"
@@ -94,6 +95,7 @@
 //Ludo Includes
 #include "extras/TasksCommon.h"
 #include "extras/ledStrip.h"
+#include "extras/Metrics.h"
 #include "lan.h"
 
 /* Preprocessor definitions ****************************************************/
@@ -173,24 +175,8 @@
 
 #define MAX_JOB_ID_LENGTH                                ( 64U )
 
-/**
- * @brief Used to clear bits in a task's notification value.
- */
-#define MAX_UINT32                                       ( 0xffffffff )
-
 /* Struct definitions *********************************************************/
 
-/**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
- */
-struct MQTTAgentCommandContext
-{
-    MQTTStatus_t xReturnStatus;
-    TaskHandle_t xTaskToNotify;
-    void * pArgs;
-};
-
 /**
  * @ingroup ota_enum_types
  * @brief The OTA MQTT interface return status.
@@ -215,11 +201,6 @@ static const char * TAG = "ota_over_mqtt_demo";
  */
 static SemaphoreHandle_t bufferSemaphore;
 
-/**
- * @brief Static handle used for MQTT agent context.
- */
-extern MQTTAgentContext_t xGlobalMqttAgentContext;
-
 /**
  * @brief This boolean is set by the coreMQTT-Agent event handler and signals
  * the OTA demo task to suspend the OTA Agent.
@@ -231,6 +212,13 @@ static uint32_t numOfBlocksRemaining = 0;
 static uint32_t currentBlockOffset = 0;
 static uint8_t currentFileId = 0;
 static uint32_t totalBytesReceived = 0;
+
+/**
+ * @brief Written image bytes and the free event buffers during a download,
+ * uploaded by extras/Metrics.c.
+ */
+METRIC_COUNTER( xOtaBytesMetric, "ota.bytes" );
+METRIC_GAUGE( xOtaFreeBuffersMetric, "ota.freeBuffers" );
 char globalJobId[ MAX_JOB_ID_LENGTH ] = { 0 };
 
 static OtaDataEvent_t dataBuffers[ otademoconfigMAX_NUM_OTA_DATA_BUFFERS ] = { 0 };
@@ -256,8 +244,7 @@ const AppVersion32_t appFirmwareVersion =
  * @brief Function used by OTA agent to publish control messages to the MQTT broker.
  *
  * The implementation uses MQTT agent to queue a publish request. It then waits
- * for the request complete notification from the agent. The notification along with result of the
- * operation is sent back to the caller task using xTaskNotify API. For publishes involving QOS 1 and
+ * on the returned future until the agent completed the request. For publishes involving QOS 1 and
  * QOS2 the operation is complete once an acknowledgment (PUBACK) is received. OTA agent uses this function
  * to fetch new job, provide status update and send other control related messages to the MQTT broker.
  *
@@ -277,11 +264,9 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
 /**
  * @brief Function used by OTA agent to subscribe for a control or data packet from the MQTT broker.
  *
- * The implementation queues a SUBSCRIBE request for the topic filter with the MQTT agent. It then waits for
- * a notification of the request completion. Notification will be sent back to caller task,
- * using xTaskNotify APIs. MQTT agent also stores a callback provided by this function with
- * the associated topic filter. The callback will be used to
- * route any data received on the matching topic to the OTA agent. OTA agent uses this function
+ * The implementation queues a SUBSCRIBE request for the topic filter with the MQTT agent. It then waits on
+ * the returned future for the request completion. Data received on the matching topic is routed
+ * to the OTA agent by vOTAProcessMessage(). OTA agent uses this function
  * to subscribe to all topic filters necessary for receiving job related control messages as
  * well as firmware image chunks from MQTT broker.
  *
@@ -298,10 +283,7 @@ static OtaMqttStatus_t prvMQTTSubscribe( const char * pTopicFilter,
  * @brief Function is used by OTA agent to unsubscribe a topicfilter from MQTT broker.
  *
  * The implementation queues an UNSUBSCRIBE request for the topic filter with the MQTT agent. It then waits
- * for a successful completion of the request from the agent. Notification along with results of
- * operation is sent using xTaskNotify API to the caller task. MQTT agent also removes the topic filter
- * subscription from its memory so any future
- * packets on this topic will not be routed to the OTA agent.
+ * on the returned future for the completion of the request from the agent.
  *
  * @param[in] pTopicFilter Topic filter to be unsubscribed.
  * @param[in] topicFilterLength Length of the topic filter.
@@ -394,66 +376,27 @@ static bool prvMatchClientIdentifierInTopic( const char * pTopic,
     return isMatch;
 }
 
-static void prvCommandCallback( MQTTAgentCommandContext_t * pCommandContext,
-                                MQTTAgentReturnInfo_t * pxReturnInfo )
-{
-    pCommandContext->xReturnStatus = pxReturnInfo->returnCode;
-
-    if( pCommandContext->xTaskToNotify != NULL )
-    {
-        xTaskNotify( pCommandContext->xTaskToNotify, ( uint32_t ) ( pxReturnInfo->returnCode ), eSetValueWithOverwrite );
-    }
-}
-
 static OtaMqttStatus_t prvMQTTSubscribe( const char * pTopicFilter,
                                          uint16_t topicFilterLength,
                                          uint8_t ucQoS )
 {
     MQTTStatus_t mqttStatus;
-    uint32_t ulNotifiedValue;
-    MQTTAgentSubscribeArgs_t xSubscribeArgs = { 0 };
-    MQTTSubscribeInfo_t xSubscribeInfo = { 0 };
-    BaseType_t result;
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
-    MQTTAgentCommandContext_t xApplicationDefinedContext = { 0 };
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
 
     configASSERT( pTopicFilter != NULL );
     configASSERT( topicFilterLength > 0 );
 
-    xSubscribeInfo.pTopicFilter = pTopicFilter;
-    xSubscribeInfo.topicFilterLength = topicFilterLength;
-    xSubscribeInfo.qos = ucQoS;
-    xSubscribeArgs.pSubscribeInfo = &xSubscribeInfo;
-    xSubscribeArgs.numSubscriptions = 1;
-
-    xApplicationDefinedContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
-
-    xCommandParams.blockTimeMs = otademoconfigMQTT_TIMEOUT_MS;
-    xCommandParams.cmdCompleteCallback = prvCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xApplicationDefinedContext;
-
-    xTaskNotifyStateClear( NULL );
-
-    mqttStatus = MQTTAgent_Subscribe( &xGlobalMqttAgentContext,
-                                      &xSubscribeArgs,
-                                      &xCommandParams );
-
-    /* Wait for command to complete so MQTTSubscribeInfo_t remains in scope for the
-     * duration of the command. */
-    if( mqttStatus == MQTTSuccess )
-    {
-        result = xTaskNotifyWait( 0, MAX_UINT32, &ulNotifiedValue, portMAX_DELAY );
-
-        if( result == pdTRUE )
-        {
-            mqttStatus = xApplicationDefinedContext.xReturnStatus;
-        }
-        else
-        {
-            mqttStatus = MQTTRecvFailed;
-        }
-    }
+    /* Incoming publishes are routed to the OTA agent by vOTAProcessMessage(),
+     * so no callback is registered with the subscription manager. */
+    mqttStatus = xMqttAgentFutureGet( xMqttAgentFutureSubscribe( pTopicFilter,
+                                                                 topicFilterLength,
+                                                                 ( MQTTQoS_t ) ucQoS,
+                                                                 NULL,
+                                                                 NULL,
+                                                                 otademoconfigMQTT_TIMEOUT_MS,
+                                                                 NULL,
+                                                                 NULL ),
+                                      portMAX_DELAY );
 
     if( mqttStatus != MQTTSuccess )
     {
@@ -481,11 +424,8 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
                                        uint8_t qos )
 {
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
-    BaseType_t result;
     MQTTStatus_t mqttStatus = MQTTBadParameter;
     MQTTPublishInfo_t publishInfo = { 0 };
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
-    MQTTAgentCommandContext_t xCommandContext = { 0 };
 
     publishInfo.pTopicName = pacTopic;
     publishInfo.topicNameLength = topicLen;
@@ -493,32 +433,13 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
     publishInfo.pPayload = pMsg;
     publishInfo.payloadLength = msgSize;
 
-    xCommandContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
-    xTaskNotifyStateClear( NULL );
-
-    xCommandParams.blockTimeMs = otademoconfigMQTT_TIMEOUT_MS;
-    xCommandParams.cmdCompleteCallback = prvCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xCommandContext;
-
-    mqttStatus = MQTTAgent_Publish( &xGlobalMqttAgentContext,
-                                    &publishInfo,
-                                    &xCommandParams );
-
-    /* Wait for command to complete so MQTTSubscribeInfo_t remains in scope for the
-     * duration of the command. */
-    if( mqttStatus == MQTTSuccess )
-    {
-        result = xTaskNotifyWait( 0, MAX_UINT32, NULL, portMAX_DELAY );
-
-        if( result != pdTRUE )
-        {
-            mqttStatus = MQTTSendFailed;
-        }
-        else
-        {
-            mqttStatus = xCommandContext.xReturnStatus;
-        }
-    }
+    /* Wait for command to complete so the topic and message remain in scope
+     * for the duration of the command. */
+    mqttStatus = xMqttAgentFutureGet( xMqttAgentFuturePublish( &publishInfo,
+                                                               otademoconfigMQTT_TIMEOUT_MS,
+                                                               NULL,
+                                                               NULL ),
+                                      portMAX_DELAY );
 
     if( mqttStatus != MQTTSuccess )
     {
@@ -544,53 +465,20 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
                                            uint8_t ucQoS )
 {
     MQTTStatus_t mqttStatus;
-    uint32_t ulNotifiedValue;
-    MQTTAgentSubscribeArgs_t xSubscribeArgs = { 0 };
-    MQTTSubscribeInfo_t xSubscribeInfo = { 0 };
-    BaseType_t result;
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
-    MQTTAgentCommandContext_t xApplicationDefinedContext = { 0 };
     OtaMqttStatus_t otaRet = OtaMqttSuccess;
 
     configASSERT( pTopicFilter != NULL );
     configASSERT( topicFilterLength > 0 );
 
-    xSubscribeInfo.pTopicFilter = pTopicFilter;
-    xSubscribeInfo.topicFilterLength = topicFilterLength;
-    xSubscribeInfo.qos = ucQoS;
-    xSubscribeArgs.pSubscribeInfo = &xSubscribeInfo;
-    xSubscribeArgs.numSubscriptions = 1;
-
-
-    xApplicationDefinedContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
-
-    xCommandParams.blockTimeMs = otademoconfigMQTT_TIMEOUT_MS;
-    xCommandParams.cmdCompleteCallback = prvCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xApplicationDefinedContext;
-
     ESP_LOGI( TAG, "Unsubscribing to topic filter: %s", pTopicFilter );
-    xTaskNotifyStateClear( NULL );
-
-
-    mqttStatus = MQTTAgent_Unsubscribe( &xGlobalMqttAgentContext,
-                                        &xSubscribeArgs,
-                                        &xCommandParams );
-
-    /* Wait for command to complete so MQTTSubscribeInfo_t remains in scope for the
-     * duration of the command. */
-    if( mqttStatus == MQTTSuccess )
-    {
-        result = xTaskNotifyWait( 0, MAX_UINT32, &ulNotifiedValue, portMAX_DELAY );
 
-        if( result == pdTRUE )
-        {
-            mqttStatus = xApplicationDefinedContext.xReturnStatus;
-        }
-        else
-        {
-            mqttStatus = MQTTRecvFailed;
-        }
-    }
+    mqttStatus = xMqttAgentFutureGet( xMqttAgentFutureUnsubscribe( pTopicFilter,
+                                                                   topicFilterLength,
+                                                                   ( MQTTQoS_t ) ucQoS,
+                                                                   otademoconfigMQTT_TIMEOUT_MS,
+                                                                   NULL,
+                                                                   NULL ),
+                                      portMAX_DELAY );
 
     if( mqttStatus != MQTTSuccess )
     {
@@ -738,6 +626,7 @@ static int16_t handleMqttStreamsBlockArrived( uint8_t * data,
     if( writeblockRes > 0 )
     {
         totalBytesReceived += writeblockRes;
+        MetricAdd( &xOtaBytesMetric, writeblockRes );
     }
 
     return writeblockRes;
@@ -1199,6 +1088,7 @@ static void processOTAEvents( void )
                 int32_t fileId;
                 int32_t blockId;
                 int32_t blockSize;
+                uint16_t usFreeBuffers;
                 static int32_t lastReceivedblockId = -1;
 
                 /*
@@ -1245,9 +1135,13 @@ static void processOTAEvents( void )
                     currentBlockOffset++;
                 }
 
+                /* The telemetry keeps the minimum of the interval, the log is for debugging only. */
+                usFreeBuffers = getFreeOTABuffers();
+                MetricSet( &xOtaFreeBuffersMetric, usFreeBuffers );
+
                 if( ( numOfBlocksRemaining % 10 ) == 0 )
                 {
-                    ESP_LOGI( TAG, "Free OTA buffers %u", getFreeOTABuffers() );
+                    ESP_LOGD( TAG, "Free OTA buffers %u", usFreeBuffers );
                 }
 
                 if( numOfBlocksRemaining == 0 )
@@ -1496,6 +1390,8 @@ void vStartOTACodeSigningDemo( void )
     BaseType_t xResult;
 
     xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
+    MetricRegister( &xOtaBytesMetric );
+    MetricRegister( &xOtaFreeBuffersMetric );
 
     if( ( xResult = xTaskCreate( prvOTADemoTask,
                                  "OTADemoTask",
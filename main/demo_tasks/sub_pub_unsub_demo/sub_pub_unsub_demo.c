@@ -33,13 +33,9 @@
  * prvSubscribePublishUnsubscribeTask().  prvSubscribePublishUnsubscribeTask()
  * subscribes to a topic, publishes a message to the same
  * topic, receives the message, then unsubscribes from the topic in a loop.
- * The command context sent to MQTTAgent_Publish(), MQTTAgent_Subscribe(), and
- * MQTTAgent_Unsubscribe contains a unique number that is sent back to the task
- * as a task notification from the callback function that executes when the
- * operations are acknowledged (or just sent in the case of QoS 0).  The
- * task checks the number it receives from the callback equals the number it
- * previously set in the command context before printing out either a success
- * or failure message.
+ * Publishes and subscribes go through the shared futures of
+ * core_mqtt_agent_futures.h, which complete when the operations are
+ * acknowledged (or just sent in the case of QoS 0).
  */
 
 /* Includes *******************************************************************/
@@ -47,7 +43,10 @@
 /* Standard includes. */
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
 
 /* FreeRTOS includes. */
 #include "freertos/FreeRTOS.h"
@@ -68,6 +67,7 @@
 /* coreMQTT-Agent network manager include. */
 #include "core_mqtt_agent_manager.h"
 #include "core_mqtt_agent_manager_events.h"
+#include "core_mqtt_agent_futures.h"
 
 /* Subscription manager include. */
 #include "subscription_manager.h"
@@ -83,6 +83,14 @@
 #include "extras/ledStrip.h"
 #include "extras/sntpTime.h"
 #include "extras/TasksCommon.h"
+#include "extras/ResourceMonitor.h"
+#include "extras/Scheduler.h"
+#include "extras/BootProfile.h"
+#include "extras/Settings.h"
+#include "extras/RevokedFilter.h"
+#include "extras/AccessRules.h"
+#include "extras/CborMessages.h"
+#include "extras/Metrics.h"
 #include "lan.h"
 
 //Json Stuff
@@ -97,9 +105,25 @@
 
 /* MQTT event group bit definitions. */
 #define MQTT_INCOMING_PUBLISH_RECEIVED_BIT         ( 1 << 0 )
-#define MQTT_PUBLISH_COMMAND_COMPLETED_BIT         ( 1 << 1 )
-#define MQTT_SUBSCRIBE_COMMAND_COMPLETED_BIT       ( 1 << 2 )
-#define MQTT_UNSUBSCRIBE_COMMAND_COMPLETED_BIT     ( 1 << 3 )
+
+/**
+ * @brief Upper bound for scheduler jobs waiting on a command acknowledgment.
+ * They share one worker, so a lost ack must not stall the other jobs.
+ */
+#define ludoACK_TIMEOUT_MS                         ( 5000U )
+
+/**
+ * @brief Period in which the settings job retries failed subscriptions and
+ * an unanswered settings request while connected.
+ */
+#define ludoSETTINGS_RETRY_MS                      ( 30000U )
+
+/* Payload formats offered with the settings request, see extras/CborMessages.h. */
+#if CONFIG_CBOR_MESSAGES
+    #define ludoWIRE_FORMATS                       "json,cbor"
+#else
+    #define ludoWIRE_FORMATS                       "json"
+#endif
 
 /* Struct definitions *********************************************************/
 
@@ -110,21 +134,11 @@
 typedef struct IncomingPublishCallbackContext
 {
     EventGroupHandle_t xMqttEventGroup;
+    SchedulerJob * pxJobToTrigger; /* Optional, run on the scheduler for each publish. */
     char pcIncomingPublish[ subpubunsubconfigSTRING_BUFFER_LENGTH ];
+    size_t xIncomingPublishLength; /* Without the terminator, CBOR payloads may contain 0x00. */
 } IncomingPublishCallbackContext_t;
 
-/**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
- */
-struct MQTTAgentCommandContext
-{
-    MQTTStatus_t xReturnStatus;
-    EventGroupHandle_t xMqttEventGroup;
-    IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext;
-    void * pArgs;
-};
-
 /**
  * @brief Parameters for this task.
  */
@@ -159,87 +173,91 @@ static char topicBuf[ subpubunsubconfigNUM_TASKS_TO_CREATE ][ subpubunsubconfigS
 static EventGroupHandle_t xNetworkEventGroup;
 
 /**
- * @brief The semaphore used to lock access to ulMessageID to eliminate a race
- * condition in which multiple tasks try to increment/get ulMessageID.
+ * @brief Settings channel state. Context and topic must outlive the
+ * subscription, both jobs run on the shared scheduler.
  */
-static SemaphoreHandle_t xMessageIdSemaphore;
+static IncomingPublishCallbackContext_t xSettingsIncomingPublishCallbackContext = { 0 };
+static char pcSettingsTopic[ 200 ];
+static bool bSettingsTopicsBuilt = false;
+static SchedulerJob * pxSettingsRequestJob = NULL;
+static SchedulerJob * pxSettingsApplyJob = NULL;
 
 /**
- * @brief The message ID for the next message sent by this demo.
+ * @brief Binary filter of revoked UIDs and time-window rules, sent next to
+ * the settings document.
  */
-static uint32_t ulMessageId = 0;
+static char pcRevokedTopic[ 200 ];
+static char pcRulesTopic[ 200 ];
 
-/* Static function declarations ***********************************************/
+/**
+ * @brief One subscription of the settings job. Started without waiting,
+ * ludoChannelSubscribeDone() marks it done and triggers the job again.
+ */
+typedef struct ChannelSubscription
+{
+    char * pcTopicFilter;
+    IncomingPubCallback_t pxCallback;
+    void * pvContext;
+    MqttAgentFutureHandle_t xFuture; /* Pending SUBSCRIBE, NULL otherwise. */
+    bool bSubscribed;
+} ChannelSubscription_t;
 
 /**
- * @brief ESP Event Loop library handler for coreMQTT-Agent events.
- *
- * This handles events defined in core_mqtt_agent_events.h.
+ * @brief Settings request, sent once per connect after all subscriptions
+ * exist. Topic and payload must outlive the pending publish.
  */
-static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
-                                          esp_event_base_t xEventBase,
-                                          int32_t lEventId,
-                                          void * pvEventData );
+static atomic_bool bSettingsRequestPending = false;
+static MqttAgentFutureHandle_t xSettingsRequestFuture = NULL;
+static char pcSettingsRequestTopic[ 200 ];
+static char pcSettingsRequestPayload[ 300 ];
 
 /**
- * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when the
- * broker ACKs the SUBSCRIBE message.  Its implementation sends a notification
- * to the task that called MQTTAgent_Subscribe() to let the task know the
- * SUBSCRIBE operation completed.  It also sets the xReturnStatus of the
- * structure passed in as the command's context to the value of the
- * xReturnStatus parameter - which enables the task to check the status of the
- * operation.
- *
- * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
- *
- * @param[in] pxCommandContext Context of the initial command.
- * @param[in].xReturnStatus The result of the command.
+ * @brief Access channel state. The response topic stays subscribed for the
+ * whole session, requests carry an id that the cloud echoes back so a late
+ * answer to an earlier scan is not taken for the current one. Only one
+ * request is outstanding at a time. ulAccessPendingId is the id the response
+ * callback still accepts, 0 if none; whoever clears it owns the answer.
  */
-static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                         MQTTAgentReturnInfo_t * pxReturnInfo );
+static IncomingPublishCallbackContext_t xAccessIncomingPublishCallbackContext = { 0 };
+static char pcAccessResponseTopic[ 200 ];
+static char pcAccessRequestTopic[ 200 ];
+static atomic_bool bAccessSubscribed = false;
+static _Atomic uint32_t ulAccessPendingId = 0;
+static uint32_t ulAccessRequestId = 0;
+static bool bAccessResponseGranted = false;
 
-static void prvUnsubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                           MQTTAgentReturnInfo_t * pxReturnInfo );
+/**
+ * @brief Cloud answers to access requests and the time from the scan to the
+ * answer in milliseconds, uploaded by extras/Metrics.c.
+ */
+METRIC_COUNTER( xAccessGrantedMetric, "access.granted" );
+METRIC_COUNTER( xAccessRefusedMetric, "access.refused" );
+METRIC_COUNTER( xAccessTimeoutMetric, "access.timeout" );
+METRIC_HISTOGRAM( xAccessLatencyMetric, "access.ms" );
 
 /**
- * @brief Passed into MQTTAgent_Publish() as the callback to execute when the
- * broker ACKs the PUBLISH message.  Its implementation sends a notification
- * to the task that called MQTTAgent_Publish() to let the task know the
- * PUBLISH operation completed.  It also sets the xReturnStatus of the
- * structure passed in as the command's context to the value of the
- * xReturnStatus parameter - which enables the task to check the status of the
- * operation.
- *
- * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
- *
- * @param[in] pxCommandContext Context of the initial command.
- * @param[in].xReturnStatus The result of the command.
+ * @brief Audit publishes of local grants that could not be sent, because the
+ * channel was not ready or the publish failed.
  */
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo );
+METRIC_COUNTER( xAccessAuditDroppedMetric, "access.auditDropped" );
+
+/* Static function declarations ***********************************************/
 
 /**
- * @brief Called by the task to wait for event from a callback function
- * after the task first executes either MQTTAgent_Publish()* or
- * MQTTAgent_Subscribe().
- *
- * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
- *
- * @param[in] xMqttEventGroup Event group used for MQTT events.
- * @param[in] uxBitsToWaitFor Event to wait for.
+ * @brief ESP Event Loop library handler for coreMQTT-Agent events.
  *
- * @return Received event.
+ * This handles events defined in core_mqtt_agent_events.h.
  */
-static EventBits_t prvWaitForEvent( EventGroupHandle_t xMqttEventGroup,
-                                    EventBits_t uxBitsToWaitFor );
+static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
+                                          esp_event_base_t xEventBase,
+                                          int32_t lEventId,
+                                          void * pvEventData );
 
 /**
- * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when
+ * @brief Passed into xMqttAgentFutureSubscribe() as the callback to execute when
  * there is an incoming publish on the topic being subscribed to.  Its
- * implementation just logs information about the incoming publish including
- * the publish messages source topic and payload.
- *
- * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
+ * implementation copies the payload into the context's buffer and signals
+ * the waiting task or scheduler job.
  *
  * @param[in] pvIncomingPublishCallbackContext Context of the initial command.
  * @param[in] pxPublishInfo Deserialized publish.
@@ -248,35 +266,10 @@ static void prvIncomingPublishCallback( void * pvIncomingPublishCallbackContext,
                                         MQTTPublishInfo_t * pxPublishInfo );
 
 /**
- * @brief Subscribe to the topic the demo task will also publish to - that
- * results in all outgoing publishes being published back to the task
- * (effectively echoed back).
- *
- * @param[in] pxIncomingPublishCallbackContext The callback context used when
- * data is received from pcTopicFilter.
- * @param[in] xQoS The quality of service (QoS) to use.  Can be zero or one
- * for all MQTT brokers.  Can also be QoS2 if supported by the broker.  AWS IoT
- * does not support QoS2.
- * @param[in] pcTopicFilter Topic filter to subscribe to.
- * @param[in] xMqttEventGroup Event group used for MQTT events.
+ * @brief Whether coreMQTT-Agent is connected and no OTA update is in
+ * progress, without blocking.
  */
-static void prvSubscribeToTopic( IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext,
-                                 MQTTQoS_t xQoS,
-                                 char * pcTopicFilter,
-                                 EventGroupHandle_t xMqttEventGroup );
-
-/**
- * @brief Unsubscribe to the topic the demo task will also publish to.
- *
- * @param[in] xQoS The quality of service (QoS) to use.  Can be zero or one
- * for all MQTT brokers.  Can also be QoS2 if supported by the broker.  AWS IoT
- * does not support QoS2.
- * @param[in] pcTopicFilter Topic filter to unsubscribe from.
- * @param[in] xMqttEventGroup Event group used for MQTT events.
- */
-static void prvUnsubscribeToTopic( MQTTQoS_t xQoS,
-                                   char * pcTopicFilter,
-                                   EventGroupHandle_t xMqttEventGroup );
+static bool prvAgentReady( void );
 
 /**
  * @brief The function that implements the task demonstrated by this file.
@@ -302,6 +295,25 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
             xEventGroupSetBits( xNetworkEventGroup,
                                 CORE_MQTT_AGENT_CONNECTED_BIT );
             sntpTimeTaskStart();
+            atomic_store( &bSettingsRequestPending, true );
+            SchedulerTrigger( pxSettingsRequestJob );
+
+            /* Scans held back during the outage can go out now. Before the
+             * first settings job the subscription does not exist yet, the job
+             * wakes the access task itself. */
+            if( atomic_load( &bAccessSubscribed ) )
+            {
+                NfcAccessChannelReady();
+            }
+
+            /* The readers run from boot and across disconnects, scans wait
+             * for the access channel. Only retry a start that failed at boot.
+             * The settings response only retunes feedback and polling. */
+            if( !NFCStarted() )
+            {
+                StartNFC();
+            }
+            RgbLedAWSConnected();
             break;
 
         case CORE_MQTT_AGENT_DISCONNECTED_EVENT:
@@ -326,6 +338,8 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
                       "commands from being enqueued." );
             xEventGroupSetBits( xNetworkEventGroup,
                                 CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
+            NfcAccessChannelReady();
+            SchedulerTrigger( pxSettingsRequestJob );
             break;
 
         default:
@@ -336,661 +350,569 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
     }
 }
 
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+static void prvIncomingPublishCallback( void * pvIncomingPublishCallbackContext,
+                                        MQTTPublishInfo_t * pxPublishInfo )
 {
-    /* Store the result in the application defined context so the task that
-     * initiated the publish can check the operation's status. */
-    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+    IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext = ( IncomingPublishCallbackContext_t * ) pvIncomingPublishCallbackContext;
 
-    if( pxCommandContext->xMqttEventGroup != NULL )
+    /* Create a message that contains the incoming MQTT payload to the logger,
+     * terminating the string first. */
+    if( pxPublishInfo->payloadLength < subpubunsubconfigSTRING_BUFFER_LENGTH )
     {
-        xEventGroupSetBits( pxCommandContext->xMqttEventGroup,
-                            MQTT_PUBLISH_COMMAND_COMPLETED_BIT );
-    }
-}
-
-static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                         MQTTAgentReturnInfo_t * pxReturnInfo )
-{
-    bool xSubscriptionAdded = false;
-    MQTTAgentSubscribeArgs_t * pxSubscribeArgs = ( MQTTAgentSubscribeArgs_t * ) pxCommandContext->pArgs;
-
-    /* Store the result in the application defined context so the task that
-     * initiated the subscribe can check the operation's status. */
-    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+        memcpy( ( void * ) ( pxIncomingPublishCallbackContext->pcIncomingPublish ),
+                pxPublishInfo->pPayload,
+                pxPublishInfo->payloadLength );
 
-    /* Check if the subscribe operation is a success. */
-    if( pxReturnInfo->returnCode == MQTTSuccess )
+        ( pxIncomingPublishCallbackContext->pcIncomingPublish )[ pxPublishInfo->payloadLength ] = 0x00;
+        pxIncomingPublishCallbackContext->xIncomingPublishLength = pxPublishInfo->payloadLength;
+    }
+    else
     {
-        /* Add subscription so that incoming publishes are routed to the application
-         * callback. */
-        xSubscriptionAdded = addSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
-                                              pxSubscribeArgs->pSubscribeInfo->pTopicFilter,
-                                              pxSubscribeArgs->pSubscribeInfo->topicFilterLength,
-                                              prvIncomingPublishCallback,
-                                              ( void * ) ( pxCommandContext->pxIncomingPublishCallbackContext ) );
+        memcpy( ( void * ) ( pxIncomingPublishCallbackContext->pcIncomingPublish ),
+                pxPublishInfo->pPayload,
+                subpubunsubconfigSTRING_BUFFER_LENGTH );
 
-        if( xSubscriptionAdded == false )
-        {
-            ESP_LOGE( TAG,
-                      "Failed to register an incoming publish callback for topic %.*s.",
-                      pxSubscribeArgs->pSubscribeInfo->topicFilterLength,
-                      pxSubscribeArgs->pSubscribeInfo->pTopicFilter );
-        }
+        ( pxIncomingPublishCallbackContext->pcIncomingPublish )[ subpubunsubconfigSTRING_BUFFER_LENGTH - 1 ] = 0x00;
+        pxIncomingPublishCallbackContext->xIncomingPublishLength = subpubunsubconfigSTRING_BUFFER_LENGTH - 1;
     }
 
-    if( pxCommandContext->xMqttEventGroup != NULL )
+    xEventGroupSetBits( pxIncomingPublishCallbackContext->xMqttEventGroup,
+                        MQTT_INCOMING_PUBLISH_RECEIVED_BIT );
+
+    if( pxIncomingPublishCallbackContext->pxJobToTrigger != NULL )
     {
-        xEventGroupSetBits( pxCommandContext->xMqttEventGroup,
-                            MQTT_SUBSCRIBE_COMMAND_COMPLETED_BIT );
+        SchedulerTrigger( pxIncomingPublishCallbackContext->pxJobToTrigger );
     }
 }
 
-static void prvUnsubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+static bool prvAgentReady( void )
 {
-    MQTTAgentSubscribeArgs_t * pxUnsubscribeArgs = ( MQTTAgentSubscribeArgs_t * ) pxCommandContext->pArgs;
+    return ( xNetworkEventGroup != NULL ) &&
+           ( ( xEventGroupGetBits( xNetworkEventGroup ) & ( CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT ) ) ==
+             ( CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT ) );
+}
 
-    /* Store the result in the application defined context so the task that
-     * initiated the subscribe can check the operation's status. */
-    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+//integer to set the payload Size
+const int LudoPayloadSize = 1500;
+//and for TopicSize
+const int LudoTopicSize = 200;
 
-    /* Check if the unsubscribe operation is a success. */
-    if( pxReturnInfo->returnCode == MQTTSuccess )
-    {
-        /* Remove subscription from subscription manager. */
-        removeSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
-                            pxUnsubscribeArgs->pSubscribeInfo->pTopicFilter,
-                            pxUnsubscribeArgs->pSubscribeInfo->topicFilterLength );
-    }
+//Event Groups werden für den Resource Monitor mitgezählt
+static EventGroupHandle_t prvCreateEventGroup( void )
+{
+    EventGroupHandle_t xEventGroup = xEventGroupCreate();
 
-    if( pxCommandContext->xMqttEventGroup != NULL )
+    if( xEventGroup != NULL )
     {
-        xEventGroupSetBits( pxCommandContext->xMqttEventGroup,
-                            MQTT_UNSUBSCRIBE_COMMAND_COMPLETED_BIT );
+        ResourceMonitorTrack( RESOURCE_EVENT_GROUPS, 1 );
     }
+
+    return xEventGroup;
 }
 
-static EventBits_t prvWaitForEvent( EventGroupHandle_t xMqttEventGroup,
-                                    EventBits_t uxBitsToWaitFor )
+//Gibt die Kopie frei, sobald der Agent fertig ist, auch wenn der Aufrufer nicht mehr wartet
+static void ludoPublishCopyDone( MqttAgentFutureHandle_t xFuture, MQTTStatus_t xStatus, void * pvContext )
 {
-    EventBits_t xReturn;
-
-    xReturn = xEventGroupWaitBits( xMqttEventGroup,
-                                   uxBitsToWaitFor,
-                                   pdTRUE, /* xClearOnExit. */
-                                   pdTRUE, /* xWaitForAllBits. */
-                                   portMAX_DELAY );
-    return xReturn;
+    ( void ) xFuture;
+    ( void ) xStatus;
+    free( pvContext );
 }
 
-static void prvIncomingPublishCallback( void * pvIncomingPublishCallbackContext,
-                                        MQTTPublishInfo_t * pxPublishInfo )
+bool prvPublishToAWS(char *pcTopic, char *pcPayload)
 {
-    IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext = ( IncomingPublishCallbackContext_t * ) pvIncomingPublishCallbackContext;
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    MqttAgentFutureHandle_t xFuture;
+    MQTTStatus_t xStatus = MQTTRecvFailed;
+    size_t xTopicLength = strlen(pcTopic);
+    size_t xPayloadLength = strlen(pcPayload);
+    char *pcCopy;
+
+    // Nicht auf die Verbindung warten, der Aufrufer versucht es beim nächsten Mal wieder
+    if( !prvAgentReady() )
+    {
+        ESP_LOGW(TAG, "Not connected, dropping publish to %s", pcTopic);
+        return false;
+    }
 
-    /* Create a message that contains the incoming MQTT payload to the logger,
-     * terminating the string first. */
-    if( pxPublishInfo->payloadLength < subpubunsubconfigSTRING_BUFFER_LENGTH )
+    //Topic und Payload müssen das begrenzte Warten überleben, daher eine Kopie
+    pcCopy = (char *) malloc(xTopicLength + 1 + xPayloadLength);
+    if( pcCopy == NULL )
     {
-        memcpy( ( void * ) ( pxIncomingPublishCallbackContext->pcIncomingPublish ),
-                pxPublishInfo->pPayload,
-                pxPublishInfo->payloadLength );
+        ESP_LOGE(TAG, "Failed to allocate memory for publish to %s", pcTopic);
+        return false;
+    }
+    memcpy(pcCopy, pcTopic, xTopicLength + 1);
+    memcpy(pcCopy + xTopicLength + 1, pcPayload, xPayloadLength);
+
+    xPublishInfo.qos = ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL;
+    xPublishInfo.pTopicName = pcCopy;
+    xPublishInfo.topicNameLength = ( uint16_t ) xTopicLength;
+    xPublishInfo.pPayload = pcCopy + xTopicLength + 1;
+    xPublishInfo.payloadLength = ( uint16_t ) xPayloadLength;
+
+    xFuture = xMqttAgentFuturePublish( &xPublishInfo, subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS,
+                                       ludoPublishCopyDone, pcCopy );
+    if( xFuture == NULL )
+    {
+        free(pcCopy);
+        ESP_LOGW(TAG, "No free future, dropping publish to %s", pcTopic);
+        return false;
+    }
 
-        ( pxIncomingPublishCallbackContext->pcIncomingPublish )[ pxPublishInfo->payloadLength ] = 0x00;
+    //Läuft auf dem Scheduler-Worker, ein verlorenes PUBACK darf ihn nicht aufhalten
+    if( xMqttAgentFutureWait( xFuture, pdMS_TO_TICKS( ludoACK_TIMEOUT_MS ), &xStatus ) == pdFALSE )
+    {
+        xStatus = MQTTRecvFailed;
     }
-    else
+    vMqttAgentFutureRelease( xFuture );
+
+    if( xStatus != MQTTSuccess )
     {
-        memcpy( ( void * ) ( pxIncomingPublishCallbackContext->pcIncomingPublish ),
-                pxPublishInfo->pPayload,
-                subpubunsubconfigSTRING_BUFFER_LENGTH );
+        ESP_LOGW(TAG, "Error %s or timed out waiting for ack for publish to %s",
+                 MQTT_Status_strerror( xStatus ), pcTopic);
+        return false;
+    }
 
-        ( pxIncomingPublishCallbackContext->pcIncomingPublish )[ subpubunsubconfigSTRING_BUFFER_LENGTH - 1 ] = 0x00;
+    return true;
+}
+
+bool prvSubscribeRawToAWS(char *pcTopicFilter, IncomingPubCallback_t pxCallback, void *pvContext)
+{
+    MQTTStatus_t xStatus;
+
+    if( !prvAgentReady() )
+    {
+        return false;
     }
 
-    xEventGroupSetBits( pxIncomingPublishCallbackContext->xMqttEventGroup,
-                        MQTT_INCOMING_PUBLISH_RECEIVED_BIT );
+    // Ein Timeout lässt das SUBSCRIBE weiterlaufen, der Aufrufer versucht es beim nächsten Lauf wieder
+    xStatus = xMqttAgentFutureGet( xMqttAgentFutureSubscribe( pcTopicFilter,
+                                                              ( uint16_t ) strlen( pcTopicFilter ),
+                                                              ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL,
+                                                              pxCallback,
+                                                              pvContext,
+                                                              subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS,
+                                                              NULL,
+                                                              NULL ),
+                                   pdMS_TO_TICKS( ludoACK_TIMEOUT_MS ) );
+
+    if( xStatus != MQTTSuccess )
+    {
+        ESP_LOGW( TAG,
+                  "Error %s or timed out waiting for ack to subscribe to %s",
+                  MQTT_Status_strerror( xStatus ),
+                  pcTopicFilter );
+        return false;
+    }
+
+    return true;
 }
 
-static void prvPublishToTopic( MQTTQoS_t xQoS,
-                               char * pcTopicName,
-                               char * pcPayload,
-                               EventGroupHandle_t xMqttEventGroup )
+//Liest die Antwort in JSON oder CBOR, unabhängig vom Format der Anfrage
+static bool ludoParseAccessResponse( const void * pvPayload, size_t xLength, bool * pbAccess, uint32_t * pulRequestId )
 {
-    uint32_t ulPublishMessageId = 0;
+    if( CborIsMessage( pvPayload, xLength ) )
+    {
+        ESP_LOGW( TAG, "Access received: %u bytes CBOR", ( unsigned ) xLength );
+        return CborParseAccess( pvPayload, xLength, pbAccess, pulRequestId );
+    }
 
-    MQTTStatus_t xCommandAdded;
-    EventBits_t xReceivedEvent = 0;
+    ESP_LOGW( TAG, "Access received: %.*s", ( int ) xLength, ( const char * ) pvPayload );
+    return JsonParseAccess( pvPayload, xLength, pbAccess, pulRequestId );
+}
 
-    MQTTPublishInfo_t xPublishInfo = { 0 };
+//Antwort auf der stehenden Subscription, läuft im Agent-Task
+static void ludoAccessIncomingPublish( void * pvContext, MQTTPublishInfo_t * pxPublishInfo )
+{
+    uint32_t ulPendingId = atomic_load( &ulAccessPendingId );
+    uint32_t ulResponseId = 0;
+    bool bAccess = false;
 
-    MQTTAgentCommandContext_t xCommandContext = { 0 };
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    if( ulPendingId == 0 )
+    {
+        ESP_LOGW( TAG, "Access response without pending request dropped" );
+        return;
+    }
 
-    xTaskNotifyStateClear( NULL );
+    if( !ludoParseAccessResponse( pxPublishInfo->pPayload, pxPublishInfo->payloadLength, &bAccess, &ulResponseId ) )
+    {
+        return;
+    }
 
-    /* Create a unique number for the publish that is about to be sent.
-     * This number is used in the command context and is sent back to this task
-     * as a notification in the callback that's executed upon receipt of the
-     * publish from coreMQTT-Agent.
-     * That way this task can match an acknowledgment to the message being sent.
-     */
-    xSemaphoreTake( xMessageIdSemaphore, portMAX_DELAY );
+    //Antworten ohne Id kommen von einer Cloud, die sie noch nicht zurückschickt.
+    //Eine späte Antwort lässt die Anfrage offen, die richtige kann noch folgen.
+    if( ( ulResponseId != 0 ) && ( ulResponseId != ulPendingId ) )
     {
-        ++ulMessageId;
-        ulPublishMessageId = ulMessageId;
+        ESP_LOGW( TAG, "Late response %" PRIu32 " dropped, waiting for %" PRIu32, ulResponseId, ulPendingId );
+        return;
     }
-    xSemaphoreGive( xMessageIdSemaphore );
 
-    /* Configure the publish operation. The topic name string must persist for
-     * duration of publish! */
-    xPublishInfo.qos = xQoS;
-    xPublishInfo.pTopicName = pcTopicName;
-    xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcTopicName );
-    xPublishInfo.pPayload = pcPayload;
-    xPublishInfo.payloadLength = ( uint16_t ) strlen( pcPayload );
-
-    /* Complete an application defined context associated with this publish
-     * message.
-     * This gets updated in the callback function so the variable must persist
-     * until the callback executes. */
-    xCommandContext.xMqttEventGroup = xMqttEventGroup;
-
-    xCommandParams.blockTimeMs = subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
-    xCommandParams.cmdCompleteCallback = prvPublishCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = &xCommandContext;
-
-    do
-    {
-        /* Wait for coreMQTT-Agent task to have working network connection and
-         * not be performing an OTA update. */
-        xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
-
-        /*ESP_LOGI( TAG,
-                  "Task \"%s\" sending publish request to coreMQTT-Agent with message \"%s\" on topic \"%s\" with ID %" PRIu32 ".",
-                  pcTaskGetName( NULL ),
-                  pcPayload,
-                  pcTopicName,
-                  ulPublishMessageId );*/
-
-        xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext,
-                                           &xPublishInfo,
-                                           &xCommandParams );
-
-        if( xCommandAdded == MQTTSuccess )
-        {
-            /* For QoS 1 and 2, wait for the publish acknowledgment.  For QoS0,
-             * wait for the publish to be sent. */
-            /*ESP_LOGI( TAG,
-                      "Task \"%s\" waiting for publish %" PRIu32 " to complete.",
-                      pcTaskGetName( NULL ),
-                      ulPublishMessageId );*/
-
-            xReceivedEvent = prvWaitForEvent( xMqttEventGroup,
-                                              MQTT_PUBLISH_COMMAND_COMPLETED_BIT );
-        }
-        else
-        {
-            ESP_LOGE( TAG,
-                      "Failed to enqueue publish command. Error code=%s",
-                      MQTT_Status_strerror( xCommandAdded ) );
-        }
+    //Der Task gibt die Anfrage an der Frist gleichzeitig auf, nur einer gewinnt
+    if( !atomic_compare_exchange_strong( &ulAccessPendingId, &ulPendingId, 0 ) )
+    {
+        return;
+    }
 
-        /* Check all ways the status was passed back just for demonstration
-         * purposes. */
-        if( ( ( xReceivedEvent & MQTT_PUBLISH_COMMAND_COMPLETED_BIT ) == 0 ) ||
-            ( xCommandContext.xReturnStatus != MQTTSuccess ) )
-        {
-            ESP_LOGW( TAG,
-                      "Error or timed out waiting for ack for publish message %" PRIu32 ". Re-attempting publish.",
-                      ulPublishMessageId );
-        }
-        else
-        {
-            /*ESP_LOGI( TAG,
-                      "Publish %" PRIu32 " succeeded for task \"%s\".",
-                      ulPublishMessageId,
-                      pcTaskGetName( NULL ) );*/
-        }
-    } while( ( xReceivedEvent & MQTT_PUBLISH_COMMAND_COMPLETED_BIT ) == 0 ||
-             ( xCommandContext.xReturnStatus != MQTTSuccess ) );
+    bAccessResponseGranted = bAccess;
+    prvIncomingPublishCallback( pvContext, pxPublishInfo );
 }
 
-static void prvSubscribeToTopic( IncomingPublishCallbackContext_t * pxIncomingPublishCallbackContext,
-                                 MQTTQoS_t xQoS,
-                                 char * pcTopicFilter,
-                                 EventGroupHandle_t xMqttEventGroup )
+bool prvAccessChannelReady( void )
 {
-    uint32_t ulSubscribeMessageId;
-
-    MQTTStatus_t xCommandAdded;
-    EventBits_t xReceivedEvent = 0;
-
-    MQTTAgentSubscribeArgs_t xSubscribeArgs = { 0 };
-    MQTTSubscribeInfo_t xSubscribeInfo = { 0 };
-
-    MQTTAgentCommandContext_t xCommandContext = { 0 };
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
-
-    xTaskNotifyStateClear( NULL );
-
-    /* Create a unique number for the subscribe that is about to be sent.
-     * This number is used in the command context and is sent back to this task
-     * as a notification in the callback that's executed upon receipt of the
-     * publish from coreMQTT-Agent.
-     * That way this task can match an acknowledgment to the message being sent.
-     */
-    xSemaphoreTake( xMessageIdSemaphore, portMAX_DELAY );
-    {
-        ++ulMessageId;
-        ulSubscribeMessageId = ulMessageId;
-    }
-    xSemaphoreGive( xMessageIdSemaphore );
-
-    /* Configure the subscribe operation.  The topic string must persist for
-     * duration of subscription! */
-    xSubscribeInfo.qos = xQoS;
-    xSubscribeInfo.pTopicFilter = pcTopicFilter;
-    xSubscribeInfo.topicFilterLength = ( uint16_t ) strlen( pcTopicFilter );
-
-    xSubscribeArgs.pSubscribeInfo = &xSubscribeInfo;
-    xSubscribeArgs.numSubscriptions = 1;
-
-    /* Complete an application defined context associated with this subscribe
-     * message.
-     * This gets updated in the callback function so the variable must persist
-     * until the callback executes. */
-    xCommandContext.xMqttEventGroup = xMqttEventGroup;
-    xCommandContext.pxIncomingPublishCallbackContext = pxIncomingPublishCallbackContext;
-    xCommandContext.pArgs = ( void * ) &xSubscribeArgs;
-
-    xCommandParams.blockTimeMs = subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
-    xCommandParams.cmdCompleteCallback = prvSubscribeCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xCommandContext;
-
-    do
-    {
-        /* Wait for coreMQTT-Agent task to have working network connection and
-         * not be performing an OTA update. */
-        xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
-
-        /*ESP_LOGI( TAG,
-                  "Task \"%s\" sending subscribe request to coreMQTT-Agent for topic filter: %s with id %" PRIu32 "",
-                  pcTaskGetName( NULL ),
-                  pcTopicFilter,
-                  ulSubscribeMessageId );*/
-
-        xCommandAdded = MQTTAgent_Subscribe( &xGlobalMqttAgentContext,
-                                             &xSubscribeArgs,
-                                             &xCommandParams );
-
-        if( xCommandAdded == MQTTSuccess )
-        {
-            /* For QoS 1 and 2, wait for the subscription acknowledgment. For QoS0,
-             * wait for the subscribe to be sent. */
-            xReceivedEvent = prvWaitForEvent( xMqttEventGroup,
-                                              MQTT_SUBSCRIBE_COMMAND_COMPLETED_BIT );
-        }
-        else
-        {
-            ESP_LOGE( TAG,
-                      "Failed to enqueue subscribe command. Error code=%s",
-                      MQTT_Status_strerror( xCommandAdded ) );
-        }
-
-        /* Check all ways the status was passed back just for demonstration
-         * purposes. */
-        if( ( ( xReceivedEvent & MQTT_SUBSCRIBE_COMMAND_COMPLETED_BIT ) == 0 ) ||
-            ( xCommandContext.xReturnStatus != MQTTSuccess ) )
-        {
-            ESP_LOGW( TAG,
-                      "Error or timed out waiting for ack to subscribe message %" PRIu32 ". Re-attempting subscribe.",
-                      ulSubscribeMessageId );
-        }
-        else
-        {
-            /*ESP_LOGI( TAG,
-                      "Subscribe %" PRIu32 " for topic filter %s succeeded for task \"%s\".",
-                      ulSubscribeMessageId,
-                      pcTopicFilter,
-                      pcTaskGetName( NULL ) );*/
-        }
-    } while( ( ( xReceivedEvent & MQTT_SUBSCRIBE_COMMAND_COMPLETED_BIT ) == 0 ) ||
-             ( xCommandContext.xReturnStatus != MQTTSuccess ) );
+    //Die Subscription entsteht mit der ersten Settings-Anfrage, der Scanner läuft schon vorher
+    return atomic_load( &bAccessSubscribed ) && prvAgentReady();
 }
 
-static void prvUnsubscribeToTopic( MQTTQoS_t xQoS,
-                                   char * pcTopicFilter,
-                                   EventGroupHandle_t xMqttEventGroup )
+//Baut eine Zugangsanfrage in JSON oder CBOR, der Puffer gehört danach dem Aufrufer
+static char * ludoBuildAccessRequest( const char * UID, uint8_t readerId, const Timestamp * scanned, bool localGrant,
+                                      size_t * pxPayloadLength )
 {
-    uint32_t ulUnsubscribeMessageId;
-
-    MQTTStatus_t xCommandAdded;
-    EventBits_t xReceivedEvent = 0;
-
-    MQTTAgentSubscribeArgs_t xUnsubscribeArgs = { 0 };
-    MQTTSubscribeInfo_t xUnsubscribeInfo = { 0 };
-
-    MQTTAgentCommandContext_t xCommandContext = { 0 };
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
-
-    xTaskNotifyStateClear( NULL );
-
-    /* Create a unique number for the subscribe that is about to be sent.
-     * This number is used in the command context and is sent back to this task
-     * as a notification in the callback that's executed upon receipt of the
-     * publish from coreMQTT-Agent.
-     * That way this task can match an acknowledgment to the message being sent.
-     */
-    xSemaphoreTake( xMessageIdSemaphore, portMAX_DELAY );
-    {
-        ++ulMessageId;
-        ulUnsubscribeMessageId = ulMessageId;
-    }
-    xSemaphoreGive( xMessageIdSemaphore );
-
-    /* Configure the subscribe operation.  The topic string must persist for
-     * duration of subscription! */
-    xUnsubscribeInfo.qos = xQoS;
-    xUnsubscribeInfo.pTopicFilter = pcTopicFilter;
-    xUnsubscribeInfo.topicFilterLength = ( uint16_t ) strlen( pcTopicFilter );
-
-    xUnsubscribeArgs.pSubscribeInfo = &xUnsubscribeInfo;
-    xUnsubscribeArgs.numSubscriptions = 1;
-
-    /* Complete an application defined context associated with this subscribe
-     * message.
-     * This gets updated in the callback function so the variable must persist
-     * until the callback executes. */
-    xCommandContext.xMqttEventGroup = xMqttEventGroup;
-    xCommandContext.pArgs = ( void * ) &xUnsubscribeArgs;
-
-    xCommandParams.blockTimeMs = subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
-    xCommandParams.cmdCompleteCallback = prvUnsubscribeCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xCommandContext;
-
-    do
-    {
-        /* Wait for coreMQTT-Agent task to have working network connection and
-         * not be performing an OTA update. */
-        xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
-        /*ESP_LOGI( TAG,
-                  "Task \"%s\" sending unsubscribe request to coreMQTT-Agent for topic filter: %s with id %" PRIu32 "",
-                  pcTaskGetName( NULL ),
-                  pcTopicFilter,
-                  ulUnsubscribeMessageId );*/
-
-        xCommandAdded = MQTTAgent_Unsubscribe( &xGlobalMqttAgentContext,
-                                               &xUnsubscribeArgs,
-                                               &xCommandParams );
-
-        if( xCommandAdded == MQTTSuccess )
-        {
-            /* For QoS 1 and 2, wait for the subscription acknowledgment.  For QoS0,
-             * wait for the subscribe to be sent. */
-            xReceivedEvent = prvWaitForEvent( xMqttEventGroup,
-                                              MQTT_UNSUBSCRIBE_COMMAND_COMPLETED_BIT );
-        }
-        else
-        {
-            ESP_LOGE( TAG,
-                      "Failed to enqueue unsubscribe command. Error code=%s",
-                      MQTT_Status_strerror( xCommandAdded ) );
-        }
+    char *pcPayload = (char *) malloc(LudoPayloadSize * sizeof(char));
+    if (pcPayload == NULL)
+    {
+        // Fehlerbehandlung für fehlgeschlagene Speicherzuweisung
+        ESP_LOGE(TAG, "Failed to allocate memory for Payload");
+        return NULL;
+    }
 
-        /* Check all ways the status was passed back just for demonstration
-         * purposes. */
-        if( ( ( xReceivedEvent & MQTT_UNSUBSCRIBE_COMMAND_COMPLETED_BIT ) == 0 ) ||
-            ( xCommandContext.xReturnStatus != MQTTSuccess ) )
-        {
-            ESP_LOGW( TAG,
-                      "Error or timed out waiting for ack to unsubscribe message %" PRIu32 ". Re-attempting subscribe.",
-                      ulUnsubscribeMessageId );
-        }
-        else
-        {
-            /*ESP_LOGI( TAG,
-                      "Unsubscribe %" PRIu32 " for topic filter %s succeeded for task \"%s\".",
-                      ulUnsubscribeMessageId,
-                      pcTopicFilter,
-                      pcTaskGetName( NULL ) );*/
-        }
-    } while( ( ( xReceivedEvent & MQTT_UNSUBSCRIBE_COMMAND_COMPLETED_BIT ) == 0 ) ||
-             ( xCommandContext.xReturnStatus != MQTTSuccess ) );
+    //0 heißt in der Antwort "ohne Id", daher nie vergeben
+    if( ++ulAccessRequestId == 0 )
+    {
+        ulAccessRequestId = 1;
+    }
+
+    //CBOR nur, wenn die Cloud es mit den Settings angefordert hat
+    const SettingsSnapshot *pxSettings = SettingsAcquire();
+    bool bCbor = pxSettings->wireCbor;
+    SettingsRelease(pxSettings);
+
+    size_t xPayloadLength = 0;
+    if (bCbor)
+    {
+        xPayloadLength = CborAccessRequest((uint8_t *) pcPayload, LudoPayloadSize, strtoull(UID, NULL, 16),
+                                           readerId, scanned, localGrant, ulAccessRequestId);
+    }
+    if (xPayloadLength == 0)
+    {
+        //ESP_LOGI(TAG, "UID: %s", UID);
+        char* JsonString = JsonAccessString(UID, readerId, scanned, localGrant, ulAccessRequestId);
+        snprintf( pcPayload, LudoPayloadSize, "%s", JsonString);
+        xPayloadLength = strlen(pcPayload);
+    }
+
+    *pxPayloadLength = xPayloadLength;
+    return pcPayload;
 }
 
-static void prvLudoPublishToTopic( MQTTQoS_t xQoS,
-                               char * pcTopicName,
-                               char * pcPayload,
-                               EventGroupHandle_t xMqttEventGroup )
+//Läuft auf dem Scheduler, wenn das Audit gesendet ist oder scheiterte
+static void ludoAccessAuditDone( MqttAgentFutureHandle_t xFuture, MQTTStatus_t xStatus, void * pvContext )
 {
-    uint32_t ulPublishMessageId = 0;
+    if( xStatus != MQTTSuccess )
+    {
+        ESP_LOGW( TAG, "Access audit %" PRIu32 " not sent: %s", ulMqttAgentFutureId( xFuture ),
+                  MQTT_Status_strerror( xStatus ) );
+        MetricAdd( &xAccessAuditDroppedMetric, 1 );
+    }
 
-    MQTTStatus_t xCommandAdded;
+    free( pvContext );
+    vMqttAgentFutureRelease( xFuture );
+}
 
+bool prvSendAccessAuditToAWS(char *UID, uint8_t readerId, const Timestamp *scanned)
+{
     MQTTPublishInfo_t xPublishInfo = { 0 };
+    size_t xPayloadLength = 0;
+    char * pcPayload;
 
-    MQTTAgentCommandContext_t xCommandContext = { 0 };
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
-
-    // Unique Message ID
-    xSemaphoreTake( xMessageIdSemaphore, portMAX_DELAY );
+    if( !prvAccessChannelReady() )
     {
-        ++ulMessageId;
-        ulPublishMessageId = ulMessageId;
+        MetricAdd( &xAccessAuditDroppedMetric, 1 );
+        return false;
     }
-    xSemaphoreGive( xMessageIdSemaphore );
 
-    // Set up the publish parameters
-    xPublishInfo.qos = xQoS;
-    xPublishInfo.pTopicName = pcTopicName;
-    xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcTopicName );
-    xPublishInfo.pPayload = pcPayload;
-    xPublishInfo.payloadLength = ( uint16_t ) strlen( pcPayload );
-
-    // Set up the command context and command info
-    xCommandContext.xMqttEventGroup = xMqttEventGroup;
-
-    xCommandParams.blockTimeMs = subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
-    xCommandParams.cmdCompleteCallback = prvPublishCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = &xCommandContext;
-
-    // Wait for coreMQTT-Agent to have network connection and be ready
-    xEventGroupWaitBits( xNetworkEventGroup,
-                         CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                         pdFALSE,
-                         pdTRUE,
-                         portMAX_DELAY );
-    
-    if ((xEventGroupGetBits(xNetworkEventGroup) & CORE_MQTT_AGENT_CONNECTED_BIT) == 0) {
-        ESP_LOGE(TAG, "MQTT connection not established, cannot publish");
-        return;
+    pcPayload = ludoBuildAccessRequest( UID, readerId, scanned, true, &xPayloadLength );
+    if( pcPayload == NULL )
+    {
+        MetricAdd( &xAccessAuditDroppedMetric, 1 );
+        return false;
     }
 
-    // Send the publish command to the coreMQTT-Agent
-    xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext,
-                                       &xPublishInfo,
-                                       &xCommandParams );
+    xPublishInfo.qos = ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL;
+    xPublishInfo.pTopicName = pcAccessRequestTopic;
+    xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcAccessRequestTopic );
+    xPublishInfo.pPayload = pcPayload;
+    xPublishInfo.payloadLength = ( uint16_t ) xPayloadLength;
 
-    if( xCommandAdded != MQTTSuccess )
+    //Die Antwort der Cloud zählt nicht, die Entscheidung ist schon gefallen und angezeigt
+    if( xMqttAgentFuturePublish( &xPublishInfo, subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS,
+                                 ludoAccessAuditDone, pcPayload ) == NULL )
     {
-        ESP_LOGE( TAG,
-                  "Failed to enqueue publish command. Error code=%s",
-                  MQTT_Status_strerror( xCommandAdded ) );
-    }
-    else
-    {
-        ESP_LOGI( TAG,
-                  "Task \"%s\" sent publish request with message \"%s\" on topic \"%s\" with ID %" PRIu32 ".",
-                  pcTaskGetName( NULL ),
-                  pcPayload,
-                  pcTopicName,
-                  ulPublishMessageId );
+        free( pcPayload );
+        MetricAdd( &xAccessAuditDroppedMetric, 1 );
+        return false;
     }
+
+    return true;
 }
 
-//integer to set the payload Size
-const int LudoPayloadSize = 1500;
-//and for TopicSize
-const int LudoTopicSize = 200;
+//Kein Zugang ohne Antwort, der Scanner darf nicht hängen bleiben
+static void ludoAccessNoResponse( const char * pcReason )
+{
+    atomic_store( &ulAccessPendingId, 0 );
+    ESP_LOGW( TAG, "No access response for request %" PRIu32 ": %s", ulAccessRequestId, pcReason );
+    MetricAdd( &xAccessTimeoutMetric, 1 );
+    RgbLedHasAccess( false );
+}
 
-static void ludoPublishToTopic(char* pcTopic, char pcPayload[LudoPayloadSize])
+void prvSendUIDToAWS(char *UID, uint8_t readerId, const Timestamp *scanned)
 {
-    EventGroupHandle_t xMqttEventGroup;
-    IncomingPublishCallbackContext_t xIncomingPublishCallbackContext;
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    MqttAgentFutureHandle_t xFuture;
+    MQTTStatus_t xStatus;
+    size_t xPayloadLength = 0;
 
-    MQTTQoS_t xQoS;
+    //PUBACK und Antwort teilen sich eine Frist, ab dem Senden
+    TickType_t xDeadline = xTaskGetTickCount() + pdMS_TO_TICKS( subpubunsubconfigACCESS_RESPONSE_TIMEOUT_MS );
 
-    xMqttEventGroup = xEventGroupCreate();
-    xIncomingPublishCallbackContext.xMqttEventGroup = xMqttEventGroup;
+    char *pcPayload = ludoBuildAccessRequest( UID, readerId, scanned, false, &xPayloadLength );
+    if (pcPayload == NULL)
+    {
+        ludoAccessNoResponse( "no memory" );
+        return;
+    }
 
-    xQoS = ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL;
+    xPublishInfo.qos = ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL;
+    xPublishInfo.pTopicName = pcAccessRequestTopic;
+    xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcAccessRequestTopic );
+    xPublishInfo.pPayload = pcPayload;
+    xPublishInfo.payloadLength = ( uint16_t ) xPayloadLength;
 
-    //prvSubscribeToTopic(&xIncomingPublishCallbackContext, xQoS, pcTopic,xMqttEventGroup);
+    //Vor dem Senden scharf schalten, die Antwort kann vor dem PUBACK kommen
+    xEventGroupClearBits( xAccessIncomingPublishCallbackContext.xMqttEventGroup, MQTT_INCOMING_PUBLISH_RECEIVED_BIT );
+    atomic_store( &ulAccessPendingId, ulAccessRequestId );
 
-    prvPublishToTopic(xQoS, pcTopic, pcPayload, xMqttEventGroup);
+    //Der Payload gehört ab hier dem Future, auch wenn das Warten vorher endet
+    xFuture = xMqttAgentFuturePublish( &xPublishInfo, subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS,
+                                       ludoPublishCopyDone, pcPayload );
+    if( xFuture == NULL )
+    {
+        free( pcPayload );
+    }
 
-    //prvWaitForEvent( xMqttEventGroup, MQTT_INCOMING_PUBLISH_RECEIVED_BIT );
+    TickType_t xNow = xTaskGetTickCount();
+    xStatus = xMqttAgentFutureGet( xFuture, ( ( int32_t ) ( xDeadline - xNow ) > 0 ) ? xDeadline - xNow : 0 );
+    if( xStatus != MQTTSuccess )
+    {
+        //Nicht weiter warten, eine schon angenommene Antwort gilt trotzdem
+        ESP_LOGW( TAG, "Access request %" PRIu32 " not acked: %s", ulAccessRequestId, MQTT_Status_strerror( xStatus ) );
+        xDeadline = xTaskGetTickCount();
+    }
 
-    //ESP_LOGI( TAG, "Task \"%s\" received: %s", pcTaskGetName( NULL ), xIncomingPublishCallbackContext.pcIncomingPublish );
+    EventBits_t xBits = 0;
+    xNow = xTaskGetTickCount();
+    if( ( int32_t ) ( xDeadline - xNow ) > 0 )
+    {
+        xBits = xEventGroupWaitBits( xAccessIncomingPublishCallbackContext.xMqttEventGroup,
+                                     MQTT_INCOMING_PUBLISH_RECEIVED_BIT,
+                                     pdTRUE,
+                                     pdTRUE,
+                                     xDeadline - xNow );
+    }
 
-    //prvUnsubscribeToTopic( xQoS, pcTopic, xMqttEventGroup );
+    //Schon abgeräumt heißt, der Callback hat die Antwort angenommen und setzt gleich das Bit
+    if( ( ( xBits & MQTT_INCOMING_PUBLISH_RECEIVED_BIT ) == 0 ) && ( atomic_exchange( &ulAccessPendingId, 0 ) == 0 ) )
+    {
+        xBits = xEventGroupWaitBits( xAccessIncomingPublishCallbackContext.xMqttEventGroup,
+                                     MQTT_INCOMING_PUBLISH_RECEIVED_BIT,
+                                     pdTRUE,
+                                     pdTRUE,
+                                     portMAX_DELAY );
+    }
 
-    vEventGroupDelete( xMqttEventGroup );
+    if( ( xBits & MQTT_INCOMING_PUBLISH_RECEIVED_BIT ) == 0 )
+    {
+        ludoAccessNoResponse( "timed out" );
+        return;
+    }
 
+    MetricAdd( bAccessResponseGranted ? &xAccessGrantedMetric : &xAccessRefusedMetric, 1 );
+    MetricRecord( &xAccessLatencyMetric, ( uint32_t ) ( ( TimestampMonoUs() - scanned->monoUs ) / 1000 ) );
+    RgbLedHasAccess( bAccessResponseGranted );
 }
 
-void prvSendUIDToAWS(char *UID)
+//Filter und Regeln sind binär und größer als der Settings-Puffer, daher direkt an die Module
+static void ludoRevokedIncomingPublish( void * pvContext, MQTTPublishInfo_t * pxPublishInfo )
 {
+    RevokedFilterReceive( pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
+}
 
-    //ESP_LOGI(TAG, "Subscribing Access channel!");
-    EventGroupHandle_t AccessMqttEventGroup;
-    IncomingPublishCallbackContext_t AccessIncomingPublishCallbackContext;
-
-    MQTTQoS_t xQoS;
+static void ludoRulesIncomingPublish( void * pvContext, MQTTPublishInfo_t * pxPublishInfo )
+{
+    AccessRulesReceive( pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
+}
 
-    AccessMqttEventGroup = xEventGroupCreate();
-    AccessIncomingPublishCallbackContext.xMqttEventGroup = AccessMqttEventGroup;
+//Settings, Sperrfilter, Regeln und Zugangsantworten. Die Access-Subscription
+//bleibt für alle Scans bestehen, der Agent Manager erneuert alle nach einem Reconnect.
+static ChannelSubscription_t xChannelSubscriptions[] =
+{
+    { pcSettingsTopic,       prvIncomingPublishCallback, &xSettingsIncomingPublishCallbackContext, NULL, false },
+    { pcRevokedTopic,        ludoRevokedIncomingPublish, NULL,                                     NULL, false },
+    { pcRulesTopic,          ludoRulesIncomingPublish,   NULL,                                     NULL, false },
+    { pcAccessResponseTopic, ludoAccessIncomingPublish,  &xAccessIncomingPublishCallbackContext,   NULL, false },
+};
 
-    xQoS = ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL;
+//Läuft auf dem Scheduler, wenn das SUBACK da ist oder das SUBSCRIBE scheiterte
+static void ludoChannelSubscribeDone( MqttAgentFutureHandle_t xFuture, MQTTStatus_t xStatus, void * pvContext )
+{
+    ChannelSubscription_t * pxSubscription = ( ChannelSubscription_t * ) pvContext;
 
-    //Set the Topic to '/ThingName/Access/sub'
-    char SetTopic[LudoTopicSize];
-    snprintf(SetTopic ,LudoTopicSize, "device/access/%s/response", LanPrintMac());
-    
-    //Subscribing to channel!
-    prvSubscribeToTopic(&AccessIncomingPublishCallbackContext, xQoS, SetTopic ,AccessMqttEventGroup);
+    vMqttAgentFutureRelease( xFuture );
+    pxSubscription->xFuture = NULL;
 
-    //ESP_LOGI(TAG, "UID: %s", UID);
-     // Speicher für Payload dynamisch allokieren
-    char *pcPayload = (char *) malloc(LudoPayloadSize * sizeof(char));
-    if (pcPayload == NULL)
+    if( xStatus != MQTTSuccess )
     {
-        // Fehlerbehandlung für fehlgeschlagene Speicherzuweisung
-        ESP_LOGE(TAG, "Failed to allocate memory for Payload");
+        //Der nächste Lauf des Intervalls versucht es wieder
+        ESP_LOGW( TAG, "Error %s subscribing to %s", MQTT_Status_strerror( xStatus ), pxSubscription->pcTopicFilter );
         return;
     }
-    char* JsonString = JsonAccessString(UID);
-    snprintf( pcPayload, LudoPayloadSize, "%s", JsonString);
-
-    //Set the Topic to '/ThingName/Access/pub'
-    char pcTopic[LudoTopicSize];
-    snprintf(pcTopic, LudoTopicSize, "device/access/%s/request", LanPrintMac());
-
-    ludoPublishToTopic(pcTopic, pcPayload);
 
-    prvWaitForEvent( AccessMqttEventGroup, MQTT_INCOMING_PUBLISH_RECEIVED_BIT );
-    ESP_LOGW(TAG, "Access received: %s", AccessIncomingPublishCallbackContext.pcIncomingPublish );
-    JsonParse(AccessIncomingPublishCallbackContext.pcIncomingPublish, "access");
-    
-    
-    //Unsubscribe and delete Task!
-    prvUnsubscribeToTopic(xQoS, SetTopic, AccessMqttEventGroup);
-    vEventGroupDelete( AccessMqttEventGroup );
+    pxSubscription->bSubscribed = true;
+    if( pxSubscription->pvContext == &xAccessIncomingPublishCallbackContext )
+    {
+        atomic_store( &bAccessSubscribed, true );
 
-    //ESP_LOGI( TAG, "Task \"%s\" Sends UID to AWS. Waiting for next tag!.", pcTaskGetName( NULL ) );
+        //Scans, die seit dem Boot auf den Kanal warten
+        NfcAccessChannelReady();
+    }
 
-    free(pcPayload);
+    SchedulerTrigger( pxSettingsRequestJob );
 }
 
-static void ludoSettingsTask( void * pvParameters )
+//Läuft auf dem Scheduler, wenn die Settings-Anfrage gesendet ist oder scheiterte
+static void ludoSettingsRequestDone( MqttAgentFutureHandle_t xFuture, MQTTStatus_t xStatus, void * pvContext )
 {
-    ESP_LOGI(TAG, "Subscribing Setting channel!");
-    EventGroupHandle_t SettingsMqttEventGroup;
-    IncomingPublishCallbackContext_t SettingsIncomingPublishCallbackContext;
-
-    MQTTQoS_t xQoS;
-
-    SettingsMqttEventGroup = xEventGroupCreate();
-    SettingsIncomingPublishCallbackContext.xMqttEventGroup = SettingsMqttEventGroup;
-
-
-    xQoS = ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL;
-    //Set the Topic to '/ThingName/Settings/pub'
-    xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT ,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
-    char SetTopic[LudoTopicSize];
-    snprintf(SetTopic ,LudoTopicSize, "device/settings/%s/response", LanPrintMac());
-    
-    //Subscribing to channel!
-    prvSubscribeToTopic(&SettingsIncomingPublishCallbackContext, xQoS, SetTopic ,SettingsMqttEventGroup);
-
-    char *Payload = (char *) malloc(LudoPayloadSize * sizeof(char));
-    if (Payload == NULL) {
-        // Fehlerbehandlung für fehlgeschlagene Speicherzuweisung
-        ESP_LOGE(TAG, "Failed to allocate memory for Payload");
+    ( void ) pvContext;
+
+    vMqttAgentFutureRelease( xFuture );
+    xSettingsRequestFuture = NULL;
+
+    if( xStatus != MQTTSuccess )
+    {
+        ESP_LOGW( TAG, "Error %s sending settings request", MQTT_Status_strerror( xStatus ) );
         return;
     }
-    snprintf(Payload, LudoPayloadSize, "{\"macAddrHex\":\"%s\"}", LanPrintMac());
 
-    // Null-Terminierung sicherstellen
-    Payload[LudoPayloadSize - 1] = '\0';
+    atomic_store( &bSettingsRequestPending, false );
+}
 
-    //Set the Topic to '/ThingName/Settings/pub'
-    char pcTopic[LudoTopicSize];
-    snprintf(pcTopic,LudoTopicSize, "device/settings/%s/request", LanPrintMac());
+//Nach jedem Connect und periodisch: fehlende Subscriptions anlegen, dann Settings anfordern.
+//Wartet nie, die Futures stoßen den Job nach dem SUBACK wieder an.
+static void ludoSettingsRequestJob( void * pvArg )
+{
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+    bool bAllSubscribed = true;
 
+    if( !prvAgentReady() )
+    {
+        //Der Connect-Event stößt den Job wieder an
+        return;
+    }
 
-    //Frage nach den settings!
-    ludoPublishToTopic(pcTopic, Payload);
+    if( !bSettingsTopicsBuilt )
+    {
+        snprintf(pcSettingsTopic, sizeof(pcSettingsTopic), "device/settings/%s/response", LanPrintMac());
+        snprintf(pcRevokedTopic, sizeof(pcRevokedTopic), "device/settings/%s/revoked", LanPrintMac());
+        snprintf(pcRulesTopic, sizeof(pcRulesTopic), "device/settings/%s/rules", LanPrintMac());
+        snprintf(pcAccessResponseTopic, sizeof(pcAccessResponseTopic), "device/access/%s/response", LanPrintMac());
+        snprintf(pcAccessRequestTopic, sizeof(pcAccessRequestTopic), "device/access/%s/request", LanPrintMac());
+        //Set the Topic to '/ThingName/Settings/pub'
+        snprintf(pcSettingsRequestTopic, sizeof(pcSettingsRequestTopic), "device/settings/%s/request", LanPrintMac());
+        bSettingsTopicsBuilt = true;
+    }
 
-    free(Payload);
-    while( 1 )
+    for( size_t i = 0; i < sizeof( xChannelSubscriptions ) / sizeof( xChannelSubscriptions[ 0 ] ); i++ )
     {
-        prvWaitForEvent( SettingsMqttEventGroup, MQTT_INCOMING_PUBLISH_RECEIVED_BIT );
-        ESP_LOGI(TAG, "Settings received: %s", SettingsIncomingPublishCallbackContext.pcIncomingPublish );
+        ChannelSubscription_t * pxSubscription = &xChannelSubscriptions[ i ];
 
-        //todo subscribe all channel and act after it
-        JsonParse(SettingsIncomingPublishCallbackContext.pcIncomingPublish, "settings");
-        //Lösche LED Task und starte NFC Scanner
-        if(!NFCStarted())
+        if( pxSubscription->bSubscribed )
         {
-            StartNFC();
-            RgbLedAWSConnected();
+            continue;
         }
-        
 
-        vTaskDelay( pdMS_TO_TICKS( subpubunsubconfigDELAY_BETWEEN_SUB_PUB_UNSUB_LOOPS_MS ) );
+        bAllSubscribed = false;
+        if( pxSubscription->xFuture == NULL )
+        {
+            ESP_LOGI( TAG, "Subscribing to %s", pxSubscription->pcTopicFilter );
+
+            //Ohne freien Future bleibt es beim nächsten Lauf
+            pxSubscription->xFuture = xMqttAgentFutureSubscribe( pxSubscription->pcTopicFilter,
+                                                                 ( uint16_t ) strlen( pxSubscription->pcTopicFilter ),
+                                                                 ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL,
+                                                                 pxSubscription->pxCallback,
+                                                                 pxSubscription->pvContext,
+                                                                 subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS,
+                                                                 ludoChannelSubscribeDone,
+                                                                 pxSubscription );
+        }
+    }
+
+    //Die Antwort käme sonst auf einem Topic ohne Subscription an
+    if( !bAllSubscribed || !atomic_load( &bSettingsRequestPending ) || ( xSettingsRequestFuture != NULL ) )
+    {
+        return;
     }
 
-    vEventGroupDelete( SettingsMqttEventGroup );
-    vTaskDelete( NULL );
+    // Mit dem Hash der angewendeten Settings kann die Cloud erkennen, ob sich etwas geändert hat.
+    // Sperrfilter und Regeln kommen nur bei anderer Seriennummer, der Filter höchstens revokedMaxBytes groß.
+    // wireFormats: was das Gerät lesen kann, die Cloud wählt per "wireFormat" in den Settings
+    snprintf(pcSettingsRequestPayload, sizeof(pcSettingsRequestPayload),
+             "{\"macAddrHex\":\"%s\",\"settingsHash\":\"%08" PRIx32 "\""
+             ",\"revokedSerial\":%" PRIu32 ",\"revokedMaxBytes\":%d,\"rulesSerial\":%" PRIu32
+             ",\"wireFormats\":\"%s\"}",
+             LanPrintMac(), SettingsGetHash(), RevokedFilterSerial(), CONFIG_NFC_REVOKED_FILTER_MAX_BYTES,
+             AccessRulesSerial(), ludoWIRE_FORMATS);
+
+    xPublishInfo.qos = ( MQTTQoS_t ) subpubunsubconfigQOS_LEVEL;
+    xPublishInfo.pTopicName = pcSettingsRequestTopic;
+    xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcSettingsRequestTopic );
+    xPublishInfo.pPayload = pcSettingsRequestPayload;
+    xPublishInfo.payloadLength = ( uint16_t ) strlen( pcSettingsRequestPayload );
+
+    //Frage nach den settings!
+    xSettingsRequestFuture = xMqttAgentFuturePublish( &xPublishInfo, subpubunsubconfigMAX_COMMAND_SEND_BLOCK_TIME_MS,
+                                                      ludoSettingsRequestDone, NULL );
+}
+
+//Wird vom Incoming-Publish Callback des Settings-Kanals angestoßen
+static void ludoSettingsApplyJob( void * pvArg )
+{
+    EventBits_t xBits = xEventGroupClearBits( xSettingsIncomingPublishCallbackContext.xMqttEventGroup,
+                                              MQTT_INCOMING_PUBLISH_RECEIVED_BIT );
+
+    if( ( xBits & MQTT_INCOMING_PUBLISH_RECEIVED_BIT ) == 0 )
+    {
+        return;
+    }
+
+    //todo subscribe all channel and act after it
+    if( CborIsMessage( xSettingsIncomingPublishCallbackContext.pcIncomingPublish, xSettingsIncomingPublishCallbackContext.xIncomingPublishLength ) )
+    {
+        //Binär, daher mit Länge statt als String
+        ESP_LOGI(TAG, "Settings received: %u bytes CBOR", ( unsigned ) xSettingsIncomingPublishCallbackContext.xIncomingPublishLength );
+        SettingsUpdate( xSettingsIncomingPublishCallbackContext.pcIncomingPublish, xSettingsIncomingPublishCallbackContext.xIncomingPublishLength );
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Settings received: %s", xSettingsIncomingPublishCallbackContext.pcIncomingPublish );
+        JsonParse(xSettingsIncomingPublishCallbackContext.pcIncomingPublish, "settings");
+    }
+    BootProfileMark(BOOT_STAGE_SETTINGS_APPLIED);
+    //Lösche LED Task und starte NFC Scanner
+    if(!NFCStarted())
+    {
+        StartNFC();
+        RgbLedAWSConnected();
+    }
 }
 
 /* Public function definitions ************************************************/
@@ -998,12 +920,27 @@ static void ludoSettingsTask( void * pvParameters )
 void vStartSubscribePublishUnsubscribeDemo( void )
 {   
     ESP_LOGI(TAG, "Starting SubscribeTask");
-    xMessageIdSemaphore = xSemaphoreCreateMutex();
     xNetworkEventGroup = xEventGroupCreate();
     xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
 
     /* Initialize the coreMQTT-Agent event group. */
     xEventGroupSetBits( xNetworkEventGroup,
                         CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
-    xTaskCreate(ludoSettingsTask, "ludoSettingsTask", SettingsTaskStackSize ,NULL, SettingsTaskPriority,NULL);
+
+    /* The settings channel runs on the shared scheduler instead of its own task. */
+    xSettingsIncomingPublishCallbackContext.xMqttEventGroup = prvCreateEventGroup();
+    configASSERT( xSettingsIncomingPublishCallbackContext.xMqttEventGroup != NULL );
+    pxSettingsApplyJob = SchedulerAddJob( "settingsApply", ludoSettingsApplyJob, NULL );
+    pxSettingsRequestJob = SchedulerAddInterval( "settingsRequest", ludoSETTINGS_RETRY_MS, ludoSETTINGS_RETRY_MS,
+                                                 ludoSettingsRequestJob, NULL );
+    xSettingsIncomingPublishCallbackContext.pxJobToTrigger = pxSettingsApplyJob;
+
+    /* Access responses are waited for by the scanning task, no job needed. */
+    xAccessIncomingPublishCallbackContext.xMqttEventGroup = prvCreateEventGroup();
+    configASSERT( xAccessIncomingPublishCallbackContext.xMqttEventGroup != NULL );
+    MetricRegister( &xAccessGrantedMetric );
+    MetricRegister( &xAccessRefusedMetric );
+    MetricRegister( &xAccessTimeoutMetric );
+    MetricRegister( &xAccessLatencyMetric );
+    MetricRegister( &xAccessAuditDroppedMetric );
 }
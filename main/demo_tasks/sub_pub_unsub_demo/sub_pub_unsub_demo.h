@@ -27,6 +27,16 @@
 #ifndef SUB_PUB_UNSUB_DEMO_H
 #define SUB_PUB_UNSUB_DEMO_H
 
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Timestamp service include. */
+#include "extras/Timestamp.h"
+
+/* Subscription manager include for IncomingPubCallback_t. */
+#include "subscription_manager.h"
+
 /* *INDENT-OFF* */
     #ifdef __cplusplus
         extern "C" {
@@ -38,7 +48,63 @@
  */
 void vStartSubscribePublishUnsubscribeDemo( void );
 
-void prvSendUIDToAWS(char *UID);
+/**
+ * @brief Whether access requests can be sent: the response topic is
+ * subscribed, the agent is connected and no OTA update runs. Scans that need
+ * the cloud wait in the NFC scan queue until it is, see NfcAccessChannelReady().
+ */
+bool prvAccessChannelReady( void );
+
+/**
+ * @brief Sends a scanned UID to AWS, waits for the access response and applies
+ * it. Only called by the NFC access task once prvAccessChannelReady() returned
+ * true, for scans that were not decided locally. PUBACK and response share
+ * subpubunsubconfigACCESS_RESPONSE_TIMEOUT_MS, without both the scan is shown
+ * as denied.
+ *
+ * @param[in] UID UID as hex string.
+ * @param[in] readerId Index of the reader the tag was scanned on.
+ * @param[in] scanned Time of the scan.
+ */
+void prvSendUIDToAWS(char *UID, uint8_t readerId, const Timestamp *scanned);
+
+/**
+ * @brief Reports a scan that was granted locally (allow-list or time rule)
+ * with "local":true. Does not wait for the publish or a response, the
+ * feedback was already given.
+ *
+ * @return false if the audit was dropped because the channel is not ready.
+ */
+bool prvSendAccessAuditToAWS(char *UID, uint8_t readerId, const Timestamp *scanned);
+
+/**
+ * @brief Publishes a payload if the agent is connected, otherwise drops it.
+ * Topic and payload are copied, the acknowledgment is waited for at most a
+ * few seconds so scheduler jobs can call it.
+ *
+ * @param[in] pcTopic Topic to publish to.
+ * @param[in] pcPayload Null terminated payload.
+ *
+ * @return false if the payload was dropped or not acknowledged in time.
+ */
+bool prvPublishToAWS(char *pcTopic, char *pcPayload);
+
+/**
+ * @brief Subscribes to a topic and hands every publish on it unmodified to a
+ * callback, so binary payloads can be received.
+ *
+ * Waits a few seconds at most for the acknowledgment. The callback runs in
+ * the coreMQTT-Agent task and must not block.
+ *
+ * @param[in] pcTopicFilter Topic filter, must persist for the lifetime of the
+ * subscription.
+ * @param[in] pxCallback Callback for incoming publishes.
+ * @param[in] pvContext Context passed to pxCallback.
+ *
+ * @return false if not connected, failed or not acknowledged in time. A timed
+ * out subscribe keeps running, calling again is safe.
+ */
+bool prvSubscribeRawToAWS(char *pcTopicFilter, IncomingPubCallback_t pxCallback, void *pvContext);
 
 /* *INDENT-OFF* */
     #ifdef __cplusplus
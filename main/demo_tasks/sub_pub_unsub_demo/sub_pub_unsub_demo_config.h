@@ -81,6 +81,12 @@
  */
 #define subpubunsubconfigTASK_STACK_SIZE                         ( ( unsigned int ) ( CONFIG_GRI_SUB_PUB_UNSUB_DEMO_TASK_STACK_SIZE ) )
 
+/**
+ * @brief How long a scan waits for the cloud's answer to an access request
+ * before it is treated as denied.
+ */
+#define subpubunsubconfigACCESS_RESPONSE_TIMEOUT_MS              ( ( int ) ( CONFIG_GRI_SUB_PUB_UNSUB_DEMO_ACCESS_RESPONSE_TIMEOUT_MS ) )
+
 /* *INDENT-OFF* */
     #ifdef __cplusplus
         } /* extern "C" */
@@ -25,22 +25,20 @@
  */
 
 /*
- * This file demonstrates a task which use the coreMQTT-agent API
+ * This file demonstrates a scheduler job which use the coreMQTT-agent API
  * to send and receive MQTT payloads and showcases how these can be used with
  * hardware.
  *
- * The created task is an instance of the task implemented by
- * prvTempSubPubAndLEDControlTask(). prvTempSubPubAndLEDControlTask()
- * subscribes to a topic then periodically reads the temperature sensor of the
+ * The job is implemented by prvTempSubPubAndLEDControlJob() and runs on the
+ * shared scheduler worker. On its first run with a connection it
+ * subscribes to a topic, then on each run it reads the temperature sensor of the
  * ESP32-C3 and publishes a JSON payload with the temperature data to the same
  * topic to which it has subscribed. The user can also publish a JSON payload to
  * this same topic to turn off and on the LED on the ESP32-C3.
- * The command context sent to MQTTAgent_Publish() contains a unique number that
- * is sent back to the task as a task notification from the callback function
- * that executes when the PUBLISH operation is acknowledged (or just sent
- * in the case of QoS 0). The task checks the number it receives from the
- * callback equals the number it previously set in the command context before
- * printing out either a success or failure message.
+ * Each publish returns a future of core_mqtt_agent_futures.h that completes
+ * when the PUBLISH operation is acknowledged (or just sent in the case of
+ * QoS 0). The job waits a bounded time for it; a publish still in flight is
+ * polled on the next run before the payload buffer is reused.
  */
 
 /* Includes *******************************************************************/
@@ -70,6 +68,7 @@
 /* coreMQTT-Agent network manager include. */
 #include "core_mqtt_agent_manager.h"
 #include "core_mqtt_agent_manager_events.h"
+#include "core_mqtt_agent_futures.h"
 
 /* coreJSON include. */
 #include "core_json.h"
@@ -77,6 +76,9 @@
 /* Subscription manager include. */
 #include "subscription_manager.h"
 
+/* Scheduler include. */
+#include "extras/Scheduler.h"
+
 /* Hardware drivers include. */
 #include "app_driver.h"
 
@@ -92,19 +94,16 @@
 #define CORE_MQTT_AGENT_CONNECTED_BIT              ( 1 << 0 )
 #define CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT    ( 1 << 1 )
 
-/* Struct definitions *********************************************************/
+/**
+ * @brief Upper bound for waiting on a command acknowledgment. The job runs on
+ * the shared scheduler worker, so it must not block forever on a lost ack.
+ */
+#define temppubsubandledcontrolACK_TIMEOUT_MS      ( 5000U )
 
 /**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
+ * @brief Name used for the scheduler job and the topic it publishes to.
  */
-struct MQTTAgentCommandContext
-{
-    MQTTStatus_t xReturnStatus;
-    TaskHandle_t xTaskToNotify;
-    uint32_t ulNotificationValue;
-    void * pArgs;
-};
+#define temppubsubandledcontrolJOB_NAME            "TempSubPubLED"
 
 /* Global variables ***********************************************************/
 
@@ -113,12 +112,6 @@ struct MQTTAgentCommandContext
  */
 const static char * TAG = "temp_sub_pub_and_led_control_demo";
 
-/**
- * @brief The MQTT agent manages the MQTT contexts.  This set the handle to the
- * context used by this demo.
- */
-extern MQTTAgentContext_t xGlobalMqttAgentContext;
-
 /**
  * @brief The buffer to hold the topic filter. The topic is generated at runtime
  * by adding the task names.
@@ -132,6 +125,20 @@ static char topicBuf[ temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH ];
  */
 static EventGroupHandle_t xNetworkEventGroup;
 
+/**
+ * @brief State kept between the runs of the publish job.
+ *
+ * @note The payload must persist until the publish completes, which can be
+ * after the job gave up waiting for it. xPublishFuture is kept until then.
+ */
+static char payloadBuf[ temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH ];
+static MQTTPublishInfo_t xPublishInfo;
+static MqttAgentFutureHandle_t xPublishFuture = NULL;
+static uint32_t ulIteration = 0UL;
+static uint32_t ulPublishPassCounts = 0;
+static uint32_t ulPublishFailCounts = 0;
+static bool bSubscribed = false;
+
 /* Static function declarations ***********************************************/
 
 /**
@@ -145,56 +152,7 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
                                           void * pvEventData );
 
 /**
- * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when the
- * broker ACKs the SUBSCRIBE message.  Its implementation sends a notification
- * to the task that called MQTTAgent_Subscribe() to let the task know the
- * SUBSCRIBE operation completed.  It also sets the xReturnStatus of the
- * structure passed in as the command's context to the value of the
- * xReturnStatus parameter - which enables the task to check the status of the
- * operation.
- *
- * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
- *
- * @param[in] pxCommandContext Context of the initial command.
- * @param[in].xReturnStatus The result of the command.
- */
-static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                         MQTTAgentReturnInfo_t * pxReturnInfo );
-
-/**
- * @brief Passed into MQTTAgent_Publish() as the callback to execute when the
- * broker ACKs the PUBLISH message.  Its implementation sends a notification
- * to the task that called MQTTAgent_Publish() to let the task know the
- * PUBLISH operation completed.  It also sets the xReturnStatus of the
- * structure passed in as the command's context to the value of the
- * xReturnStatus parameter - which enables the task to check the status of the
- * operation.
- *
- * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
- *
- * @param[in] pxCommandContext Context of the initial command.
- * @param[in].xReturnStatus The result of the command.
- */
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo );
-
-/**
- * @brief Called by the task to wait for a notification from a callback function
- * after the task first executes either MQTTAgent_Publish()* or
- * MQTTAgent_Subscribe().
- *
- * See https://freertos.org/mqtt/mqtt-agent-demo.html#example_mqtt_api_call
- *
- * @param[in] pxCommandContext Context of the initial command.
- * @param[out] pulNotifiedValue The task's notification value after it receives
- * a notification from the callback.
- *
- * @return pdTRUE if the task received a notification, otherwise pdFALSE.
- */
-static BaseType_t prvWaitForCommandAcknowledgment( uint32_t * pulNotifiedValue );
-
-/**
- * @brief Passed into MQTTAgent_Subscribe() as the callback to execute when
+ * @brief Passed into xMqttAgentFutureSubscribe() as the callback to execute when
  * there is an incoming publish on the topic being subscribed to.  Its
  * implementation just logs information about the incoming publish including
  * the publish messages source topic and payload.
@@ -220,81 +178,12 @@ static bool prvSubscribeToTopic( MQTTQoS_t xQoS,
                                  char * pcTopicFilter );
 
 /**
- * @brief The function that implements the task demonstrated by this file.
+ * @brief The scheduler job demonstrated by this file, one publish per run.
  */
-static void prvTempSubPubAndLEDControlTask( void * pvParameters );
+static void prvTempSubPubAndLEDControlJob( void * pvArg );
 
 /* Static function definitions ************************************************/
 
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo )
-{
-    /* Store the result in the application defined context so the task that
-     * initiated the publish can check the operation's status. */
-    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
-
-    if( pxCommandContext->xTaskToNotify != NULL )
-    {
-        /* Send the context's ulNotificationValue as the notification value so
-         * the receiving task can check the value it set in the context matches
-         * the value it receives in the notification. */
-        xTaskNotify( pxCommandContext->xTaskToNotify,
-                     pxCommandContext->ulNotificationValue,
-                     eSetValueWithOverwrite );
-    }
-}
-
-static void prvSubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                         MQTTAgentReturnInfo_t * pxReturnInfo )
-{
-    bool xSubscriptionAdded = false;
-    MQTTAgentSubscribeArgs_t * pxSubscribeArgs = ( MQTTAgentSubscribeArgs_t * ) pxCommandContext->pArgs;
-
-    /* Store the result in the application defined context so the task that
-     * initiated the subscribe can check the operation's status.  Also send the
-     * status as the notification value.  These things are just done for
-     * demonstration purposes. */
-    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
-
-    /* Check if the subscribe operation is a success. Only one topic is
-     * subscribed by this demo. */
-    if( pxReturnInfo->returnCode == MQTTSuccess )
-    {
-        /* Add subscription so that incoming publishes are routed to the application
-         * callback. */
-        xSubscriptionAdded = addSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
-                                              pxSubscribeArgs->pSubscribeInfo->pTopicFilter,
-                                              pxSubscribeArgs->pSubscribeInfo->topicFilterLength,
-                                              prvIncomingPublishCallback,
-                                              NULL );
-
-        if( xSubscriptionAdded == false )
-        {
-            ESP_LOGE( TAG,
-                      "Failed to register an incoming publish callback for topic %.*s.",
-                      pxSubscribeArgs->pSubscribeInfo->topicFilterLength,
-                      pxSubscribeArgs->pSubscribeInfo->pTopicFilter );
-        }
-    }
-
-    xTaskNotify( pxCommandContext->xTaskToNotify,
-                 ( uint32_t ) ( pxReturnInfo->returnCode ),
-                 eSetValueWithOverwrite );
-}
-
-static BaseType_t prvWaitForCommandAcknowledgment( uint32_t * pulNotifiedValue )
-{
-    BaseType_t xReturn;
-
-    /* Wait for this task to get notified, passing out the value it gets
-     * notified with. */
-    xReturn = xTaskNotifyWait( 0,
-                               0,
-                               pulNotifiedValue,
-                               portMAX_DELAY );
-    return xReturn;
-}
-
 static void prvParseIncomingPublish( char * publishPayload,
                                      size_t publishPayloadLength )
 {
@@ -371,239 +260,157 @@ static void prvIncomingPublishCallback( void * pvIncomingPublishCallbackContext,
 static bool prvSubscribeToTopic( MQTTQoS_t xQoS,
                                  char * pcTopicFilter )
 {
-    MQTTStatus_t xCommandAdded;
-    BaseType_t xCommandAcknowledged = pdFALSE;
-    MQTTAgentSubscribeArgs_t xSubscribeArgs;
-    MQTTSubscribeInfo_t xSubscribeInfo;
-    static int32_t ulNextSubscribeMessageID = 0;
-    MQTTAgentCommandContext_t xApplicationDefinedContext = { 0UL };
-    MQTTAgentCommandInfo_t xCommandParams = { 0UL };
-
-    /* Create a unique number of the subscribe that is about to be sent.  The number
-     * is used as the command context and is sent back to this task as a notification
-     * in the callback that executed upon receipt of the subscription acknowledgment.
-     * That way this task can match an acknowledgment to a subscription. */
-    xTaskNotifyStateClear( NULL );
-
-    ulNextSubscribeMessageID++;
-
-    /* Complete the subscribe information.  The topic string must persist for
-     * duration of subscription! */
-    xSubscribeInfo.pTopicFilter = pcTopicFilter;
-    xSubscribeInfo.topicFilterLength = ( uint16_t ) strlen( pcTopicFilter );
-    xSubscribeInfo.qos = xQoS;
-    xSubscribeArgs.pSubscribeInfo = &xSubscribeInfo;
-    xSubscribeArgs.numSubscriptions = 1;
-
-    /* Complete an application defined context associated with this subscribe message.
-     * This gets updated in the callback function so the variable must persist until
-     * the callback executes. */
-    xApplicationDefinedContext.ulNotificationValue = ulNextSubscribeMessageID;
-    xApplicationDefinedContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
-    xApplicationDefinedContext.pArgs = ( void * ) &xSubscribeArgs;
-
-    xCommandParams.blockTimeMs = temppubsubandledcontrolconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
-    xCommandParams.cmdCompleteCallback = prvSubscribeCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = ( void * ) &xApplicationDefinedContext;
-
-    /* Loop in case the queue used to communicate with the MQTT agent is full and
-     * attempts to post to it time out.  The queue will not become full if the
-     * priority of the MQTT agent task is higher than the priority of the task
-     * calling this function. */
-    ESP_LOGI( TAG,
-              "Sending subscribe request to agent for topic filter: %s with id %d",
-              pcTopicFilter,
-              ( int ) ulNextSubscribeMessageID );
+    MQTTStatus_t xStatus;
 
-    do
-    {
-        xCommandAdded = MQTTAgent_Subscribe( &xGlobalMqttAgentContext,
-                                             &xSubscribeArgs,
-                                             &xCommandParams );
-    } while( xCommandAdded != MQTTSuccess );
-
-    /* Wait for acks to the subscribe message - this is optional but done here
-     * so the code below can check the notification sent by the callback matches
-     * the ulNextSubscribeMessageID value set in the context above. */
-    xCommandAcknowledged = prvWaitForCommandAcknowledgment( NULL );
-
-    /* Check both ways the status was passed back just for demonstration
-     * purposes. */
-    if( ( xCommandAcknowledged != pdTRUE ) ||
-        ( xApplicationDefinedContext.xReturnStatus != MQTTSuccess ) )
+    ESP_LOGI( TAG,
+              "Sending subscribe request to agent for topic filter: %s",
+              pcTopicFilter );
+
+    /* The topic string must persist for duration of subscription! A timed
+     * out wait leaves the subscribe running, the next run tries again. */
+    xStatus = xMqttAgentFutureGet( xMqttAgentFutureSubscribe( pcTopicFilter,
+                                                              ( uint16_t ) strlen( pcTopicFilter ),
+                                                              xQoS,
+                                                              prvIncomingPublishCallback,
+                                                              NULL,
+                                                              temppubsubandledcontrolconfigMAX_COMMAND_SEND_BLOCK_TIME_MS,
+                                                              NULL,
+                                                              NULL ),
+                                   pdMS_TO_TICKS( temppubsubandledcontrolACK_TIMEOUT_MS ) );
+
+    if( xStatus != MQTTSuccess )
     {
         ESP_LOGE( TAG,
-                  "Error or timed out waiting for ack to subscribe message topic %s",
+                  "Error %s or timed out waiting for ack to subscribe message topic %s",
+                  MQTT_Status_strerror( xStatus ),
                   pcTopicFilter );
     }
     else
     {
         ESP_LOGI( TAG,
-                  "Received subscribe ack for topic %s containing ID %d",
-                  pcTopicFilter,
-                  ( int ) xApplicationDefinedContext.ulNotificationValue );
+                  "Received subscribe ack for topic %s",
+                  pcTopicFilter );
     }
 
-    return xCommandAcknowledged;
+    return xStatus == MQTTSuccess;
 }
 
-static void prvTempSubPubAndLEDControlTask( void * pvParameters )
+static void prvTempSubPubAndLEDControlJob( void * pvArg )
 {
-    MQTTPublishInfo_t xPublishInfo = { 0UL };
-    char payloadBuf[ temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH ];
-    MQTTAgentCommandContext_t xCommandContext;
-    uint32_t ulNotification = 0U, ulValueToNotify = 0UL;
-    MQTTStatus_t xCommandAdded;
-    MQTTQoS_t xQoS;
-    TickType_t xTicksToDelay;
+    MQTTStatus_t xStatus = MQTTRecvFailed;
+    MQTTQoS_t xQoS = ( MQTTQoS_t ) temppubsubandledcontrolconfigQOS_LEVEL;
     float temperatureValue;
-    MQTTAgentCommandInfo_t xCommandParams = { 0UL };
-    char * pcTopicBuffer = topicBuf;
-    const char * pcTaskName;
-    uint32_t ulPublishPassCounts = 0;
-    uint32_t ulPublishFailCounts = 0;
 
-    pcTaskName = pcTaskGetName( xTaskGetCurrentTaskHandle() );
+    ( void ) pvArg;
 
-    /* Hardware initialisation */
-    app_driver_init();
-
-    /* Initialize the coreMQTT-Agent event group. */
-    xNetworkEventGroup = xEventGroupCreate();
-    xEventGroupSetBits( xNetworkEventGroup,
-                        CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
-
-    /* Register coreMQTT-Agent event handler. */
-    xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
+    /* Skip this round if coreMQTT-Agent has no working network connection or
+     * is performing an OTA update, the next run tries again. */
+    if( ( xEventGroupGetBits( xNetworkEventGroup ) &
+          ( CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT ) ) !=
+        ( CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT ) )
+    {
+        return;
+    }
 
-    xQoS = ( MQTTQoS_t ) temppubsubandledcontrolconfigQOS_LEVEL;
+    /* A publish that timed out on an earlier run still reads payloadBuf. It
+     * was already counted as failed, only give its future back. */
+    if( xPublishFuture != NULL )
+    {
+        if( xMqttAgentFuturePoll( xPublishFuture, NULL ) != pdTRUE )
+        {
+            ESP_LOGW( TAG,
+                      "Publish %" PRIu32 " still in flight, skipping this run.",
+                      ulIteration - 1 );
+            return;
+        }
 
-    /* Create a topic name for this task to publish to. */
-    snprintf( pcTopicBuffer,
-              temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH,
-              "/filter/%s",
-              pcTaskName );
+        vMqttAgentFutureRelease( xPublishFuture );
+        xPublishFuture = NULL;
+    }
 
-    /* Subscribe to the same topic to which this task will publish.  That will
+    /* Subscribe to the same topic to which this job will publish.  That will
      * result in each published message being published from the server back to
      * the target. */
-    prvSubscribeToTopic( xQoS, pcTopicBuffer );
-
-    /* Configure the publish operation. */
-    memset( ( void * ) &xPublishInfo, 0x00, sizeof( xPublishInfo ) );
-    xPublishInfo.qos = xQoS;
-    xPublishInfo.pTopicName = pcTopicBuffer;
-    xPublishInfo.topicNameLength = ( uint16_t ) strlen( pcTopicBuffer );
-    xPublishInfo.pPayload = payloadBuf;
-
-    /* Store the handler to this task in the command context so the callback
-     * that executes when the command is acknowledged can send a notification
-     * back to this task. */
-    memset( ( void * ) &xCommandContext, 0x00, sizeof( xCommandContext ) );
-    xCommandContext.xTaskToNotify = xTaskGetCurrentTaskHandle();
-
-    xCommandParams.blockTimeMs = temppubsubandledcontrolconfigMAX_COMMAND_SEND_BLOCK_TIME_MS;
-    xCommandParams.cmdCompleteCallback = prvPublishCommandCallback;
-    xCommandParams.pCmdCompleteCallbackContext = &xCommandContext;
-
-    ulValueToNotify = 0UL;
-
-    /* For an infinite number of publishes */
-    while( 1 )
+    if( bSubscribed == false )
     {
-        /* Create a payload to send with the publish message.  This contains
-         * the task name, temperature and the iteration number. */
-
-        temperatureValue = app_driver_temp_sensor_read_celsius();
-
-        snprintf( payloadBuf,
-                  temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH,
-                  "{"                            \
-                  "\"temperatureSensor\":"       \
-                  "{"                            \
-                  " \"taskName\": \"%s\","       \
-                  " \"temperatureValue\": %f,"   \
-                  " \"iteration\": %" PRIu32 ""  \
-                                             "}" \
-                                             "}" \
-                  ,
-                  pcTaskName,
-                  temperatureValue,
-                  ulValueToNotify );
-
-        xPublishInfo.payloadLength = ( uint16_t ) strlen( payloadBuf );
-
-        /* Also store the incrementing number in the command context so it can
-         * be accessed by the callback that executes when the publish operation
-         * is acknowledged. */
-        xCommandContext.ulNotificationValue = ulValueToNotify;
-
-        /* Wait for coreMQTT-Agent task to have working network connection and
-         * not be performing an OTA update. */
-        xEventGroupWaitBits( xNetworkEventGroup,
-                             CORE_MQTT_AGENT_CONNECTED_BIT | CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT,
-                             pdFALSE,
-                             pdTRUE,
-                             portMAX_DELAY );
-
-        ESP_LOGI( TAG,
-                  "Sending publish request to agent with message \"%s\" on topic \"%s\"",
-                  payloadBuf,
-                  pcTopicBuffer );
+        bSubscribed = prvSubscribeToTopic( xQoS, topicBuf );
 
-        /* To ensure ulNotification doesn't accidentally hold the expected value
-         * as it is to be checked against the value sent from the callback.. */
-        ulNotification = ~ulValueToNotify;
+        if( bSubscribed == false )
+        {
+            return;
+        }
+    }
 
-        xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext,
-                                           &xPublishInfo,
-                                           &xCommandParams );
-        configASSERT( xCommandAdded == MQTTSuccess );
+    /* Create a payload to send with the publish message.  This contains
+     * the job name, temperature and the iteration number. */
+    temperatureValue = app_driver_temp_sensor_read_celsius();
 
-        /* For QoS 1 and 2, wait for the publish acknowledgment.  For QoS0,
-         * wait for the publish to be sent. */
-        ESP_LOGI( TAG,
-                  "Task %s waiting for publish %" PRIu32 " to complete.",
-                  pcTaskName,
-                  ulValueToNotify );
+    snprintf( payloadBuf,
+              temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH,
+              "{"                            \
+              "\"temperatureSensor\":"       \
+              "{"                            \
+              " \"taskName\": \"%s\","       \
+              " \"temperatureValue\": %f,"   \
+              " \"iteration\": %" PRIu32 ""  \
+                                         "}" \
+                                         "}" \
+              ,
+              temppubsubandledcontrolJOB_NAME,
+              temperatureValue,
+              ulIteration );
+
+    xPublishInfo.payloadLength = ( uint16_t ) strlen( payloadBuf );
 
-        prvWaitForCommandAcknowledgment( &ulNotification );
+    ESP_LOGI( TAG,
+              "Sending publish request to agent with message \"%s\" on topic \"%s\"",
+              payloadBuf,
+              topicBuf );
 
-        /* The value received by the callback that executed when the publish was
-         * acked came from the context passed into MQTTAgent_Publish() above, so
-         * should match the value set in the context above. */
-        if( ulNotification == ulValueToNotify )
-        {
-            ulPublishPassCounts++;
-            ESP_LOGI( TAG,
-                      "Rx'ed %s from Tx to %s (P%" PRIu32 ":F%" PRIu32 ").",
-                      ( xQoS == 0 ) ? "completion notification for QoS0 publish" : "ack for QoS1 publish",
-                      pcTopicBuffer,
-                      ulPublishPassCounts,
-                      ulPublishFailCounts );
-        }
-        else
-        {
-            ulPublishFailCounts++;
-            ESP_LOGE( TAG,
-                      "Timed out Rx'ing %s from Tx to %s (P%" PRIu32 ":F%" PRIu32 ")",
-                      ( xQoS == 0 ) ? "completion notification for QoS0 publish" : "ack for QoS1 publish",
-                      pcTopicBuffer,
-                      ulPublishPassCounts,
-                      ulPublishFailCounts );
-        }
+    xPublishFuture = xMqttAgentFuturePublish( &xPublishInfo,
+                                              temppubsubandledcontrolconfigMAX_COMMAND_SEND_BLOCK_TIME_MS,
+                                              NULL,
+                                              NULL );
 
-        ulValueToNotify++;
+    /* For QoS 1 and 2, wait for the publish acknowledgment.  For QoS0,
+     * wait for the publish to be sent. A publish that could not be enqueued
+     * completes right away with the error. */
+    ESP_LOGI( TAG,
+              "Job %s waiting for publish %" PRIu32 " to complete.",
+              temppubsubandledcontrolJOB_NAME,
+              ulIteration );
 
-        /* Add a little randomness into the delay so the tasks don't remain
-         * in lockstep. */
-        xTicksToDelay = pdMS_TO_TICKS( temppubsubandledcontrolconfigDELAY_BETWEEN_PUBLISH_OPERATIONS_MS ) +
-                        ( rand() % 0xff );
+    if( xMqttAgentFutureWait( xPublishFuture,
+                              pdMS_TO_TICKS( temppubsubandledcontrolACK_TIMEOUT_MS ),
+                              &xStatus ) == pdTRUE )
+    {
+        vMqttAgentFutureRelease( xPublishFuture );
+        xPublishFuture = NULL;
+    }
 
-        vTaskDelay( xTicksToDelay );
+    if( xStatus == MQTTSuccess )
+    {
+        ulPublishPassCounts++;
+        ESP_LOGI( TAG,
+                  "Rx'ed %s from Tx to %s (P%" PRIu32 ":F%" PRIu32 ").",
+                  ( xQoS == 0 ) ? "completion notification for QoS0 publish" : "ack for QoS1 publish",
+                  topicBuf,
+                  ulPublishPassCounts,
+                  ulPublishFailCounts );
+    }
+    else
+    {
+        ulPublishFailCounts++;
+        ESP_LOGE( TAG,
+                  "Error %s or timed out Rx'ing %s from Tx to %s (P%" PRIu32 ":F%" PRIu32 ")",
+                  MQTT_Status_strerror( xStatus ),
+                  ( xQoS == 0 ) ? "completion notification for QoS0 publish" : "ack for QoS1 publish",
+                  topicBuf,
+                  ulPublishPassCounts,
+                  ulPublishFailCounts );
     }
 
-    vTaskDelete( NULL );
+    ulIteration++;
 }
 
 static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
@@ -630,6 +437,9 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
                       "commands from being enqueued." );
             xEventGroupClearBits( xNetworkEventGroup,
                                   CORE_MQTT_AGENT_CONNECTED_BIT );
+
+            /* A clean session drops the subscription, renew it next run. */
+            bSubscribed = false;
             break;
 
         case CORE_MQTT_AGENT_OTA_STARTED_EVENT:
@@ -660,10 +470,36 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
 
 void vStartTempSubPubAndLEDControlDemo( void )
 {
-    xTaskCreate( prvTempSubPubAndLEDControlTask,
-                 "TempSubPubLED",
-                 temppubsubandledcontrolconfigTASK_STACK_SIZE,
-                 NULL,
-                 temppubsubandledcontrolconfigTASK_PRIORITY,
-                 NULL );
+    /* Hardware initialisation */
+    app_driver_init();
+
+    /* Initialize the coreMQTT-Agent event group. */
+    xNetworkEventGroup = xEventGroupCreate();
+    xEventGroupSetBits( xNetworkEventGroup,
+                        CORE_MQTT_AGENT_OTA_NOT_IN_PROGRESS_BIT );
+
+    /* Register coreMQTT-Agent event handler. */
+    xCoreMqttAgentManagerRegisterHandler( prvCoreMqttAgentEventHandler );
+
+    /* Create a topic name for this job to publish to. */
+    snprintf( topicBuf,
+              temppubsubandledcontrolconfigSTRING_BUFFER_LENGTH,
+              "/filter/%s",
+              temppubsubandledcontrolJOB_NAME );
+
+    /* Configure the publish operation. */
+    memset( ( void * ) &xPublishInfo, 0x00, sizeof( xPublishInfo ) );
+    xPublishInfo.qos = ( MQTTQoS_t ) temppubsubandledcontrolconfigQOS_LEVEL;
+    xPublishInfo.pTopicName = topicBuf;
+    xPublishInfo.topicNameLength = ( uint16_t ) strlen( topicBuf );
+    xPublishInfo.pPayload = payloadBuf;
+
+    if( SchedulerAddInterval( temppubsubandledcontrolJOB_NAME,
+                              temppubsubandledcontrolconfigDELAY_BETWEEN_PUBLISH_OPERATIONS_MS,
+                              temppubsubandledcontrolconfigDELAY_BETWEEN_PUBLISH_OPERATIONS_MS,
+                              prvTempSubPubAndLEDControlJob,
+                              NULL ) == NULL )
+    {
+        ESP_LOGE( TAG, "Failed to schedule the temperature publish job." );
+    }
 }
@@ -0,0 +1,369 @@
+/*
+ * AccessRules.c
+ *
+ *  Zeitfenster je Gruppe, siehe AccessRules.h
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "AccessRules.h"
+#include "Scheduler.h"
+#include "Timestamp.h"
+
+static const char* TAG = "AccessRules";
+
+// Layout muss zu main/tools/gen_rules.py passen
+#define RULES_MAGIC             0x4C524341u     // "ACRL"
+#define RULES_FORMAT_VERSION    1
+#define RULES_MAX_GROUPS        CONFIG_ACCESS_RULES_MAX_GROUPS
+#define RULES_MAX_UIDS          CONFIG_ACCESS_RULES_MAX_UIDS
+
+#define WEEK_QUARTERS           (7 * 96)
+#define WEEK_BYTES              (WEEK_QUARTERS / 8)
+#define MEMBER_SIZE             6
+#define QUARTER_S               900
+
+// Die Vorberechnung schaut höchstens einen Tag voraus, danach wird neu gerechnet
+#define LOOKAHEAD_QUARTERS      96
+#define REFRESH_INTERVAL_MS     15000
+
+#define NVS_NAMESPACE           "rules"
+#define NVS_KEY_RULES           "rules"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t formatVersion;
+    uint8_t groupCount;
+    uint8_t reserved;
+    uint32_t memberCount;
+    uint32_t serial;
+    uint32_t crc32;             // über alles nach dem Kopf, wie zlib.crc32()
+} AccessRulesHeader;
+
+_Static_assert(sizeof(AccessRulesHeader) == 20, "AccessRulesHeader must match gen_rules.py");
+
+#define RULES_MAX_SIZE  (sizeof(AccessRulesHeader) + RULES_MAX_GROUPS * WEEK_BYTES + RULES_MAX_UIDS * MEMBER_SIZE)
+
+// Veröffentlichter Regelsatz, wird danach nicht mehr verändert
+typedef struct {
+    uint32_t serial;
+    uint32_t version;           // zählt pro Veröffentlichung, kennzeichnet die Vorberechnung
+    uint32_t groupCount;
+    uint32_t memberCount;
+    uint8_t weeks[RULES_MAX_GROUPS][WEEK_BYTES];
+    uint8_t members[RULES_MAX_UIDS * MEMBER_SIZE];
+} AccessRulesSet;
+
+static AccessRulesSet sets[2];
+static _Atomic uint32_t setRefs[2];
+static _Atomic uint32_t currentSet = 0;
+
+// Vorberechnung je Gruppe in einem Wort, damit Scans sie ohne Lock lesen:
+// Bit 0 Zustand, Bits 1..39 gültig bis (UTC-Sekunden), Bits 40..63 Version des Regelsatzes
+static _Atomic uint64_t groupCache[RULES_MAX_GROUPS];
+
+#define CACHE_VERSION_MASK      0xFFFFFFu
+#define CACHE_UNTIL_MASK        ((1ULL << 39) - 1)
+
+// Empfangspuffer, gehört dem Apply-Job solange rxBusy gesetzt ist
+static uint8_t rxBuffer[RULES_MAX_SIZE];
+static size_t rxLength = 0;
+static atomic_bool rxBusy = false;
+static SchedulerJob *applyJob = NULL;
+static SchedulerJob *refreshJob = NULL;
+
+static _Atomic uint32_t allowedCount = 0;
+static _Atomic uint32_t deniedCount = 0;
+static _Atomic uint32_t slowPathCount = 0;
+
+static inline uint64_t MemberUid(const uint8_t *members, uint32_t index)
+{
+    const uint8_t *p = members + (size_t)index * MEMBER_SIZE;
+    return ((uint64_t)p[0] << 32) | ((uint64_t)p[1] << 24) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 8) | p[4];
+}
+
+// Gruppe der UID oder -1
+static int FindGroup(const AccessRulesSet *set, uint64_t uid)
+{
+    uint32_t lo = 0, hi = set->memberCount;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint64_t key = MemberUid(set->members, mid);
+
+        if (key == uid) {
+            return set->members[(size_t)mid * MEMBER_SIZE + 5];
+        }
+        if (key < uid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+// Zustand der Gruppe zur UTC-Zeit t in Ortszeit
+static bool StateAt(const uint8_t *week, time_t t)
+{
+    struct tm local;
+    localtime_r(&t, &local);
+
+    uint32_t quarter = ((local.tm_wday + 6) % 7) * 96 + local.tm_hour * 4 + local.tm_min / 15;
+    return (week[quarter >> 3] >> (quarter & 7)) & 1;
+}
+
+// Zustand jetzt und Zeitpunkt der nächsten Änderung. Es wird in UTC-Viertelstunden
+// gelaufen und jede in Ortszeit umgerechnet, so zählen Zeitumstellungen automatisch mit.
+// Alle Zonen in TimeZones.h haben Offsets in ganzen Viertelstunden
+static bool NextTransition(const uint8_t *week, time_t now, time_t *validUntil)
+{
+    bool state = StateAt(week, now);
+    time_t t = now - now % QUARTER_S;
+
+    for (int i = 0; i < LOOKAHEAD_QUARTERS; i++) {
+        t += QUARTER_S;
+        if (StateAt(week, t) != state) {
+            break;
+        }
+    }
+    *validUntil = t;
+    return state;
+}
+
+static const AccessRulesSet *SetAcquire(void)
+{
+    for (;;) {
+        uint32_t slot = atomic_load(&currentSet);
+
+        atomic_fetch_add(&setRefs[slot], 1);
+        if (slot == atomic_load(&currentSet)) {
+            return &sets[slot];
+        }
+        atomic_fetch_sub(&setRefs[slot], 1);
+    }
+}
+
+static void SetRelease(const AccessRulesSet *set)
+{
+    atomic_fetch_sub(&setRefs[set - sets], 1);
+}
+
+AccessRuleResult AccessRulesCheck(uint64_t uid)
+{
+    // Ohne Uhrzeit kann kein Zeitfenster geprüft werden
+    if (!TimestampHasUtc()) {
+        return ACCESS_RULE_NONE;
+    }
+
+    const AccessRulesSet *set = SetAcquire();
+    int group = FindGroup(set, uid);
+    if (group < 0) {
+        SetRelease(set);
+        return ACCESS_RULE_NONE;
+    }
+
+    time_t now = (time_t)(TimestampUtcUs() / 1000000);
+    uint64_t cached = atomic_load(&groupCache[group]);
+    bool state;
+
+    if ((cached >> 40) == (set->version & CACHE_VERSION_MASK) && (uint64_t)now < ((cached >> 1) & CACHE_UNTIL_MASK)) {
+        state = cached & 1;
+    } else {
+        // Vorberechnung noch nicht da oder gerade abgelaufen, ein localtime_r reicht
+        atomic_fetch_add(&slowPathCount, 1);
+        state = StateAt(set->weeks[group], now);
+    }
+    SetRelease(set);
+
+    atomic_fetch_add(state ? &allowedCount : &deniedCount, 1);
+    return state ? ACCESS_RULE_ALLOW : ACCESS_RULE_DENY;
+}
+
+// Rechnet abgelaufene Gruppen neu, läuft periodisch und nach neuen Regeln
+static void AccessRulesRefreshJob(void *arg)
+{
+    if (!TimestampHasUtc()) {
+        return;
+    }
+
+    const AccessRulesSet *set = SetAcquire();
+    time_t now = (time_t)(TimestampUtcUs() / 1000000);
+    uint64_t version = set->version & CACHE_VERSION_MASK;
+
+    for (uint32_t g = 0; g < set->groupCount; g++) {
+        uint64_t cached = atomic_load(&groupCache[g]);
+
+        if ((cached >> 40) == version && (uint64_t)now < ((cached >> 1) & CACHE_UNTIL_MASK)) {
+            continue;
+        }
+
+        time_t validUntil;
+        bool state = NextTransition(set->weeks[g], now, &validUntil);
+        atomic_store(&groupCache[g], (version << 40) | (((uint64_t)validUntil & CACHE_UNTIL_MASK) << 1) | state);
+        ESP_LOGD(TAG, "Group %" PRIu32 " %s until %lld", g, state ? "open" : "closed", (long long)validUntil);
+    }
+    SetRelease(set);
+}
+
+// Prüft Kopf, Größe, CRC und Sortierung, ohne etwas zu verändern
+static bool RulesValidate(const uint8_t *data, size_t len, AccessRulesHeader *header)
+{
+    if (len < sizeof(*header)) {
+        return false;
+    }
+    memcpy(header, data, sizeof(*header));
+
+    if (header->magic != RULES_MAGIC || header->formatVersion != RULES_FORMAT_VERSION ||
+        header->groupCount > RULES_MAX_GROUPS || header->memberCount > RULES_MAX_UIDS ||
+        len != sizeof(*header) + (size_t)header->groupCount * WEEK_BYTES + (size_t)header->memberCount * MEMBER_SIZE) {
+        ESP_LOGE(TAG, "Invalid rules (%u bytes, %u groups, %" PRIu32 " UIDs)",
+                 (unsigned)len, header->groupCount, header->memberCount);
+        return false;
+    }
+    if (esp_rom_crc32_le(0, data + sizeof(*header), len - sizeof(*header)) != header->crc32) {
+        ESP_LOGE(TAG, "Rules %" PRIu32 " CRC mismatch", header->serial);
+        return false;
+    }
+
+    const uint8_t *members = data + sizeof(*header) + (size_t)header->groupCount * WEEK_BYTES;
+    for (uint32_t i = 0; i < header->memberCount; i++) {
+        if ((i > 0 && MemberUid(members, i - 1) >= MemberUid(members, i)) ||
+            members[(size_t)i * MEMBER_SIZE + 5] >= header->groupCount) {
+            ESP_LOGE(TAG, "Rules %" PRIu32 ": UID %" PRIu32 " unsorted or with unknown group", header->serial, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void RulesPublish(const uint8_t *data, const AccessRulesHeader *header)
+{
+    uint32_t previous = atomic_load(&currentSet);
+    uint32_t spare = previous ^ 1;
+    AccessRulesSet *set = &sets[spare];
+    const uint8_t *weeks = data + sizeof(*header);
+
+    // Scans halten den Regelsatz nur für wenige µs
+    while (atomic_load(&setRefs[spare]) != 0) {
+        vTaskDelay(1);
+    }
+
+    set->serial = header->serial;
+    set->version = sets[previous].version + 1;
+    set->groupCount = header->groupCount;
+    set->memberCount = header->memberCount;
+    memcpy(set->weeks, weeks, (size_t)header->groupCount * WEEK_BYTES);
+    memcpy(set->members, weeks + (size_t)header->groupCount * WEEK_BYTES, (size_t)header->memberCount * MEMBER_SIZE);
+    atomic_store(&currentSet, spare);
+
+    ESP_LOGI(TAG, "Rules %" PRIu32 ": %u groups, %" PRIu32 " UIDs", header->serial, header->groupCount, header->memberCount);
+}
+
+static void RulesStore(const uint8_t *data, size_t len)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, NVS_KEY_RULES, data, len);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store rules: %s", esp_err_to_name(err));
+    }
+}
+
+// Läuft auf dem Scheduler, angestoßen von AccessRulesReceive()
+static void AccessRulesApplyJob(void *arg)
+{
+    AccessRulesHeader header;
+
+    if (!atomic_load(&rxBusy)) {
+        return;
+    }
+
+    if (RulesValidate(rxBuffer, rxLength, &header) && header.serial != AccessRulesSerial()) {
+        RulesPublish(rxBuffer, &header);
+        RulesStore(rxBuffer, rxLength);
+        SchedulerTrigger(refreshJob);
+    }
+    atomic_store(&rxBusy, false);
+}
+
+void AccessRulesReceive(const void *payload, size_t len)
+{
+    if (applyJob == NULL || len > sizeof(rxBuffer)) {
+        ESP_LOGW(TAG, "Rules of %u bytes dropped", (unsigned)len);
+        return;
+    }
+    if (atomic_exchange(&rxBusy, true)) {
+        ESP_LOGW(TAG, "Rules dropped, previous ones still being applied");
+        return;
+    }
+
+    memcpy(rxBuffer, payload, len);
+    rxLength = len;
+    SchedulerTrigger(applyJob);
+}
+
+bool AccessRulesInit(void)
+{
+    AccessRulesHeader header;
+    size_t len = sizeof(rxBuffer);
+    nvs_handle_t handle;
+
+    if (applyJob == NULL) {
+        applyJob = SchedulerAddJob("rulesApply", AccessRulesApplyJob, NULL);
+        refreshJob = SchedulerAddInterval("rulesRefresh", REFRESH_INTERVAL_MS, REFRESH_INTERVAL_MS,
+                                          AccessRulesRefreshJob, NULL);
+    }
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        ESP_LOGI(TAG, "No cached rules");
+        return false;
+    }
+    bool ok = nvs_get_blob(handle, NVS_KEY_RULES, rxBuffer, &len) == ESP_OK;
+    nvs_close(handle);
+
+    // Läuft vor dem ersten Scan und vor dem Empfang, der Puffer ist hier noch frei
+    if (!ok || !RulesValidate(rxBuffer, len, &header)) {
+        ESP_LOGW(TAG, "Cached rules missing or invalid, waiting for the cloud");
+        return false;
+    }
+    RulesPublish(rxBuffer, &header);
+    return true;
+}
+
+uint32_t AccessRulesSerial(void)
+{
+    const AccessRulesSet *set = SetAcquire();
+    uint32_t serial = set->serial;
+    SetRelease(set);
+    return serial;
+}
+
+void AccessRulesGetStats(uint32_t *allowed, uint32_t *denied, uint32_t *slowPath)
+{
+    if (allowed != NULL) {
+        *allowed = atomic_load(&allowedCount);
+    }
+    if (denied != NULL) {
+        *denied = atomic_load(&deniedCount);
+    }
+    if (slowPath != NULL) {
+        *slowPath = atomic_load(&slowPathCount);
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ * AccessRules.h
+ *
+ *  Zeitfenster für den Zugang, lokal ausgewertet. Die Cloud schickt pro
+ *  Gruppe einen Wochenplan aus 672 Bits (7 Tage x 96 Viertelstunden,
+ *  Montag 00:00 = Bit 0, Ortszeit laut TimeZones.h) und eine Zuordnung
+ *  UID -> Gruppe. Erzeugt wird das Paket mit main/tools/gen_rules.py und
+ *  binär über den Settings-Kanal (device/settings/<mac>/rules) geschickt.
+ *
+ *  Für jede Gruppe wird der aktuelle Zustand mit dem Zeitpunkt der nächsten
+ *  Änderung vorberechnet, inklusive Sommer-/Winterzeit. Ein Scan prüft dann
+ *  nur noch die UTC-Zeit gegen diesen Zeitpunkt.
+ *
+ *  Layout (little endian, 20 Byte Kopf):
+ *    u32 magic "ACRL", u16 Format (1), u8 Gruppen, u8 0, u32 UIDs,
+ *    u32 Seriennummer, u32 CRC32 ab Byte 20, dann je Gruppe 84 Byte
+ *    Wochenplan, dann je UID 5 Byte UID (big endian, aufsteigend) + 1 Byte Gruppe
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAIN_ACCESSRULES_H_
+#define MAIN_ACCESSRULES_H_
+
+typedef enum {
+    ACCESS_RULE_NONE = 0,       // keine Regel oder keine gültige Uhrzeit, die Cloud entscheidet
+    ACCESS_RULE_ALLOW,          // UID im Zeitfenster ihrer Gruppe
+    ACCESS_RULE_DENY,           // UID außerhalb des Zeitfensters
+} AccessRuleResult;
+
+// Lädt die zuletzt empfangenen Regeln aus dem NVS und legt die Jobs an, nach StartScheduler() aufrufen
+//@return false wenn keine gültigen Regeln gespeichert sind
+bool AccessRulesInit(void);
+
+// Wertet die Regel der UID zur aktuellen Zeit aus, blockiert nie
+AccessRuleResult AccessRulesCheck(uint64_t uid);
+
+// Nimmt Regeln aus dem MQTT-Callback entgegen, geprüft und übernommen wird auf dem Scheduler
+void AccessRulesReceive(const void *payload, size_t len);
+
+// Seriennummer der aktiven Regeln, 0 ohne Regeln
+uint32_t AccessRulesSerial(void);
+
+// Lokal entschiedene Scans: erlaubt, abgelehnt, davon ohne Vorberechnung ausgewertet
+void AccessRulesGetStats(uint32_t *allowed, uint32_t *denied, uint32_t *slowPath);
+
+#endif /* MAIN_ACCESSRULES_H_ */
@@ -0,0 +1,660 @@
+/*
+ * AllowList.c
+ *
+ *  Suche in der eingeblendeten Zugangsliste, siehe AllowList.h
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "AllowList.h"
+
+static const char* TAG = "AllowList";
+
+// Layout muss zu main/tools/gen_allowlist.py passen (little endian, 32 Byte)
+#define ALLOWLIST_MAGIC             0x54534C41u     // "ALST"
+#define ALLOWLIST_FORMAT_VERSION    1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t formatVersion;
+    uint16_t recordSize;
+    uint32_t count;
+    uint32_t serial;
+    uint32_t crc32;             // über alle Einträge, wie zlib.crc32()
+    uint8_t reserved[12];
+} AllowListHeader;
+
+_Static_assert(sizeof(AllowListHeader) == 32, "AllowListHeader must match gen_allowlist.py");
+
+// UIDs sind annähernd gleichverteilt, nach wenigen Interpolationsschritten ist der Bereich klein.
+// Danach binär weiter, damit ungünstige Verteilungen nicht linear werden
+#define INTERPOLATION_STEPS         4
+
+// Obergrenze für 40-Bit-UIDs
+#define UID_LIMIT                   (1ULL << 40)
+
+// Anzahl Suchen für die Messung beim Start
+#define SELFTEST_LOOKUPS            64
+
+#define OVERLAY_MAX                 CONFIG_ALLOWLIST_OVERLAY_MAX_ENTRIES
+
+#define NVS_NAMESPACE               "allowlist"
+#define NVS_KEY_OVERLAY             "overlay"
+
+#define FLASH_SECTOR_SIZE           4096
+// Schreibzugriffe auf verschlüsselte Partitionen brauchen 16-Byte-Vielfache
+#define FLASH_WRITE_ALIGN           16
+
+// Stand der Liste: Basisliste im Flash plus Änderungen aus Deltas im RAM.
+// Wird nach dem Veröffentlichen nicht mehr verändert
+typedef struct {
+    uint32_t version;               // Seriennummer der Basisliste, danach die des letzten Deltas
+    const uint8_t *baseRecords;     // NULL ohne geflashte Liste oder während eines Full-Resyncs
+    uint32_t baseCount;
+    uint32_t baseSerial;
+    uint16_t addCount;              // UIDs, die nicht in der Basisliste stehen
+    uint16_t removeCount;           // UIDs der Basisliste, die nicht mehr gelten
+    uint8_t adds[OVERLAY_MAX * ALLOWLIST_RECORD_SIZE];
+    uint8_t removes[OVERLAY_MAX * ALLOWLIST_RECORD_SIZE];
+} AllowListView;
+
+// Im NVS gespeicherter Overlay-Kopf, danach adds und removes
+typedef struct {
+    uint32_t baseSerial;
+    uint32_t version;
+    uint16_t addCount;
+    uint16_t removeCount;
+} OverlayRecord;
+
+#define OVERLAY_BLOB_SIZE   (sizeof(OverlayRecord) + 2 * OVERLAY_MAX * ALLOWLIST_RECORD_SIZE)
+
+// Aktueller und vorheriger Stand, der vorherige wird erst überschrieben, wenn ihn niemand mehr liest
+static AllowListView views[2];
+static _Atomic uint32_t viewRefs[2];
+static _Atomic uint32_t currentView = 0;
+
+// Nur der schreibende Task (Boot, dann Sync-Job) verändert diese Werte
+static const esp_partition_t *partition = NULL;
+static bool bMapped = false;
+static esp_partition_mmap_handle_t mapHandle;
+static uint8_t overlayBlob[OVERLAY_BLOB_SIZE];
+
+static uint32_t fullSerial = 0;
+static uint32_t fullLength = 0;
+static uint32_t fullNextOffset = 0;
+static bool bFullActive = false;
+static uint8_t fullHeader[sizeof(AllowListHeader)];
+
+static _Atomic uint32_t lastLookupUs = 0;
+static _Atomic uint32_t maxLookupUs = 0;
+
+static inline uint64_t RecordKey(const uint8_t *records, uint32_t index)
+{
+    const uint8_t *r = records + (size_t)index * ALLOWLIST_RECORD_SIZE;
+
+    return ((uint64_t)r[0] << 32) | ((uint64_t)r[1] << 24) | ((uint64_t)r[2] << 16) |
+           ((uint64_t)r[3] << 8) | (uint64_t)r[4];
+}
+
+static inline void RecordPut(uint8_t *records, uint32_t index, uint64_t uid)
+{
+    uint8_t *r = records + (size_t)index * ALLOWLIST_RECORD_SIZE;
+
+    r[0] = (uint8_t)(uid >> 32);
+    r[1] = (uint8_t)(uid >> 24);
+    r[2] = (uint8_t)(uid >> 16);
+    r[3] = (uint8_t)(uid >> 8);
+    r[4] = (uint8_t)uid;
+}
+
+static bool Search(const uint8_t *records, uint32_t count, uint64_t uid)
+{
+    if (records == NULL || count == 0) {
+        return false;
+    }
+
+    uint32_t lo = 0;
+    uint32_t hi = count - 1;
+    // Schlüssel knapp außerhalb von [lo, hi], jeder Vergleich verengt sie ohne zusätzlichen Flash-Zugriff
+    uint64_t lowKey = 0;
+    uint64_t highKey = UID_LIMIT;
+
+    for (int step = 0; lo <= hi; step++) {
+        uint32_t mid;
+
+        if (step < INTERPOLATION_STEPS) {
+            // (uid - lowKey) < 2^40 und (hi - lo + 1) < 2^18 bei voller Partition, das Produkt passt in 64 Bit
+            uint64_t offset = ((uid - lowKey) * (uint64_t)(hi - lo + 1)) / (highKey - lowKey);
+            mid = lo + (offset > hi - lo ? hi - lo : (uint32_t)offset);
+        } else {
+            mid = lo + (hi - lo) / 2;
+        }
+
+        uint64_t key = RecordKey(records, mid);
+        if (key == uid) {
+            return true;
+        }
+        if (key < uid) {
+            lo = mid + 1;
+            lowKey = key;
+        } else {
+            if (mid == 0) {
+                return false;
+            }
+            hi = mid - 1;
+            highKey = key;
+        }
+    }
+    return false;
+}
+
+static const AllowListView *ViewAcquire(void)
+{
+    for (;;) {
+        uint32_t slot = atomic_load(&currentView);
+
+        atomic_fetch_add(&viewRefs[slot], 1);
+        // Nur gültig, wenn der Slot nach dem Zählen noch aktuell ist, sonst wird er evtl. gerade neu beschrieben
+        if (slot == atomic_load(&currentView)) {
+            return &views[slot];
+        }
+        atomic_fetch_sub(&viewRefs[slot], 1);
+    }
+}
+
+static void ViewRelease(const AllowListView *view)
+{
+    atomic_fetch_sub(&viewRefs[view - views], 1);
+}
+
+// Liefert den freien Slot, sobald kein Leser mehr den vorherigen Stand hält. Suchen dauern nur µs
+static AllowListView *ViewReserve(void)
+{
+    uint32_t spare = atomic_load(&currentView) ^ 1;
+
+    while (atomic_load(&viewRefs[spare]) != 0) {
+        vTaskDelay(1);
+    }
+    return &views[spare];
+}
+
+static void ViewPublish(AllowListView *view)
+{
+    atomic_store(&currentView, (uint32_t)(view - views));
+}
+
+static bool InBase(const AllowListView *view, uint64_t uid)
+{
+    return Search(view->baseRecords, view->baseCount, uid);
+}
+
+static bool ViewContains(const AllowListView *view, uint64_t uid)
+{
+    if (Search(view->removes, view->removeCount, uid)) {
+        return false;
+    }
+    return Search(view->adds, view->addCount, uid) || InBase(view, uid);
+}
+
+bool AllowListContains(uint64_t uid)
+{
+    int64_t start = esp_timer_get_time();
+    const AllowListView *view = ViewAcquire();
+    bool found = ViewContains(view, uid);
+    ViewRelease(view);
+    uint32_t took = (uint32_t)(esp_timer_get_time() - start);
+
+    atomic_store(&lastLookupUs, took);
+    if (took > atomic_load(&maxLookupUs)) {
+        atomic_store(&maxLookupUs, took);
+    }
+    return found;
+}
+
+// Misst Treffer gleichmäßig über die Liste und dieselbe Anzahl Fehlgriffe daneben
+static void SelfTest(const uint8_t *records, uint32_t count)
+{
+    uint32_t stride = count > SELFTEST_LOOKUPS ? count / SELFTEST_LOOKUPS : 1;
+    uint32_t hits = 0, lookups = 0;
+    int64_t start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < count && lookups < SELFTEST_LOOKUPS; i += stride, lookups++) {
+        hits += Search(records, count, RecordKey(records, i)) ? 1 : 0;
+        Search(records, count, RecordKey(records, i) + 1);
+    }
+
+    int64_t took = esp_timer_get_time() - start;
+    if (hits != lookups) {
+        ESP_LOGE(TAG, "Self test found %" PRIu32 " of %" PRIu32 " entries, list not sorted?", hits, lookups);
+    }
+    if (lookups > 0) {
+        ESP_LOGI(TAG, "Lookup %" PRId64 " us average over %" PRIu32 " entries", took / (2 * lookups), count);
+    }
+}
+
+// Prüft Header und CRC der geflashten Liste und blendet sie in view ein
+static bool MapBase(AllowListView *view)
+{
+    AllowListHeader header;
+
+    if (esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read header");
+        return false;
+    }
+
+    // Leere (gelöschte) Partition ist kein Fehler, es wurde nur noch keine Liste geflasht
+    if (header.magic != ALLOWLIST_MAGIC) {
+        ESP_LOGI(TAG, "No allow-list flashed");
+        return false;
+    }
+    if (header.formatVersion != ALLOWLIST_FORMAT_VERSION || header.recordSize != ALLOWLIST_RECORD_SIZE ||
+        header.count > (partition->size - sizeof(header)) / ALLOWLIST_RECORD_SIZE) {
+        ESP_LOGE(TAG, "Unsupported allow-list (version %u, record %u, count %" PRIu32 ")",
+                 header.formatVersion, header.recordSize, header.count);
+        return false;
+    }
+
+    const void *mapped;
+    size_t mapLen = sizeof(header) + (size_t)header.count * ALLOWLIST_RECORD_SIZE;
+    esp_err_t err = esp_partition_mmap(partition, 0, mapLen, ESP_PARTITION_MMAP_DATA, &mapped, &mapHandle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map allow-list: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    const uint8_t *data = (const uint8_t *)mapped + sizeof(header);
+    if (esp_rom_crc32_le(0, data, header.count * ALLOWLIST_RECORD_SIZE) != header.crc32) {
+        ESP_LOGE(TAG, "Allow-list CRC mismatch, ignoring it");
+        esp_partition_munmap(mapHandle);
+        return false;
+    }
+
+    bMapped = true;
+    view->baseRecords = data;
+    view->baseCount = header.count;
+    view->baseSerial = header.serial;
+    view->version = header.serial;
+    ESP_LOGI(TAG, "Allow-list %" PRIu32 " with %" PRIu32 " entries", header.serial, header.count);
+
+    SelfTest(data, header.count);
+    return true;
+}
+
+static void OverlayStore(const AllowListView *view)
+{
+    OverlayRecord record = {
+        .baseSerial = view->baseSerial,
+        .version = view->version,
+        .addCount = view->addCount,
+        .removeCount = view->removeCount,
+    };
+    size_t addBytes = (size_t)view->addCount * ALLOWLIST_RECORD_SIZE;
+    size_t removeBytes = (size_t)view->removeCount * ALLOWLIST_RECORD_SIZE;
+    nvs_handle_t handle;
+
+    memcpy(overlayBlob, &record, sizeof(record));
+    memcpy(overlayBlob + sizeof(record), view->adds, addBytes);
+    memcpy(overlayBlob + sizeof(record) + addBytes, view->removes, removeBytes);
+
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, NVS_KEY_OVERLAY, overlayBlob, sizeof(record) + addBytes + removeBytes);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store overlay: %s", esp_err_to_name(err));
+    }
+}
+
+// Übernimmt die gespeicherten Deltas, wenn sie zur geflashten Basisliste gehören
+static void OverlayLoad(AllowListView *view)
+{
+    size_t len = sizeof(overlayBlob);
+    OverlayRecord record;
+    nvs_handle_t handle;
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    bool ok = nvs_get_blob(handle, NVS_KEY_OVERLAY, overlayBlob, &len) == ESP_OK && len >= sizeof(record);
+    nvs_close(handle);
+    if (!ok) {
+        return;
+    }
+
+    memcpy(&record, overlayBlob, sizeof(record));
+    size_t addBytes = (size_t)record.addCount * ALLOWLIST_RECORD_SIZE;
+    size_t removeBytes = (size_t)record.removeCount * ALLOWLIST_RECORD_SIZE;
+
+    if (record.baseSerial != view->baseSerial || record.addCount > OVERLAY_MAX || record.removeCount > OVERLAY_MAX ||
+        len != sizeof(record) + addBytes + removeBytes) {
+        ESP_LOGW(TAG, "Stored overlay does not match the flashed list, dropping it");
+        return;
+    }
+
+    view->version = record.version;
+    view->addCount = record.addCount;
+    view->removeCount = record.removeCount;
+    memcpy(view->adds, overlayBlob + sizeof(record), addBytes);
+    memcpy(view->removes, overlayBlob + sizeof(record) + addBytes, removeBytes);
+    ESP_LOGI(TAG, "Overlay version %" PRIu32 " (+%u -%u) restored", record.version, record.addCount, record.removeCount);
+}
+
+bool AllowListInit(void)
+{
+    if (partition != NULL) {
+        return bMapped;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ALLOWLIST_PARTITION_LABEL);
+    if (partition == NULL) {
+        ESP_LOGW(TAG, "No %s partition", ALLOWLIST_PARTITION_LABEL);
+        return false;
+    }
+
+    // Läuft vor dem Start der Leser, daher direkt im aktuellen Slot.
+    // Ohne geflashte Liste können Deltas trotzdem eine kleine Liste im Overlay aufbauen
+    AllowListView *view = &views[atomic_load(&currentView)];
+    memset(view, 0, sizeof(*view));
+    MapBase(view);
+    OverlayLoad(view);
+    return bMapped;
+}
+
+uint32_t AllowListCount(void)
+{
+    const AllowListView *view = ViewAcquire();
+    uint32_t count = view->baseCount + view->addCount - view->removeCount;
+    ViewRelease(view);
+    return count;
+}
+
+uint32_t AllowListSerial(void)
+{
+    const AllowListView *view = ViewAcquire();
+    uint32_t serial = view->baseSerial;
+    ViewRelease(view);
+    return serial;
+}
+
+uint32_t AllowListVersion(void)
+{
+    const AllowListView *view = ViewAcquire();
+    uint32_t version = view->version;
+    ViewRelease(view);
+    return version;
+}
+
+void AllowListGetOverlay(uint16_t *adds, uint16_t *removes, uint16_t *capacity)
+{
+    const AllowListView *view = ViewAcquire();
+    if (adds != NULL) {
+        *adds = view->addCount;
+    }
+    if (removes != NULL) {
+        *removes = view->removeCount;
+    }
+    if (capacity != NULL) {
+        *capacity = OVERLAY_MAX;
+    }
+    ViewRelease(view);
+}
+
+void AllowListGetLookupStats(uint32_t *lastUs, uint32_t *maxUs)
+{
+    if (lastUs != NULL) {
+        *lastUs = atomic_load(&lastLookupUs);
+    }
+    if (maxUs != NULL) {
+        *maxUs = atomic_load(&maxLookupUs);
+    }
+}
+
+// Streng aufsteigend = sortiert und ohne Duplikate
+static bool IsStrictlyAscending(const uint8_t *records, uint32_t count)
+{
+    for (uint32_t i = 1; i < count; i++) {
+        if (RecordKey(records, i - 1) >= RecordKey(records, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// dst = (list \ drop) ∪ { x ∈ add | InBase(x) == wantInBase }, alle Listen sortiert
+static bool BuildOverlayList(const AllowListView *view, uint8_t *dst, uint16_t *dstCount,
+                             const uint8_t *list, uint32_t listCount,
+                             const uint8_t *drop, uint32_t dropCount,
+                             const uint8_t *add, uint32_t addCount, bool wantInBase)
+{
+    uint32_t i = 0, j = 0, n = 0;
+
+    for (;;) {
+        while (i < listCount && Search(drop, dropCount, RecordKey(list, i))) {
+            i++;
+        }
+        while (j < addCount && InBase(view, RecordKey(add, j)) != wantInBase) {
+            j++;
+        }
+        if (i >= listCount && j >= addCount) {
+            break;
+        }
+
+        uint64_t next;
+        if (j >= addCount || (i < listCount && RecordKey(list, i) <= RecordKey(add, j))) {
+            next = RecordKey(list, i++);
+            if (j < addCount && RecordKey(add, j) == next) {
+                j++;
+            }
+        } else {
+            next = RecordKey(add, j++);
+        }
+
+        if (n >= OVERLAY_MAX) {
+            return false;
+        }
+        RecordPut(dst, n++, next);
+    }
+
+    *dstCount = (uint16_t)n;
+    return true;
+}
+
+AllowListResult AllowListApplyDelta(uint32_t fromVersion, uint32_t toVersion,
+                                    const uint8_t *adds, uint16_t addCount,
+                                    const uint8_t *removes, uint16_t removeCount)
+{
+    const AllowListView *current = &views[atomic_load(&currentView)];
+
+    if (partition == NULL) {
+        return ALLOWLIST_INVALID;
+    }
+    if (bFullActive) {
+        return ALLOWLIST_RESYNC_REQUIRED;
+    }
+    if (fromVersion != current->version || toVersion == fromVersion) {
+        return ALLOWLIST_VERSION_MISMATCH;
+    }
+    if (!IsStrictlyAscending(adds, addCount) || !IsStrictlyAscending(removes, removeCount)) {
+        return ALLOWLIST_INVALID;
+    }
+    for (uint16_t i = 0; i < addCount; i++) {
+        if (Search(removes, removeCount, RecordKey(adds, i))) {
+            return ALLOWLIST_INVALID;
+        }
+    }
+
+    // Schattenkopie bauen, der aktuelle Stand bleibt bis zum Umschalten unberührt
+    AllowListView *next = ViewReserve();
+    next->baseRecords = current->baseRecords;
+    next->baseCount = current->baseCount;
+    next->baseSerial = current->baseSerial;
+    next->version = toVersion;
+
+    if (!BuildOverlayList(current, next->adds, &next->addCount, current->adds, current->addCount,
+                          removes, removeCount, adds, addCount, false) ||
+        !BuildOverlayList(current, next->removes, &next->removeCount, current->removes, current->removeCount,
+                          adds, addCount, removes, removeCount, true)) {
+        ESP_LOGW(TAG, "Overlay full, a full resync is needed");
+        return ALLOWLIST_RESYNC_REQUIRED;
+    }
+
+    ViewPublish(next);
+    OverlayStore(next);
+    ESP_LOGI(TAG, "Version %" PRIu32 " -> %" PRIu32 " (+%u -%u), overlay +%u -%u", fromVersion, toVersion,
+             addCount, removeCount, next->addCount, next->removeCount);
+    return ALLOWLIST_OK;
+}
+
+// Schaltet auf einen leeren Stand mit Version 0 um und gibt die Einblendung frei, sobald niemand mehr sucht.
+// Bricht der Full-Resync ab, passt so kein Delta mehr und die Cloud muss neu anbieten
+static void DetachBase(void)
+{
+    AllowListView *next = ViewReserve();
+
+    memset(next, 0, sizeof(*next));
+    ViewPublish(next);
+
+    // Der alte Stand ist jetzt der freie Slot, erst ohne Leser darf das Flash darunter verschwinden
+    ViewReserve();
+    if (bMapped) {
+        esp_partition_munmap(mapHandle);
+        bMapped = false;
+    }
+}
+
+AllowListResult AllowListFullBegin(uint32_t serial, uint32_t length)
+{
+    if (partition == NULL) {
+        return ALLOWLIST_INVALID;
+    }
+    if (length < sizeof(AllowListHeader) || length > partition->size ||
+        (length - sizeof(AllowListHeader)) % ALLOWLIST_RECORD_SIZE != 0) {
+        ESP_LOGE(TAG, "Full resync with invalid length %" PRIu32, length);
+        return ALLOWLIST_INVALID;
+    }
+
+    // Ab hier entscheidet die Cloud, bis die neue Liste vollständig und geprüft ist
+    DetachBase();
+    esp_err_t err = esp_partition_erase_range(partition, 0, FLASH_SECTOR_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase header: %s", esp_err_to_name(err));
+        return ALLOWLIST_INVALID;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, NVS_KEY_OVERLAY);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    fullSerial = serial;
+    fullLength = length;
+    fullNextOffset = 0;
+    bFullActive = true;
+    ESP_LOGI(TAG, "Full resync to %" PRIu32 " (%" PRIu32 " bytes)", serial, length);
+    return ALLOWLIST_OK;
+}
+
+bool AllowListFullActive(void)
+{
+    return bFullActive;
+}
+
+uint32_t AllowListFullNextOffset(void)
+{
+    return fullNextOffset;
+}
+
+uint32_t AllowListFullSerial(void)
+{
+    return fullSerial;
+}
+
+// Schreibt data an offset, für verschlüsselte Partitionen mit 0xFF auf 16 Byte aufgefüllt
+static esp_err_t WriteAligned(uint32_t offset, uint8_t *data, size_t len, size_t capacity)
+{
+    size_t padded = (len + FLASH_WRITE_ALIGN - 1) & ~(size_t)(FLASH_WRITE_ALIGN - 1);
+
+    if (padded > capacity) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(data + len, 0xFF, padded - len);
+    return esp_partition_write(partition, offset, data, padded);
+}
+
+AllowListResult AllowListFullWrite(uint32_t serial, uint32_t offset, uint8_t *data, size_t len, size_t capacity)
+{
+    if (!bFullActive || serial != fullSerial) {
+        return ALLOWLIST_VERSION_MISMATCH;
+    }
+    if (offset != fullNextOffset || offset % FLASH_SECTOR_SIZE != 0 || len == 0 || len > fullLength - offset ||
+        (offset == 0 && len < sizeof(fullHeader))) {
+        return ALLOWLIST_INVALID;
+    }
+
+    // Sektor 0 wurde schon beim Begin gelöscht
+    uint32_t eraseStart = offset == 0 ? FLASH_SECTOR_SIZE : offset;
+    uint32_t eraseEnd = (offset + len + FLASH_SECTOR_SIZE - 1) & ~(uint32_t)(FLASH_SECTOR_SIZE - 1);
+    esp_err_t err = ESP_OK;
+
+    if (eraseEnd > eraseStart) {
+        err = esp_partition_erase_range(partition, eraseStart, eraseEnd - eraseStart);
+    }
+
+    if (err == ESP_OK && offset == 0) {
+        // Der Header wird erst geschrieben, wenn alles andere im Flash steht
+        memcpy(fullHeader, data, sizeof(fullHeader));
+        if (len > sizeof(fullHeader)) {
+            err = WriteAligned(sizeof(fullHeader), data + sizeof(fullHeader), len - sizeof(fullHeader),
+                               capacity - sizeof(fullHeader));
+        }
+    } else if (err == ESP_OK) {
+        err = WriteAligned(offset, data, len, capacity);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write block at %" PRIu32 ": %s", offset, esp_err_to_name(err));
+        return ALLOWLIST_INVALID;
+    }
+
+    fullNextOffset = offset + len;
+    if (fullNextOffset < fullLength) {
+        return ALLOWLIST_PENDING;
+    }
+
+    // Letzter Block: Header schreiben, neu einblenden und per CRC prüfen
+    bFullActive = false;
+    AllowListHeader header;
+    memcpy(&header, fullHeader, sizeof(header));
+    if (header.serial != fullSerial) {
+        ESP_LOGE(TAG, "Image serial %" PRIu32 " does not match %" PRIu32, header.serial, fullSerial);
+        return ALLOWLIST_INVALID;
+    }
+    if (esp_partition_write(partition, 0, fullHeader, sizeof(fullHeader)) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write header");
+        return ALLOWLIST_INVALID;
+    }
+
+    AllowListView *next = ViewReserve();
+    memset(next, 0, sizeof(*next));
+    if (!MapBase(next)) {
+        return ALLOWLIST_INVALID;
+    }
+    ViewPublish(next);
+    return ALLOWLIST_OK;
+}
@@ -0,0 +1,78 @@
+/*
+ * AllowList.h
+ *
+ *  Lokale Zugangsliste in der Datenpartition "allowlist". Die Einträge sind
+ *  sortierte 5-Byte-UIDs (big endian, gleiche Reihenfolge wie der Hex-String
+ *  aus convert_uid_to_string()) und werden direkt im per esp_partition_mmap
+ *  eingeblendeten Flash gesucht, ohne sie ins RAM zu kopieren.
+ *
+ *  Änderungen kommen als Deltas (siehe AllowListSync.h) und landen in einem
+ *  kleinen Overlay im RAM, das im NVS gesichert wird. Jedes Delta wird auf
+ *  einer Schattenkopie angewendet und erst vollständig umgeschaltet, Leser
+ *  sehen also nie einen halben Stand. Läuft das Overlay voll, wird die ganze
+ *  Liste blockweise neu in die Partition geschrieben.
+ *
+ *  Das Image erzeugt main/tools/gen_allowlist.py.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAIN_ALLOWLIST_H_
+#define MAIN_ALLOWLIST_H_
+
+#define ALLOWLIST_PARTITION_LABEL   "allowlist"
+#define ALLOWLIST_RECORD_SIZE       5
+
+typedef enum {
+    ALLOWLIST_OK = 0,
+    ALLOWLIST_PENDING,              // Full-Resync: Block geschrieben, weitere folgen
+    ALLOWLIST_VERSION_MISMATCH,     // Delta passt nicht zur aktuellen Version
+    ALLOWLIST_RESYNC_REQUIRED,      // Overlay voll oder Full-Resync läuft
+    ALLOWLIST_INVALID,              // Daten fehlerhaft, nichts geändert
+} AllowListResult;
+
+// Prüft Header und CRC, blendet die Liste ein und lädt das Overlay, einmal beim Start aufrufen
+//@return false wenn keine gültige Liste geflasht ist, Zugriffe laufen dann über Overlay und Cloud
+bool AllowListInit(void);
+
+// Sucht die 40-Bit-UID, blockiert nie und braucht keinen Lock
+bool AllowListContains(uint64_t uid);
+
+// Anzahl gültiger Einträge inklusive Overlay
+uint32_t AllowListCount(void);
+
+// Seriennummer der geflashten Liste, vom Tool vergeben
+uint32_t AllowListSerial(void);
+
+// Version inklusive aller angewendeten Deltas, wird der Cloud gemeldet
+uint32_t AllowListVersion(void);
+
+// Belegung des Overlays
+void AllowListGetOverlay(uint16_t *adds, uint16_t *removes, uint16_t *capacity);
+
+// Dauer der letzten Suche und das Maximum seit dem Start
+void AllowListGetLookupStats(uint32_t *lastUs, uint32_t *maxUs);
+
+// Die folgenden Funktionen verändern die Liste und dürfen nur aus einem Task aufgerufen werden
+
+// Wendet ein Delta an, adds und removes jeweils streng aufsteigend sortiert
+AllowListResult AllowListApplyDelta(uint32_t fromVersion, uint32_t toVersion,
+                                    const uint8_t *adds, uint16_t addCount,
+                                    const uint8_t *removes, uint16_t removeCount);
+
+// Startet den Full-Resync: die alte Liste wird verworfen, bis zum Abschluss entscheidet nur die Cloud
+AllowListResult AllowListFullBegin(uint32_t serial, uint32_t length);
+
+// Schreibt den nächsten Block des Images, offset ist ein Vielfaches von 4096.
+// data muss bis capacity beschreibbar sein (Auffüllen für verschlüsselte Partitionen)
+//@return ALLOWLIST_PENDING solange Blöcke fehlen, ALLOWLIST_OK wenn die neue Liste aktiv ist
+AllowListResult AllowListFullWrite(uint32_t serial, uint32_t offset, uint8_t *data, size_t len, size_t capacity);
+
+bool AllowListFullActive(void);
+
+uint32_t AllowListFullNextOffset(void);
+
+uint32_t AllowListFullSerial(void);
+
+#endif /* MAIN_ALLOWLIST_H_ */
@@ -0,0 +1,282 @@
+/*
+ * AllowListSync.c
+ *
+ *  Delta- und Full-Sync der Zugangsliste, siehe AllowListSync.h
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "AllowListSync.h"
+#include "AllowList.h"
+#include "Scheduler.h"
+#include "core_mqtt_agent_manager.h"
+#include "core_mqtt_agent_manager_events.h"
+#include "networking/wifi/lan.h"
+#include "demo_tasks/sub_pub_unsub_demo/sub_pub_unsub_demo.h"
+
+static const char* TAG = "AllowListSync";
+
+#define MAGIC_DELTA         0x54444C41u     // "ALDT"
+#define MAGIC_FULL_OFFER    0x4F464C41u     // "ALFO"
+#define MAGIC_FULL_BLOCK    0x4B424C41u     // "ALBK"
+
+#define DELTA_HEADER_SIZE   16
+#define OFFER_SIZE          12
+#define BLOCK_HEADER_SIZE   12
+
+// Ein Flash-Sektor pro Block, passt mit Header in den MQTT-Netzwerkpuffer
+#define FULL_BLOCK_SIZE     4096
+#define MAX_MESSAGE_SIZE    (BLOCK_HEADER_SIZE + FULL_BLOCK_SIZE)
+
+// Ohne Antwort wird der Block nach dieser Zeit erneut angefordert
+#define FULL_RETRY_MS       15000
+
+static char syncTopic[100];
+static bool bSubscribed = false;
+
+// Empfangspuffer, der Callback füllt ihn nur, wenn der Apply-Job ihn freigegeben hat.
+// Reserve am Ende für das Auffüllen beim Schreiben in die verschlüsselte Partition
+static uint8_t rxBuffer[MAX_MESSAGE_SIZE + 16];
+static size_t rxLength = 0;
+static atomic_bool rxBusy = false;
+static _Atomic uint32_t rxDropped = 0;
+
+static SchedulerJob *statusJob = NULL;
+static SchedulerJob *applyJob = NULL;
+
+// Messwerte der letzten Operation (ein Delta oder ein kompletter Full-Resync)
+static const char *lastResult = "hello";
+static uint32_t opBytes = 0;
+static uint32_t lastOpBytes = 0;
+static uint32_t lastApplyUs = 0;
+static uint32_t maxApplyUs = 0;
+static int64_t fullStartUs = 0;
+static int64_t lastBlockRequestUs = 0;
+
+static uint32_t ReadU32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t ReadU16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static const char *ResultName(AllowListResult result)
+{
+    switch (result) {
+        case ALLOWLIST_OK:                  return "ok";
+        case ALLOWLIST_PENDING:             return "pending";
+        case ALLOWLIST_VERSION_MISMATCH:    return "mismatch";
+        case ALLOWLIST_RESYNC_REQUIRED:     return "resync";
+        default:                            return "invalid";
+    }
+}
+
+static void PublishStatus(void)
+{
+    char topic[100];
+    char payload[384];
+    uint16_t adds, removes, capacity;
+
+    AllowListGetOverlay(&adds, &removes, &capacity);
+    snprintf(topic, sizeof(topic), "device/allowlist/%s/status", LanPrintMac());
+    snprintf(payload, sizeof(payload),
+             "{\"macAddrHex\":\"%s\",\"version\":%" PRIu32 ",\"baseSerial\":%" PRIu32 ",\"entries\":%" PRIu32
+             ",\"overlayAdds\":%u,\"overlayRemoves\":%u,\"overlayCapacity\":%u,\"result\":\"%s\""
+             ",\"rxBytes\":%" PRIu32 ",\"applyUs\":%" PRIu32 ",\"maxApplyUs\":%" PRIu32 ",\"dropped\":%" PRIu32 "}",
+             LanPrintMac(), AllowListVersion(), AllowListSerial(), AllowListCount(),
+             adds, removes, capacity, lastResult,
+             lastOpBytes, lastApplyUs, maxApplyUs, atomic_load(&rxDropped));
+
+    prvPublishToAWS(topic, payload);
+}
+
+static void RequestBlock(void)
+{
+    char topic[100];
+    char payload[160];
+
+    snprintf(topic, sizeof(topic), "device/allowlist/%s/full/get", LanPrintMac());
+    snprintf(payload, sizeof(payload), "{\"macAddrHex\":\"%s\",\"serial\":%" PRIu32 ",\"offset\":%" PRIu32 ",\"length\":%d}",
+             LanPrintMac(), AllowListFullSerial(), AllowListFullNextOffset(), FULL_BLOCK_SIZE);
+
+    lastBlockRequestUs = esp_timer_get_time();
+    prvPublishToAWS(topic, payload);
+}
+
+static void FinishOperation(const char *result, uint32_t tookUs)
+{
+    lastResult = result;
+    lastOpBytes = opBytes;
+    lastApplyUs = tookUs;
+    if (tookUs > maxApplyUs) {
+        maxApplyUs = tookUs;
+    }
+    opBytes = 0;
+    PublishStatus();
+}
+
+static void HandleDelta(const uint8_t *msg, size_t len)
+{
+    if (len < DELTA_HEADER_SIZE) {
+        FinishOperation("invalid", 0);
+        return;
+    }
+
+    uint32_t fromVersion = ReadU32(msg + 4);
+    uint32_t toVersion = ReadU32(msg + 8);
+    uint16_t addCount = ReadU16(msg + 12);
+    uint16_t removeCount = ReadU16(msg + 14);
+    const uint8_t *adds = msg + DELTA_HEADER_SIZE;
+    const uint8_t *removes = adds + (size_t)addCount * ALLOWLIST_RECORD_SIZE;
+
+    if (len != DELTA_HEADER_SIZE + ((size_t)addCount + removeCount) * ALLOWLIST_RECORD_SIZE) {
+        FinishOperation("invalid", 0);
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    AllowListResult result = AllowListApplyDelta(fromVersion, toVersion, adds, addCount, removes, removeCount);
+    FinishOperation(ResultName(result), (uint32_t)(esp_timer_get_time() - start));
+}
+
+static void HandleFullOffer(const uint8_t *msg, size_t len)
+{
+    if (len != OFFER_SIZE) {
+        FinishOperation("invalid", 0);
+        return;
+    }
+
+    AllowListResult result = AllowListFullBegin(ReadU32(msg + 4), ReadU32(msg + 8));
+    if (result != ALLOWLIST_OK) {
+        FinishOperation(ResultName(result), 0);
+        return;
+    }
+    fullStartUs = esp_timer_get_time();
+    RequestBlock();
+}
+
+static void HandleFullBlock(uint8_t *msg, size_t len)
+{
+    if (len <= BLOCK_HEADER_SIZE) {
+        FinishOperation("invalid", 0);
+        return;
+    }
+
+    AllowListResult result = AllowListFullWrite(ReadU32(msg + 4), ReadU32(msg + 8), msg + BLOCK_HEADER_SIZE,
+                                                len - BLOCK_HEADER_SIZE,
+                                                sizeof(rxBuffer) - BLOCK_HEADER_SIZE);
+    if (result == ALLOWLIST_PENDING) {
+        RequestBlock();
+        return;
+    }
+
+    // Fertig oder abgebrochen, Dauer über den ganzen Download inklusive Flash-Schreiben
+    FinishOperation(result == ALLOWLIST_OK ? "full" : ResultName(result),
+                    (uint32_t)(esp_timer_get_time() - fullStartUs));
+}
+
+// Läuft auf dem Scheduler, angestoßen vom Incoming-Publish Callback
+static void AllowListApplyJob(void *arg)
+{
+    if (!atomic_load(&rxBusy)) {
+        return;
+    }
+
+    if (rxLength < 4) {
+        FinishOperation("invalid", 0);
+    } else {
+        switch (ReadU32(rxBuffer)) {
+            case MAGIC_DELTA:
+                HandleDelta(rxBuffer, rxLength);
+                break;
+            case MAGIC_FULL_OFFER:
+                HandleFullOffer(rxBuffer, rxLength);
+                break;
+            case MAGIC_FULL_BLOCK:
+                HandleFullBlock(rxBuffer, rxLength);
+                break;
+            default:
+                ESP_LOGW(TAG, "Unknown message %08" PRIx32, ReadU32(rxBuffer));
+                FinishOperation("invalid", 0);
+                break;
+        }
+    }
+
+    atomic_store(&rxBusy, false);
+}
+
+// Läuft im coreMQTT-Agent Task, kopiert nur und gibt an den Scheduler ab
+static void AllowListIncomingPublish(void *pvContext, MQTTPublishInfo_t *pxPublishInfo)
+{
+    if (pxPublishInfo->payloadLength > MAX_MESSAGE_SIZE || atomic_exchange(&rxBusy, true)) {
+        atomic_fetch_add(&rxDropped, 1);
+        return;
+    }
+
+    memcpy(rxBuffer, pxPublishInfo->pPayload, pxPublishInfo->payloadLength);
+    rxLength = pxPublishInfo->payloadLength;
+    opBytes += rxLength;
+    SchedulerTrigger(applyJob);
+}
+
+// Nach jedem Connect: einmal abonnieren, dann Stand melden bzw. einen unterbrochenen Download fortsetzen
+static void AllowListStatusJob(void *arg)
+{
+    if (!bSubscribed) {
+        snprintf(syncTopic, sizeof(syncTopic), "device/allowlist/%s/sync", LanPrintMac());
+        // Wartet begrenzt auf das SUBACK, bei Fehler versucht es der Retry-Job wieder
+        if (!prvSubscribeRawToAWS(syncTopic, AllowListIncomingPublish, NULL)) {
+            return;
+        }
+        bSubscribed = true;
+    }
+
+    if (AllowListFullActive()) {
+        RequestBlock();
+    } else {
+        PublishStatus();
+    }
+}
+
+// Fordert einen ausgebliebenen Block erneut an
+static void AllowListRetryJob(void *arg)
+{
+    if (!bSubscribed) {
+        SchedulerTrigger(statusJob);
+        return;
+    }
+
+    if (AllowListFullActive() && !atomic_load(&rxBusy) &&
+        esp_timer_get_time() - lastBlockRequestUs > (int64_t)FULL_RETRY_MS * 1000) {
+        ESP_LOGW(TAG, "No block for %d ms, requesting again", FULL_RETRY_MS);
+        RequestBlock();
+    }
+}
+
+static void AllowListSyncEventHandler(void *pvHandlerArg, esp_event_base_t xEventBase,
+                                      int32_t lEventId, void *pvEventData)
+{
+    if (lEventId == CORE_MQTT_AGENT_CONNECTED_EVENT) {
+        SchedulerTrigger(statusJob);
+    }
+}
+
+void StartAllowListSync(void)
+{
+    if (statusJob != NULL) {
+        return;
+    }
+
+    applyJob = SchedulerAddJob("allowListApply", AllowListApplyJob, NULL);
+    statusJob = SchedulerAddJob("allowListStatus", AllowListStatusJob, NULL);
+    SchedulerAddInterval("allowListRetry", FULL_RETRY_MS, FULL_RETRY_MS, AllowListRetryJob, NULL);
+    xCoreMqttAgentManagerRegisterHandler(AllowListSyncEventHandler);
+}
@@ -0,0 +1,33 @@
+/*
+ * AllowListSync.h
+ *
+ *  Abgleich der lokalen Zugangsliste mit der Cloud über MQTT.
+ *
+ *  Gerät -> Cloud (JSON):
+ *    device/allowlist/<mac>/status    Version, Overlay-Belegung, Ergebnis der
+ *                                     letzten Nachricht, übertragene Bytes und
+ *                                     Dauer. Wird nach dem Connect und nach jeder
+ *                                     Nachricht gesendet und dient als Anfrage
+ *                                     für das nächste Delta.
+ *    device/allowlist/<mac>/full/get  {"serial","offset","length"} fordert beim
+ *                                     Full-Resync den nächsten Block an.
+ *
+ *  Cloud -> Gerät (binär, little endian) auf device/allowlist/<mac>/sync:
+ *    "ALDT" u32 fromVersion, u32 toVersion, u16 adds, u16 removes, dann die
+ *           UIDs (je 5 Byte, big endian, streng aufsteigend), erst adds, dann removes
+ *    "ALFO" u32 serial, u32 length       bietet ein neues Image von gen_allowlist.py an
+ *    "ALBK" u32 serial, u32 offset, data ein Block des Images, offset Vielfaches von 4096
+ *
+ *  Es ist immer nur eine Nachricht unterwegs: die Cloud sendet die nächste erst
+ *  nach dem Status bzw. der Blockanfrage des Geräts.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef MAIN_ALLOWLISTSYNC_H_
+#define MAIN_ALLOWLISTSYNC_H_
+
+// Registriert den Handler für Connect-Events und legt die Jobs an, vor dem Start des MQTT-Managers aufrufen
+void StartAllowListSync(void);
+
+#endif /* MAIN_ALLOWLISTSYNC_H_ */
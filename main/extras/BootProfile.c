@@ -0,0 +1,122 @@
+/*
+ * BootProfile.c
+ *
+ *  Misst die Startphasen, siehe BootProfile.h
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "BootProfile.h"
+#include "Scheduler.h"
+#include "Timestamp.h"
+#include "networking/wifi/lan.h"
+#include "demo_tasks/sub_pub_unsub_demo/sub_pub_unsub_demo.h"
+
+static const char* TAG = "BootProfile";
+
+#define STAGE_NOT_REACHED       UINT32_MAX
+
+// Prüfabstand des Report-Jobs
+#define REPORT_CHECK_MS         2000
+// Spätestens so lange nach dem Connect wird gesendet, auch wenn noch Phasen fehlen
+#define REPORT_MAX_WAIT_MS      30000
+
+static const char* const stageNames[BOOT_STAGE_COUNT] = {
+    [BOOT_STAGE_APP_MAIN]           = "appMain",
+    [BOOT_STAGE_LED_STARTED]        = "ledStarted",
+    [BOOT_STAGE_NVS_READY]          = "nvsReady",
+    [BOOT_STAGE_SETTINGS_CACHED]    = "settingsCached",
+    [BOOT_STAGE_CREDENTIALS_LOADED] = "credentialsLoaded",
+    [BOOT_STAGE_ETH_STARTED]        = "ethStarted",
+    [BOOT_STAGE_NETWORK_UP]         = "networkUp",
+    [BOOT_STAGE_MQTT_CONNECTED]     = "mqttConnected",
+    [BOOT_STAGE_NFC_READY]          = "nfcReady",
+    [BOOT_STAGE_SETTINGS_APPLIED]   = "settingsApplied",
+    [BOOT_STAGE_FIRST_SCAN]         = "firstScan",
+};
+
+static _Atomic uint32_t stageMs[BOOT_STAGE_COUNT] = { [0 ... BOOT_STAGE_COUNT - 1] = STAGE_NOT_REACHED };
+
+static SchedulerJob *reportJob = NULL;
+
+void BootProfileMark(BootStage stage)
+{
+    if (stage >= BOOT_STAGE_COUNT) {
+        return;
+    }
+
+    uint32_t expected = STAGE_NOT_REACHED;
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+
+    if (atomic_compare_exchange_strong(&stageMs[stage], &expected, now)) {
+        ESP_LOGI(TAG, "%s after %" PRIu32 " ms", stageNames[stage], now);
+    }
+}
+
+int32_t BootProfileGetMs(BootStage stage)
+{
+    if (stage >= BOOT_STAGE_COUNT) {
+        return -1;
+    }
+
+    uint32_t ms = atomic_load(&stageMs[stage]);
+    return ms == STAGE_NOT_REACHED ? -1 : (int32_t)ms;
+}
+
+// Ein Datensatz mit allen Phasen, fehlende Phasen als null
+static bool PublishReport(void)
+{
+    char topic[100];
+    char payload[512];
+    int len;
+
+    snprintf(topic, sizeof(topic), "device/boot/%s", LanPrintMac());
+    len = snprintf(payload, sizeof(payload), "{\"macAddrHex\":\"%s\",\"boot\":%" PRIu32 ",\"resetReason\":%d,\"stagesMs\":{",
+                   LanPrintMac(), TimestampBootCount(), (int)esp_reset_reason());
+
+    for (int i = 0; i < BOOT_STAGE_COUNT && len < (int)sizeof(payload); i++) {
+        int32_t ms = BootProfileGetMs((BootStage)i);
+
+        if (ms < 0) {
+            len += snprintf(payload + len, sizeof(payload) - len, "%s\"%s\":null", i ? "," : "", stageNames[i]);
+        } else {
+            len += snprintf(payload + len, sizeof(payload) - len, "%s\"%s\":%" PRId32, i ? "," : "", stageNames[i], ms);
+        }
+    }
+    if (len < (int)sizeof(payload)) {
+        snprintf(payload + len, sizeof(payload) - len, "}}");
+    }
+
+    return prvPublishToAWS(topic, payload);
+}
+
+// Wartet nach dem Connect auf Settings oder den Timeout, sendet einmal und entfernt sich dann
+static void BootProfileReportJob(void *arg)
+{
+    int32_t connectedMs = BootProfileGetMs(BOOT_STAGE_MQTT_CONNECTED);
+
+    if (connectedMs < 0) {
+        return;
+    }
+    if (BootProfileGetMs(BOOT_STAGE_SETTINGS_APPLIED) < 0 &&
+        esp_timer_get_time() / 1000 - connectedMs < REPORT_MAX_WAIT_MS) {
+        return;
+    }
+
+    if (PublishReport()) {
+        SchedulerCancel(reportJob);
+    }
+}
+
+void StartBootProfileReport(void)
+{
+    if (reportJob != NULL) {
+        return;
+    }
+    reportJob = SchedulerAddInterval("bootReport", REPORT_CHECK_MS, REPORT_CHECK_MS, BootProfileReportJob, NULL);
+}
@@ -0,0 +1,38 @@
+/*
+ * BootProfile.h
+ *
+ *  Zeitstempel der Startphasen seit Power-On. Nach dem Connect wird
+ *  einmalig ein gemeinsamer Datensatz an device/boot/<mac> gesendet.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef MAIN_BOOTPROFILE_H_
+#define MAIN_BOOTPROFILE_H_
+
+typedef enum {
+    BOOT_STAGE_APP_MAIN = 0,
+    BOOT_STAGE_LED_STARTED,
+    BOOT_STAGE_NVS_READY,
+    BOOT_STAGE_SETTINGS_CACHED,
+    BOOT_STAGE_CREDENTIALS_LOADED,
+    BOOT_STAGE_ETH_STARTED,
+    BOOT_STAGE_NETWORK_UP,
+    BOOT_STAGE_MQTT_CONNECTED,
+    BOOT_STAGE_NFC_READY,
+    BOOT_STAGE_SETTINGS_APPLIED,
+    BOOT_STAGE_FIRST_SCAN,
+    BOOT_STAGE_COUNT
+} BootStage;
+
+// Merkt sich den ersten Zeitpunkt der Phase, spätere Aufrufe werden ignoriert
+// Darf aus jedem Task und aus Event-Handlern aufgerufen werden
+void BootProfileMark(BootStage stage);
+
+// Millisekunden seit Power-On, -1 wenn die Phase noch nicht erreicht wurde
+int32_t BootProfileGetMs(BootStage stage);
+
+// Legt den Job an, der den Datensatz nach dem Connect einmal sendet
+void StartBootProfileReport(void);
+
+#endif /* MAIN_BOOTPROFILE_H_ */
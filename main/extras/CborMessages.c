@@ -0,0 +1,287 @@
+/*
+ * CborMessages.c
+ *
+ *  CBOR für Zugangs- und Settings-Nachrichten, siehe CborMessages.h
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "cbor.h"
+
+#include "CborMessages.h"
+#include "networking/wifi/lan.h"
+
+static const char* TAG = "CBOR";
+
+// Schlüssel der Zugangsnachrichten, müssen zu main/tools/wire_format.py und zur Cloud passen
+enum {
+    ACCESS_KEY_MAC = 1,
+    ACCESS_KEY_UID,
+    ACCESS_KEY_READER,
+    ACCESS_KEY_BOOT,
+    ACCESS_KEY_MONO_US,
+    ACCESS_KEY_TS,
+    ACCESS_KEY_LOCAL,
+    ACCESS_KEY_REQUEST,
+    ACCESS_KEY_COUNT = ACCESS_KEY_REQUEST,
+};
+
+// Antwort der Cloud: {1: true, 2: req}
+#define ACCESS_KEY_GRANTED      1
+#define ACCESS_KEY_RESPONSE_REQ 2
+
+#define MAC_BYTES               6
+#define UID_BYTES               5
+#define SETTINGS_KEY_MAX_LEN    24
+
+typedef enum {
+    FIELD_BOOL,
+    FIELD_INT,
+    FIELD_STRING,
+    FIELD_WIRE_FORMAT,
+} SettingsFieldType;
+
+typedef struct {
+    const char *key;
+    SettingsFieldType type;
+    size_t offset;
+    size_t size;
+} SettingsField;
+
+#define FIELD(name, type) { #name, type, offsetof(LudoSettings, name), sizeof(((LudoSettings *)0)->name) }
+
+// Gleiche Schlüssel wie in JsonParseSettings()
+static const SettingsField settingsFields[] = {
+    FIELD(useWifi, FIELD_BOOL),
+    FIELD(useNfcReader, FIELD_BOOL),
+    FIELD(useBuzzer, FIELD_BOOL),
+    FIELD(beepOnScan, FIELD_INT),
+    FIELD(beepOnValidScan, FIELD_INT),
+    FIELD(beepOnInvalidScan, FIELD_INT),
+    FIELD(patternOnScan, FIELD_STRING),
+    FIELD(patternOnValidScan, FIELD_STRING),
+    FIELD(patternOnInvalidScan, FIELD_STRING),
+    FIELD(useRgbLed, FIELD_BOOL),
+    FIELD(colorOnScan, FIELD_STRING),
+    FIELD(colorOnValidScan, FIELD_STRING),
+    FIELD(colorOnInvalidScan, FIELD_STRING),
+    FIELD(nfcPollMaxIdleMs, FIELD_INT),
+    FIELD(nfcBusinessStart, FIELD_INT),
+    FIELD(nfcBusinessEnd, FIELD_INT),
+    { "wireFormat", FIELD_WIRE_FORMAT, offsetof(LudoSettings, wireCbor), sizeof(bool) },
+};
+
+bool CborIsMessage(const void *payload, size_t len)
+{
+#if CONFIG_CBOR_MESSAGES
+    // Major Type 5 (Map), JSON beginnt mit '{' oder Leerzeichen
+    return len > 0 && (((const uint8_t *)payload)[0] & 0xE0) == 0xA0;
+#else
+    return false;
+#endif
+}
+
+// MAC kommt als Hex-String aus lan.c, für CBOR wieder als Bytes
+static void MacBytes(uint8_t mac[MAC_BYTES])
+{
+    const char *hex = LanPrintMac();
+    char byte[3] = { 0 };
+
+    for (int i = 0; i < MAC_BYTES; i++) {
+        memcpy(byte, hex + 2 * i, 2);
+        mac[i] = (uint8_t)strtoul(byte, NULL, 16);
+    }
+}
+
+size_t CborAccessRequest(uint8_t *buf, size_t size, uint64_t uid, uint8_t readerId,
+                         const Timestamp *scanned, bool localGrant, uint32_t requestId)
+{
+    CborEncoder encoder, map;
+    uint8_t mac[MAC_BYTES];
+    uint8_t uidBytes[UID_BYTES];
+    CborError err = CborNoError;
+
+    MacBytes(mac);
+    for (int i = 0; i < UID_BYTES; i++) {
+        uidBytes[i] = (uint8_t)(uid >> (8 * (UID_BYTES - 1 - i)));
+    }
+
+    cbor_encoder_init(&encoder, buf, size, 0);
+    err |= cbor_encoder_create_map(&encoder, &map, ACCESS_KEY_COUNT);
+    err |= cbor_encode_uint(&map, ACCESS_KEY_MAC);
+    err |= cbor_encode_byte_string(&map, mac, sizeof(mac));
+    err |= cbor_encode_uint(&map, ACCESS_KEY_UID);
+    err |= cbor_encode_byte_string(&map, uidBytes, sizeof(uidBytes));
+    err |= cbor_encode_uint(&map, ACCESS_KEY_READER);
+    err |= cbor_encode_uint(&map, readerId);
+    err |= cbor_encode_uint(&map, ACCESS_KEY_BOOT);
+    err |= cbor_encode_uint(&map, scanned->boot);
+    err |= cbor_encode_uint(&map, ACCESS_KEY_MONO_US);
+    err |= cbor_encode_int(&map, scanned->monoUs);
+    err |= cbor_encode_uint(&map, ACCESS_KEY_TS);
+    err |= cbor_encode_int(&map, TimestampToUtcUs(scanned->monoUs) / 1000);
+    err |= cbor_encode_uint(&map, ACCESS_KEY_LOCAL);
+    err |= cbor_encode_boolean(&map, localGrant);
+    err |= cbor_encode_uint(&map, ACCESS_KEY_REQUEST);
+    err |= cbor_encode_uint(&map, requestId);
+    err |= cbor_encoder_close_container(&encoder, &map);
+
+    if (err != CborNoError) {
+        ESP_LOGE(TAG, "Access request does not fit in %u bytes", (unsigned)size);
+        return 0;
+    }
+    return cbor_encoder_get_buffer_size(&encoder, buf);
+}
+
+// Öffnet die Map auf oberster Ebene
+static bool EnterMap(const void *payload, size_t len, CborParser *parser, CborValue *map)
+{
+    CborValue root;
+
+    if (cbor_parser_init(payload, len, 0, parser, &root) != CborNoError || !cbor_value_is_map(&root) ||
+        cbor_value_enter_container(&root, map) != CborNoError) {
+        ESP_LOGE(TAG, "Ungültiges CBOR");
+        return false;
+    }
+    return true;
+}
+
+bool CborParseAccess(const void *payload, size_t len, bool *access, uint32_t *requestId)
+{
+    CborParser parser;
+    CborValue it;
+    bool found = false;
+
+    *requestId = 0;
+    if (!EnterMap(payload, len, &parser, &it)) {
+        return false;
+    }
+
+    while (!cbor_value_at_end(&it)) {
+        uint64_t key = 0;
+        bool isAccess = false, isRequest = false;
+
+        if (cbor_value_is_unsigned_integer(&it)) {
+            cbor_value_get_uint64(&it, &key);
+            isAccess = key == ACCESS_KEY_GRANTED;
+            isRequest = key == ACCESS_KEY_RESPONSE_REQ;
+        } else if (cbor_value_is_text_string(&it)) {
+            cbor_value_text_string_equals(&it, "access", &isAccess);
+            cbor_value_text_string_equals(&it, "req", &isRequest);
+        }
+        if (cbor_value_advance(&it) != CborNoError || cbor_value_at_end(&it)) {
+            return false;
+        }
+
+        if (isAccess && cbor_value_is_boolean(&it)) {
+            cbor_value_get_boolean(&it, access);
+            found = true;
+        } else if (isRequest && cbor_value_is_unsigned_integer(&it)) {
+            cbor_value_get_uint64(&it, &key);
+            *requestId = (uint32_t)key;
+        }
+        if (cbor_value_advance(&it) != CborNoError) {
+            return false;
+        }
+    }
+
+    if (found) {
+        ESP_LOGI(TAG, "access: %s", *access ? "true" : "false");
+    }
+    return found;
+}
+
+// Liest einen Wert in das Feld, Zahlen und bool dürfen wie im JSON auch als String kommen
+static void ReadSettingsField(const CborValue *value, const SettingsField *field, LudoSettings *settings)
+{
+    uint8_t *out = (uint8_t *)settings + field->offset;
+    char text[SETTINGS_KEY_MAX_LEN];
+    size_t textLen = sizeof(text);
+    CborError err = CborNoError;
+
+    if (cbor_value_is_null(value)) {
+        return;
+    }
+
+    switch (field->type) {
+    case FIELD_BOOL:
+        if (cbor_value_is_boolean(value)) {
+            err = cbor_value_get_boolean(value, (bool *)out);
+        } else if (cbor_value_is_text_string(value)) {
+            err = cbor_value_text_string_equals(value, "true", (bool *)out);
+        }
+        break;
+
+    case FIELD_INT:
+        if (cbor_value_is_integer(value)) {
+            err = cbor_value_get_int_checked(value, (int *)out);
+        } else if (cbor_value_is_text_string(value) &&
+                   (err = cbor_value_copy_text_string(value, text, &textLen, NULL)) == CborNoError) {
+            *(int *)out = atoi(text);
+        }
+        break;
+
+    case FIELD_STRING:
+        if (cbor_value_is_text_string(value)) {
+            textLen = field->size;
+            err = cbor_value_copy_text_string(value, (char *)out, &textLen, NULL);
+            if (err != CborNoError) {
+                out[0] = '\0';
+            }
+        }
+        break;
+
+    case FIELD_WIRE_FORMAT:
+        if (cbor_value_is_text_string(value)) {
+            bool cbor = false;
+            err = cbor_value_text_string_equals(value, "cbor", &cbor);
+            *(bool *)out = cbor;
+        }
+        break;
+    }
+
+    if (err != CborNoError) {
+        ESP_LOGW(TAG, "%s ignored", field->key);
+    }
+}
+
+bool CborParseSettings(const void *payload, size_t len, LudoSettings *settings)
+{
+    CborParser parser;
+    CborValue it;
+    char key[SETTINGS_KEY_MAX_LEN];
+
+    LudoSettingsDefaults(settings);
+
+    if (!EnterMap(payload, len, &parser, &it)) {
+        return false;
+    }
+
+    while (!cbor_value_at_end(&it)) {
+        size_t keyLen = sizeof(key);
+
+        // Unbekannte oder zu lange Schlüssel werden übersprungen, wie fehlende Felder im JSON
+        if (!cbor_value_is_text_string(&it) || cbor_value_copy_text_string(&it, key, &keyLen, NULL) != CborNoError) {
+            key[0] = '\0';
+        }
+        if (cbor_value_advance(&it) != CborNoError || cbor_value_at_end(&it)) {
+            ESP_LOGE(TAG, "Settings abgeschnitten");
+            return false;
+        }
+
+        for (size_t i = 0; i < sizeof(settingsFields) / sizeof(settingsFields[0]); i++) {
+            if (strcmp(key, settingsFields[i].key) == 0) {
+                ReadSettingsField(&it, &settingsFields[i], settings);
+                break;
+            }
+        }
+        if (cbor_value_advance(&it) != CborNoError) {
+            ESP_LOGE(TAG, "Settings abgeschnitten");
+            return false;
+        }
+    }
+    return true;
+}
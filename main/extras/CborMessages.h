@@ -0,0 +1,46 @@
+/*
+ * CborMessages.h
+ *
+ *  CBOR als kompakte Alternative zu JSON für die Topics unter
+ *  device/access/<mac>/ und device/settings/<mac>/. Das Gerät meldet
+ *  "wireFormats":"json,cbor" mit der Settings-Anfrage, die Cloud schaltet
+ *  mit "wireFormat":"cbor" im Settings-Dokument um. Eingehende Nachrichten
+ *  werden am ersten Byte erkannt, JSON aus Json.c bleibt jederzeit gültig.
+ *
+ *  Kodiert und gelesen wird mit tinycbor direkt im Puffer des Aufrufers,
+ *  ohne Heap.
+ *
+ *  Zugangsanfrage, Map mit Zahlen als Schlüssel:
+ *    1 MAC (6 Byte), 2 UID (5 Byte, big endian), 3 readerId, 4 boot,
+ *    5 monoUs, 6 ts (ms UTC, 0 ohne Sync), 7 local (bool), 8 req
+ *  Antwort: {1: bool, 2: req} oder {"access": bool, "req": req}
+ *  Settings: gleiche Schlüssel wie das JSON-Dokument, Zahlen und bool als
+ *  CBOR-Werte statt Strings
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Json.h"
+#include "Timestamp.h"
+
+#ifndef MAIN_CBORMESSAGES_H_
+#define MAIN_CBORMESSAGES_H_
+
+// true wenn die Nachricht eine CBOR-Map ist, JSON beginnt nie mit 0xA0..0xBF
+bool CborIsMessage(const void *payload, size_t len);
+
+// Kodiert die Zugangsanfrage wie JsonAccessString()
+//@return Länge in buf, 0 wenn buf zu klein ist
+size_t CborAccessRequest(uint8_t *buf, size_t size, uint64_t uid, uint8_t readerId,
+                         const Timestamp *scanned, bool localGrant, uint32_t requestId);
+
+// Liest die Antwort der Cloud, requestId ist 0 wenn sie keine enthält
+//@return false wenn die Antwort ungültig ist oder kein access enthält
+bool CborParseAccess(const void *payload, size_t len, bool *access, uint32_t *requestId);
+
+// Wie JsonParseSettings(), fehlende Felder bekommen die Standardwerte
+//@return false wenn das CBOR ungültig ist
+bool CborParseSettings(const void *payload, size_t len, LudoSettings *settings);
+
+#endif /* MAIN_CBORMESSAGES_H_ */
@@ -7,6 +7,8 @@
 #include <stdbool.h>
 #include "Json.h"
 #include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
 #include "esp_log.h"
 #include "string.h"
 
@@ -14,12 +16,14 @@
 
 #include "extras/ledStrip.h"
 #include "extras/Piepser.h"
+#include "extras/NFC.h"
+#include "extras/Settings.h"
 #include "networking/wifi/lan.h"
 
 
 static const char* TAG = "JSON";
 
-char* JsonAccessString(const char* UID)
+char* JsonAccessString(const char* UID, uint8_t readerId, const Timestamp* scanned, bool localGrant, uint32_t requestId)
 {
 	// JSON-String-Puffer
     static char json_buffer[1500];
@@ -32,8 +36,15 @@ char* JsonAccessString(const char* UID)
     char UID_field[128];
     snprintf(UID_field, sizeof(UID_field), "\"uid\":\"%s\"", UID);
 
+    // boot + monoUs ordnen die Scans auch ohne gültige Uhrzeit, ts ist 0 vor dem ersten SNTP-Sync
+    char Time_field[128];
+    snprintf(Time_field, sizeof(Time_field), "\"boot\":%" PRIu32 ",\"monoUs\":%" PRId64 ",\"ts\":%" PRId64,
+             scanned->boot, scanned->monoUs, TimestampToUtcUs(scanned->monoUs) / 1000);
+
     // Füge die einzelnen Teile zusammen
-    snprintf(json_buffer, sizeof(json_buffer), "{%s,%s}", Mac_field, UID_field);
+    // local: Zugang wurde bereits über die lokale Liste gewährt, req: ordnet die Antwort der Anfrage zu
+    snprintf(json_buffer, sizeof(json_buffer), "{%s,%s,\"readerId\":%u,%s,\"local\":%s,\"req\":%" PRIu32 "}", Mac_field, UID_field, readerId,
+             Time_field, localGrant ? "true" : "false", requestId);
     
     // Ausgabe des JSON-Strings
     //ESP_LOGI(TAG, "Erstellter JSON-String: %s", json_buffer);
@@ -41,123 +52,136 @@ char* JsonAccessString(const char* UID)
 	return json_buffer;
 }
 
-void JsonParse(char* income, char* channel)
+// Kopiert einen String-Wert, "null" oder ein fehlender Schlüssel lassen das Feld leer
+static void JsonCopyString(const char* income, size_t len, const char* key, char* out, size_t outLen)
 {
-    if(channel == "settings")
-    {
-        JSONStatus_t result;
-        char *value;
-        size_t value_length;
-        bool useWifi = false, useNfcReader = false, useRgbLed = false, useBuzzer = false;
-        int beepOnScan = 0, beepOnValidScan = 0, beepOnInvalidScan = 0;
-        char colorOnScan[7] = "", colorOnValidScan[7] = "", colorOnInvalidScan[7] = "";
-
-        // Überprüfe, ob das JSON-Format gültig ist
-        result = JSON_Validate(income, strlen(income));
-        if (result != JSONSuccess) {
-            ESP_LOGE(TAG, "Ungültiges JSON-Format");
-            return;
-        }
-        ESP_LOGI(TAG, "JSON ist gültig");
-
-        // useWifi parsen
-        result = JSON_Search(income, strlen(income), "useWifi", strlen("useWifi"), &value, &value_length);
-        if (result == JSONSuccess) {
-            useWifi = (strncmp(value, "true", value_length) == 0);
-            ESP_LOGI(TAG, "useWifi: %s", useWifi ? "true" : "false");
-            //TODO Send use Wifi
-        }
+    char *value;
+    size_t value_length;
 
-        // useNfcReader parsen
-        result = JSON_Search(income, strlen(income), "useNfcReader", strlen("useNfcReader"), &value, &value_length);
-        if (result == JSONSuccess) {
-            useNfcReader = (strncmp(value, "true", value_length) == 0);
-            ESP_LOGI(TAG, "useNfcReader: %s", useNfcReader ? "true" : "false");
-            //Todo UseNFC Reader
-        }
+    if (JSON_Search((char*)income, len, (char*)key, strlen(key), &value, &value_length) == JSONSuccess &&
+        strncmp(value, "null", value_length) != 0) {
+        snprintf(out, outLen, "%.*s", (int)value_length, value);
+        ESP_LOGI(TAG, "%s: %s", key, out);
+    }
+}
 
-        // useBuzzer parsen__________________________________________________________________________________________________________________
-        result = JSON_Search(income, strlen(income), "useBuzzer", strlen("useBuzzer"), &value, &value_length);
-        if (result == JSONSuccess) {
-            useBuzzer = (strncmp(value, "true", value_length) == 0);
-            ESP_LOGI(TAG, "useBuzzer: %s", useBuzzer ? "true" : "false");
-        }
+static void JsonReadInt(const char* income, size_t len, const char* key, int* out)
+{
+    char *value;
+    size_t value_length;
 
-        // beepOnScan parsen
-        result = JSON_Search(income, strlen(income), "beepOnScan", strlen("beepOnScan"), &value, &value_length);
-        if (result == JSONSuccess && strncmp(value, "null", value_length) != 0) {
-            beepOnScan = atoi(value);
-            ESP_LOGI(TAG, "beepOnScan: %d", beepOnScan);
-        }
+    if (JSON_Search((char*)income, len, (char*)key, strlen(key), &value, &value_length) == JSONSuccess &&
+        strncmp(value, "null", value_length) != 0) {
+        *out = atoi(value);
+        ESP_LOGI(TAG, "%s: %d", key, *out);
+    }
+}
 
-        // beepOnValidScan parsen
-        result = JSON_Search(income, strlen(income), "beepOnValidScan", strlen("beepOnValidScan"), &value, &value_length);
-        if (result == JSONSuccess && strncmp(value, "null", value_length) != 0) {
-            beepOnValidScan = atoi(value);
-            ESP_LOGI(TAG, "beepOnValidScan: %d", beepOnValidScan);
-        }
+static void JsonReadBool(const char* income, size_t len, const char* key, bool* out)
+{
+    char *value;
+    size_t value_length;
 
-        // beepOnInvalidScan parsen
-        result = JSON_Search(income, strlen(income), "beepOnInvalidScan", strlen("beepOnInvalidScan"), &value, &value_length);
-        if (result == JSONSuccess && strncmp(value, "null", value_length) != 0) {
-            beepOnInvalidScan = atoi(value);
-            ESP_LOGI(TAG, "beepOnInvalidScan: %d", beepOnInvalidScan);
-        }
+    if (JSON_Search((char*)income, len, (char*)key, strlen(key), &value, &value_length) == JSONSuccess) {
+        *out = (strncmp(value, "true", value_length) == 0);
+        ESP_LOGI(TAG, "%s: %s", key, *out ? "true" : "false");
+    }
+}
 
-        Sound_ChangeSettings(beepOnValidScan, beepOnInvalidScan, beepOnScan, useBuzzer);
+void LudoSettingsDefaults(LudoSettings* settings)
+{
+    // Fehlende Felder behalten diese Werte, wie bisher beim direkten Anwenden
+    memset(settings, 0, sizeof(*settings));
+    settings->nfcPollMaxIdleMs = -1;
+    settings->nfcBusinessStart = -1;
+    settings->nfcBusinessEnd = -1;
+}
 
-        // useRgbLed parsen__________________________________________________________________________________________________________________
-        result = JSON_Search(income, strlen(income), "useRgbLed", strlen("useRgbLed"), &value, &value_length);
-        if (result == JSONSuccess) {
-            useRgbLed = (strncmp(value, "true", value_length) == 0);
-            ESP_LOGI(TAG, "useRgbLed: %s", useRgbLed ? "true" : "false");
-        }
+bool JsonParseSettings(const char* income, size_t len, LudoSettings* settings)
+{
+    char wireFormat[8] = "";
 
-        // colorOnScan parsen
-        result = JSON_Search(income, strlen(income), "colorOnScan", strlen("colorOnScan"), &value, &value_length);
-        if (result == JSONSuccess && strncmp(value, "null", value_length) != 0) {
-            snprintf(colorOnScan, sizeof(colorOnScan), "%.*s", (int)value_length, value);
-            ESP_LOGI(TAG, "colorOnScan: %s", colorOnScan);
-        }
+    LudoSettingsDefaults(settings);
 
-        // colorOnValidScan parsen
-        result = JSON_Search(income, strlen(income), "colorOnValidScan", strlen("colorOnValidScan"), &value, &value_length);
-        if (result == JSONSuccess && strncmp(value, "null", value_length) != 0) {
-            snprintf(colorOnValidScan, sizeof(colorOnValidScan), "%.*s", (int)value_length, value);
-            ESP_LOGI(TAG, "colorOnValidScan: %s", colorOnValidScan);
-        }
+    // Überprüfe, ob das JSON-Format gültig ist
+    if (JSON_Validate((char*)income, len) != JSONSuccess) {
+        ESP_LOGE(TAG, "Ungültiges JSON-Format");
+        return false;
+    }
+    ESP_LOGI(TAG, "JSON ist gültig");
+
+    //TODO Send use Wifi, UseNFC Reader
+    JsonReadBool(income, len, "useWifi", &settings->useWifi);
+    JsonReadBool(income, len, "useNfcReader", &settings->useNfcReader);
+
+    // Buzzer und Einzeltöne
+    JsonReadBool(income, len, "useBuzzer", &settings->useBuzzer);
+    JsonReadInt(income, len, "beepOnScan", &settings->beepOnScan);
+    JsonReadInt(income, len, "beepOnValidScan", &settings->beepOnValidScan);
+    JsonReadInt(income, len, "beepOnInvalidScan", &settings->beepOnInvalidScan);
+
+    // Optionale Tonmuster "freq:dauer:pause,..." ersetzen die Einzeltöne
+    JsonCopyString(income, len, "patternOnScan", settings->patternOnScan, sizeof(settings->patternOnScan));
+    JsonCopyString(income, len, "patternOnValidScan", settings->patternOnValidScan, sizeof(settings->patternOnValidScan));
+    JsonCopyString(income, len, "patternOnInvalidScan", settings->patternOnInvalidScan, sizeof(settings->patternOnInvalidScan));
+
+    // RGB LED
+    JsonReadBool(income, len, "useRgbLed", &settings->useRgbLed);
+    JsonCopyString(income, len, "colorOnScan", settings->colorOnScan, sizeof(settings->colorOnScan));
+    JsonCopyString(income, len, "colorOnValidScan", settings->colorOnValidScan, sizeof(settings->colorOnValidScan));
+    JsonCopyString(income, len, "colorOnInvalidScan", settings->colorOnInvalidScan, sizeof(settings->colorOnInvalidScan));
+
+    // Adaptive NFC Abfragerate
+    JsonReadInt(income, len, "nfcPollMaxIdleMs", &settings->nfcPollMaxIdleMs);
+    JsonReadInt(income, len, "nfcBusinessStart", &settings->nfcBusinessStart);
+    JsonReadInt(income, len, "nfcBusinessEnd", &settings->nfcBusinessEnd);
+
+    // Format der Zugangsanfragen, ohne Angabe JSON
+    JsonCopyString(income, len, "wireFormat", wireFormat, sizeof(wireFormat));
+    settings->wireCbor = strcmp(wireFormat, "cbor") == 0;
+
+    return true;
+}
 
-        // colorOnInvalidScan parsen
-        result = JSON_Search(income, strlen(income), "colorOnInvalidScan", strlen("colorOnInvalidScan"), &value, &value_length);
-        if (result == JSONSuccess && strncmp(value, "null", value_length) != 0) {
-            snprintf(colorOnInvalidScan, sizeof(colorOnInvalidScan), "%.*s", (int)value_length, value);
-            ESP_LOGI(TAG, "colorOnInvalidScan: %s", colorOnInvalidScan);
-        }
-        RgbLed_ChangeSettings(colorOnValidScan, colorOnInvalidScan, colorOnScan, useRgbLed);
+bool JsonParseAccess(const char* income, size_t len, bool* access, uint32_t* requestId)
+{
+    char *value;
+    size_t value_length;
+
+    *access = false;
+    *requestId = 0;
+
+    // Überprüfe, ob das JSON-Format gültig ist
+    if (JSON_Validate((char*)income, len) != JSONSuccess) {
+        ESP_LOGE(TAG, "Ungültiges JSON-Format");
+        return false;
+    }
+    ESP_LOGI(TAG, "JSON ist gültig");
+
+    if (JSON_Search((char*)income, len, "access", strlen("access"), &value, &value_length) == JSONSuccess) {
+        *access = (strncmp(value, "true", value_length) == 0);
+        ESP_LOGI(TAG, "access: %s", *access ? "true" : "false");
+    }
+    if (JSON_Search((char*)income, len, "req", strlen("req"), &value, &value_length) == JSONSuccess) {
+        *requestId = strtoul(value, NULL, 10);
+    }
+    return true;
+}
+
+void JsonParse(char* income, char* channel)
+{
+    if(channel == "settings")
+    {
+        // Wird mit dem Cache abgeglichen, nur geänderte Gruppen werden angewendet
+        SettingsUpdate(income, strlen(income));
     }
     else if(channel == "access")
     {
-        JSONStatus_t result;
-        char *value;
-        size_t value_length;
-        bool bAccess = false;
-
-        // Überprüfe, ob das JSON-Format gültig ist
-        result = JSON_Validate(income, strlen(income));
-        if (result != JSONSuccess) {
-            ESP_LOGE(TAG, "Ungültiges JSON-Format");
-            return;
-        }
-        ESP_LOGI(TAG, "JSON ist gültig");
+        bool bAccess;
+        uint32_t requestId;
 
-        // useWifi parsen
-        result = JSON_Search(income, strlen(income), "access", strlen("access"), &value, &value_length);
-        if (result == JSONSuccess) {
-            bAccess = (strncmp(value, "true", value_length) == 0);
-            ESP_LOGI(TAG, "access: %s", bAccess ? "true" : "false");
+        if (JsonParseAccess(income, strlen(income), &bAccess, &requestId)) {
+            RgbLedHasAccess(bAccess);
         }
-
-        RgbLedHasAccess(bAccess);
-
     }
 }
@@ -5,12 +5,51 @@
  *      Author: macra
  */
 #include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_log.h"
+#include "Timestamp.h"
 
 #ifndef MAIN_JSON_H_
 #define MAIN_JSON_H_
 
-char* JsonAccessString(const char* UID);
+//@param readerId Reader, an dem der Tag gescannt wurde
+//@param scanned Zeitpunkt des Scans, UTC nur wenn die Zeit schon synchronisiert ist
+//@param requestId kommt in der Antwort als "req" zurück
+char* JsonAccessString(const char* UID, uint8_t readerId, const Timestamp* scanned, bool localGrant, uint32_t requestId);
+
+// Liest die Antwort der Cloud, requestId ist 0 wenn sie kein "req" enthält
+//@return false wenn das JSON ungültig ist
+bool JsonParseAccess(const char* income, size_t len, bool* access, uint32_t* requestId);
+
+// Inhalt des Settings-Kanals
+typedef struct {
+    bool useWifi;
+    bool useNfcReader;
+    bool useBuzzer;
+    int beepOnScan;
+    int beepOnValidScan;
+    int beepOnInvalidScan;
+    char patternOnScan[96];
+    char patternOnValidScan[96];
+    char patternOnInvalidScan[96];
+    bool useRgbLed;
+    char colorOnScan[7];
+    char colorOnValidScan[7];
+    char colorOnInvalidScan[7];
+    int nfcPollMaxIdleMs;
+    int nfcBusinessStart;
+    int nfcBusinessEnd;
+    bool wireCbor;              // "wireFormat":"cbor", Zugangsanfragen als CBOR senden
+} LudoSettings;
+
+// Werte für Felder, die im Dokument fehlen
+void LudoSettingsDefaults(LudoSettings* settings);
+
+// Liest ein Settings-Dokument, fehlende Felder bekommen die Standardwerte
+//@return false wenn das JSON ungültig ist
+bool JsonParseSettings(const char* income, size_t len, LudoSettings* settings);
 
 void JsonParse(char* income, char* channel);
 
@@ -0,0 +1,217 @@
+/*
+ * Metrics.c
+ *
+ *  Metrik-Registry und gesammeltes Senden, siehe Metrics.h
+ */
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "Metrics.h"
+#include "Scheduler.h"
+#include "Timestamp.h"
+#include "networking/wifi/lan.h"
+#include "demo_tasks/sub_pub_unsub_demo/sub_pub_unsub_demo.h"
+
+static const char* TAG = "Metrics";
+
+#define METRICS_PAYLOAD_SIZE    1536
+
+// Neue Metriken kommen vorne dazu, entfernt wird nie
+static _Atomic(Metric *) metricsHead = NULL;
+
+static SchedulerJob *metricsJob = NULL;
+static int64_t lastPublishUs = 0;
+
+// Nur vom Sende-Job benutzt
+static char payload[METRICS_PAYLOAD_SIZE];
+static size_t payloadLen = 0;
+static bool payloadOverflow = false;
+
+void MetricRegister(Metric *metric)
+{
+    if (atomic_exchange(&metric->registered, true)) {
+        return;
+    }
+
+    Metric *head = atomic_load(&metricsHead);
+    do {
+        metric->next = head;
+    } while (!atomic_compare_exchange_weak(&metricsHead, &head, metric));
+}
+
+static void UpdateMin(_Atomic int32_t *min, int32_t value)
+{
+    int32_t current = atomic_load_explicit(min, memory_order_relaxed);
+    while (value < current &&
+           !atomic_compare_exchange_weak_explicit(min, &current, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void UpdateMax(_Atomic int32_t *max, int32_t value)
+{
+    int32_t current = atomic_load_explicit(max, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(max, &current, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void MetricSet(Metric *metric, int32_t value)
+{
+    atomic_store_explicit(&metric->value, value, memory_order_relaxed);
+    UpdateMin(&metric->min, value);
+    UpdateMax(&metric->max, value);
+}
+
+void MetricRecord(Metric *metric, uint32_t value)
+{
+    int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+
+    if (bucket >= METRIC_HISTOGRAM_BUCKETS) {
+        bucket = METRIC_HISTOGRAM_BUCKETS - 1;
+    }
+    atomic_fetch_add_explicit(&metric->buckets->counts[bucket], 1, memory_order_relaxed);
+}
+
+static void Append(const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    if (payloadOverflow) {
+        return;
+    }
+
+    va_start(args, format);
+    len = vsnprintf(payload + payloadLen, sizeof(payload) - payloadLen, format, args);
+    va_end(args);
+
+    if (len < 0 || (size_t)len >= sizeof(payload) - payloadLen) {
+        payloadOverflow = true;
+        return;
+    }
+    payloadLen += len;
+}
+
+// Schreibt den Wert seit dem letzten Senden, übernommen wird er erst nach dem Senden
+static void AppendMetric(Metric *metric)
+{
+    switch (metric->type) {
+    case METRIC_TYPE_COUNTER:
+        metric->pending = atomic_load_explicit(&metric->value, memory_order_relaxed);
+        Append("\"%s\":%" PRIu32, metric->name, (uint32_t)(metric->pending - metric->reported));
+        break;
+
+    case METRIC_TYPE_GAUGE:
+        metric->takenMin = atomic_exchange_explicit(&metric->min, INT32_MAX, memory_order_relaxed);
+        metric->takenMax = atomic_exchange_explicit(&metric->max, INT32_MIN, memory_order_relaxed);
+        if (metric->takenMin > metric->takenMax) {
+            Append("\"%s\":[%" PRId32 "]", metric->name, atomic_load(&metric->value));
+        } else {
+            Append("\"%s\":[%" PRId32 ",%" PRId32 ",%" PRId32 "]", metric->name, atomic_load(&metric->value),
+                   metric->takenMin, metric->takenMax);
+        }
+        break;
+
+    case METRIC_TYPE_HISTOGRAM: {
+        MetricBuckets *b = metric->buckets;
+        uint32_t total = 0;
+        int last = -1;
+
+        for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++) {
+            b->pending[i] = atomic_load_explicit(&b->counts[i], memory_order_relaxed);
+            total += b->pending[i] - b->reported[i];
+            if (b->pending[i] != b->reported[i]) {
+                last = i;
+            }
+        }
+        Append("\"%s\":[%" PRIu32 ",[", metric->name, total);
+        for (int i = 0; i <= last; i++) {
+            Append("%s%" PRIu32, i ? "," : "", b->pending[i] - b->reported[i]);
+        }
+        Append("]]");
+        break;
+    }
+    }
+}
+
+// Nach erfolgreichem Senden gelten die Werte als gemeldet, sonst gehen sie ins nächste Intervall
+static void FinishMetric(Metric *metric, bool sent)
+{
+    switch (metric->type) {
+    case METRIC_TYPE_COUNTER:
+        if (sent) {
+            metric->reported = metric->pending;
+        }
+        break;
+
+    case METRIC_TYPE_GAUGE:
+        if (!sent && metric->takenMin <= metric->takenMax) {
+            UpdateMin(&metric->min, metric->takenMin);
+            UpdateMax(&metric->max, metric->takenMax);
+        }
+        break;
+
+    case METRIC_TYPE_HISTOGRAM:
+        if (sent) {
+            for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++) {
+                metric->buckets->reported[i] = metric->buckets->pending[i];
+            }
+        }
+        break;
+    }
+}
+
+// Läuft im festen Abstand auf dem Scheduler
+static void MetricsJob(void *arg)
+{
+    char topic[100];
+    int64_t nowUs = esp_timer_get_time();
+    Metric *head = atomic_load(&metricsHead);
+    bool sent = false;
+
+    // Abgefragte Gauges zuerst, damit sie im selben Intervall landen
+    for (Metric *m = head; m != NULL; m = m->next) {
+        if (m->sample != NULL) {
+            MetricSet(m, m->sample());
+        }
+    }
+
+    payloadLen = 0;
+    payloadOverflow = false;
+    Append("{\"macAddrHex\":\"%s\",\"boot\":%" PRIu32 ",\"uptimeS\":%" PRIu32 ",\"intervalS\":%" PRIu32 ",\"m\":{",
+           LanPrintMac(), TimestampBootCount(), (uint32_t)(nowUs / 1000000),
+           (uint32_t)((nowUs - lastPublishUs) / 1000000));
+    for (Metric *m = head; m != NULL; m = m->next) {
+        Append(m == head ? "" : ",");
+        AppendMetric(m);
+    }
+    Append("}}");
+
+    if (payloadOverflow) {
+        ESP_LOGW(TAG, "Metrics do not fit in %d bytes, not published", METRICS_PAYLOAD_SIZE);
+    } else {
+        snprintf(topic, sizeof(topic), "device/telemetry/%s", LanPrintMac());
+        sent = prvPublishToAWS(topic, payload);
+    }
+
+    for (Metric *m = head; m != NULL; m = m->next) {
+        FinishMetric(m, sent);
+    }
+    if (sent) {
+        lastPublishUs = nowUs;
+    }
+}
+
+void StartMetrics(void)
+{
+    if (metricsJob != NULL || CONFIG_METRICS_INTERVAL_S == 0) {
+        return;
+    }
+    metricsJob = SchedulerAddInterval("metrics", CONFIG_METRICS_INTERVAL_S * 1000,
+                                      CONFIG_METRICS_INTERVAL_S * 1000, MetricsJob, NULL);
+}
@@ -0,0 +1,89 @@
+/*
+ * Metrics.h
+ *
+ *  Kleine Metrik-Registry: Zähler, Messwerte (Gauges) und Histogramme.
+ *  Jedes Modul legt seine Metriken statisch an und meldet sie beim Start
+ *  einmal an. Erfassen ist lock-frei und ohne Heap, ein Scheduler-Job
+ *  sendet alle Metriken eines Intervalls gesammelt an device/telemetry/<mac>.
+ *
+ *  Nachricht, Werte seit dem letzten erfolgreichen Senden:
+ *    {"macAddrHex":..,"boot":..,"uptimeS":..,"intervalS":..,"m":{
+ *      "<zähler>":n,
+ *      "<gauge>":[letzter,min,max] oder [letzter] ohne Änderung im Intervall,
+ *      "<histogramm>":[n,[c0,c1,..]]}}
+ *  Histogramm-Bucket 0 zählt den Wert 0, Bucket i die Werte 2^(i-1) bis
+ *  2^i - 1, der letzte Bucket alles darüber. Nullen am Ende fehlen.
+ */
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef MAIN_METRICS_H_
+#define MAIN_METRICS_H_
+
+#define METRIC_HISTOGRAM_BUCKETS    16
+
+typedef enum {
+    METRIC_TYPE_COUNTER = 0,
+    METRIC_TYPE_GAUGE,
+    METRIC_TYPE_HISTOGRAM,
+} MetricType;
+
+typedef struct {
+    _Atomic uint32_t counts[METRIC_HISTOGRAM_BUCKETS];
+    // Nur vom Sende-Job benutzt: Stand beim letzten Senden und im laufenden Versuch
+    uint32_t reported[METRIC_HISTOGRAM_BUCKETS];
+    uint32_t pending[METRIC_HISTOGRAM_BUCKETS];
+} MetricBuckets;
+
+typedef struct Metric {
+    const char *name;
+    MetricType type;
+    int32_t (*sample)(void);        // Gauge: wird vor dem Senden abgefragt, sonst NULL
+    MetricBuckets *buckets;         // nur Histogramme
+    _Atomic int32_t value;          // Zähler: Summe seit Boot, Gauge: letzter Wert
+    _Atomic int32_t min;            // Gauge: seit dem letzten Senden
+    _Atomic int32_t max;
+    // Nur vom Sende-Job benutzt, damit ein fehlgeschlagenes Senden nichts verliert
+    int32_t reported;
+    int32_t pending;
+    int32_t takenMin;
+    int32_t takenMax;
+    atomic_bool registered;
+    struct Metric *next;
+} Metric;
+
+#define METRIC_DEFINE(var, metricName, metricType, sampleFn, bucketsPtr) \
+    static Metric var = { .name = metricName, .type = metricType, .sample = sampleFn, \
+                          .buckets = bucketsPtr, .min = INT32_MAX, .max = INT32_MIN }
+
+// Zähler, z.B. METRIC_COUNTER(scansMetric, "nfc.scans");
+#define METRIC_COUNTER(var, name)               METRIC_DEFINE(var, name, METRIC_TYPE_COUNTER, NULL, NULL)
+// Gauge, der Wert kommt per MetricSet()
+#define METRIC_GAUGE(var, name)                 METRIC_DEFINE(var, name, METRIC_TYPE_GAUGE, NULL, NULL)
+// Gauge, den der Sende-Job selbst über sampleFn abfragt (Heap, Stack)
+#define METRIC_GAUGE_SAMPLED(var, name, sampleFn) METRIC_DEFINE(var, name, METRIC_TYPE_GAUGE, sampleFn, NULL)
+// Histogramm mit Zweierpotenzen als Bucket-Grenzen
+#define METRIC_HISTOGRAM(var, name) \
+    static MetricBuckets var##Buckets; \
+    METRIC_DEFINE(var, name, METRIC_TYPE_HISTOGRAM, NULL, &var##Buckets)
+
+// Meldet die Metrik an, mehrfacher Aufruf ist unschädlich. Darf aus jedem Task kommen
+void MetricRegister(Metric *metric);
+
+// Erhöht einen Zähler, darf aus jedem Task und aus Event-Handlern aufgerufen werden
+static inline void MetricAdd(Metric *metric, int32_t n)
+{
+    atomic_fetch_add_explicit(&metric->value, n, memory_order_relaxed);
+}
+
+// Setzt einen Gauge und führt Minimum und Maximum des Intervalls nach
+void MetricSet(Metric *metric, int32_t value);
+
+// Zählt einen Wert im Histogramm
+void MetricRecord(Metric *metric, uint32_t value);
+
+// Legt den Sende-Job an, mehrfacher Aufruf ist unschädlich
+void StartMetrics(void);
+
+#endif /* MAIN_METRICS_H_ */
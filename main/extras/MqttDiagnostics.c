@@ -0,0 +1,73 @@
+/*
+ * MqttDiagnostics.c
+ *
+ *  Histogramme der Agent-Kommandos auf Konsole und MQTT, siehe MqttDiagnostics.h
+ */
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "MqttDiagnostics.h"
+#include "Scheduler.h"
+#include "Timestamp.h"
+#include "core_mqtt_agent_command_log.h"
+#include "networking/wifi/lan.h"
+#include "demo_tasks/sub_pub_unsub_demo/sub_pub_unsub_demo.h"
+
+static const char* TAG = "MqttDiagnostics";
+
+// Reicht für etwa 20 belegte Buckets je Histogramm
+#define DIAG_PAYLOAD_SIZE       4096
+
+static SchedulerJob *diagJob = NULL;
+
+// Nur vom Scheduler-Worker benutzt, prvPublishToAWS() kopiert den Payload
+static char payload[DIAG_PAYLOAD_SIZE];
+
+static void PublishHistograms(void)
+{
+    char topic[100];
+    int len;
+    size_t jsonLen;
+
+    snprintf(topic, sizeof(topic), "device/diag/%s", LanPrintMac());
+    len = snprintf(payload, sizeof(payload), "{\"macAddrHex\":\"%s\",\"boot\":%" PRIu32 ",\"uptimeS\":%" PRIu32 ",\"mqttAgent\":",
+                   LanPrintMac(), TimestampBootCount(), (uint32_t)(esp_timer_get_time() / 1000000));
+
+    // Platz für die schließende Klammer lassen
+    jsonLen = xMqttAgentCommandLogJson(payload + len, sizeof(payload) - len - 1);
+    if (jsonLen == 0) {
+        ESP_LOGW(TAG, "Histograms do not fit in %d bytes, not published", DIAG_PAYLOAD_SIZE);
+        return;
+    }
+    snprintf(payload + len + jsonLen, sizeof(payload) - len - jsonLen, "}");
+
+    prvPublishToAWS(topic, payload);
+}
+
+// Läuft im festen Abstand auf dem Scheduler
+static void MqttDiagnosticsJob(void *arg)
+{
+    MqttDiagnosticsDump();
+
+#if CONFIG_MQTT_DIAGNOSTICS_PUBLISH
+    PublishHistograms();
+#endif
+}
+
+void MqttDiagnosticsDump(void)
+{
+    vMqttAgentCommandLogPrint();
+}
+
+void StartMqttDiagnostics(void)
+{
+    if (diagJob != NULL || CONFIG_MQTT_DIAGNOSTICS_INTERVAL_S == 0) {
+        return;
+    }
+    diagJob = SchedulerAddInterval("mqttDiag", CONFIG_MQTT_DIAGNOSTICS_INTERVAL_S * 1000,
+                                   CONFIG_MQTT_DIAGNOSTICS_INTERVAL_S * 1000, MqttDiagnosticsJob, NULL);
+}
@@ -0,0 +1,18 @@
+/*
+ * MqttDiagnostics.h
+ *
+ *  Gibt die Latenz-Histogramme der coreMQTT-Agent Kommandos periodisch
+ *  auf der Konsole aus und sendet sie an device/diag/<mac>, siehe
+ *  networking/mqtt/core_mqtt_agent_command_log.h. Grundlage zum Einstellen
+ *  von Queue-Länge und Netzwerkpuffer des Agents.
+ */
+#ifndef MAIN_MQTTDIAGNOSTICS_H_
+#define MAIN_MQTTDIAGNOSTICS_H_
+
+// Legt den periodischen Job an, mehrfacher Aufruf ist unschädlich
+void StartMqttDiagnostics(void);
+
+// Gibt die Histogramme sofort auf der Konsole aus
+void MqttDiagnosticsDump(void);
+
+#endif /* MAIN_MQTTDIAGNOSTICS_H_ */
@@ -10,60 +10,159 @@
 #include "rc522.h"
 #include <stdio.h>
 #include <stdint.h>
+#include <time.h>
 #include "string.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
 
 #include "NFC.h"
+#include "ScanQueue.h"
+#include "BootProfile.h"
+#include "AllowList.h"
+#include "RevokedFilter.h"
+#include "AccessRules.h"
+#include "TasksCommon.h"
 #include "Piepser.h"
 #include "sntpTime.h"
 #include "ledStrip.h"
+#include "Metrics.h"
 
 #include "demo_tasks/sub_pub_unsub_demo/sub_pub_unsub_demo.h"
 
 static const char* TAG = "NFC READ";
-static rc522_handle_t scanner;
 
-char uid_string[11];
-uint64_t uid_decimal = 000000000000;
+// Gemeinsamer SPI-Bus aller Reader
+#define NFC_SPI_HOST        SPI3_HOST
+#define NFC_SPI_MISO_GPIO   15
+#define NFC_SPI_MOSI_GPIO   16
+#define NFC_SPI_SCK_GPIO    17
+
+// Chip-Select je Reader, Index = Reader-ID
+static const int readerCsGpio[NFC_READER_COUNT] = {
+    CONFIG_NFC_READER0_CS_GPIO,
+#if NFC_READER_COUNT > 1
+    CONFIG_NFC_READER1_CS_GPIO,
+#endif
+#if NFC_READER_COUNT > 2
+    CONFIG_NFC_READER2_CS_GPIO,
+#endif
+#if NFC_READER_COUNT > 3
+    CONFIG_NFC_READER3_CS_GPIO,
+#endif
+};
 
-bool TagScanned = false;
+// Zuletzt gesehene UIDs je Reader. Zwei Karten im Wechsel am selben Reader (z.B. zwei
+// Karten in einer Hülle) verdrängen sich so nicht gegenseitig aus der Unterdrückung
+#define NFC_RECENT_UIDS     4
+
+typedef struct {
+    uint64_t uid;
+    int64_t seenUs;             // 0 = frei
+} NfcRecentUid;
+
+typedef struct {
+    rc522_handle_t scanner;
+    ScanQueue queue;            // Producer: rc522 Task dieses Readers, Consumer: Access-Task
+
+    // Nur vom Access-Task benutzt: Scan, der auf den Access-Kanal wartet. Solange er
+    // hier liegt, bleiben die weiteren Scans dieses Readers in der Queue
+    NfcScan held;
+    bool hasHeld;
+
+    // Nur vom rc522 Handler dieses Readers benutzt
+    NfcRecentUid recent[NFC_RECENT_UIDS];
+
+    // Abstand zwischen zwei Abfragefenstern, nur vom Policy-Timer benutzt
+    int64_t lastWindowUs;
+    uint32_t revisitMaxMs;
+    uint64_t revisitSumMs;
+    uint32_t revisitCount;
+} NfcReader;
+
+static NfcReader readers[NFC_READER_COUNT];
 
 bool bNFCStarted = false;
 
+static TaskHandle_t accessTaskHandle = NULL;
+
+static int32_t SampleAccessTaskStack(void);
+static int32_t SamplePollsPerMinute(void);
+
+// Zähler der Scan-Pipeline: weitergeleitet, als Duplikat verworfen, Queue voll
+METRIC_COUNTER(scansAccepted, "nfc.scans");
+METRIC_COUNTER(scansDuplicate, "nfc.duplicates");
+METRIC_COUNTER(scansDropped, "nfc.dropped");
+// Lokale Entscheidungen, die Antworten der Cloud zählt prvSendUIDToAWS()
+METRIC_COUNTER(accessLocalGranted, "access.localGranted");
+METRIC_COUNTER(accessRulesDenied, "access.rulesDenied");
+METRIC_COUNTER(accessRevokedDenied, "access.revokedDenied");
+METRIC_GAUGE_SAMPLED(accessTaskStack, "stack.nfcAccess", SampleAccessTaskStack);
+METRIC_GAUGE_SAMPLED(pollsPerMinuteMetric, "nfc.pollsPerMinute", SamplePollsPerMinute);
+
+// Abfrage-Scheduler: es ist immer höchstens ein Reader aktiv. Der Policy-Timer gibt
+// jedem Reader reihum ein kurzes Abfragefenster. Nach einer Sichtung und während der
+// Geschäftszeiten folgen die Runden direkt aufeinander, im Leerlauf wächst die Pause
+// zwischen zwei Runden exponentiell bis pollMaxIdleMs.
+#define NFC_POLL_WINDOW_MS   (2 * CONFIG_NFC_SCAN_INTERVAL_MS)
+
+// esp_timer_stop() wartet nicht auf einen laufenden Callback. pollLock schützt daher
+// activeReader, die Scanner-Handles und bNFCStarted: Start und Abbau halten es die ganze
+// Zeit, der Policy-Timer nur während eines Durchlaufs. Der Timer wird einmal angelegt
+// und nie gelöscht, ein abgebrochener Callback kann also nie ein freigegebenes Handle sehen.
+static SemaphoreHandle_t pollLock = NULL;
+static esp_timer_handle_t pollTimer = NULL;
+static int activeReader = -1;                   // -1 = alle pausiert
+static uint32_t pollIdleMs = CONFIG_NFC_POLL_IDLE_MIN_MS;
+static int64_t pollActiveSinceUs = 0;
+
+static _Atomic uint32_t lastActivityMs = 0;     // letzte Sichtung, von den rc522 Handlern gesetzt
+static _Atomic int pollMaxIdleMs = CONFIG_NFC_POLL_IDLE_MAX_MS;
+static _Atomic int businessStartHour = -1;      // -1 = keine Geschäftszeiten
+static _Atomic int businessEndHour = -1;
+
+// Abfragen pro Minute, geschätzt aus der aktiven Zeit der Reader
+static uint32_t pollActiveMsThisMinute = 0;
+static int64_t pollMinuteStartUs = 0;
+static _Atomic uint32_t pollsPerMinute = 0;
+
 bool NFCStarted()
 {
     return bNFCStarted;
 }
 
-char* NFC_TagScanned()
+// Nur mit pollLock aufrufen
+static void DestroyReaders(void)
 {
-    if(TagScanned)
-    {
-        return uid_string;
+    bNFCStarted = false;
+    if (pollTimer != NULL) {
+        esp_timer_stop(pollTimer);
     }
-    else
-    {
-        return NULL;
+    activeReader = -1;
+
+    // Rückwärts, damit Reader 0 den von ihm angelegten SPI-Bus zuletzt freigibt
+    for (int i = NFC_READER_COUNT - 1; i >= 0; i--) {
+        if (readers[i].scanner != NULL) {
+            esp_err_t ret = rc522_destroy(readers[i].scanner);
+            if (ret == ESP_OK) {
+                ESP_LOGI(TAG, "NFC reader %d destroyed successfully.", i);
+                readers[i].scanner = NULL;  // Setze den Handle auf NULL, da er jetzt ungültig ist
+            } else {
+                ESP_LOGE(TAG, "Failed to destroy NFC reader %d.", i);
+            }
+        }
     }
 }
 
-uint64_t PrintDecUID()
-{
-    return uid_decimal;
-}
-
 void DestroyNFC(void)
 {
-    bNFCStarted = false;
-    if (scanner != NULL) {
-        esp_err_t ret = rc522_destroy(scanner);
-        if (ret == ESP_OK) {
-            ESP_LOGI(TAG, "NFC reader destroyed successfully.");
-            scanner = NULL;  // Setze den Handle auf NULL, da er jetzt ungültig ist
-        } else {
-            ESP_LOGE(TAG, "Failed to destroy NFC reader.");
-        }
+    if (pollLock == NULL) {
+        return;
     }
+    // Wartet, bis ein gerade laufender Policy-Callback fertig ist
+    xSemaphoreTake(pollLock, portMAX_DELAY);
+    DestroyReaders();
+    xSemaphoreGive(pollLock);
 }
 
 //Converts The SN to Hex
@@ -84,68 +183,438 @@ void convert_uid_to_string(uint64_t uid_decimal, char* uid_string)
     snprintf(uid_string, 11, "%02X%02X%02X%02X%02X", uid[0], uid[1], uid[2], uid[3], uid[4]);
 }
 
-//Handler for NFC waits until a tag is scanned and Prints the the UID
+// Gleiche UID am selben Reader innerhalb des Fensters seit ihrer letzten Sichtung = dieselbe
+// Präsentation. Eine neue UID ersetzt den am längsten nicht gesehenen Eintrag
+static bool IsDuplicateScan(NfcReader *reader, uint64_t uid, int64_t now)
+{
+    NfcRecentUid *entry = NULL;
+    NfcRecentUid *oldest = &reader->recent[0];
+
+    for (int i = 0; i < NFC_RECENT_UIDS; i++) {
+        NfcRecentUid *recent = &reader->recent[i];
+
+        if (recent->seenUs != 0 && recent->uid == uid) {
+            entry = recent;
+            break;
+        }
+        if (recent->seenUs < oldest->seenUs) {
+            oldest = recent;
+        }
+    }
+
+    bool duplicate = entry != NULL &&
+                     (now - entry->seenUs) < (int64_t)CONFIG_NFC_DUPLICATE_SUPPRESS_MS * 1000;
+
+    if (entry == NULL) {
+        entry = oldest;
+        entry->uid = uid;
+    }
+    entry->seenUs = now;
+    // Jede Sichtung, auch ein Duplikat, hält die Reader im schnellen Modus;
+    // das Fenster läuft damit ab dem Entfernen der Karte
+    atomic_store(&lastActivityMs, (uint32_t)(now / 1000));
+    return duplicate;
+}
+
+static bool IsBusinessHours(void)
+{
+    int start = atomic_load(&businessStartHour);
+    int end = atomic_load(&businessEndHour);
+    time_t now = time(NULL);
+    struct tm timeinfo;
+
+    if (start < 0 || end < 0) {
+        return false;
+    }
+    localtime_r(&now, &timeinfo);
+    // Vor der ersten SNTP Synchronisation ist die Uhrzeit unbrauchbar
+    if (timeinfo.tm_year < (2020 - 1900)) {
+        return false;
+    }
+    if (start <= end) {
+        return timeinfo.tm_hour >= start && timeinfo.tm_hour < end;
+    }
+    return timeinfo.tm_hour >= start || timeinfo.tm_hour < end;
+}
+
+static bool WantsFastPolling(int64_t now)
+{
+    uint32_t sinceActivityMs = (uint32_t)(now / 1000) - atomic_load(&lastActivityMs);
+
+    return sinceActivityMs < CONFIG_NFC_POLL_FAST_HOLD_MS || IsBusinessHours();
+}
+
+static void LogReaderPollStats(void)
+{
+    for (int i = 0; i < NFC_READER_COUNT; i++) {
+        NfcReader *reader = &readers[i];
+        uint32_t avgMs = reader->revisitCount ? (uint32_t)(reader->revisitSumMs / reader->revisitCount) : 0;
+
+        ESP_LOGI(TAG, "Reader %d: poll latency avg %" PRIu32 " ms, max %" PRIu32 " ms (%" PRIu32 " windows)",
+                 i, avgMs, reader->revisitMaxMs, reader->revisitCount);
+    }
+}
+
+static void AccountPollTime(int64_t now)
+{
+    if (activeReader >= 0) {
+        pollActiveMsThisMinute += (uint32_t)((now - pollActiveSinceUs) / 1000);
+        pollActiveSinceUs = now;
+    }
+    if (now - pollMinuteStartUs >= 60LL * 1000 * 1000) {
+        atomic_store(&pollsPerMinute, pollActiveMsThisMinute / CONFIG_NFC_SCAN_INTERVAL_MS);
+        pollActiveMsThisMinute = 0;
+        pollMinuteStartUs = now;
+        LogReaderPollStats();
+    }
+}
+
+static void ActivateReader(int index, int64_t now)
+{
+    NfcReader *reader = &readers[index];
+
+    // Poll-Latenz: wie lange eine neu aufgelegte Karte an diesem Reader höchstens warten musste
+    if (reader->lastWindowUs != 0) {
+        uint32_t revisitMs = (uint32_t)((now - reader->lastWindowUs) / 1000);
+        if (revisitMs > reader->revisitMaxMs) {
+            reader->revisitMaxMs = revisitMs;
+        }
+        reader->revisitSumMs += revisitMs;
+        reader->revisitCount++;
+    }
+
+    if (activeReader != index) {
+        rc522_start(reader->scanner);
+        pollActiveSinceUs = now;
+    }
+    activeReader = index;
+}
+
+// Der gerade aktive Reader bleibt bis zum Ende seines Fensters aktiv
+static void DeactivateReader(int64_t now)
+{
+    if (activeReader >= 0) {
+        readers[activeReader].lastWindowUs = now;
+        rc522_pause(readers[activeReader].scanner);
+        activeReader = -1;
+    }
+}
+
+// Policy-Timer, läuft im esp_timer Task
+static void NfcPollTimerCallback(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t nextMs = NFC_POLL_WINDOW_MS;
+
+    // Belegt heißt: Start oder Abbau läuft. Nicht warten, um den esp_timer Task nicht
+    // aufzuhalten, sondern später wieder vorbeischauen. Läuft der Timer schon wieder
+    // (StartNFC), schlägt das harmlos fehl; nach einem Abbau endet der nächste Lauf
+    // an bNFCStarted
+    if (xSemaphoreTake(pollLock, 0) != pdTRUE) {
+        esp_timer_start_once(pollTimer, (uint64_t)nextMs * 1000);
+        return;
+    }
+    if (!bNFCStarted) {
+        xSemaphoreGive(pollLock);
+        return;
+    }
+
+    AccountPollTime(now);
+
+    int next = activeReader + 1;
+
+    if (activeReader >= 0 && next < NFC_READER_COUNT) {
+        // Runde fortsetzen
+        DeactivateReader(now);
+        ActivateReader(next, now);
+    } else if (WantsFastPolling(now)) {
+        // Neue Runde ohne Pause; ein einzelner Reader läuft einfach weiter
+        pollIdleMs = CONFIG_NFC_POLL_IDLE_MIN_MS;
+        if (NFC_READER_COUNT > 1 || activeReader < 0) {
+            DeactivateReader(now);
+            ActivateReader(0, now);
+        }
+    } else if (activeReader >= 0) {
+        // Runde vorbei: pausieren und die Pause verdoppeln
+        DeactivateReader(now);
+        nextMs = pollIdleMs;
+        pollIdleMs = pollIdleMs * 2;
+        if (pollIdleMs > (uint32_t)atomic_load(&pollMaxIdleMs)) {
+            pollIdleMs = (uint32_t)atomic_load(&pollMaxIdleMs);
+        }
+    } else {
+        ActivateReader(0, now);
+    }
+
+    esp_timer_start_once(pollTimer, (uint64_t)nextMs * 1000);
+    xSemaphoreGive(pollLock);
+}
+
+//Handler for NFC waits until a tag is scanned and hands it to the access task
+//@param arg Reader-ID
 static void rc522_handler(void* arg, esp_event_base_t base, int32_t event_id, void* event_data)
 {
     rc522_event_data_t* data = (rc522_event_data_t*) event_data;
+    uint8_t readerId = (uint8_t)(uintptr_t)arg;
+    NfcReader *reader = &readers[readerId];
 
     switch(event_id) {
         case RC522_EVENT_TAG_SCANNED: 
             {
                 rc522_tag_t* tag = (rc522_tag_t*) data->ptr;
-                //ESP_LOGI(TAG, "Tag scanned (sn: %" PRIu64 ")", tag->serial_number);
-                uid_decimal = tag->serial_number;
-
-                convert_uid_to_string(uid_decimal, uid_string);
-
-                //ESP_LOGI(TAG, "Time: %s  Serial Number in Hex: %s",sntpGetTIme(), uid_string);
+                NfcScan scan = {
+                    .uid = tag->serial_number,
+                    .scanned = TimestampNow(),
+                    .readerId = readerId,
+                };
+
+                if (IsDuplicateScan(reader, scan.uid, scan.scanned.monoUs)) {
+                    MetricAdd(&scansDuplicate, 1);
+                    break;
+                }
+
+                if (!ScanQueuePush(&reader->queue, &scan)) {
+                    MetricAdd(&scansDropped, 1);
+                    ESP_LOGW(TAG, "Scan queue of reader %u full, scan dropped", readerId);
+                    break;
+                }
+                MetricAdd(&scansAccepted, 1);
+                BootProfileMark(BOOT_STAGE_FIRST_SCAN);
+
+                // Sofortiges Feedback, die Anfrage an AWS macht der Access-Task
                 ScanningSound();
                 RGBLEDScanning();
-
-				//Send Data To AWS
-                prvSendUIDToAWS(uid_string);
-                TagScanned = true;
-
+                xTaskNotifyGive(accessTaskHandle);
             }
+            break;
         case RC522_EVENT_NONE:
             {
-                ESP_LOGI(TAG, "Waiting for Tag");
-                TagScanned = false;
+                ESP_LOGD(TAG, "Waiting for Tag");
             }
             break;
     }
 }
 
-void StartNFC(void)
+// Entscheidet einen Scan ohne Cloud, soweit das geht. Gibt das Feedback für lokale
+// Entscheidungen sofort und liefert true, wenn der Scan noch an die Cloud muss
+static bool DecideLocally(const NfcScan *scan)
 {
-    rc522_config_t config = {0};
-        config.spi.host = SPI3_HOST;
-        config.spi.miso_gpio = 15;
-        config.spi.mosi_gpio = 16;
-        config.spi.sck_gpio = 17;
-        config.spi.sda_gpio = 18;
+    // Bekannte UIDs bekommen sofort Zugang, die Cloud erfährt es nur per Audit
+    bool localGrant = false;
+#if CONFIG_NFC_ACCESS_RULES
+    // Zeitfenster gehen vor: außerhalb wird abgelehnt, auch wenn die UID in der Liste steht
+    AccessRuleResult rule = AccessRulesCheck(scan->uid);
+    if (rule == ACCESS_RULE_DENY) {
+        MetricAdd(&accessRulesDenied, 1);
+        NoAccessSound();
+        RgbLedHasAccess(false);
+        return false;
+    }
+    localGrant = rule == ACCESS_RULE_ALLOW;
+#endif
+#if CONFIG_NFC_LOCAL_ALLOWLIST
+    localGrant = localGrant || AllowListContains(scan->uid);
+#endif
+    if (localGrant) {
+        char uid[11];
+
+        MetricAdd(&accessLocalGranted, 1);
+        AccessSound();
+        RgbLedHasAccess(true);
+        // Ohne Warten auf Cloud oder Antwort, die nächsten Scans kommen sofort dran
+        convert_uid_to_string(scan->uid, uid);
+        if (!prvSendAccessAuditToAWS(uid, scan->readerId, &scan->scanned)) {
+            ESP_LOGW(TAG, "Access channel not ready, audit of local grant dropped");
+        }
+        return false;
+    }
 
-    
+#if CONFIG_NFC_REVOKED_FILTER
+    // Gesperrte UIDs werden ohne Anfrage abgelehnt. Die Zugangsliste geht vor,
+    // so trifft ein falsch-positiver Treffer nie eine lokal bekannte UID
+    if (RevokedFilterMayContain(scan->uid)) {
+        RevokedFilterCountDenied();
+        MetricAdd(&accessRevokedDenied, 1);
+        NoAccessSound();
+        RgbLedHasAccess(false);
+        return false;
+    }
+#endif
+    return true;
+}
 
-    esp_err_t ret = rc522_create(&config, &scanner);
-    if(ret != ESP_OK)
-    {
-        ESP_LOGE(TAG, "rc522_create FAILED!");
+// Consumer: arbeitet angenommene Scans aller Reader nacheinander ab
+static void NfcAccessTask(void *pvParameters)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        bool pending = true;
+        while (pending) {
+            pending = false;
+            // Reihum je ein Scan pro Reader, damit kein Reader den anderen aushungert
+            for (int i = 0; i < NFC_READER_COUNT; i++) {
+                NfcReader *reader = &readers[i];
+
+                if (!reader->hasHeld) {
+                    if (!ScanQueuePop(&reader->queue, &reader->held)) {
+                        continue;
+                    }
+                    if (!DecideLocally(&reader->held)) {
+                        pending = true;
+                        continue;
+                    }
+                    reader->hasHeld = true;
+                }
+
+                // Vor dem ersten Connect oder ohne Subscription bleibt der Scan liegen,
+                // NfcAccessChannelReady() weckt den Task wieder
+                if (!prvAccessChannelReady()) {
+                    continue;
+                }
+
+                char uid[11];
+                convert_uid_to_string(reader->held.uid, uid);
+                prvSendUIDToAWS(uid, reader->held.readerId, &reader->held.scanned);
+                reader->hasHeld = false;
+                pending = true;
+            }
+        }
+    }
+}
+
+void NfcAccessChannelReady(void)
+{
+    if (accessTaskHandle != NULL) {
+        xTaskNotifyGive(accessTaskHandle);
+    }
+}
+
+// Freier Stack des Access-Tasks in Bytes, für die Telemetrie
+static int32_t SampleAccessTaskStack(void)
+{
+    return accessTaskHandle != NULL ? (int32_t)uxTaskGetStackHighWaterMark(accessTaskHandle) : 0;
+}
+
+// Geschätzte Reader-Abfragen (SPI Scan-Zyklen) in der letzten vollen Minute
+static int32_t SamplePollsPerMinute(void)
+{
+    return (int32_t)atomic_load(&pollsPerMinute);
+}
+
+void NFC_ChangePollSettings(int MaxIdleMs, int BusinessStartHour, int BusinessEndHour)
+{
+    if (MaxIdleMs >= CONFIG_NFC_POLL_IDLE_MIN_MS) {
+        atomic_store(&pollMaxIdleMs, MaxIdleMs);
     }
-    ESP_LOGI(TAG, "rc522_create Success!");
-    ret = rc522_register_events(scanner, RC522_EVENT_ANY, rc522_handler, NULL);
+    if (BusinessStartHour >= 0 && BusinessStartHour < 24 && BusinessEndHour >= 0 && BusinessEndHour < 24) {
+        atomic_store(&businessStartHour, BusinessStartHour);
+        atomic_store(&businessEndHour, BusinessEndHour);
+    } else {
+        atomic_store(&businessStartHour, -1);
+        atomic_store(&businessEndHour, -1);
+    }
+    ESP_LOGI(TAG, "Poll settings: max idle %d ms, business hours %d-%d",
+             atomic_load(&pollMaxIdleMs), atomic_load(&businessStartHour), atomic_load(&businessEndHour));
+}
+
+static bool StartReader(uint8_t readerId)
+{
+    NfcReader *reader = &readers[readerId];
+    rc522_config_t config = {0};
+        config.spi.host = NFC_SPI_HOST;
+        config.spi.miso_gpio = NFC_SPI_MISO_GPIO;
+        config.spi.mosi_gpio = NFC_SPI_MOSI_GPIO;
+        config.spi.sck_gpio = NFC_SPI_SCK_GPIO;
+        config.spi.sda_gpio = readerCsGpio[readerId];
+        // Reader 0 legt den Bus an, alle weiteren hängen sich nur mit eigenem CS an
+        config.spi.bus_is_initialized = (readerId > 0);
+        config.scan_interval_ms = CONFIG_NFC_SCAN_INTERVAL_MS;
+
+    esp_err_t ret = rc522_create(&config, &reader->scanner);
     if(ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "rc522_register_events FAILED!");
+        ESP_LOGE(TAG, "rc522_create FAILED for reader %u!", readerId);
+        reader->scanner = NULL;
+        return false;
     }
-    ESP_LOGI(TAG, "rc522_register_events Success!");
-    ret = rc522_start(scanner);
+    ret = rc522_register_events(reader->scanner, RC522_EVENT_ANY, rc522_handler, (void *)(uintptr_t)readerId);
     if(ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "rc522_start FAILED!");
+        ESP_LOGE(TAG, "rc522_register_events FAILED for reader %u!", readerId);
+    }
+    ESP_LOGI(TAG, "Reader %u created (CS GPIO %d)", readerId, readerCsGpio[readerId]);
+    return true;
+}
+
+void StartNFC(void)
+{
+    // Queues und Access-Task überleben DestroyNFC und werden nur einmal angelegt
+    if (accessTaskHandle == NULL) {
+        for (int i = 0; i < NFC_READER_COUNT; i++) {
+            ScanQueueInit(&readers[i].queue);
+        }
+        pollLock = xSemaphoreCreateMutex();
+        configASSERT(pollLock != NULL);
+        xTaskCreate(NfcAccessTask, "NfcAccess", AccessTaskStackSize, NULL, AccessTaskPriority, &accessTaskHandle);
+
+        MetricRegister(&scansAccepted);
+        MetricRegister(&scansDuplicate);
+        MetricRegister(&scansDropped);
+        MetricRegister(&accessLocalGranted);
+        MetricRegister(&accessRulesDenied);
+        MetricRegister(&accessRevokedDenied);
+        MetricRegister(&accessTaskStack);
+        MetricRegister(&pollsPerMinuteMetric);
     }
+
+    xSemaphoreTake(pollLock, portMAX_DELAY);
+    // Boot und Connect können beide starten
+    if (bNFCStarted) {
+        xSemaphoreGive(pollLock);
+        return;
+    }
+
+    for (int i = 0; i < NFC_READER_COUNT; i++) {
+        if (!StartReader(i)) {
+            // Ohne vollständigen Satz an Readern kann der Scheduler nicht reihum schalten
+            DestroyReaders();
+            xSemaphoreGive(pollLock);
+            return;
+        }
+        readers[i].lastWindowUs = 0;
+    }
+
+    // Erster Reader beginnt sofort, danach entscheidet der Scheduler
+    int64_t now = esp_timer_get_time();
+    pollMinuteStartUs = now;
+    pollIdleMs = CONFIG_NFC_POLL_IDLE_MIN_MS;
+    atomic_store(&lastActivityMs, (uint32_t)(now / 1000));
+    activeReader = -1;
+    ActivateReader(0, now);
     ESP_LOGI(TAG, "rc522_start Success!");
     bNFCStarted = true;
+    BootProfileMark(BOOT_STAGE_NFC_READY);
+
+    // Unter pollLock, ein früher Callback kommt so erst nach dem Start an die Reader
+    if (pollTimer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = NfcPollTimerCallback,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "nfc_poll",
+            .skip_unhandled_events = true,
+        };
+        if (esp_timer_create(&timer_args, &pollTimer) != ESP_OK) {
+            ESP_LOGE(TAG, "Poll scheduler timer could not be created, only reader 0 is polled");
+            pollTimer = NULL;
+            xSemaphoreGive(pollLock);
+            return;
+        }
+    }
+    esp_timer_stop(pollTimer);
+    esp_timer_start_once(pollTimer, (uint64_t)NFC_POLL_WINDOW_MS * 1000);
+    xSemaphoreGive(pollLock);
 }
 
 
@@ -8,20 +8,20 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "esp_log.h"
+#include "sdkconfig.h"
 
 #ifndef MAIN_NFC_H_
 #define MAIN_NFC_H_
 
-// Starts the NFC Loop to wait for a NFC Tag
+// Anzahl RC522 Reader am gemeinsamen SPI-Bus
+#define NFC_READER_COUNT CONFIG_NFC_READER_COUNT
+
+// Starts all NFC readers and the poll scheduler to wait for a NFC Tag
 void StartNFC(void);
 
-//Destroy NFC
+//Destroy NFC, waits for a running poll timer callback before freeing the readers
 void DestroyNFC(void);
 
-//Gives the UID in Decimal
-uint64_t PrintDecUID();
-char* NFC_TagScanned();
-
 //Converts The SN to Hex
 //@param UID in Decimal
 //@param UID in HEX as String
@@ -29,4 +29,13 @@ void convert_uid_to_string(uint64_t uid_decimal, char* uid_string);
 
 bool NFCStarted();
 
+// Weckt den Access-Task, wenn der Access-Kanal zur Cloud bereit ist. Bis dahin
+// bleiben Scans, die eine Antwort der Cloud brauchen, in der Queue
+void NfcAccessChannelReady(void);
+
+// Adaptive Abfragerate aus dem Settings-Kanal
+//@param MaxIdleMs längste Pause im Leerlauf
+//@param BusinessStartHour, BusinessEndHour Stunden mit Dauerbetrieb, -1 = keine
+void NFC_ChangePollSettings(int MaxIdleMs, int BusinessStartHour, int BusinessEndHour);
+
 #endif /* MAIN_NFC_H_ */
\ No newline at end of file
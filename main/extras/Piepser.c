@@ -5,130 +5,312 @@
  *      Author: macra
  */
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <stdio.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/ledc.h"
 
 #include "Piepser.h"
+#include "Settings.h"
 #include "TasksCommon.h"
 
 
-//TODO Hängt kode auf darf nicht sein
 static const char* TAG = "Buzzer";
 
-TaskHandle_t soundTaskHandle = NULL;
+#define SOUND_LEDC_MODE      LEDC_LOW_SPEED_MODE
+#define SOUND_LEDC_TIMER     LEDC_TIMER_0
+#define SOUND_LEDC_CHANNEL   LEDC_CHANNEL_0
+#define SOUND_DUTY_ON        4096    // 50 % bei 13 Bit Auflösung
+#define SOUND_QUEUE_LENGTH   4
 
-int ScanningFreq = 500;
-int AccessFreq = 1500;
-int NoAccessFreq = 1000;
+// Statische Queue, damit pro Piepser weder Heap noch Task angelegt werden
+static QueueHandle_t soundQueue = NULL;
+static StaticQueue_t soundQueueStruct;
+static uint8_t soundQueueStorage[SOUND_QUEUE_LENGTH * sizeof(SoundSequence)];
 
-bool bUseBuzzer = true;
+// Sequenzer-Zustand, wird nur im esp_timer Callback verändert
+static esp_timer_handle_t soundTimer = NULL;
+static SoundSequence current;
+static bool active = false;
+static uint8_t step = 0;            // 2 * Tonindex + (0 = Ton, 1 = Pause)
+static int64_t nextEventUs = 0;     // absoluter Zeitpunkt des nächsten Schritts
 
-void makeSoundTask(void *param)
+static atomic_bool cancelRequested = false;
+
+static void SoundToneOn(uint16_t freqHz)
+{
+    if (ledc_set_freq(SOUND_LEDC_MODE, SOUND_LEDC_TIMER, freqHz) != ESP_OK) {
+        ESP_LOGE(TAG, "Frequenz %u Hz nicht einstellbar", freqHz);
+        return;
+    }
+    ledc_set_duty(SOUND_LEDC_MODE, SOUND_LEDC_CHANNEL, SOUND_DUTY_ON);
+    ledc_update_duty(SOUND_LEDC_MODE, SOUND_LEDC_CHANNEL);
+}
+
+static void SoundToneOff(void)
+{
+    ledc_set_duty(SOUND_LEDC_MODE, SOUND_LEDC_CHANNEL, 0);
+    ledc_update_duty(SOUND_LEDC_MODE, SOUND_LEDC_CHANNEL);
+}
+
+static void SoundArm(int64_t now)
+{
+    int64_t delay = nextEventUs - now;
+
+    // Liefert ESP_ERR_INVALID_STATE, wenn ein Kick den Timer schon gestartet hat;
+    // der dann folgende Callback plant anhand von nextEventUs selbst neu.
+    esp_timer_start_once(soundTimer, delay > 0 ? (uint64_t)delay : 0);
+}
+
+// Sequenzer: jeder Aufruf führt genau einen Schritt (Ton an / Pause) aus und plant den
+// nächsten auf einen absoluten Zeitpunkt relativ zum Start der Folge, so dass sich
+// Verzögerungen einzelner Callbacks nicht aufsummieren. Läuft im esp_timer Task,
+// pro Note wird kein Anwendungs-Task geweckt.
+static void SoundTimerCallback(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (atomic_exchange(&cancelRequested, false) && active) {
+        SoundToneOff();
+        active = false;
+    }
+
+    // Zu früh geweckt (z.B. durch einen Kick von SoundPlay): nur neu planen
+    if (active && now < nextEventUs) {
+        SoundArm(now);
+        return;
+    }
+
+    if (!active) {
+        if (xQueueReceive(soundQueue, &current, 0) != pdPASS) {
+            return;
+        }
+        active = true;
+        step = 0;
+        nextEventUs = now;
+    }
+
+    for (;;) {
+        uint8_t index = step / 2;
+
+        if (index >= current.count || index >= SOUND_MAX_TONES) {
+            SoundToneOff();
+            active = false;
+            // Nächste Folge direkt anschließen, falls vorhanden
+            if (uxQueueMessagesWaiting(soundQueue) > 0) {
+                nextEventUs = now;
+                SoundArm(now);
+            }
+            return;
+        }
+
+        const SoundTone *tone = &current.tones[index];
+        uint16_t durationMs = (step % 2 == 0) ? tone->durationMs : tone->gapMs;
+
+        if (step % 2 == 0) {
+            if (tone->freqHz > 0) {
+                SoundToneOn(tone->freqHz);
+            } else {
+                SoundToneOff();
+            }
+        } else {
+            SoundToneOff();
+        }
+
+        step++;
+        nextEventUs += (int64_t)durationMs * 1000;
+
+        if (durationMs > 0) {
+            SoundArm(now);
+            return;
+        }
+    }
+}
+
+static void SoundKick(void)
 {
-    int input = *(int *)param; // Dereferenzieren des Zeigers, um die Frequenz zu erhalten
-    free(param);  // Den Speicher freigeben, nachdem der Wert gelesen wurde
+    esp_timer_start_once(soundTimer, 0);
+}
+
+void StartSound(void)
+{
+    if (soundTimer != NULL) {
+        return;
+    }
 
-    // Konfiguration des PWM-Controllers
+    // LEDC wird einmalig beim Start konfiguriert, danach wird nur noch die Frequenz umgestellt
     ledc_timer_config_t ledc_timer = {
-        .speed_mode       = LEDC_LOW_SPEED_MODE,
-        .timer_num        = LEDC_TIMER_0,
+        .speed_mode       = SOUND_LEDC_MODE,
+        .timer_num        = SOUND_LEDC_TIMER,
         .duty_resolution  = LEDC_TIMER_13_BIT,
-        .freq_hz          = input,
+        .freq_hz          = 1000,
         .clk_cfg          = LEDC_AUTO_CLK
     };
-    if (ledc_timer_config(&ledc_timer) == ESP_OK) {
-        //ESP_LOGI(TAG, "PWM-Timer konfiguriert");
-    } else {
+    if (ledc_timer_config(&ledc_timer) != ESP_OK) {
         ESP_LOGE(TAG, "PWM-Timer Konfiguration fehlgeschlagen");
     }
 
-    // Konfiguration des PWM-Kanals
     ledc_channel_config_t ledc_channel = {
-        .speed_mode     = LEDC_LOW_SPEED_MODE,
-        .channel        = LEDC_CHANNEL_0,
-        .timer_sel      = LEDC_TIMER_0,
+        .speed_mode     = SOUND_LEDC_MODE,
+        .channel        = SOUND_LEDC_CHANNEL,
+        .timer_sel      = SOUND_LEDC_TIMER,
         .intr_type      = LEDC_INTR_DISABLE,
         .gpio_num       = PIEZO_GPIO_PIN,
-        .duty           = 4096,
+        .duty           = 0,
         .hpoint         = 0
     };
-    if (ledc_channel_config(&ledc_channel) == ESP_OK) {
-        //ESP_LOGI(TAG, "PWM-Kanal konfiguriert");
-    } else {
+    if (ledc_channel_config(&ledc_channel) != ESP_OK) {
         ESP_LOGE(TAG, "PWM-Kanal Konfiguration fehlgeschlagen");
     }
 
-    // Starten des Tons
-    ledc_set_duty(ledc_channel.speed_mode, ledc_channel.channel, ledc_channel.duty);
-    ledc_update_duty(ledc_channel.speed_mode, ledc_channel.channel);
+    soundQueue = xQueueCreateStatic(SOUND_QUEUE_LENGTH, sizeof(SoundSequence), soundQueueStorage, &soundQueueStruct);
 
-    // Piepser für eine bestimmte Zeit aktivieren
-    vTaskDelay(pdMS_TO_TICKS(1000)); // 1 Sekunde lang piepsen
+    const esp_timer_create_args_t timer_args = {
+        .callback = SoundTimerCallback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sound_seq",
+        .skip_unhandled_events = false,
+    };
+    if (esp_timer_create(&timer_args, &soundTimer) != ESP_OK) {
+        ESP_LOGE(TAG, "Sequenzer-Timer konnte nicht angelegt werden");
+        soundTimer = NULL;
+    }
+}
+
+// Kopiert die Tonfolge in die Queue, die Referenz auf den Snapshot wird danach nicht mehr gebraucht
+static bool SoundEnqueue(const SoundSequence *seq, bool preempt)
+{
+    if (soundTimer == NULL || seq == NULL || seq->count == 0) {
+        return false;
+    }
 
-    // PWM ausschalten (Duty Cycle auf 0 setzen)
-    ledc_stop(ledc_channel.speed_mode, ledc_channel.channel, 0);
+    if (preempt) {
+        SoundCancel();
+    }
 
-    // Task-Handle auf NULL setzen, nachdem der Task abgeschlossen ist
-    soundTaskHandle = NULL;
-    vTaskDelete(NULL); // Task beenden
+    if (xQueueSend(soundQueue, seq, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Sound-Queue voll, Ton verworfen");
+        return false;
+    }
+
+    SoundKick();
+    return true;
 }
 
-void createSoundTask(int input)
+bool SoundPlay(const SoundSequence *seq, bool preempt)
 {
-    if(bUseBuzzer)
-    {
-        if (soundTaskHandle == NULL) {  // Prüfen, ob der Task bereits existiert
-            int *freq = malloc(sizeof(int));  // Dynamischer Speicher für Frequenz
-            if (freq == NULL) {
-                ESP_LOGE(TAG, "Speicherallokation fehlgeschlagen");
-                return;
-            }
-            *freq = input;  // Frequenzwert setzen
+    const SettingsSnapshot *settings = SettingsAcquire();
+    bool played = settings->useBuzzer && SoundEnqueue(seq, preempt);
 
-            if (xTaskCreate(makeSoundTask, "make_sound_task", MakeSoundTaskStackSize, freq, MakeSoundTaskPriority, &soundTaskHandle) != pdPASS) {
-                ESP_LOGE(TAG, "Task-Erstellung fehlgeschlagen");
-                free(freq);  // Speicher freigeben bei Fehler
-            } else {
-                //ESP_LOGI(TAG, "Task für makeSound erstellt");
+    SettingsRelease(settings);
+    return played;
+}
+
+void SoundCancel(void)
+{
+    if (soundTimer == NULL) {
+        return;
+    }
+    xQueueReset(soundQueue);
+    atomic_store(&cancelRequested, true);
+    esp_timer_stop(soundTimer);
+    SoundKick();
+}
+
+bool SoundParsePattern(const char *text, size_t len, SoundSequence *out)
+{
+    SoundSequence seq = { 0 };
+    const char *p = text;
+    const char *end = text + len;
+
+    while (p < end && seq.count < SOUND_MAX_TONES) {
+        char *next;
+        unsigned long values[3] = { 0, 0, 0 };
+
+        for (int field = 0; field < 3; field++) {
+            values[field] = strtoul(p, &next, 10);
+            if (next == p || next > end || values[field] > UINT16_MAX) {
+                return false;
             }
+            p = next;
+            if (field < 2) {
+                if (p >= end || *p != ':') {
+                    return false;
+                }
+                p++;
+            }
+        }
+
+        seq.tones[seq.count].freqHz = (uint16_t)values[0];
+        seq.tones[seq.count].durationMs = (uint16_t)values[1];
+        seq.tones[seq.count].gapMs = (uint16_t)values[2];
+        seq.count++;
+
+        if (p < end && *p == ',') {
+            p++;
         } else {
-            ESP_LOGW(TAG, "Sound-Task läuft bereits.");
+            break;
         }
     }
+
+    if (seq.count == 0 || p != end) {
+        return false;
+    }
+
+    *out = seq;
+    return true;
 }
 
 void ScanningSound()
 {
-    //ESP_LOGI(TAG, "High Sound Task!");
-    createSoundTask(ScanningFreq);
+    const SettingsSnapshot *settings = SettingsAcquire();
+
+    if (settings->useBuzzer) {
+        SoundEnqueue(&settings->scanSound, false);
+    }
+    SettingsRelease(settings);
 }
 
+// Das Zugangsergebnis ersetzt einen noch laufenden Scan-Ton
 void AccessSound()
 {
-    ESP_LOGI(TAG, "Low Sound Task!");
-    createSoundTask(AccessFreq);
+    const SettingsSnapshot *settings = SettingsAcquire();
+
+    if (settings->useBuzzer) {
+        SoundEnqueue(&settings->accessSound, true);
+    }
+    SettingsRelease(settings);
 }
 void NoAccessSound()
 {
-    ESP_LOGI(TAG, "Low Sound Task!");
-    createSoundTask(NoAccessFreq);
+    const SettingsSnapshot *settings = SettingsAcquire();
+
+    if (settings->useBuzzer) {
+        SoundEnqueue(&settings->noAccessSound, true);
+    }
+    SettingsRelease(settings);
 }
 
-// Funktion, um den RGB-String zu parsen und die Farben zu setzen
-void Sound_ChangeSettings(int Access, int NoAccess, int Scanning, bool UseBuzzer)
+static void SetSingleBeep(SoundSequence *seq, int freq)
 {
-    bUseBuzzer = UseBuzzer; 
-    ESP_LOGI(TAG, "bUseBusser = %s", bUseBuzzer ? "true" : "false");
-    AccessFreq = Access;
-    NoAccessFreq = NoAccess;
-    ScanningFreq = Scanning;
-    ESP_LOGI(TAG, "Succesfully changed settings");
+    seq->count = 1;
+    seq->tones[0].freqHz = (uint16_t)freq;
+    seq->tones[0].durationMs = SOUND_BEEP_MS;
+    seq->tones[0].gapMs = 0;
 }
 
-
-
-
+void SoundBuildSequence(int freq, const char *pattern, SoundSequence *out)
+{
+    SetSingleBeep(out, freq);
+    if (pattern != NULL && pattern[0] != '\0' && !SoundParsePattern(pattern, strlen(pattern), out)) {
+        ESP_LOGW(TAG, "Ungültiges Muster: %s", pattern);
+    }
+}
@@ -4,6 +4,9 @@
  *  Created on: 7 Jun 2024
  *      Author: macra
  */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_err.h"
@@ -14,12 +17,48 @@
 #ifndef Piepser
 #define Piepser
 
+// Maximale Anzahl Töne pro Tonfolge
+#define SOUND_MAX_TONES 8
+
+// Dauer eines einzelnen Feedback-Tons
+#define SOUND_BEEP_MS   1000
+
+// Ein Ton: Frequenz (0 = Pause), Dauer und Pause danach
+typedef struct {
+    uint16_t freqHz;
+    uint16_t durationMs;
+    uint16_t gapMs;
+} SoundTone;
+
+// Tonfolge, wird per Wert in die Sound-Queue kopiert
+typedef struct {
+    uint8_t count;
+    SoundTone tones[SOUND_MAX_TONES];
+} SoundSequence;
+
+// Konfiguriert LEDC einmalig und legt den esp_timer für den Ton-Sequenzer an
+void StartSound(void);
+
+// Reiht eine Tonfolge ein, blockiert nie.
+// @param preempt laufende und wartende Tonfolgen vorher abbrechen
+// @return false, wenn der Summer deaktiviert oder die Queue voll ist
+bool SoundPlay(const SoundSequence *seq, bool preempt);
+
+// Bricht die laufende Tonfolge ab und leert die Queue
+void SoundCancel(void);
+
+// Parst ein Muster der Form "freq:dauer:pause,freq:dauer:pause,..." (Hz, ms, ms)
+// @return false bei Syntaxfehler oder mehr als SOUND_MAX_TONES Tönen
+bool SoundParsePattern(const char *text, size_t len, SoundSequence *out);
+
+// Muster aus dem Settings-Kanal, bei leerem oder ungültigem Muster ein Einzelton mit freq
+void SoundBuildSequence(int freq, const char *pattern, SoundSequence *out);
+
+// Spielen die Töne aus dem aktuellen Settings-Snapshot
 void ScanningSound();
 
 void AccessSound();
 
 void NoAccessSound();
 
-void Sound_ChangeSettings(int Access, int NoAccess, int Scanning, bool UseBuzzer);
-
 #endif /* Piepser */
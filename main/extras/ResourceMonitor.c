@@ -0,0 +1,208 @@
+/*
+ * ResourceMonitor.c
+ *
+ *  Ersetzt den täglichen Neustart: misst in festen Abständen die Ressourcen,
+ *  meldet Trends über MQTT und startet nur bei Bedarf die MQTT/TLS Verbindung neu.
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <fcntl.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+
+#include "ResourceMonitor.h"
+#include "Scheduler.h"
+#include "Timestamp.h"
+#include "Settings.h"
+#include "AllowList.h"
+#include "RevokedFilter.h"
+#include "AccessRules.h"
+#include "Metrics.h"
+#include "core_mqtt_agent_manager.h"
+#include "networking/wifi/lan.h"
+#include "demo_tasks/sub_pub_unsub_demo/sub_pub_unsub_demo.h"
+
+static const char* TAG = "ResourceMonitor";
+
+#define MONITOR_HISTORY_LEN     16
+
+static SchedulerJob *monitorJob = NULL;
+static uint32_t samples = 0;
+
+static _Atomic int32_t trackedCounters[RESOURCE_COUNTER_MAX];
+
+// Verlauf des freien Heaps für die Trendberechnung
+static uint32_t historyFreeHeap[MONITOR_HISTORY_LEN];
+static uint32_t historyUptimeS[MONITOR_HISTORY_LEN];
+static uint32_t historyCount = 0;
+
+static ResourceSample lastSample;
+static bool bHaveSample = false;
+
+// Jede Messung geht in die Telemetrie, so kommen Minimum und Maximum des Intervalls mit
+METRIC_GAUGE(freeHeapMetric, "heap.free");
+METRIC_GAUGE(minFreeHeapMetric, "heap.minFree");
+METRIC_GAUGE(largestBlockMetric, "heap.largestBlock");
+
+static uint32_t networkRestarts = 0;
+static uint32_t lastRestartUptimeS = 0;
+static uint32_t lowSamples = 0;         // aufeinanderfolgende Messungen unter der Schwelle
+
+void ResourceMonitorTrack(ResourceCounter counter, int delta)
+{
+    if (counter < RESOURCE_COUNTER_MAX) {
+        atomic_fetch_add(&trackedCounters[counter], delta);
+    }
+}
+
+bool ResourceMonitorGetSample(ResourceSample *sample)
+{
+    if (!bHaveSample) {
+        return false;
+    }
+    *sample = lastSample;
+    return true;
+}
+
+// lwIP bietet keine Abfrage der offenen Sockets, daher jeden Deskriptor prüfen
+static uint32_t CountOpenSockets(void)
+{
+    uint32_t count = 0;
+
+    for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; fd++) {
+        if (fcntl(fd, F_GETFL, 0) >= 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int32_t HeapTrendPerHour(uint32_t freeHeap, uint32_t uptimeS)
+{
+    uint32_t slot = historyCount % MONITOR_HISTORY_LEN;
+    uint32_t oldest = (historyCount < MONITOR_HISTORY_LEN) ? 0 : slot;
+    int32_t trend = 0;
+
+    if (historyCount > 0 && uptimeS > historyUptimeS[oldest]) {
+        int64_t delta = (int64_t)freeHeap - (int64_t)historyFreeHeap[oldest];
+        trend = (int32_t)(delta * 3600 / (int64_t)(uptimeS - historyUptimeS[oldest]));
+    }
+
+    historyFreeHeap[slot] = freeHeap;
+    historyUptimeS[slot] = uptimeS;
+    historyCount++;
+    return trend;
+}
+
+static void TakeSample(ResourceSample *sample)
+{
+    sample->uptimeS = (uint32_t)(esp_timer_get_time() / 1000000);
+    sample->freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    sample->minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    sample->largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    sample->tasks = uxTaskGetNumberOfTasks();
+    sample->sockets = CountOpenSockets();
+    sample->eventGroups = atomic_load(&trackedCounters[RESOURCE_EVENT_GROUPS]);
+    sample->heapTrendPerHour = HeapTrendPerHour(sample->freeHeap, sample->uptimeS);
+    sample->networkRestarts = networkRestarts;
+}
+
+// Schwellen prüfen; zuerst nur die Verbindung neu aufbauen (TLS-Puffer werden frei),
+// der Neustart des Geräts bleibt der letzte Ausweg
+static void CheckThresholds(const ResourceSample *sample)
+{
+    bool low = sample->freeHeap < CONFIG_RESOURCE_MONITOR_MIN_FREE_HEAP ||
+               sample->largestBlock < CONFIG_RESOURCE_MONITOR_MIN_LARGEST_BLOCK;
+
+    lowSamples = low ? lowSamples + 1 : 0;
+
+    if (sample->freeHeap < CONFIG_RESOURCE_MONITOR_CRITICAL_FREE_HEAP) {
+        ESP_LOGE(TAG, "Free heap critical (%" PRIu32 " bytes), restarting device", sample->freeHeap);
+        vTaskDelay(pdMS_TO_TICKS(2000));  // 2 Sekunden Verzögerung, um die Log-Meldung zu sehen
+        esp_restart();
+    }
+
+    if (lowSamples < CONFIG_RESOURCE_MONITOR_LOW_SAMPLES) {
+        return;
+    }
+    if (networkRestarts > 0 &&
+        sample->uptimeS - lastRestartUptimeS < CONFIG_RESOURCE_MONITOR_RESTART_COOLDOWN_S) {
+        return;
+    }
+
+    ESP_LOGW(TAG, "Heap low (free %" PRIu32 ", largest block %" PRIu32 "), restarting network connection",
+             sample->freeHeap, sample->largestBlock);
+    if (xCoreMqttAgentManagerRestartConnection() == pdPASS) {
+        networkRestarts++;
+        lastRestartUptimeS = sample->uptimeS;
+        lowSamples = 0;
+    }
+}
+
+static void PublishSample(const ResourceSample *sample)
+{
+    char topic[100];
+    char payload[512];
+
+    uint32_t allowListMaxUs, rulesDenied;
+    AllowListGetLookupStats(NULL, &allowListMaxUs);
+    AccessRulesGetStats(NULL, &rulesDenied, NULL);
+
+    snprintf(topic, sizeof(topic), "device/health/%s", LanPrintMac());
+    snprintf(payload, sizeof(payload),
+             "{\"macAddrHex\":\"%s\",\"boot\":%" PRIu32 ",\"uptimeS\":%" PRIu32 ",\"freeHeap\":%" PRIu32 ",\"minFreeHeap\":%" PRIu32
+             ",\"largestBlock\":%" PRIu32 ",\"heapTrendPerHour\":%" PRId32 ",\"tasks\":%" PRIu32
+             ",\"eventGroups\":%" PRId32 ",\"sockets\":%" PRIu32 ",\"networkRestarts\":%" PRIu32 ",\"settingsVersion\":%" PRIu32
+             ",\"allowListSerial\":%" PRIu32 ",\"allowListMaxUs\":%" PRIu32
+             ",\"revokedSerial\":%" PRIu32 ",\"revokedDenied\":%" PRIu32
+             ",\"rulesSerial\":%" PRIu32 ",\"rulesDenied\":%" PRIu32 "}",
+             LanPrintMac(), TimestampBootCount(), sample->uptimeS, sample->freeHeap, sample->minFreeHeap,
+             sample->largestBlock, sample->heapTrendPerHour, sample->tasks,
+             sample->eventGroups, sample->sockets, sample->networkRestarts, SettingsGetVersion(),
+             AllowListSerial(), allowListMaxUs, RevokedFilterSerial(), RevokedFilterDenied(),
+             AccessRulesSerial(), rulesDenied);
+
+    prvPublishToAWS(topic, payload);
+}
+
+// Läuft im festen Abstand auf dem Scheduler
+static void ResourceMonitorJob(void *arg)
+{
+    ResourceSample sample;
+    TakeSample(&sample);
+    lastSample = sample;
+    bHaveSample = true;
+
+    MetricSet(&freeHeapMetric, sample.freeHeap);
+    MetricSet(&minFreeHeapMetric, sample.minFreeHeap);
+    MetricSet(&largestBlockMetric, sample.largestBlock);
+
+    ESP_LOGD(TAG, "free %" PRIu32 " min %" PRIu32 " largest %" PRIu32 " trend %" PRId32 "/h tasks %" PRIu32,
+             sample.freeHeap, sample.minFreeHeap, sample.largestBlock, sample.heapTrendPerHour, sample.tasks);
+
+    CheckThresholds(&sample);
+
+    if (++samples % CONFIG_RESOURCE_MONITOR_REPORT_EVERY == 0) {
+        PublishSample(&sample);
+    }
+}
+
+void StartResourceMonitor(void)
+{
+    if (monitorJob != NULL) {
+        return;
+    }
+    MetricRegister(&freeHeapMetric);
+    MetricRegister(&minFreeHeapMetric);
+    MetricRegister(&largestBlockMetric);
+    monitorJob = SchedulerAddInterval("resources", CONFIG_RESOURCE_MONITOR_INTERVAL_S * 1000,
+                                      CONFIG_RESOURCE_MONITOR_INTERVAL_S * 1000, ResourceMonitorJob, NULL);
+}
@@ -0,0 +1,40 @@
+/*
+ * ResourceMonitor.h
+ *
+ *  Überwacht Heap, Tasks, Event Groups und Sockets zur Laufzeit und
+ *  startet bei Unterschreiten der Schwellen gezielt die Netzwerkverbindung neu.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef MAIN_RESOURCEMONITOR_H_
+#define MAIN_RESOURCEMONITOR_H_
+
+// Ressourcen, die nicht vom System abgefragt werden können und daher mitgezählt werden
+typedef enum {
+    RESOURCE_EVENT_GROUPS = 0,
+    RESOURCE_COUNTER_MAX
+} ResourceCounter;
+
+typedef struct {
+    uint32_t uptimeS;
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t largestBlock;
+    uint32_t tasks;
+    uint32_t sockets;
+    int32_t  eventGroups;
+    int32_t  heapTrendPerHour;      // Änderung des freien Heaps in Byte pro Stunde
+    uint32_t networkRestarts;
+} ResourceSample;
+
+// Legt den periodischen Monitor-Job im Scheduler an, mehrfacher Aufruf ist unschädlich
+void StartResourceMonitor(void);
+
+// Zählt eine mitgezählte Ressource hoch (delta > 0) oder runter (delta < 0)
+void ResourceMonitorTrack(ResourceCounter counter, int delta);
+
+// Letzte Messung, false solange noch keine vorliegt
+bool ResourceMonitorGetSample(ResourceSample *sample);
+
+#endif /* MAIN_RESOURCEMONITOR_H_ */
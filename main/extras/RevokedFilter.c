@@ -0,0 +1,273 @@
+/*
+ * RevokedFilter.c
+ *
+ *  Bloom-Filter der gesperrten UIDs, siehe RevokedFilter.h
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "RevokedFilter.h"
+#include "Scheduler.h"
+
+static const char* TAG = "RevokedFilter";
+
+// Layout muss zu main/tools/gen_revoked.py passen
+#define FILTER_MAGIC            0x46425652u     // "RVBF"
+#define FILTER_FORMAT_VERSION   1
+#define FILTER_MAX_HASHES       16
+#define FILTER_MAX_BYTES        CONFIG_NFC_REVOKED_FILTER_MAX_BYTES
+
+#define NVS_NAMESPACE           "revoked"
+#define NVS_KEY_FILTER          "filter"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t formatVersion;
+    uint8_t hashCount;
+    uint8_t reserved;
+    uint32_t bitCount;
+    uint32_t entries;
+    uint32_t serial;
+    uint32_t crc32;             // über die Bits, wie zlib.crc32()
+} RevokedFilterHeader;
+
+_Static_assert(sizeof(RevokedFilterHeader) == 24, "RevokedFilterHeader must match gen_revoked.py");
+
+typedef struct {
+    RevokedFilterHeader header;
+    uint32_t falsePositivePpm;
+    uint8_t bits[FILTER_MAX_BYTES];
+} RevokedFilterSlot;
+
+// Aktueller und vorheriger Filter, wie bei der Zugangsliste
+static RevokedFilterSlot slots[2];
+static _Atomic uint32_t slotRefs[2];
+static _Atomic uint32_t currentSlot = 0;
+
+// Empfangspuffer, gehört dem Apply-Job solange rxBusy gesetzt ist
+static uint8_t rxBuffer[sizeof(RevokedFilterHeader) + FILTER_MAX_BYTES];
+static size_t rxLength = 0;
+static atomic_bool rxBusy = false;
+static SchedulerJob *applyJob = NULL;
+
+static _Atomic uint32_t deniedCount = 0;
+
+// splitmix64, verteilt auch fortlaufende UIDs gleichmäßig
+static uint64_t HashUid(uint64_t uid)
+{
+    uint64_t z = uid + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Double Hashing h1 + i*h2, Abbildung auf [0, bitCount) per Multiplikation statt Modulo
+static bool FilterContains(const RevokedFilterSlot *slot, uint64_t uid)
+{
+    uint32_t bitCount = slot->header.bitCount;
+
+    if (bitCount == 0) {
+        return false;
+    }
+
+    uint64_t hash = HashUid(uid);
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+
+    for (uint32_t i = 0; i < slot->header.hashCount; i++) {
+        uint32_t bit = (uint32_t)(((uint64_t)(h1 + i * h2) * bitCount) >> 32);
+        if ((slot->bits[bit >> 3] & (1u << (bit & 7))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const RevokedFilterSlot *SlotAcquire(void)
+{
+    for (;;) {
+        uint32_t slot = atomic_load(&currentSlot);
+
+        atomic_fetch_add(&slotRefs[slot], 1);
+        if (slot == atomic_load(&currentSlot)) {
+            return &slots[slot];
+        }
+        atomic_fetch_sub(&slotRefs[slot], 1);
+    }
+}
+
+static void SlotRelease(const RevokedFilterSlot *slot)
+{
+    atomic_fetch_sub(&slotRefs[slot - slots], 1);
+}
+
+bool RevokedFilterMayContain(uint64_t uid)
+{
+    const RevokedFilterSlot *slot = SlotAcquire();
+    bool found = FilterContains(slot, uid);
+    SlotRelease(slot);
+    return found;
+}
+
+// Prüft Kopf, Größe und CRC, ohne etwas zu verändern
+static bool FilterValidate(const uint8_t *data, size_t len, RevokedFilterHeader *header)
+{
+    if (len < sizeof(*header)) {
+        return false;
+    }
+    memcpy(header, data, sizeof(*header));
+
+    size_t bytes = header->bitCount / 8;
+    if (header->magic != FILTER_MAGIC || header->formatVersion != FILTER_FORMAT_VERSION ||
+        header->bitCount % 8 != 0 || bytes > FILTER_MAX_BYTES || len != sizeof(*header) + bytes ||
+        header->hashCount > FILTER_MAX_HASHES || (header->bitCount != 0 && header->hashCount == 0)) {
+        ESP_LOGE(TAG, "Invalid filter (%u bytes, %" PRIu32 " bits, %u hashes)",
+                 (unsigned)len, header->bitCount, header->hashCount);
+        return false;
+    }
+    if (esp_rom_crc32_le(0, data + sizeof(*header), bytes) != header->crc32) {
+        ESP_LOGE(TAG, "Filter %" PRIu32 " CRC mismatch", header->serial);
+        return false;
+    }
+    return true;
+}
+
+// (1 - e^(-k*n/m))^k, nur beim Umschalten berechnet
+static uint32_t FalsePositivePpm(const RevokedFilterHeader *header)
+{
+    if (header->bitCount == 0 || header->entries == 0) {
+        return 0;
+    }
+    float k = header->hashCount;
+    float fill = 1.0f - expf(-k * (float)header->entries / (float)header->bitCount);
+    return (uint32_t)(powf(fill, k) * 1e6f);
+}
+
+static void FilterPublish(const uint8_t *data, const RevokedFilterHeader *header)
+{
+    uint32_t spare = atomic_load(&currentSlot) ^ 1;
+    RevokedFilterSlot *slot = &slots[spare];
+
+    // Scans halten den Filter nur für wenige µs
+    while (atomic_load(&slotRefs[spare]) != 0) {
+        vTaskDelay(1);
+    }
+
+    slot->header = *header;
+    slot->falsePositivePpm = FalsePositivePpm(header);
+    memcpy(slot->bits, data + sizeof(*header), header->bitCount / 8);
+    atomic_store(&currentSlot, spare);
+
+    ESP_LOGI(TAG, "Filter %" PRIu32 ": %" PRIu32 " UIDs in %" PRIu32 " bytes, %u hashes, ~%" PRIu32 " ppm false positives",
+             header->serial, header->entries, header->bitCount / 8, header->hashCount, slot->falsePositivePpm);
+}
+
+static void FilterStore(const uint8_t *data, size_t len)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, NVS_KEY_FILTER, data, len);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store filter: %s", esp_err_to_name(err));
+    }
+}
+
+// Läuft auf dem Scheduler, angestoßen von RevokedFilterReceive()
+static void RevokedFilterApplyJob(void *arg)
+{
+    RevokedFilterHeader header;
+
+    if (!atomic_load(&rxBusy)) {
+        return;
+    }
+
+    if (FilterValidate(rxBuffer, rxLength, &header) && header.serial != RevokedFilterSerial()) {
+        FilterPublish(rxBuffer, &header);
+        FilterStore(rxBuffer, rxLength);
+    }
+    atomic_store(&rxBusy, false);
+}
+
+void RevokedFilterReceive(const void *payload, size_t len)
+{
+    if (applyJob == NULL || len > sizeof(rxBuffer)) {
+        ESP_LOGW(TAG, "Filter of %u bytes dropped", (unsigned)len);
+        return;
+    }
+    if (atomic_exchange(&rxBusy, true)) {
+        ESP_LOGW(TAG, "Filter dropped, previous one still being applied");
+        return;
+    }
+
+    memcpy(rxBuffer, payload, len);
+    rxLength = len;
+    SchedulerTrigger(applyJob);
+}
+
+bool RevokedFilterInit(void)
+{
+    RevokedFilterHeader header;
+    size_t len = sizeof(rxBuffer);
+    nvs_handle_t handle;
+
+    if (applyJob == NULL) {
+        applyJob = SchedulerAddJob("revokedApply", RevokedFilterApplyJob, NULL);
+    }
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        ESP_LOGI(TAG, "No cached filter");
+        return false;
+    }
+    bool ok = nvs_get_blob(handle, NVS_KEY_FILTER, rxBuffer, &len) == ESP_OK;
+    nvs_close(handle);
+
+    // Läuft vor dem ersten Scan und vor dem Empfang, der Puffer ist hier noch frei
+    if (!ok || !FilterValidate(rxBuffer, len, &header)) {
+        ESP_LOGW(TAG, "Cached filter missing or invalid, waiting for the cloud");
+        return false;
+    }
+    FilterPublish(rxBuffer, &header);
+    return true;
+}
+
+uint32_t RevokedFilterSerial(void)
+{
+    const RevokedFilterSlot *slot = SlotAcquire();
+    uint32_t serial = slot->header.serial;
+    SlotRelease(slot);
+    return serial;
+}
+
+uint32_t RevokedFilterFalsePositivePpm(void)
+{
+    const RevokedFilterSlot *slot = SlotAcquire();
+    uint32_t ppm = slot->falsePositivePpm;
+    SlotRelease(slot);
+    return ppm;
+}
+
+void RevokedFilterCountDenied(void)
+{
+    atomic_fetch_add(&deniedCount, 1);
+}
+
+uint32_t RevokedFilterDenied(void)
+{
+    return atomic_load(&deniedCount);
+}
@@ -0,0 +1,44 @@
+/*
+ * RevokedFilter.h
+ *
+ *  Bloom-Filter der gesperrten UIDs. Die Cloud baut ihn mit
+ *  main/tools/gen_revoked.py und schickt ihn binär über den Settings-Kanal
+ *  (device/settings/<mac>/revoked). Ein Treffer wird lokal abgelehnt, ohne
+ *  Anfrage an die Cloud. Falsch-positive Treffer betreffen nur UIDs, die nicht
+ *  in der lokalen Zugangsliste stehen, die Rate bestimmt die Cloud über die
+ *  Filtergröße, höchstens CONFIG_NFC_REVOKED_FILTER_MAX_BYTES.
+ *
+ *  Layout (little endian, 24 Byte Kopf):
+ *    u32 magic "RVBF", u16 Format (1), u8 Hashfunktionen, u8 0,
+ *    u32 Bits, u32 Einträge, u32 Seriennummer, u32 CRC32 der Bits, dann die Bits
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAIN_REVOKEDFILTER_H_
+#define MAIN_REVOKEDFILTER_H_
+
+// Lädt den zuletzt empfangenen Filter aus dem NVS, nach nvs_flash_init() aufrufen
+//@return false wenn kein gültiger Filter gespeichert ist
+bool RevokedFilterInit(void);
+
+// true wenn die UID vermutlich gesperrt ist, false sicher nicht. Blockiert nie
+bool RevokedFilterMayContain(uint64_t uid);
+
+// Nimmt einen Filter aus dem MQTT-Callback entgegen, kopiert ihn und prüft/übernimmt ihn auf dem Scheduler.
+// Kommt ein Filter, während der vorige noch verarbeitet wird, wird er verworfen
+void RevokedFilterReceive(const void *payload, size_t len);
+
+// Seriennummer des aktiven Filters, 0 ohne Filter
+uint32_t RevokedFilterSerial(void);
+
+// Erwartete Falsch-positiv-Rate des aktiven Filters in ppm
+uint32_t RevokedFilterFalsePositivePpm(void);
+
+// Zählt lokal abgelehnte Scans, vom Access-Task aufgerufen
+void RevokedFilterCountDenied(void);
+
+uint32_t RevokedFilterDenied(void);
+
+#endif /* MAIN_REVOKEDFILTER_H_ */
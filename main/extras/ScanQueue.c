@@ -0,0 +1,42 @@
+/*
+ * ScanQueue.c
+ *
+ *  Lock-freie SPSC Queue für NFC-Scans.
+ */
+#include "ScanQueue.h"
+
+void ScanQueueInit(ScanQueue *queue)
+{
+    atomic_store_explicit(&queue->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, 0, memory_order_relaxed);
+}
+
+bool ScanQueuePush(ScanQueue *queue, const NfcScan *scan)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head - tail >= SCAN_QUEUE_LEN) {
+        return false;
+    }
+
+    queue->slots[head & (SCAN_QUEUE_LEN - 1)] = *scan;
+    // Slot erst nach dem Schreiben für den Consumer sichtbar machen
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool ScanQueuePop(ScanQueue *queue, NfcScan *scan)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail == head) {
+        return false;
+    }
+
+    *scan = queue->slots[tail & (SCAN_QUEUE_LEN - 1)];
+    // Slot erst nach dem Lesen an den Producer zurückgeben
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
@@ -0,0 +1,44 @@
+/*
+ * ScanQueue.h
+ *
+ *  Lock-freie Single-Producer/Single-Consumer Queue für NFC-Scans.
+ *  Producer ist der rc522 Event-Handler, Consumer der Access-Task.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "sdkconfig.h"
+#include "Timestamp.h"
+
+#ifndef MAIN_SCANQUEUE_H_
+#define MAIN_SCANQUEUE_H_
+
+#define SCAN_QUEUE_LEN CONFIG_NFC_SCAN_QUEUE_LEN
+
+_Static_assert((SCAN_QUEUE_LEN & (SCAN_QUEUE_LEN - 1)) == 0, "NFC_SCAN_QUEUE_LEN muss eine Zweierpotenz sein");
+
+// Ein einzelner Scan, wie er vom Reader gemeldet wurde
+typedef struct {
+    uint64_t uid;
+    Timestamp scanned;      // Zeitpunkt des Scans, über Reboots sortierbar
+    uint8_t readerId;       // Index des Readers, siehe NFC_READER_COUNT
+} NfcScan;
+
+typedef struct {
+    NfcScan slots[SCAN_QUEUE_LEN];
+    _Atomic uint32_t head;  // nur vom Producer geschrieben
+    _Atomic uint32_t tail;  // nur vom Consumer geschrieben
+} ScanQueue;
+
+void ScanQueueInit(ScanQueue *queue);
+
+// Nur vom Producer aufrufen
+// @return false, wenn die Queue voll ist
+bool ScanQueuePush(ScanQueue *queue, const NfcScan *scan);
+
+// Nur vom Consumer aufrufen
+// @return false, wenn die Queue leer ist
+bool ScanQueuePop(ScanQueue *queue, NfcScan *scan);
+
+#endif /* MAIN_SCANQUEUE_H_ */
@@ -0,0 +1,460 @@
+/*
+ * Scheduler.c
+ *
+ *  Hierarchisches Timer-Rad mit 4 Ebenen zu je 64 Slots. Ebene 0 löst einen
+ *  Scheduler-Tick auf, jede weitere Ebene das 64-fache der vorherigen
+ *  (bei 100 ms Tick reicht das Rad gut 19 Tage). Jobs wandern beim Überlauf
+ *  einer Ebene eine Ebene nach unten. Der Worker schläft bis zum nächsten
+ *  belegten Slot der Ebene 0 oder bis zum nächsten Überlauf.
+ */
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "Scheduler.h"
+#include "TasksCommon.h"
+#include "Metrics.h"
+
+static const char* TAG = "Scheduler";
+
+#define WHEEL_LEVELS        4
+#define WHEEL_BITS          6
+#define WHEEL_SLOTS         (1 << WHEEL_BITS)
+#define WHEEL_MASK          (WHEEL_SLOTS - 1)
+#define WHEEL_MAX_TICKS     ((1UL << (WHEEL_LEVELS * WHEEL_BITS)) - 1)
+
+#define TICK_MS             CONFIG_SCHEDULER_TICK_MS
+
+// Wartezeit, wenn ein Cron-Job noch keine gültige Uhrzeit hat
+#define CRON_RETRY_MS       60000
+
+typedef enum {
+    JOB_FREE = 0,
+    JOB_MANUAL,
+    JOB_INTERVAL,
+    JOB_CRON,
+} JobType;
+
+struct SchedulerJob {
+    JobType type;
+    const char *name;
+    SchedulerCallback callback;
+    void *arg;
+
+    uint32_t periodTicks;       // JOB_INTERVAL
+    int8_t minute;              // JOB_CRON
+    int8_t hour;
+    uint8_t weekdays;
+
+    uint32_t expires;           // absoluter Tick
+    bool armed;                 // hängt im Rad
+    uint8_t level;              // Position im Rad, gültig wenn armed
+    uint8_t slot;
+    bool running;
+    bool cancelled;
+    bool triggered;
+
+    SchedulerJob *next;
+    SchedulerJob *prev;
+};
+
+static SchedulerJob jobs[CONFIG_SCHEDULER_MAX_JOBS];
+static SchedulerJob *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint64_t occupied[WHEEL_LEVELS];     // belegte Slots je Ebene
+
+static uint32_t currentTick = 0;
+static int64_t startUs = 0;
+
+static SemaphoreHandle_t schedulerMutex = NULL;
+static SemaphoreHandle_t schedulerWake = NULL;
+static TaskHandle_t schedulerTaskHandle = NULL;
+
+static uint32_t NowTicks(void)
+{
+    return (uint32_t)((esp_timer_get_time() - startUs) / 1000 / TICK_MS);
+}
+
+static uint32_t MsToTicks(uint32_t ms)
+{
+    uint32_t ticks = (ms + TICK_MS - 1) / TICK_MS;
+    return ticks > 0 ? ticks : 1;
+}
+
+// Abstand in Slots der Ebene zwischen dem aktuellen Tick und expires
+static uint32_t LevelDistance(uint32_t expires, int level)
+{
+    int shift = level * WHEEL_BITS;
+
+    return ((expires >> shift) - (currentTick >> shift)) & (UINT32_MAX >> shift);
+}
+
+static void WheelInsert(SchedulerJob *job)
+{
+    int level = 0;
+
+    if (job->expires - currentTick > WHEEL_MAX_TICKS) {
+        job->expires = currentTick + WHEEL_MAX_TICKS;
+    }
+    // Die Ebene folgt aus den Slot-Grenzen, nicht aus dem Abstand: niedrigste Ebene, auf der
+    // expires weniger als eine Runde vor dem aktuellen Slot liegt. Auf der obersten Ebene
+    // kann es genau eine Runde sein, dann ist es der aktuelle Slot bei seinem nächsten
+    // Auflösen, und das ist genau der fällige Abschnitt
+    while (level < WHEEL_LEVELS - 1 && LevelDistance(job->expires, level) >= WHEEL_SLOTS) {
+        level++;
+    }
+
+    uint32_t slot = (job->expires >> (level * WHEEL_BITS)) & WHEEL_MASK;
+
+    job->prev = NULL;
+    job->next = wheel[level][slot];
+    if (job->next != NULL) {
+        job->next->prev = job;
+    }
+    wheel[level][slot] = job;
+    occupied[level] |= (1ULL << slot);
+    job->level = (uint8_t)level;
+    job->slot = (uint8_t)slot;
+    job->armed = true;
+}
+
+static void WheelRemove(SchedulerJob *job)
+{
+    if (!job->armed) {
+        return;
+    }
+
+    SchedulerJob **head = &wheel[job->level][job->slot];
+
+    if (job->prev != NULL) {
+        job->prev->next = job->next;
+    } else {
+        *head = job->next;
+    }
+    if (job->next != NULL) {
+        job->next->prev = job->prev;
+    }
+    if (*head == NULL) {
+        occupied[job->level] &= ~(1ULL << job->slot);
+    }
+    job->next = job->prev = NULL;
+    job->armed = false;
+}
+
+// Slot einer höheren Ebene auflösen und die Jobs neu einsortieren
+static void WheelCascade(int level, uint32_t slot)
+{
+    SchedulerJob *job = wheel[level][slot];
+
+    wheel[level][slot] = NULL;
+    occupied[level] &= ~(1ULL << slot);
+
+    while (job != NULL) {
+        SchedulerJob *next = job->next;
+        job->armed = false;
+        WheelInsert(job);
+        job = next;
+    }
+}
+
+// Nächster Start eines Cron-Jobs als Verzögerung in ms, 0 wenn die Uhrzeit unbekannt ist
+static uint32_t CronDelayMs(const SchedulerJob *job)
+{
+    time_t now = time(NULL);
+    struct tm timeInfo;
+
+    localtime_r(&now, &timeInfo);
+    if (timeInfo.tm_year < (2020 - 1900)) {
+        return 0;
+    }
+
+    time_t candidate = now - timeInfo.tm_sec + 60;
+
+    // Höchstens gut eine Woche durchsuchen, Stunden und Tage werden übersprungen
+    for (int i = 0; i < 8 * 24 + 60; i++) {
+        localtime_r(&candidate, &timeInfo);
+
+        if ((job->weekdays & (1 << timeInfo.tm_wday)) == 0) {
+            candidate += (time_t)(24 - timeInfo.tm_hour) * 3600 - timeInfo.tm_min * 60;
+            continue;
+        }
+        if (job->hour != SCHEDULER_ANY_HOUR && timeInfo.tm_hour != job->hour) {
+            candidate += 3600 - timeInfo.tm_min * 60;
+            continue;
+        }
+        if (timeInfo.tm_min != job->minute) {
+            candidate += (timeInfo.tm_min < job->minute) ? (job->minute - timeInfo.tm_min) * 60
+                                                          : (60 - timeInfo.tm_min) * 60;
+            continue;
+        }
+        return (uint32_t)(candidate - now) * 1000;
+    }
+    return 0;
+}
+
+static bool CronMatchesNow(const SchedulerJob *job)
+{
+    time_t now = time(NULL);
+    struct tm timeInfo;
+
+    localtime_r(&now, &timeInfo);
+    return timeInfo.tm_min == job->minute &&
+           (job->hour == SCHEDULER_ANY_HOUR || timeInfo.tm_hour == job->hour) &&
+           (job->weekdays & (1 << timeInfo.tm_wday)) != 0;
+}
+
+// Nach einem Lauf (oder beim Anlegen) den nächsten Termin setzen, Mutex muss gehalten werden
+static void JobArm(SchedulerJob *job, bool first, uint32_t firstDelayTicks)
+{
+    switch (job->type) {
+        case JOB_INTERVAL:
+            if (first) {
+                job->expires = currentTick + firstDelayTicks;
+            } else {
+                // Phase halten, verpasste Läufe nicht nachholen
+                uint32_t now = NowTicks();
+                do {
+                    job->expires += job->periodTicks;
+                } while ((int32_t)(job->expires - now) <= 0);
+            }
+            break;
+        case JOB_CRON: {
+            uint32_t delayMs = CronDelayMs(job);
+            job->expires = currentTick + MsToTicks(delayMs > 0 ? delayMs : CRON_RETRY_MS);
+            break;
+        }
+        default:
+            return;
+    }
+    WheelInsert(job);
+}
+
+static SchedulerJob *JobAlloc(JobType type, const char *name, SchedulerCallback callback, void *arg)
+{
+    SchedulerJob *job = NULL;
+
+    if (schedulerMutex == NULL || callback == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < CONFIG_SCHEDULER_MAX_JOBS; i++) {
+        if (jobs[i].type == JOB_FREE) {
+            job = &jobs[i];
+            break;
+        }
+    }
+    if (job == NULL) {
+        ESP_LOGE(TAG, "No free job slot for %s", name);
+        return NULL;
+    }
+    memset(job, 0, sizeof(*job));
+    job->type = type;
+    job->name = name;
+    job->callback = callback;
+    job->arg = arg;
+    return job;
+}
+
+static void JobFree(SchedulerJob *job)
+{
+    WheelRemove(job);
+    job->type = JOB_FREE;
+}
+
+SchedulerJob *SchedulerAddJob(const char *name, SchedulerCallback callback, void *arg)
+{
+    SchedulerJob *job;
+
+    xSemaphoreTake(schedulerMutex, portMAX_DELAY);
+    job = JobAlloc(JOB_MANUAL, name, callback, arg);
+    xSemaphoreGive(schedulerMutex);
+    return job;
+}
+
+SchedulerJob *SchedulerAddInterval(const char *name, uint32_t periodMs, uint32_t firstDelayMs,
+                                   SchedulerCallback callback, void *arg)
+{
+    SchedulerJob *job;
+
+    xSemaphoreTake(schedulerMutex, portMAX_DELAY);
+    job = JobAlloc(JOB_INTERVAL, name, callback, arg);
+    if (job != NULL) {
+        job->periodTicks = MsToTicks(periodMs);
+        JobArm(job, true, MsToTicks(firstDelayMs));
+    }
+    xSemaphoreGive(schedulerMutex);
+    xSemaphoreGive(schedulerWake);
+    return job;
+}
+
+SchedulerJob *SchedulerAddCron(const char *name, int minute, int hour, uint8_t weekdays,
+                               SchedulerCallback callback, void *arg)
+{
+    SchedulerJob *job;
+
+    if (minute < 0 || minute > 59 || hour < SCHEDULER_ANY_HOUR || hour > 23 || (weekdays & 0x7F) == 0) {
+        ESP_LOGE(TAG, "Invalid cron spec for %s", name);
+        return NULL;
+    }
+
+    xSemaphoreTake(schedulerMutex, portMAX_DELAY);
+    job = JobAlloc(JOB_CRON, name, callback, arg);
+    if (job != NULL) {
+        job->minute = (int8_t)minute;
+        job->hour = (int8_t)hour;
+        job->weekdays = weekdays & 0x7F;
+        JobArm(job, true, 0);
+    }
+    xSemaphoreGive(schedulerMutex);
+    xSemaphoreGive(schedulerWake);
+    return job;
+}
+
+void SchedulerTrigger(SchedulerJob *job)
+{
+    if (job == NULL) {
+        return;
+    }
+    xSemaphoreTake(schedulerMutex, portMAX_DELAY);
+    job->triggered = true;
+    xSemaphoreGive(schedulerMutex);
+    xSemaphoreGive(schedulerWake);
+}
+
+void SchedulerCancel(SchedulerJob *job)
+{
+    if (job == NULL) {
+        return;
+    }
+    xSemaphoreTake(schedulerMutex, portMAX_DELAY);
+    if (job->running) {
+        job->cancelled = true;
+    } else {
+        JobFree(job);
+    }
+    xSemaphoreGive(schedulerMutex);
+}
+
+static void RunJob(SchedulerJob *job)
+{
+    job->running = true;
+    xSemaphoreGive(schedulerMutex);
+
+    int64_t started = esp_timer_get_time();
+    job->callback(job->arg);
+    int64_t tookMs = (esp_timer_get_time() - started) / 1000;
+    if (tookMs > CONFIG_SCHEDULER_SLOW_JOB_MS) {
+        ESP_LOGW(TAG, "Job %s took %" PRId64 " ms", job->name, tookMs);
+    }
+
+    xSemaphoreTake(schedulerMutex, portMAX_DELAY);
+    job->running = false;
+}
+
+// Rad bis zum aktuellen Tick weiterdrehen und fällige Jobs ausführen, Mutex wird gehalten
+static void SchedulerAdvance(uint32_t target)
+{
+    while ((int32_t)(target - currentTick) > 0) {
+        currentTick++;
+
+        uint32_t slot0 = currentTick & WHEEL_MASK;
+        // Bei Überlauf einer Ebene den passenden Slot der nächsten Ebene auflösen
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if ((currentTick & ((1UL << (level * WHEEL_BITS)) - 1)) != 0) {
+                break;
+            }
+            WheelCascade(level, (currentTick >> (level * WHEEL_BITS)) & WHEEL_MASK);
+        }
+
+        while (wheel[0][slot0] != NULL) {
+            SchedulerJob *job = wheel[0][slot0];
+            WheelRemove(job);
+
+            if (job->type == JOB_CRON && !CronMatchesNow(job)) {
+                // Uhr wurde verstellt oder war noch nicht gesetzt
+                JobArm(job, false, 0);
+                continue;
+            }
+
+            job->triggered = false;
+            RunJob(job);
+
+            if (job->cancelled) {
+                JobFree(job);
+            } else {
+                JobArm(job, false, 0);
+            }
+        }
+    }
+}
+
+static void RunTriggeredJobs(void)
+{
+    for (int i = 0; i < CONFIG_SCHEDULER_MAX_JOBS; i++) {
+        SchedulerJob *job = &jobs[i];
+
+        if (job->type == JOB_FREE || !job->triggered) {
+            continue;
+        }
+        job->triggered = false;
+        RunJob(job);
+        if (job->cancelled) {
+            JobFree(job);
+        }
+    }
+}
+
+// Ticks bis zum nächsten belegten Slot der Ebene 0 oder bis zum nächsten Überlauf
+static uint32_t TicksUntilNextEvent(void)
+{
+    uint32_t slot = currentTick & WHEEL_MASK;
+    uint32_t untilWrap = WHEEL_SLOTS - slot;
+    uint64_t ahead = (slot == WHEEL_MASK) ? 0 : (occupied[0] >> (slot + 1));
+
+    if (ahead != 0) {
+        return (uint32_t)__builtin_ctzll(ahead) + 1;
+    }
+    return untilWrap;
+}
+
+static void SchedulerTask(void *pvParameters)
+{
+    while (1)
+    {
+        xSemaphoreTake(schedulerMutex, portMAX_DELAY);
+        RunTriggeredJobs();
+        SchedulerAdvance(NowTicks());
+        uint32_t sleepTicks = TicksUntilNextEvent();
+        xSemaphoreGive(schedulerMutex);
+
+        xSemaphoreTake(schedulerWake, pdMS_TO_TICKS(sleepTicks * TICK_MS));
+    }
+}
+
+// Freier Stack des Workers in Bytes, alle Jobs teilen ihn
+static int32_t SampleSchedulerStack(void)
+{
+    return schedulerTaskHandle != NULL ? (int32_t)uxTaskGetStackHighWaterMark(schedulerTaskHandle) : 0;
+}
+
+METRIC_GAUGE_SAMPLED(schedulerStackMetric, "stack.scheduler", SampleSchedulerStack);
+
+void StartScheduler(void)
+{
+    if (schedulerTaskHandle != NULL) {
+        return;
+    }
+
+    startUs = esp_timer_get_time();
+    schedulerMutex = xSemaphoreCreateMutex();
+    schedulerWake = xSemaphoreCreateBinary();
+    configASSERT(schedulerMutex != NULL && schedulerWake != NULL);
+
+    xTaskCreate(SchedulerTask, "Scheduler", SchedulerTaskStackSize, NULL, SchedulerTaskPriority, &schedulerTaskHandle);
+    MetricRegister(&schedulerStackMetric);
+}
@@ -0,0 +1,45 @@
+/*
+ * Scheduler.h
+ *
+ *  Gemeinsamer Scheduler für periodische und uhrzeitgesteuerte Aufgaben.
+ *  Alle Callbacks laufen nacheinander auf einem einzigen Worker-Task.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef MAIN_SCHEDULER_H_
+#define MAIN_SCHEDULER_H_
+
+// Wochentage für Cron-Jobs, Bit 0 = Sonntag wie tm_wday
+#define SCHEDULER_EVERY_DAY     0x7F
+#define SCHEDULER_WEEKDAYS      0x3E
+#define SCHEDULER_ANY_HOUR      (-1)
+
+typedef void (*SchedulerCallback)(void *arg);
+
+typedef struct SchedulerJob SchedulerJob;
+
+// Startet den Worker-Task, mehrfacher Aufruf ist unschädlich
+void StartScheduler(void);
+
+// Job, der nur per SchedulerTrigger() läuft
+SchedulerJob *SchedulerAddJob(const char *name, SchedulerCallback callback, void *arg);
+
+// Job im festen Abstand auf der monotonen Zeitbasis
+//@param firstDelayMs Verzögerung bis zum ersten Lauf
+SchedulerJob *SchedulerAddInterval(const char *name, uint32_t periodMs, uint32_t firstDelayMs,
+                                   SchedulerCallback callback, void *arg);
+
+// Job zur lokalen Uhrzeit (nach SNTP), z.B. für Wartungsfenster
+//@param hour 0-23 oder SCHEDULER_ANY_HOUR
+//@param weekdays Bitmaske der Wochentage, Bit 0 = Sonntag
+SchedulerJob *SchedulerAddCron(const char *name, int minute, int hour, uint8_t weekdays,
+                               SchedulerCallback callback, void *arg);
+
+// Lässt den Job so bald wie möglich laufen, der normale Takt bleibt erhalten
+void SchedulerTrigger(SchedulerJob *job);
+
+// Entfernt den Job, ein laufender Callback wird noch beendet
+void SchedulerCancel(SchedulerJob *job);
+
+#endif /* MAIN_SCHEDULER_H_ */
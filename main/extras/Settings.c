@@ -0,0 +1,266 @@
+/*
+ * Settings.c
+ *
+ *  Settings-Cache im NVS mit Hash, siehe Settings.h
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include "Settings.h"
+#include "Json.h"
+#include "CborMessages.h"
+#include "BootProfile.h"
+#include "Piepser.h"
+#include "ledStrip.h"
+#include "NFC.h"
+
+static const char* TAG = "Settings";
+
+#define NVS_NAMESPACE       "settings"
+#define NVS_KEY_DOC         "doc"
+#define NVS_KEY_HASH        "hash"
+#define NVS_KEY_VERSION     "version"
+
+// Bei Änderungen an LudoSettings oder am Dokumentformat erhöhen, alte Caches werden dann verworfen
+#define SETTINGS_CACHE_VERSION  2
+#define SETTINGS_MAX_DOC_LEN    1024
+
+// Aktueller, vorheriger und ein freier Slot, damit ein noch gelesener Stand nicht überschrieben wird
+#define SNAPSHOT_SLOTS          3
+
+// Werkseinstellung bis zum ersten Dokument
+#define DEFAULT_SCAN_FREQ       500
+#define DEFAULT_ACCESS_FREQ     1500
+#define DEFAULT_NOACCESS_FREQ   1000
+
+static LudoSettings current;
+static uint32_t currentHash = 0;
+static bool bHaveCurrent = false;
+
+// Nur der schreibende Task (Boot, dann Settings-Job) verändert Slots, die nicht aktuell sind
+static SettingsSnapshot snapshots[SNAPSHOT_SLOTS] = {
+    [0] = {
+        .useBuzzer = true,
+        .scanSound = { .count = 1, .tones = { { DEFAULT_SCAN_FREQ, SOUND_BEEP_MS, 0 } } },
+        .accessSound = { .count = 1, .tones = { { DEFAULT_ACCESS_FREQ, SOUND_BEEP_MS, 0 } } },
+        .noAccessSound = { .count = 1, .tones = { { DEFAULT_NOACCESS_FREQ, SOUND_BEEP_MS, 0 } } },
+        .useRgbLed = true,
+    },
+};
+static _Atomic uint32_t snapshotRefs[SNAPSHOT_SLOTS];
+static _Atomic uint32_t currentSlot = 0;
+static _Atomic uint32_t currentVersion = 0;
+
+// FNV-1a, reicht zum Erkennen von Änderungen und beschädigten Einträgen
+static uint32_t SettingsHash(const char *document, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)document[i];
+        hash *= 16777619u;
+    }
+    // 0 steht für "kein Dokument"
+    return hash != 0 ? hash : 1;
+}
+
+const SettingsSnapshot *SettingsAcquire(void)
+{
+    for (;;) {
+        uint32_t slot = atomic_load(&currentSlot);
+
+        atomic_fetch_add(&snapshotRefs[slot], 1);
+        // Nur gültig, wenn der Slot nach dem Zählen noch aktuell ist, sonst wird er evtl. gerade neu beschrieben
+        if (slot == atomic_load(&currentSlot)) {
+            return &snapshots[slot];
+        }
+        atomic_fetch_sub(&snapshotRefs[slot], 1);
+    }
+}
+
+void SettingsRelease(const SettingsSnapshot *snapshot)
+{
+    if (snapshot != NULL) {
+        atomic_fetch_sub(&snapshotRefs[snapshot - snapshots], 1);
+    }
+}
+
+uint32_t SettingsGetVersion(void)
+{
+    return atomic_load(&currentVersion);
+}
+
+// Sucht einen Slot, der weder aktuell ist noch gelesen wird. Leser halten nur kurz, daher kurz warten
+static uint32_t SnapshotReserve(void)
+{
+    for (;;) {
+        uint32_t active = atomic_load(&currentSlot);
+
+        for (uint32_t i = 0; i < SNAPSHOT_SLOTS; i++) {
+            if (i != active && atomic_load(&snapshotRefs[i]) == 0) {
+                return i;
+            }
+        }
+        vTaskDelay(1);
+    }
+}
+
+static void ParseColor(const char *hex, rgb_t *out, const char *name)
+{
+    if (!RgbLedParseColor(hex, out)) {
+        ESP_LOGW(TAG, "Ungültige Farbe für %s: %s", name, hex);
+    }
+}
+
+// Baut den kompletten Stand aus dem Dokument und schaltet ihn atomar um
+static void SettingsPublish(const LudoSettings *next, uint32_t hash)
+{
+    uint32_t previous = atomic_load(&currentSlot);
+    uint32_t slot = SnapshotReserve();
+    SettingsSnapshot *snapshot = &snapshots[slot];
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->version = snapshots[previous].version + 1;
+    snapshot->hash = hash;
+
+    snapshot->useBuzzer = next->useBuzzer;
+    SoundBuildSequence(next->beepOnScan, next->patternOnScan, &snapshot->scanSound);
+    SoundBuildSequence(next->beepOnValidScan, next->patternOnValidScan, &snapshot->accessSound);
+    SoundBuildSequence(next->beepOnInvalidScan, next->patternOnInvalidScan, &snapshot->noAccessSound);
+
+    snapshot->useRgbLed = next->useRgbLed;
+    ParseColor(next->colorOnScan, &snapshot->scanColor, "Scanning");
+    ParseColor(next->colorOnValidScan, &snapshot->accessColor, "Access");
+    ParseColor(next->colorOnInvalidScan, &snapshot->noAccessColor, "NoAccess");
+
+#if CONFIG_CBOR_MESSAGES
+    snapshot->wireCbor = next->wireCbor;
+#endif
+
+    atomic_store(&currentSlot, slot);
+    atomic_store(&currentVersion, snapshot->version);
+    ESP_LOGI(TAG, "Settings version %" PRIu32 " published", snapshot->version);
+}
+
+// Veröffentlicht den neuen Snapshot, die NFC-Abfrage wird nur bei Änderung neu gesetzt, previous NULL = alle
+static void SettingsApply(const LudoSettings *next, const LudoSettings *previous, uint32_t hash)
+{
+    SettingsPublish(next, hash);
+
+    if (previous == NULL || next->nfcPollMaxIdleMs != previous->nfcPollMaxIdleMs ||
+        next->nfcBusinessStart != previous->nfcBusinessStart ||
+        next->nfcBusinessEnd != previous->nfcBusinessEnd) {
+        NFC_ChangePollSettings(next->nfcPollMaxIdleMs, next->nfcBusinessStart, next->nfcBusinessEnd);
+    }
+}
+
+// Die Cloud schickt JSON oder, nach Aushandlung, CBOR. Beides wird so auch gespeichert
+static bool SettingsParse(const char *document, size_t len, LudoSettings *settings)
+{
+    if (CborIsMessage(document, len)) {
+        return CborParseSettings(document, len, settings);
+    }
+    return JsonParseSettings(document, len, settings);
+}
+
+static void SettingsStore(const char *document, size_t len, uint32_t hash)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return;
+    }
+
+    // Hash zuletzt, ein abgebrochener Schreibvorgang fällt beim Laden über den Hash auf
+    err = nvs_set_blob(handle, NVS_KEY_DOC, document, len);
+    if (err == ESP_OK) {
+        err = nvs_set_u32(handle, NVS_KEY_VERSION, SETTINGS_CACHE_VERSION);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u32(handle, NVS_KEY_HASH, hash);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store settings: %s", esp_err_to_name(err));
+    }
+    nvs_close(handle);
+}
+
+bool SettingsLoadCached(void)
+{
+    static char document[SETTINGS_MAX_DOC_LEN];
+    size_t len = sizeof(document);
+    uint32_t version = 0, hash = 0;
+    nvs_handle_t handle;
+    LudoSettings settings;
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        ESP_LOGI(TAG, "No cached settings");
+        return false;
+    }
+
+    bool ok = nvs_get_u32(handle, NVS_KEY_VERSION, &version) == ESP_OK &&
+              nvs_get_u32(handle, NVS_KEY_HASH, &hash) == ESP_OK &&
+              nvs_get_blob(handle, NVS_KEY_DOC, document, &len) == ESP_OK;
+    nvs_close(handle);
+
+    if (!ok || version != SETTINGS_CACHE_VERSION || SettingsHash(document, len) != hash) {
+        ESP_LOGW(TAG, "Cached settings missing or outdated, waiting for the cloud");
+        return false;
+    }
+
+    if (!SettingsParse(document, len, &settings)) {
+        return false;
+    }
+
+    SettingsApply(&settings, NULL, hash);
+    current = settings;
+    currentHash = hash;
+    bHaveCurrent = true;
+    BootProfileMark(BOOT_STAGE_SETTINGS_CACHED);
+    ESP_LOGI(TAG, "Cached settings %08" PRIx32 " applied", hash);
+    return true;
+}
+
+void SettingsUpdate(const char *document, size_t len)
+{
+    LudoSettings settings;
+    uint32_t hash = SettingsHash(document, len);
+
+    if (bHaveCurrent && hash == currentHash) {
+        ESP_LOGI(TAG, "Settings %08" PRIx32 " unchanged", hash);
+        return;
+    }
+
+    // Ungültige oder abgeschnittene Dokumente werden weder angewendet noch gespeichert
+    if (!SettingsParse(document, len, &settings)) {
+        return;
+    }
+
+    SettingsApply(&settings, bHaveCurrent ? &current : NULL, hash);
+    current = settings;
+    currentHash = hash;
+    bHaveCurrent = true;
+
+    if (len <= SETTINGS_MAX_DOC_LEN) {
+        SettingsStore(document, len, hash);
+    } else {
+        ESP_LOGW(TAG, "Settings document too large to cache (%u bytes)", (unsigned)len);
+    }
+}
+
+uint32_t SettingsGetHash(void)
+{
+    return bHaveCurrent ? currentHash : 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * Settings.h
+ *
+ *  Zuletzt angewendetes Settings-Dokument im NVS. Beim Boot wird es sofort
+ *  angewendet, damit der Reader ohne Cloud-Antwort arbeitet. Die Antwort der
+ *  Cloud wird danach abgeglichen und nur geänderte Gruppen neu gesetzt.
+ *
+ *  Die Werte für Ton und LED liegen in einem unveränderlichen Snapshot. Ein
+ *  neues Dokument erzeugt einen neuen Snapshot, der per atomarem Umschalten
+ *  veröffentlicht wird. Leser halten kurz eine Referenz und sehen so immer
+ *  einen vollständigen Stand, ohne Lock.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <led_strip.h>
+#include "Piepser.h"
+
+#ifndef MAIN_SETTINGS_H_
+#define MAIN_SETTINGS_H_
+
+// Ein veröffentlichter Stand, wird nach dem Umschalten nie mehr verändert
+typedef struct {
+    uint32_t version;           // zählt pro Veröffentlichung hoch, 0 = Werkseinstellung
+    uint32_t hash;              // Hash des Dokuments, 0 = Werkseinstellung
+    bool useBuzzer;
+    SoundSequence scanSound;
+    SoundSequence accessSound;
+    SoundSequence noAccessSound;
+    bool useRgbLed;
+    rgb_t scanColor;
+    rgb_t accessColor;
+    rgb_t noAccessColor;
+    bool wireCbor;              // Zugangsanfragen als CBOR statt JSON, siehe CborMessages.h
+} SettingsSnapshot;
+
+// Lädt das gespeicherte Dokument und wendet es an, erst nach nvs_flash_init() aufrufen
+//@return false wenn kein gültiges Dokument gespeichert ist
+bool SettingsLoadCached(void);
+
+// Neues Dokument aus der Cloud: bei gleichem Hash passiert nichts, sonst werden
+// die geänderten Gruppen angewendet und das Dokument gespeichert
+void SettingsUpdate(const char *document, size_t len);
+
+// Hash des aktuell angewendeten Dokuments, 0 wenn noch keins angewendet wurde
+uint32_t SettingsGetHash(void);
+
+// Version des aktuellen Snapshots, für Health- und Boot-Berichte
+uint32_t SettingsGetVersion(void);
+
+// Referenz auf den aktuellen Snapshot, blockiert nie. Nur kurz halten und
+// immer mit SettingsRelease() zurückgeben, sonst kann der Slot nicht wiederverwendet werden
+const SettingsSnapshot *SettingsAcquire(void);
+
+void SettingsRelease(const SettingsSnapshot *snapshot);
+
+#endif /* MAIN_SETTINGS_H_ */
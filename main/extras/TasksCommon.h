@@ -18,11 +18,6 @@
 #define PrintTaskPriority						3
 #define PrintTaskCoreID							1
 
-//SNTP Time Task
-#define SNTPTaskStackSize						4096
-#define SNTPTaskPriority						2
-#define SNTPTaskCoreID							1
-
 //OTA Task
 #define OTATaskStackSize						8192
 #define OTATaskPriority						    8
@@ -35,16 +30,16 @@
 #define HasAccessTaskStackSize					3072
 #define HasAccessTaskPriority				    7
 
-//Settings Task
-#define SettingsTaskStackSize					4096
-#define SettingsTaskPriority				    7
+//Scheduler Worker Task, führt SNTP, Resource Monitor, Settings und Temperatur-Demo aus
+#define SchedulerTaskStackSize					4096
+#define SchedulerTaskPriority					4
+
+//Startup Task, lädt die Credentials parallel zu NVS und Ethernet
+#define StartupTaskStackSize					3072
+#define StartupTaskPriority						5
 
 //Scanning Task
 #define ScanningTaskStackSize					2048
 #define ScanningTaskPriority					7
 
-//MakeSound Task
-#define MakeSoundTaskStackSize					4096
-#define MakeSoundTaskPriority				    7
-
 #endif /* MAIN_TASKSCOMMON_H_ */
@@ -0,0 +1,189 @@
+/*
+ * Timestamp.c
+ *
+ *  Monotone Zeitbasis mit UTC-Offset und Slew-Korrektur, siehe Timestamp.h
+ */
+#include <stdatomic.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "Timestamp.h"
+
+static const char TAG[] = "timestamp";
+
+#define NVS_NAMESPACE   "timestamp"
+#define NVS_KEY_BOOT    "boots"
+
+// Ab dieser Abweichung wird der Offset direkt gesetzt statt eingeschwenkt
+#define STEP_THRESHOLD_US   1000000LL
+// 500 ppm: pro 2000 us monotoner Zeit wird 1 us korrigiert
+#define SLEW_DIVISOR        2000
+
+// Mindestzeit, ab der die SNTP-Zeit als gültig gilt (01.01.2016)
+#define MIN_VALID_UTC_S     1451606400LL
+
+static uint32_t bootCount = 0;
+
+// Offset zur UTC-Zeit: utc = mono + baseOffsetUs + Slew-Anteil
+// Einziger Schreiber ist der SNTP-Callback, Leser nutzen den Sequenzzähler
+static _Atomic uint32_t seq = 0;
+static bool hasUtc = false;
+static int64_t baseOffsetUs = 0;
+static int64_t slewTotalUs = 0;
+static int64_t slewStartUs = 0;
+
+void TimestampInit(void)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return;
+    }
+
+    uint32_t stored = 0;
+    // Beim allerersten Start gibt es den Schlüssel noch nicht
+    nvs_get_u32(handle, NVS_KEY_BOOT, &stored);
+    bootCount = stored + 1;
+
+    err = nvs_set_u32(handle, NVS_KEY_BOOT, bootCount);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store boot count: %s", esp_err_to_name(err));
+    }
+    nvs_close(handle);
+
+    ESP_LOGI(TAG, "Boot %" PRIu32, bootCount);
+}
+
+uint32_t TimestampBootCount(void)
+{
+    return bootCount;
+}
+
+int64_t TimestampMonoUs(void)
+{
+    return esp_timer_get_time();
+}
+
+Timestamp TimestampNow(void)
+{
+    Timestamp now = { .boot = bootCount, .monoUs = esp_timer_get_time() };
+    return now;
+}
+
+int TimestampCompare(const Timestamp *a, const Timestamp *b)
+{
+    if (a->boot != b->boot) {
+        return a->boot < b->boot ? -1 : 1;
+    }
+    if (a->monoUs != b->monoUs) {
+        return a->monoUs < b->monoUs ? -1 : 1;
+    }
+    return 0;
+}
+
+// Offset zum Zeitpunkt monoUs, der Slew wird linear bis slewTotalUs aufgebaut
+static int64_t OffsetAt(int64_t monoUs, int64_t base, int64_t slewTotal, int64_t slewStart)
+{
+    int64_t applied = (monoUs - slewStart) / SLEW_DIVISOR;
+
+    if (applied < 0) {
+        applied = 0;
+    }
+    if (slewTotal >= 0) {
+        return base + (applied < slewTotal ? applied : slewTotal);
+    }
+    return base - (applied < -slewTotal ? applied : -slewTotal);
+}
+
+bool TimestampHasUtc(void)
+{
+    return hasUtc;
+}
+
+int64_t TimestampToUtcUs(int64_t monoUs)
+{
+    uint32_t start;
+    bool valid;
+    int64_t base, slewTotal, slewStart;
+
+    do {
+        start = atomic_load_explicit(&seq, memory_order_acquire);
+        valid = hasUtc;
+        base = baseOffsetUs;
+        slewTotal = slewTotalUs;
+        slewStart = slewStartUs;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((start & 1) || start != atomic_load_explicit(&seq, memory_order_relaxed));
+
+    if (!valid) {
+        return 0;
+    }
+    return monoUs + OffsetAt(monoUs, base, slewTotal, slewStart);
+}
+
+int64_t TimestampUtcUs(void)
+{
+    return TimestampToUtcUs(esp_timer_get_time());
+}
+
+void TimestampSync(int64_t utcUs, int64_t monoUs)
+{
+    if (utcUs < MIN_VALID_UTC_S * 1000000LL) {
+        ESP_LOGW(TAG, "Ignoring invalid sync time");
+        return;
+    }
+
+    int64_t target = utcUs - monoUs;
+    int64_t current = hasUtc ? OffsetAt(monoUs, baseOffsetUs, slewTotalUs, slewStartUs) : 0;
+    int64_t error = target - current;
+
+    atomic_fetch_add_explicit(&seq, 1, memory_order_acq_rel);
+    atomic_thread_fence(memory_order_release);
+
+    bool step = !hasUtc || error > STEP_THRESHOLD_US || error < -STEP_THRESHOLD_US;
+
+    if (step) {
+        // Erster Sync oder zu große Abweichung: Offset direkt setzen
+        baseOffsetUs = target;
+        slewTotalUs = 0;
+        hasUtc = true;
+    } else {
+        // Ab jetzt vom aktuellen Offset aus einschwenken, die UTC-Zeit bleibt monoton
+        baseOffsetUs = current;
+        slewTotalUs = error;
+    }
+    slewStartUs = monoUs;
+
+    atomic_fetch_add_explicit(&seq, 1, memory_order_release);
+
+    if (step) {
+        ESP_LOGI(TAG, "SNTP sync, time set");
+    } else {
+        ESP_LOGI(TAG, "SNTP sync, slewing %lld us", (long long)error);
+    }
+}
+
+size_t TimestampFormat(int64_t utcUs, char *buffer, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+    buffer[0] = '\0';
+
+    time_t seconds = (time_t)(utcUs / 1000000);
+    if (seconds < MIN_VALID_UTC_S) {
+        return 0;
+    }
+
+    struct tm timeInfo;
+    localtime_r(&seconds, &timeInfo);
+    return strftime(buffer, len, "%d.%m.%Y %H:%M:%S", &timeInfo);
+}
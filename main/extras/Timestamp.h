@@ -0,0 +1,51 @@
+/*
+ * Timestamp.h
+ *
+ *  Zeitstempel-Dienst: monotone 64-bit Mikrosekunden seit Boot plus ein
+ *  UTC-Offset, der bei jedem SNTP-Sync nachgeführt wird. Kleine Abweichungen
+ *  werden langsam eingeschwenkt (Slew), damit die UTC-Zeit nie springt.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAIN_TIMESTAMP_H_
+#define MAIN_TIMESTAMP_H_
+
+// Zeitpunkt eines Ereignisses, über Reboots hinweg sortierbar (erst boot, dann monoUs)
+typedef struct {
+    uint32_t boot;      // Boot-Zähler aus dem NVS
+    int64_t monoUs;     // esp_timer_get_time() beim Ereignis
+} Timestamp;
+
+// Liest und erhöht den Boot-Zähler, erst nach nvs_flash_init() aufrufen
+void TimestampInit(void);
+
+uint32_t TimestampBootCount(void);
+
+// Monotone Zeit seit Boot, springt nie
+int64_t TimestampMonoUs(void);
+
+// Für den Hot Path: nur Boot-Zähler und Timer lesen, umgerechnet wird später
+Timestamp TimestampNow(void);
+
+// <0, 0, >0 wie strcmp, Reihenfolge auch über Reboots
+int TimestampCompare(const Timestamp *a, const Timestamp *b);
+
+// true nach dem ersten SNTP-Sync in diesem Boot
+bool TimestampHasUtc(void);
+
+// Rechnet eine monotone Zeit dieses Boots in UTC-Mikrosekunden um
+//@return 0 solange noch kein Sync erfolgt ist
+int64_t TimestampToUtcUs(int64_t monoUs);
+
+int64_t TimestampUtcUs(void);
+
+// Neuer Referenzpunkt vom SNTP, große Abweichungen werden gesetzt, kleine eingeschwenkt
+void TimestampSync(int64_t utcUs, int64_t monoUs);
+
+// Formatiert UTC-Mikrosekunden als lokale Zeit "dd.mm.yyyy HH:MM:SS"
+//@return Länge des Strings, 0 wenn die Zeit nicht gültig ist
+size_t TimestampFormat(int64_t utcUs, char *buffer, size_t len);
+
+#endif /* MAIN_TIMESTAMP_H_ */
@@ -1,35 +1,40 @@
 #include "app_state.h"
-#include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
-#include "ledStrip.h"
+#include <stdatomic.h>
 
-// Globale Variable für den App-Zustand
-static LedAppState ledState;
-static SemaphoreHandle_t appStateMutex = NULL;
+// Der komplette LED-Zustand wird in ein 32-Bit-Wort gepackt und atomar veröffentlicht:
+//   Bit  0..23  Farbe (r << 16 | g << 8 | b)
+//   Bit 24      isScanning
+//   Bit 25      hasAccess
+//   Bit 28..31  appState + 1 (APP_STATE_IDLE = -1 wird zu 0)
+// Schreiber nehmen keinen Mutex und können so keine Prioritätsinversion beim LED-
+// oder NFC-Task auslösen. Die LED liest den Zustand aus ihrer Event-Queue, nicht von hier.
+#define APP_STATE_COLOR_MASK    0x00FFFFFFu
+#define APP_STATE_SCANNING_BIT  (1u << 24)
+#define APP_STATE_ACCESS_BIT    (1u << 25)
+#define APP_STATE_STATE_SHIFT   28
 
-void InitAppState(void) {
-    if (appStateMutex == NULL) {
-        appStateMutex = xSemaphoreCreateMutex(); // Erstelle den Mutex
+static _Atomic uint32_t ulPackedState = 0;
+
+static uint32_t PackState(AppState state, rgb_t color, bool scanning, bool access) {
+    uint32_t packed = ((uint32_t)color.r << 16) | ((uint32_t)color.g << 8) | (uint32_t)color.b;
+
+    if (scanning) {
+        packed |= APP_STATE_SCANNING_BIT;
     }
+    if (access) {
+        packed |= APP_STATE_ACCESS_BIT;
+    }
+    packed |= ((uint32_t)(state + 1) & 0x0Fu) << APP_STATE_STATE_SHIFT;
 
-    ledState.appState = APP_STATE_IDLE;
-    ledState.currentColor = colors[0];
-    ledState.isScanning = false;
-    ledState.hasAccess = false;
+    return packed;
 }
 
-void UpdateAppState(AppState newState, rgb_t newColor, bool scanning, bool access) {
-    xSemaphoreTake(appStateMutex, portMAX_DELAY);
-    ledState.appState = newState;
-    ledState.currentColor = newColor;
-    ledState.isScanning = scanning;
-    ledState.hasAccess = access;
-    xSemaphoreGive(appStateMutex);
+void InitAppState(void) {
+    rgb_t black = { .r = 0, .g = 0, .b = 0 };
+
+    atomic_store(&ulPackedState, PackState(APP_STATE_IDLE, black, false, false));
 }
 
-AppState GetAppState(void) {
-    xSemaphoreTake(appStateMutex, portMAX_DELAY);
-    AppState currentState = ledState.appState;
-    xSemaphoreGive(appStateMutex);
-    return currentState;
-}
\ No newline at end of file
+void UpdateAppState(AppState newState, rgb_t newColor, bool scanning, bool access) {
+    atomic_store(&ulPackedState, PackState(newState, newColor, scanning, access));
+}
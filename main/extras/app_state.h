@@ -1,6 +1,8 @@
 #ifndef APP_STATE_H
 #define APP_STATE_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "led_strip.h"
 
 // Enum zur Beschreibung der möglichen Anwendungszustände
@@ -31,7 +33,4 @@ void InitAppState(void);
 // Setzt den App-Zustand
 void UpdateAppState(AppState newState, rgb_t newColor, bool scanning, bool access);
 
-// Gibt den aktuellen Zustand zurück
-AppState GetAppState(void);
-
 #endif // APP_STATE_H
\ No newline at end of file
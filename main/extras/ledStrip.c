@@ -5,26 +5,98 @@
  *      Author: macra
  */
 #include <stdbool.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <stdio.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "TasksCommon.h"
 #include <led_strip.h>
 #include "ledStrip.h"
 #include "app_state.h"
+#include "Settings.h"
+#include "Metrics.h"
 
-#include <math.h>
-
-bool bUseRgbLed = true;
-
-rgb_t scanning_color, access_color, no_access_color;
+// Zur Build-Zeit von tools/gen_led_tables.py erzeugte Gamma- und Keyframe-Tabellen
+#include "led_tables.h"
 
 static const char* TAG = "LED_CONTROL";
 
+//Define Colors
+const rgb_t colors[64] = {
+	{ .r = 0x00, .g = 0x00, .b = 0x00 }, // 0 Black
+    { .r = 0x80, .g = 0x00, .b = 0x00 }, // 1 Dark Red
+    { .r = 0xFF, .g = 0x00, .b = 0x00 }, // 2 Red
+    { .r = 0x80, .g = 0x40, .b = 0x00 }, // 3 Dark Orange
+    { .r = 0xFF, .g = 0x80, .b = 0x00 }, // 4 Orange
+    { .r = 0xFF, .g = 0xFF, .b = 0x00 }, // 5 Yellow
+    { .r = 0x80, .g = 0xFF, .b = 0x00 }, // 6 Light Green-Yellow
+    { .r = 0x00, .g = 0xFF, .b = 0x00 }, // 7 Green
+    { .r = 0x00, .g = 0x80, .b = 0x00 }, // 8 Dark Green
+    { .r = 0x00, .g = 0x80, .b = 0x40 }, // 9 Dark Turquoise
+    { .r = 0x00, .g = 0xFF, .b = 0x80 }, // 10 Turquoise
+    { .r = 0x00, .g = 0xFF, .b = 0xFF }, // 11 Cyan
+    { .r = 0x00, .g = 0x80, .b = 0xFF }, // 12 Light Blue
+    { .r = 0x00, .g = 0x00, .b = 0xFF }, // 13 Blue
+    { .r = 0x00, .g = 0x00, .b = 0x80 }, // 14 Dark Blue
+    { .r = 0x40, .g = 0x00, .b = 0x80 }, // 15 Violet
+    { .r = 0x80, .g = 0x00, .b = 0xFF }, // 16 Purple
+    { .r = 0xFF, .g = 0x00, .b = 0xFF }, // 17 Magenta
+    { .r = 0xFF, .g = 0x00, .b = 0x80 }, // 18 Hot Pink
+    { .r = 0xFF, .g = 0x40, .b = 0x80 }, // 19 Light Pink
+    { .r = 0x80, .g = 0x00, .b = 0x40 }, // 20 Dark Pink
+    { .r = 0xFF, .g = 0x80, .b = 0x80 }, // 21 Peach
+    { .r = 0x80, .g = 0x40, .b = 0x40 }, // 22 Dark Peach
+    { .r = 0xFF, .g = 0xA5, .b = 0x00 }, // 23 Orange-Red
+    { .r = 0xFF, .g = 0xC0, .b = 0x00 }, // 24 Gold
+    { .r = 0xFF, .g = 0xE0, .b = 0x00 }, // 25 Light Yellow
+    { .r = 0x80, .g = 0x80, .b = 0x00 }, // 26 Olive
+    { .r = 0x80, .g = 0xFF, .b = 0x80 }, // 27 Light Green
+    { .r = 0x40, .g = 0x80, .b = 0x40 }, // 28 Forest Green
+    { .r = 0x80, .g = 0x80, .b = 0x80 }, // 29 Gray
+    { .r = 0xC0, .g = 0xC0, .b = 0xC0 }, // 30 Silver
+    { .r = 0xFF, .g = 0xFF, .b = 0xFF }, // 31 White
+    { .r = 0x80, .g = 0x00, .b = 0x80 }, // 32 Dark Purple
+    { .r = 0x00, .g = 0x40, .b = 0x40 }, // 33 Dark Cyan
+    { .r = 0x00, .g = 0x80, .b = 0x80 }, // 34 Teal
+    { .r = 0x40, .g = 0xFF, .b = 0xFF }, // 35 Light Cyan
+    { .r = 0x40, .g = 0xFF, .b = 0x80 }, // 36 Spring Green
+    { .r = 0x80, .g = 0xFF, .b = 0xC0 }, // 37 Pale Green
+    { .r = 0xC0, .g = 0xFF, .b = 0x80 }, // 38 Light Lime
+    { .r = 0xFF, .g = 0xFF, .b = 0x80 }, // 39 Light Yellow-Green
+    { .r = 0xFF, .g = 0x80, .b = 0xFF }, // 40 Light Magenta
+    { .r = 0x80, .g = 0x40, .b = 0xFF }, // 41 Indigo
+    { .r = 0x40, .g = 0x40, .b = 0x80 }, // 42 Midnight Blue
+    { .r = 0x80, .g = 0x80, .b = 0x40 }, // 43 Olive Drab
+    { .r = 0xC0, .g = 0x80, .b = 0x00 }, // 44 Dark Orange
+    { .r = 0x40, .g = 0x40, .b = 0x00 }, // 45 Dark Olive
+    { .r = 0x80, .g = 0x40, .b = 0x00 }, // 46 Saddle Brown
+    { .r = 0xFF, .g = 0x80, .b = 0x40 }, // 47 Coral
+    { .r = 0xFF, .g = 0xC0, .b = 0xC0 }, // 48 Light Pink
+    { .r = 0x40, .g = 0x00, .b = 0x40 }, // 49 Dark Violet
+    { .r = 0xFF, .g = 0x40, .b = 0xC0 }, // 50 Fuchsia
+    { .r = 0xFF, .g = 0x00, .b = 0xC0 }, // 51 Deep Pink
+    { .r = 0xC0, .g = 0x00, .b = 0xC0 }, // 52 Dark Magenta
+    { .r = 0x40, .g = 0x00, .b = 0xC0 }, // 53 Royal Purple
+    { .r = 0x00, .g = 0x40, .b = 0xFF }, // 54 Dodger Blue
+    { .r = 0x00, .g = 0x80, .b = 0xC0 }, // 55 Sky Blue
+    { .r = 0x00, .g = 0x40, .b = 0x80 }, // 56 Steel Blue
+    { .r = 0xC0, .g = 0xFF, .b = 0xFF }, // 57 Light Sky Blue
+    { .r = 0xFF, .g = 0xFF, .b = 0xC0 }, // 58 Light Goldenrod
+    { .r = 0xFF, .g = 0xE0, .b = 0xC0 }, // 59 Light Salmon
+    { .r = 0xFF, .g = 0xA5, .b = 0xFF }, // 60 Light Lavender
+    { .r = 0xC0, .g = 0x00, .b = 0x80 }, // 61 Mulberry
+    { .r = 0xC0, .g = 0xFF, .b = 0xC0 }, // 62 Honeydew
+    { .r = 0x80, .g = 0xFF, .b = 0xFF }
+};
+
 #define LED_TYPE LED_STRIP_WS2812
 #define LED_GPIO CONFIG_LED_STRIP_GPIO
 #define RING_LEN CONFIG_LED_STRIP_LEN
@@ -39,237 +111,301 @@ static led_strip_t strip = {
 #endif
 };
 
-static bool bRGBInit = false;
-static int bRGBInstall = 0;
-TaskHandle_t xLEDTaskHandle = NULL;
-TaskHandle_t ScanningHandle;
+// Fester Frame-Takt des Renderers
+#define LED_FRAME_PERIOD_MS    (1000 / CONFIG_LED_STRIP_FRAME_RATE_HZ)
+#define LED_FRAME_PERIOD_TICKS ((pdMS_TO_TICKS(LED_FRAME_PERIOD_MS) > 0) ? pdMS_TO_TICKS(LED_FRAME_PERIOD_MS) : 1)
 
-static void Waterfall(rgb_t color, AppState state) {
-    int delay = 30;
+static TaskHandle_t xLEDTaskHandle = NULL;
 
-    // Initialisiere den LED-Streifen nur, wenn er noch nicht initialisiert wurde
-    if (!bRGBInit) {
-        ESP_ERROR_CHECK(led_strip_init(&strip));
-        bRGBInit = true;
-    }
+// Ereignis an den Renderer, wird von jeder RgbLed*() Funktion gepostet
+typedef struct {
+    AppState state;
+    rgb_t color;
+    int64_t postedUs;   // Zeitstempel des Posts für die Latenzmessung
+} LedEvent;
 
-    for (int i = 0; i < strip.length; i++) {
-        led_strip_set_pixel(&strip, i, color);
-        led_strip_flush(&strip);
-        vTaskDelay(pdMS_TO_TICKS(delay));
+// Mailbox mit Länge 1: das neueste Ereignis überschreibt ein noch nicht abgeholtes
+static QueueHandle_t xLEDEventQueue = NULL;
 
-        // Überprüfe regelmäßig den Zustand, um eine vorzeitige Rückgabe zu verhindern
-        if (GetAppState() != state) {
-            //break;
-        }
+// Latenz vom Post bis zum ersten geflushten Frame des Ereignisses
+static volatile uint32_t ulLastFeedbackLatencyUs = 0;
+static volatile uint32_t ulMaxFeedbackLatencyUs = 0;
+
+static int32_t SampleLedTaskStack(void);
+
+METRIC_COUNTER(framesMetric, "led.frames");
+METRIC_HISTOGRAM(feedbackLatencyMetric, "led.feedbackUs");
+METRIC_GAUGE_SAMPLED(ledTaskStackMetric, "stack.led", SampleLedTaskStack);
+
+// Framebuffer, wird pro Frame komplett neu berechnet und mit einem Flush ausgegeben
+static rgb_t xFrame[RING_LEN];
+
+_Static_assert(LED_TABLES_RING_LEN == RING_LEN, "led_tables.h was generated for a different ring length");
+
+typedef enum {
+    LED_ANIM_OFF,
+    LED_ANIM_WATERFALL,
+    LED_ANIM_PULSE,
+    LED_ANIM_SPINNER
+} LedAnimation;
+
+// Zustände, deren Animation nur einmal läuft und danach stehen bleibt
+static bool IsOneShotState(AppState state) {
+    return state == APP_STATE_IDLE ||
+           state == APP_STATE_AWS_CONNECTED ||
+           state == APP_STATE_ACCESS ||
+           state == APP_STATE_NOACCESS;
+}
+
+static LedAnimation AnimationForState(AppState state) {
+    switch (state) {
+        case APP_STATE_IDLE:
+            return LED_ANIM_OFF;
+        case APP_STATE_WIFI_STARTED:
+        case APP_STATE_WIFI_PROVISIONING:
+            return LED_ANIM_PULSE;
+        case APP_STATE_OTA_UPDATE:
+        case APP_STATE_SCANNING:
+            return LED_ANIM_SPINNER;
+        default:
+            return LED_ANIM_WATERFALL;
     }
+}
 
-    for (int i = 0; i < strip.length; i++) {
-        led_strip_set_pixel(&strip, i, colors[0]);  // Führe eine 'zurückgesetzte' Animation durch
-        led_strip_flush(&strip);
-        vTaskDelay(pdMS_TO_TICKS(delay));
+static uint32_t AnimationFrames(LedAnimation anim) {
+    switch (anim) {
+        case LED_ANIM_WATERFALL:
+            return LED_WATERFALL_FRAMES;
+        case LED_ANIM_PULSE:
+            return LED_PULSE_FRAMES;
+        case LED_ANIM_SPINNER:
+            return LED_SPINNER_FRAMES;
+        default:
+            return 1;
+    }
+}
 
-        if (GetAppState() != state) {
-            break;
+// Skaliert einen Farbkanal mit der Keyframe-Intensität und korrigiert das Ergebnis über die Gamma-LUT
+static inline uint8_t ScaleChannel(uint8_t channel, uint8_t intensity) {
+    return led_gamma8[((uint32_t)channel * (intensity + 1)) >> 8];
+}
+
+// Berechnet einen Frame der Animation in den Framebuffer, nur über Tabellenzugriffe.
+// @return true, wenn der letzte Frame der Animation berechnet wurde
+static bool RenderFrame(LedAnimation anim, rgb_t color, uint32_t step) {
+    for (uint32_t i = 0; i < RING_LEN; i++) {
+        uint8_t intensity;
+
+        switch (anim) {
+            case LED_ANIM_WATERFALL:
+                intensity = led_waterfall[step][i];
+                break;
+            case LED_ANIM_PULSE:
+                intensity = led_pulse[step];
+                break;
+            case LED_ANIM_SPINNER:
+                intensity = led_spinner[step][i];
+                break;
+            default:
+                intensity = 0;
+                break;
         }
+
+        xFrame[i].r = ScaleChannel(color.r, intensity);
+        xFrame[i].g = ScaleChannel(color.g, intensity);
+        xFrame[i].b = ScaleChannel(color.b, intensity);
     }
 
-    // Der Streifen wird nur freigegeben, wenn die Animation vollständig abgeschlossen ist
-    led_strip_free(&strip);
-    bRGBInit = false;  // Setze den Initialisierungsstatus zurück
+    return step >= AnimationFrames(anim) - 1;
 }
 
+static void RecordFeedbackLatency(int64_t postedUs) {
+    uint32_t latency = (uint32_t)(esp_timer_get_time() - postedUs);
+
+    ulLastFeedbackLatencyUs = latency;
+    if (latency > ulMaxFeedbackLatencyUs) {
+        ulMaxFeedbackLatencyUs = latency;
+    }
+    MetricRecord(&feedbackLatencyMetric, latency);
+    ESP_LOGD(TAG, "Feedback latency: %" PRIu32 " us", latency);
+}
+
+// Langlebiger Renderer mit Ereignis-Zustandsautomat. Zwischen zwei Frames wartet der Task
+// auf der Event-Queue, ein neues Ereignis unterbricht die laufende Animation sofort und
+// wird noch im selben Frame ausgegeben.
 static void LEDTask(void *pvParameters) {
+    LedEvent shown = { .state = APP_STATE_IDLE, .color = colors[0], .postedUs = 0 };
+    LedEvent event;
+    uint32_t step = 0;
+    bool done = false;
+    bool pendingLatency = false;
+    TickType_t nextFrame;
+
+    led_strip_install();
+    ESP_ERROR_CHECK(led_strip_init(&strip));
+
+    nextFrame = xTaskGetTickCount();
+
     for (;;) {
-        if (!bRGBInstall) {
-            led_strip_install();
-            bRGBInstall = 1;
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = ((int32_t)(nextFrame - now) > 0) ? (nextFrame - now) : 0;
+
+        // Im Leerlauf (One-Shot abgeschlossen) ohne Timeout auf das nächste Ereignis warten
+        if (xQueueReceive(xLEDEventQueue, &event, done ? portMAX_DELAY : wait) == pdPASS) {
+            shown = event;
+            step = 0;
+            done = false;
+            pendingLatency = true;
+            nextFrame = xTaskGetTickCount();
         }
 
-        switch (GetAppState()) {
-            case APP_STATE_IDLE:
-                Waterfall(colors[0], APP_STATE_IDLE);
-                break;
-            case APP_STATE_CERTS_LOADED:
-                Waterfall(colors[6], APP_STATE_CERTS_LOADED);
-                break;
-            case APP_STATE_WIFI_STARTED:
-                Waterfall(colors[9], APP_STATE_WIFI_STARTED);
-                break;
-            case APP_STATE_WIFI_PROVISIONING:
-                Waterfall(colors[10], APP_STATE_WIFI_PROVISIONING);
-                break;
-            case APP_STATE_WIFI_CONNECTED:
-                Waterfall(colors[5], APP_STATE_WIFI_CONNECTED);
-                break;
-            case APP_STATE_AWS_CONNECTED:
-                Waterfall(colors[50], APP_STATE_AWS_CONNECTED);
-				
-				vTaskDelay(pdMS_TO_TICKS(200));
-				if (xLEDTaskHandle != NULL) {
-    				ESP_LOGI(TAG, "Deleting Task!");
-					xLEDTaskHandle = NULL;
-    				vTaskDelete(xLEDTaskHandle);
-				}
-                break;
+        if (!done) {
+            LedAnimation anim = AnimationForState(shown.state);
+            done = RenderFrame(anim, shown.color, step++);
 
-			case APP_STATE_SCANNING:
-				Waterfall(scanning_color, APP_STATE_SCANNING);
-				break;
-			case APP_STATE_ACCESS:
-				Waterfall(access_color, APP_STATE_ACCESS);
-
-				vTaskDelay(pdMS_TO_TICKS(200));
-				if (xLEDTaskHandle != NULL) {
-        			ESP_LOGI(TAG, "Deleting Task!");
-					xLEDTaskHandle = NULL;
-        			vTaskDelete(xLEDTaskHandle);
-				}
-				break;
-			case APP_STATE_NOACCESS:
-				Waterfall(no_access_color, APP_STATE_NOACCESS);
-
-				vTaskDelay(pdMS_TO_TICKS(200));
-				if (xLEDTaskHandle != NULL) {
-        			ESP_LOGI(TAG, "Deleting Task!");
-					xLEDTaskHandle = NULL;
-        			vTaskDelete(xLEDTaskHandle);
-				}
-				break;
+            if (done && !IsOneShotState(shown.state)) {
+                step = 0;
+                done = false;
+            }
 
-            default:
-                break;
+            led_strip_set_pixels(&strip, 0, RING_LEN, xFrame);
+            led_strip_flush(&strip);
+            MetricAdd(&framesMetric, 1);
+
+            if (pendingLatency) {
+                RecordFeedbackLatency(shown.postedUs);
+                pendingLatency = false;
+            }
         }
+
+        nextFrame += LED_FRAME_PERIOD_TICKS;
+    }
+}
+
+// Setzt den App-Zustand und postet das Ereignis an den Renderer. Blockiert nie.
+static void PostLedEvent(AppState state, rgb_t color, bool scanning, bool access) {
+    LedEvent event = { .state = state, .color = color, .postedUs = esp_timer_get_time() };
+
+    UpdateAppState(state, color, scanning, access);
+
+    if (xLEDEventQueue != NULL) {
+        xQueueOverwrite(xLEDEventQueue, &event);
     }
 }
 
 void StartLED(void) {
-    if (xLEDTaskHandle == NULL && ScanningHandle == NULL) {
+    if (xLEDEventQueue == NULL) {
+        xLEDEventQueue = xQueueCreate(1, sizeof(LedEvent));
+    }
+    if (xLEDTaskHandle == NULL) {
         xTaskCreate(&LEDTask, "LEDTask", LEDTaskStackSize, NULL, LEDTaskPriority, &xLEDTaskHandle);
     }
+    MetricRegister(&framesMetric);
+    MetricRegister(&feedbackLatencyMetric);
+    MetricRegister(&ledTaskStackMetric);
 }
 
-void RGBLEDScanning(void) {
-    ESP_LOGI(TAG, "Starting Scanning LED Task");
-
-    // Setze den Zustand auf "Scannen"
-    UpdateAppState(APP_STATE_SCANNING, scanning_color, true, false);
+// Freier Stack des Renderers in Bytes, für die Telemetrie
+static int32_t SampleLedTaskStack(void) {
+    return xLEDTaskHandle != NULL ? (int32_t)uxTaskGetStackHighWaterMark(xLEDTaskHandle) : 0;
+}
 
-    // Wenn der Task nicht mehr läuft (Handle ist NULL), erstelle den Task neu
-    if (xLEDTaskHandle == NULL) {
-        xTaskCreate(&LEDTask, "LEDTask", LEDTaskStackSize, NULL, LEDTaskPriority, &xLEDTaskHandle);
-        ESP_LOGI(TAG, "LED Scanning Task created successfully");
-    } else {
-        ESP_LOGW(TAG, "LED Scanning Task is already running");
+void RgbLedGetFeedbackLatency(uint32_t *lastUs, uint32_t *maxUs) {
+    if (lastUs != NULL) {
+        *lastUs = ulLastFeedbackLatencyUs;
     }
+    if (maxUs != NULL) {
+        *maxUs = ulMaxFeedbackLatencyUs;
+    }
+}
+
+// Feedback-Farbe aus dem Snapshot, bei abgeschalteter LED bleibt sie dunkel
+static rgb_t FeedbackColor(const SettingsSnapshot *settings, rgb_t color) {
+    rgb_t off = { 0 };
+    return settings->useRgbLed ? color : off;
+}
+
+void RGBLEDScanning(void) {
+    const SettingsSnapshot *settings = SettingsAcquire();
+    rgb_t color = FeedbackColor(settings, settings->scanColor);
+    SettingsRelease(settings);
+
+    ESP_LOGI(TAG, "Scanning");
+    PostLedEvent(APP_STATE_SCANNING, color, true, false);
 }
 
 void RgbLedHasAccess(bool access) {
+    const SettingsSnapshot *settings = SettingsAcquire();
+    rgb_t color = FeedbackColor(settings, access ? settings->accessColor : settings->noAccessColor);
+    SettingsRelease(settings);
+
     ESP_LOGI(TAG, "Received Access: %s", access ? "granted" : "denied");
 
     if (access) {
         ESP_LOGI(TAG, "Changing to Access Color");
-        UpdateAppState(APP_STATE_ACCESS, access_color, false, true);
+        PostLedEvent(APP_STATE_ACCESS, color, false, true);
     } else {
         ESP_LOGI(TAG, "Changing to No Access Color");
-        UpdateAppState(APP_STATE_NOACCESS, no_access_color, false, false);
+        PostLedEvent(APP_STATE_NOACCESS, color, false, false);
     }
 }
 
 void RgbLedCertsLoaded(void) {
     ESP_LOGI(TAG, "CertsLoaded!");
-    if (xLEDTaskHandle == NULL) {
-        xTaskCreate(&LEDTask, "LEDTask", LEDTaskStackSize, NULL, LEDTaskPriority, &xLEDTaskHandle);
-    }
-    UpdateAppState(APP_STATE_CERTS_LOADED, colors[6], false, false);
+    PostLedEvent(APP_STATE_CERTS_LOADED, colors[6], false, false);
 }
 
 void RgbLedETHAppStarted(void) {
     ESP_LOGI(TAG, "Wifi/Eth Started");
-    if (xLEDTaskHandle == NULL) {
-        xTaskCreate(&LEDTask, "LEDTask", LEDTaskStackSize, NULL, LEDTaskPriority, &xLEDTaskHandle);
-    }
-    UpdateAppState(APP_STATE_WIFI_STARTED, colors[9], false, false);
+    PostLedEvent(APP_STATE_WIFI_STARTED, colors[9], false, false);
 }
 
 void RgbLedETHConnected(void) {
     ESP_LOGI(TAG, "ETH Connected");
-    if (xLEDTaskHandle == NULL) {
-        xTaskCreate(&LEDTask, "LEDTask", LEDTaskStackSize, NULL, LEDTaskPriority, &xLEDTaskHandle);
-    }
-    UpdateAppState(APP_STATE_WIFI_CONNECTED, colors[50], false, false);
+    PostLedEvent(APP_STATE_WIFI_CONNECTED, colors[5], false, false);
 }
 
 void RgbLedWifiProvisioningStarted(void) {
     ESP_LOGI(TAG, "Wifi/Eth Connecting");
-    if (xLEDTaskHandle == NULL) {
-        xTaskCreate(&LEDTask, "LEDTask", LEDTaskStackSize, NULL, LEDTaskPriority, &xLEDTaskHandle);
-    }
-    UpdateAppState(APP_STATE_WIFI_PROVISIONING, colors[10], false, false);
+    PostLedEvent(APP_STATE_WIFI_PROVISIONING, colors[10], false, false);
 }
 
 void RgbLedAWSConnected(void) {
     ESP_LOGI(TAG, "AWS Connected");
-    if (xLEDTaskHandle == NULL) {
-        xTaskCreate(&LEDTask, "LEDTask", LEDTaskStackSize, NULL, LEDTaskPriority, &xLEDTaskHandle);
-    }
-    UpdateAppState(APP_STATE_AWS_CONNECTED, colors[50], false, false);
+    PostLedEvent(APP_STATE_AWS_CONNECTED, colors[50], false, false);
 }
 
-// Funktion, um den RGB-String zu parsen und die Farben zu setzen
-void RgbLed_ChangeSettings(char *Access, char *NoAccess, char *Scanning, bool UseRGB_LED)
+// Parst "RRGGBB" ohne führendes #
+bool RgbLedParseColor(const char *hex, rgb_t *out)
 {
-    bUseRgbLed = UseRGB_LED;
-
-    char access_r[8], access_g[8], access_b[8];
-    char no_access_r[8], no_access_g[8], no_access_b[8];
-    char scanning_r[8], scanning_g[8], scanning_b[8];
-    char temp_access_r[3], temp_access_g[3], temp_access_b[3];
-    char temp_no_access_r[3], temp_no_access_g[3], temp_no_access_b[3];
-    char temp_scanning_r[3], temp_scanning_g[3], temp_scanning_b[3];
-
-    // Access-String in RGB-Werte umwandeln und 0x hinzufügen
-    sscanf(Access, "%2s%2s%2s", temp_access_r, temp_access_g, temp_access_b);
-    sprintf(access_r, "0x%s", temp_access_r);
-    sprintf(access_g, "0x%s", temp_access_g);
-    sprintf(access_b, "0x%s", temp_access_b);
-    access_color.r = strtol(access_r, NULL, 16);
-    access_color.g = strtol(access_g, NULL, 16);
-    access_color.b = strtol(access_b, NULL, 16);
-    ESP_LOGI(TAG, "access_color: %s %s %s", access_r, access_g, access_b);
-
-    // NoAccess-String in RGB-Werte umwandeln und 0x hinzufügen
-    sscanf(NoAccess, "%2s%2s%2s", temp_no_access_r, temp_no_access_g, temp_no_access_b);
-    sprintf(no_access_r, "0x%s", temp_no_access_r);
-    sprintf(no_access_g, "0x%s", temp_no_access_g);
-    sprintf(no_access_b, "0x%s", temp_no_access_b);
-    no_access_color.r = strtol(no_access_r, NULL, 16);
-    no_access_color.g = strtol(no_access_g, NULL, 16);
-    no_access_color.b = strtol(no_access_b, NULL, 16);
-    ESP_LOGI(TAG, "no_access_color: %s %s %s", no_access_r, no_access_g, no_access_b);
-
-    // Scanning-String in RGB-Werte umwandeln und 0x hinzufügen
-    sscanf(Scanning, "%2s%2s%2s", temp_scanning_r, temp_scanning_g, temp_scanning_b);
-    sprintf(scanning_r, "0x%s", temp_scanning_r);
-    sprintf(scanning_g, "0x%s", temp_scanning_g);
-    sprintf(scanning_b, "0x%s", temp_scanning_b);
-    scanning_color.r = strtol(scanning_r, NULL, 16);
-    scanning_color.g = strtol(scanning_g, NULL, 16);
-    scanning_color.b = strtol(scanning_b, NULL, 16);
-    ESP_LOGI(TAG, "scanning_color: %s %s %s", scanning_r, scanning_g, scanning_b);
+    uint8_t channels[3];
+
+    if (hex == NULL || strlen(hex) != 6) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        char byte[3] = { hex[2 * i], hex[2 * i + 1], '\0' };
+        char *end;
+
+        channels[i] = (uint8_t)strtol(byte, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+
+    out->r = channels[0];
+    out->g = channels[1];
+    out->b = channels[2];
+    return true;
 }
 
 void RgbLedOTAUpdateIncomming(void)
 {
 	ESP_LOGI(TAG, "OTA Update Incoming!");
-	Waterfall(colors[38], -1);
+	PostLedEvent(APP_STATE_OTA_UPDATE, colors[38], false, false);
 }
 void RgbLedOTAUpdateDone(void)
 {
 	ESP_LOGI(TAG, "OTA Update Done!");
-	Waterfall(colors[50], -1);
+	PostLedEvent(APP_STATE_AWS_CONNECTED, colors[50], false, false);
 }
-
-
-
-
@@ -8,9 +8,12 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "lwip/apps/sntp.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
 
-#include "TasksCommon.h"
+#include "Scheduler.h"
 #include "sntpTime.h"
+#include "Timestamp.h"
 #include "TimeZones.h"
 
 //TODO Make Timezonechanges working
@@ -36,6 +39,12 @@ void sntpTimeChangeTimeZone(char* timezone)
     TimeZone = timezone;
 }
 
+//Jede SNTP-Antwort führt den UTC-Offset des Zeitstempel-Dienstes nach
+static void sntpTimeSyncNotification(struct timeval *tv)
+{
+    TimestampSync((int64_t)tv->tv_sec * 1000000 + tv->tv_usec, esp_timer_get_time());
+}
+
 //initialize SNTP service using SNTP_OPMODE_POLL mode
 static void sntpTimeSyncInitSntp(void)
 {
@@ -45,6 +54,7 @@ static void sntpTimeSyncInitSntp(void)
     {
         // Set the operating mode
 		sntp_setoperatingmode(SNTP_OPMODE_POLL);
+		sntp_set_time_sync_notification_cb(sntpTimeSyncNotification);
 		sntpOpModeSet = true;
     }
     sntp_setservername(0, "pool.ntp.org");
@@ -103,85 +113,31 @@ static void sntpTimeSyncOptainTime(void)
     }
 }
 
-void waitForTimeAndExecute(int targetHour, int targetMinute, void (*callback)(void))
-{
-    while (1)
-    {
-        time_t now;
-        struct tm timeInfo;
-
-        // Hole die aktuelle Zeit
-        time(&now);
-        localtime_r(&now, &timeInfo);
-
-        // Überprüfen, ob es die gewünschte Uhrzeit ist (z.B. 04:00)
-        if (timeInfo.tm_hour == targetHour && timeInfo.tm_min == targetMinute)
-        {
-            ESP_LOGI(TAG, "Es ist jetzt %02d:%02d Uhr, führe den Code aus.", targetHour, targetMinute);
+//Abstand der Zeitprüfung, ein Resync erfolgt erst nach TIME_SYNC_THRESHOLD
+#define SNTP_CHECK_INTERVAL_MS 10000
 
-            // Führe die übergebene Funktion aus
-            if (callback != NULL)
-            {
-                callback();  // Die Funktion wird aufgerufen, wenn die Zeit erreicht wurde
-            }
-
-            break;  // Nach Ausführung aus der Schleife ausbrechen
-        }
-
-        // Warte 1 Minute, bevor die Zeit erneut überprüft wird
-        vTaskDelay(pdMS_TO_TICKS(60000));  // 60000 ms = 1 Minute
-    }
-}
-
-// Beispiel Callback-Funktion
-void executeAtFourAM(void)
+//SNTP Time syncronization job, läuft auf dem Scheduler
+//@param arg unused
+static void sntpTimeSync(void *arg)
 {
-    ESP_LOGI("Restart", "ESP wird neu gestartet...");
-    vTaskDelay(pdMS_TO_TICKS(2000));  // 2 Sekunden Verzögerung, um die Log-Meldung zu sehen
-    esp_restart();  // Neustart des ESP32
+    sntpTimeSyncOptainTime();
 }
 
-
-//SNTP Time syncronization task
-//@param arg pvParam
-static void sntpTimeSync(void *pvParam)
+char* sntpGetTIme(char* buffer, size_t len)
 {
-    OldTImeZone = TimeZone;
-
-    while(1)
-    {
-        sntpTimeSyncOptainTime();
-        vTaskDelay(10000 / portTICK_PERIOD_MS);
-        // Warte bis 04:00 Uhr und führe den Code aus
-        waitForTimeAndExecute(10, 00, executeAtFourAM);
-    }
-    vTaskDelete(NULL);
+    // Kein Logging hier, der Aufrufer entscheidet selbst
+    TimestampFormat(TimestampUtcUs(), buffer, len);
+    return buffer;
 }
 
-char* sntpGetTIme(void)
+void sntpTimeTaskStart(void)
 {
-    static char time_buff[100] = {0};
-
-    time_t now = 0;
-    struct tm timeInfo = {0};
-
-    time(&now);
-    localtime_r(&now, &timeInfo);
+    // Wird bei jedem Connect aufgerufen, der Job darf aber nur einmal angelegt werden
+    static SchedulerJob *sntpJob = NULL;
 
-    if(timeInfo.tm_year < (2016 - 1900))
-    {
-        ESP_LOGI(TAG, "Time is not set yet");  
+    if (sntpJob != NULL) {
+        return;
     }
-    else
-    {
-        strftime(time_buff, sizeof(time_buff), "%d.%m.%Y %H:%M:%S", &timeInfo);
-        ESP_LOGI(TAG, "Current time Info: %s", time_buff);
-    }
-    
-    return time_buff;
-}
-
-void sntpTimeTaskStart(void)
-{
-    xTaskCreatePinnedToCore(&sntpTimeSync, "sntpTimeSync", SNTPTaskStackSize, NULL, SNTPTaskPriority, NULL, SNTPTaskCoreID);
+    OldTImeZone = TimeZone;
+    sntpJob = SchedulerAddInterval("sntp", SNTP_CHECK_INTERVAL_MS, 0, sntpTimeSync, NULL);
 }
\ No newline at end of file
@@ -9,15 +9,18 @@
 #ifndef sntpTime
 #define sntpTime
 
+#include <stdbool.h>
+#include <stddef.h>
+
 //Change the timeZone
 void sntpTimeChangeTimeZone(char* timezone);
 
-//Starts the SNTP server syncronisation task
+//Starts the periodic SNTP server syncronisation on the scheduler
 void sntpTimeTaskStart(void);
 
-//Returns local time if set.
-//@return local time buffer
-char* sntpGetTIme(void);
+//Writes the local time if set, otherwise an empty string.
+//@return buffer
+char* sntpGetTIme(char* buffer, size_t len);
 
 bool isTimeValid(void);
 
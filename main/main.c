@@ -60,6 +60,18 @@
 #include "extras/ledStrip.h"
 #include "extras/NFC.h"
 #include "extras/Piepser.h"
+#include "extras/ResourceMonitor.h"
+#include "extras/MqttDiagnostics.h"
+#include "extras/Metrics.h"
+#include "extras/Scheduler.h"
+#include "extras/Timestamp.h"
+#include "extras/BootProfile.h"
+#include "extras/Settings.h"
+#include "extras/AllowList.h"
+#include "extras/AllowListSync.h"
+#include "extras/RevokedFilter.h"
+#include "extras/AccessRules.h"
+#include "extras/TasksCommon.h"
 
 /* Demo includes. */
 #if CONFIG_GRI_ENABLE_SUB_PUB_UNSUB_DEMO
@@ -119,6 +131,14 @@ static NetworkContext_t xNetworkContext;
  */
 static BaseType_t prvInitializeNetworkContext( void );
 
+/**
+ * @brief Task that runs prvInitializeNetworkContext() while app_main brings up
+ * NVS and Ethernet, then notifies app_main with the result.
+ *
+ * @param[in] pvParameters Handle of the task to notify.
+ */
+static void prvLoadCredentialsTask( void * pvParameters );
+
 /**
  * @brief This function starts all enabled demos.
  */
@@ -249,6 +269,16 @@ static BaseType_t prvInitializeNetworkContext( void )
     return xRet;
 }
 
+static void prvLoadCredentialsTask( void * pvParameters )
+{
+    TaskHandle_t xTaskToNotify = ( TaskHandle_t ) pvParameters;
+    BaseType_t xRet = prvInitializeNetworkContext();
+
+    BootProfileMark( BOOT_STAGE_CREDENTIALS_LOADED );
+    xTaskNotify( xTaskToNotify, ( uint32_t ) xRet, eSetValueWithOverwrite );
+    vTaskDelete( NULL );
+}
+
 static void prvStartEnabledDemos( void )
 {
     BaseType_t xResult;
@@ -322,13 +352,34 @@ static void prvStartEnabledDemos( void )
  */
 void app_main( void )
 {
+    BootProfileMark( BOOT_STAGE_APP_MAIN );
+
     InitAppState();
 
     //At first starting The LED Ring Task!
     StartLED();
+    BootProfileMark( BOOT_STAGE_LED_STARTED );
+
+    //Persistent sound task, LEDC is configured once here
+    StartSound();
+
+    //Shared worker for periodic and wall-clock jobs
+    StartScheduler();
+
+    //Watches heap and tasks, replaces the daily restart
+    StartResourceMonitor();
+
+    //Latency histograms of the MQTT agent commands
+    StartMqttDiagnostics();
+
+    //Telemetry of all modules in one message per interval
+    StartMetrics();
+
+    //Sends the boot stage timestamps once after connect
+    StartBootProfileReport();
     
-    /* This is used to store the return of initialization functions. */
-    BaseType_t xRet;
+    /* This is used to store the result of the credential loading task. */
+    uint32_t ulCredentialsResult = pdFAIL;
 
     /* This is used to store the error return of ESP-IDF functions. */
     esp_err_t xEspErrRet;
@@ -336,12 +387,17 @@ void app_main( void )
     //Befor inilizialize show it with the ring
     RgbLedCertsLoaded();
 
-    /* Initialize global network context. */
-    xRet = prvInitializeNetworkContext();
-
-    if( xRet != pdPASS )
+    /* Initialize global network context in its own task. Reading the
+     * credentials does not depend on NVS or the network, so it runs while
+     * the stages below bring those up. */
+    if( xTaskCreate( prvLoadCredentialsTask,
+                     "Credentials",
+                     StartupTaskStackSize,
+                     xTaskGetCurrentTaskHandle(),
+                     StartupTaskPriority,
+                     NULL ) != pdPASS )
     {
-        ESP_LOGE( TAG, "Failed to initialize global network context." );
+        ESP_LOGE( TAG, "Failed to create credential loading task." );
         return;
     }
 
@@ -360,23 +416,57 @@ void app_main( void )
         ESP_ERROR_CHECK( nvs_flash_init() );
     }
 
+    //Boot counter for timestamps that can be ordered across reboots
+    TimestampInit();
+    BootProfileMark( BOOT_STAGE_NVS_READY );
+
+    //Last settings from the cloud, so the reader does not wait for the round trip
+    SettingsLoadCached();
+
+    //Local allow-list for access decisions without the cloud
+    AllowListInit();
+
+    //Revoked UIDs from the last filter the cloud sent
+    RevokedFilterInit();
+
+    //Time-window rules, evaluated once SNTP has set the clock
+    AccessRulesInit();
+
     /* Initialize ESP-Event library default event loop.
      * This handles WiFi and TCP/IP events and this needs to be called before
      * starting WiFi and the coreMQTT-Agent network manager. */
     ESP_ERROR_CHECK( esp_event_loop_create_default() );
 
-    /* Start demo tasks. This needs to be done before starting WiFi and
-     * and the coreMQTT-Agent network manager so demos can
-     * register their coreMQTT-Agent event handlers before events happen. */
-    prvStartEnabledDemos();
-
     //And then show that we are starting the Ethernet or WIFI
     RgbLedETHAppStarted();
+
+    //PHY reset, autonegotiation and DHCP run while the credentials are loaded.
+    //The manager picks up an IP that arrived before it was started.
     if(!bUseWifi)
     {
         start_ethernet();
     }
-    else if(bUseWifi)
+
+    xTaskNotifyWait( 0, 0, &ulCredentialsResult, portMAX_DELAY );
+
+    if( ulCredentialsResult != pdPASS )
+    {
+        ESP_LOGE( TAG, "Failed to initialize global network context." );
+        return;
+    }
+
+    /* Start demo tasks. This needs to be done before starting WiFi and
+     * and the coreMQTT-Agent network manager so demos can
+     * register their coreMQTT-Agent event handlers before events happen. */
+    prvStartEnabledDemos();
+
+    //Delta updates of the allow-list, registers for the connect event like the demos
+    StartAllowListSync();
+
+    //Scans are queued until the access request can be sent
+    StartNFC();
+
+    if(bUseWifi)
     {
         /* Start WiFi. */
         app_wifi_init();
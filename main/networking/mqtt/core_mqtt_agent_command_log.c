@@ -0,0 +1,742 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_command_log.h"
+
+//LUDO Includes
+#include "extras/Timestamp.h"
+
+/* Preprocessor definitions ***************************************************/
+
+#if ( configMQTT_AGENT_COMMAND_LOG_SIZE & ( configMQTT_AGENT_COMMAND_LOG_SIZE - 1 ) ) != 0
+    #error "configMQTT_AGENT_COMMAND_LOG_SIZE must be a power of two."
+#endif
+
+#define COMMAND_LOG_MASK         ( configMQTT_AGENT_COMMAND_LOG_SIZE - 1U )
+
+/* Bucket layout, see core_mqtt_agent_command_log.h. */
+#define HISTOGRAM_SUB_BITS       2U
+#define HISTOGRAM_SUB_BUCKETS    ( 1U << HISTOGRAM_SUB_BITS )
+#define HISTOGRAM_MIN_SHIFT      6U
+#define HISTOGRAM_MAX_SHIFT      23U
+
+#if ( 1U + ( HISTOGRAM_MAX_SHIFT - HISTOGRAM_MIN_SHIFT + 1U ) * HISTOGRAM_SUB_BUCKETS ) != MQTT_AGENT_HISTOGRAM_BUCKETS
+    #error "MQTT_AGENT_HISTOGRAM_BUCKETS does not match the bucket layout."
+#endif
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief Timestamps of a record, in the order they are taken.
+ */
+typedef enum CommandStamp
+{
+    eStampEnqueue = 0,
+    eStampDequeue,
+    eStampSend,
+    eStampAck,
+    eStampDone,
+    eStampCount
+} CommandStamp_t;
+
+/**
+ * @brief A ring entry. ulId works as a sequence lock: it is 0 while the
+ * entry is rewritten, readers compare it before and after copying.
+ */
+typedef struct CommandLogSlot
+{
+    _Atomic uint32_t ulId;
+    _Atomic uint32_t ulType;
+    _Atomic uint32_t ulStatus;
+    _Atomic uint32_t ulStampUs[ eStampCount ];
+} CommandLogSlot_t;
+
+/**
+ * @brief Bounded output buffer for the JSON and the log lines.
+ */
+typedef struct TextBuffer
+{
+    char * pcBuffer;
+    size_t xSize;
+    size_t xLength;
+    bool xOverflow;
+} TextBuffer_t;
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "core_mqtt_agent_command_log";
+
+/**
+ * @brief Names of MqttAgentCommandType_t for the logs and the JSON.
+ */
+static const char * const pcCommandNames[ eMqttAgentCommandTypeCount ] =
+{
+    "publish",
+    "subscribe",
+    "unsubscribe"
+};
+
+/**
+ * @brief Names of MqttAgentCommandStage_t.
+ */
+static const char * const pcStageNames[ eMqttAgentStageCount ] =
+{
+    "queue",
+    "send",
+    "broker",
+    "ack"
+};
+
+/**
+ * @brief Names of MqttAgentPublishDirection_t.
+ */
+static const char * const pcDirectionNames[ eMqttAgentPublishDirectionCount ] =
+{
+    "out",
+    "in"
+};
+
+/**
+ * @brief Next message id, shared by all commands.
+ */
+static _Atomic uint32_t ulNextId = 1;
+
+/**
+ * @brief The ring, entry of an id is ulId & COMMAND_LOG_MASK.
+ */
+static CommandLogSlot_t xCommandLog[ configMQTT_AGENT_COMMAND_LOG_SIZE ];
+
+/**
+ * @brief Command the agent task currently writes to the socket, 0 if none.
+ */
+static _Atomic uint32_t ulAgentCommandId;
+
+/**
+ * @brief Latency histograms per command type and stage.
+ */
+static _Atomic uint32_t ulLatencyCounts[ eMqttAgentCommandTypeCount ][ eMqttAgentStageCount ][ MQTT_AGENT_HISTOGRAM_BUCKETS ];
+
+/**
+ * @brief Publish size histograms per direction.
+ */
+static _Atomic uint32_t ulPublishSizeCounts[ eMqttAgentPublishDirectionCount ][ MQTT_AGENT_HISTOGRAM_BUCKETS ];
+
+/**
+ * @brief Commands waiting in the queue when the agent took one, index 0 for
+ * a depth of 1.
+ */
+static _Atomic uint32_t ulQueueDepthCounts[ configMQTT_AGENT_COMMAND_QUEUE_LENGTH ];
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Low 32 bits of the monotonic time, never 0 so 0 can mean "not yet".
+ */
+static uint32_t prvNowUs( void );
+
+/**
+ * @brief Stores the current time in the record of ulId if it is still in the
+ * ring.
+ *
+ * @return true if the record was found.
+ */
+static bool prvStamp( uint32_t ulId,
+                      CommandStamp_t xStamp );
+
+/**
+ * @brief Copies the record of ulId if it is still in the ring and done.
+ *
+ * @return true if pxRecord was filled.
+ */
+static bool prvReadRecord( uint32_t ulId,
+                           MqttAgentCommandRecord_t * pxRecord );
+
+/**
+ * @brief Histogram bucket of a value.
+ */
+static size_t prvBucket( uint32_t ulValue );
+
+/**
+ * @brief Smallest value of a bucket.
+ */
+static uint32_t prvBucketLow( size_t xBucket );
+
+/**
+ * @brief Copies a histogram and sums its counts.
+ *
+ * @return Number of values in the histogram.
+ */
+static uint32_t prvCopyHistogram( _Atomic uint32_t * pulSource,
+                                  uint32_t * pulCounts,
+                                  size_t xBuckets );
+
+/**
+ * @brief Upper bound of the bucket holding the given percentile, the lower
+ * bound for the last bucket.
+ */
+static uint32_t prvPercentile( const uint32_t * pulCounts,
+                               uint32_t ulTotal,
+                               uint32_t ulPercent );
+
+/**
+ * @brief Appends formatted text, sets xOverflow if it does not fit.
+ */
+static void prvAppend( TextBuffer_t * pxWriter,
+                           const char * pcFormat,
+                           ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+
+/**
+ * @brief Appends "name":{"n":..,"p50":..,"p90":..,"p99":..,"b":[[low,count],..]}.
+ */
+static void prvJsonHistogram( TextBuffer_t * pxWriter,
+                              const char * pcName,
+                              _Atomic uint32_t * pulSource );
+
+/**
+ * @brief Logs one histogram line for vMqttAgentCommandLogPrint().
+ */
+static void prvPrintHistogram( const char * pcName,
+                               const char * pcStage,
+                               const char * pcUnit,
+                               _Atomic uint32_t * pulSource );
+
+/* Static function definitions ************************************************/
+
+static uint32_t prvNowUs( void )
+{
+    uint32_t ulNowUs = ( uint32_t ) TimestampMonoUs();
+
+    return ( ulNowUs != 0U ) ? ulNowUs : 1U;
+}
+
+static bool prvStamp( uint32_t ulId,
+                      CommandStamp_t xStamp )
+{
+    CommandLogSlot_t * pxSlot = &xCommandLog[ ulId & COMMAND_LOG_MASK ];
+
+    if( ( ulId == 0U ) || ( atomic_load_explicit( &pxSlot->ulId, memory_order_acquire ) != ulId ) )
+    {
+        return false;
+    }
+
+    /* Release, a reader that sees the done time also sees the status. */
+    atomic_store_explicit( &pxSlot->ulStampUs[ xStamp ], prvNowUs(), memory_order_release );
+
+    return true;
+}
+
+static bool prvReadRecord( uint32_t ulId,
+                           MqttAgentCommandRecord_t * pxRecord )
+{
+    CommandLogSlot_t * pxSlot = &xCommandLog[ ulId & COMMAND_LOG_MASK ];
+    uint32_t ulStampUs[ eStampCount ];
+    uint32_t ulPreviousUs;
+    size_t xStamp;
+
+    if( ( ulId == 0U ) || ( atomic_load_explicit( &pxSlot->ulId, memory_order_acquire ) != ulId ) )
+    {
+        return false;
+    }
+
+    ulStampUs[ eStampDone ] = atomic_load_explicit( &pxSlot->ulStampUs[ eStampDone ], memory_order_acquire );
+
+    for( xStamp = 0; xStamp < eStampDone; xStamp++ )
+    {
+        ulStampUs[ xStamp ] = atomic_load_explicit( &pxSlot->ulStampUs[ xStamp ], memory_order_relaxed );
+    }
+
+    pxRecord->ulId = ulId;
+    pxRecord->xType = ( MqttAgentCommandType_t ) atomic_load_explicit( &pxSlot->ulType, memory_order_relaxed );
+    pxRecord->xStatus = ( MQTTStatus_t ) atomic_load_explicit( &pxSlot->ulStatus, memory_order_relaxed );
+
+    /* Rewritten by a newer command while copying. */
+    atomic_thread_fence( memory_order_acquire );
+
+    if( atomic_load_explicit( &pxSlot->ulId, memory_order_relaxed ) != ulId )
+    {
+        return false;
+    }
+
+    if( ( ulStampUs[ eStampDone ] == 0U ) || ( pxRecord->xType >= eMqttAgentCommandTypeCount ) )
+    {
+        return false;
+    }
+
+    /* A late stamp of an overwritten command is older than the enqueue time
+     * of the new one. */
+    ulPreviousUs = ulStampUs[ eStampEnqueue ];
+
+    for( xStamp = eStampDequeue; xStamp < eStampCount; xStamp++ )
+    {
+        if( ulStampUs[ xStamp ] == 0U )
+        {
+            continue;
+        }
+
+        if( ( int32_t ) ( ulStampUs[ xStamp ] - ulPreviousUs ) < 0 )
+        {
+            return false;
+        }
+
+        ulPreviousUs = ulStampUs[ xStamp ];
+    }
+
+    pxRecord->ulEnqueueUs = ulStampUs[ eStampEnqueue ];
+    pxRecord->ulDequeueUs = ulStampUs[ eStampDequeue ];
+    pxRecord->ulSendUs = ulStampUs[ eStampSend ];
+    pxRecord->ulAckUs = ulStampUs[ eStampAck ];
+    pxRecord->ulDoneUs = ulStampUs[ eStampDone ];
+
+    return true;
+}
+
+static size_t prvBucket( uint32_t ulValue )
+{
+    uint32_t ulShift;
+
+    if( ulValue < ( 1U << HISTOGRAM_MIN_SHIFT ) )
+    {
+        return 0;
+    }
+
+    ulShift = 31U - ( uint32_t ) __builtin_clz( ulValue );
+
+    if( ulShift > HISTOGRAM_MAX_SHIFT )
+    {
+        return MQTT_AGENT_HISTOGRAM_BUCKETS - 1U;
+    }
+
+    return 1U + ( ulShift - HISTOGRAM_MIN_SHIFT ) * HISTOGRAM_SUB_BUCKETS +
+           ( ( ulValue >> ( ulShift - HISTOGRAM_SUB_BITS ) ) & ( HISTOGRAM_SUB_BUCKETS - 1U ) );
+}
+
+static uint32_t prvBucketLow( size_t xBucket )
+{
+    uint32_t ulShift;
+    uint32_t ulSub;
+
+    if( xBucket == 0U )
+    {
+        return 0;
+    }
+
+    ulShift = HISTOGRAM_MIN_SHIFT + ( uint32_t ) ( xBucket - 1U ) / HISTOGRAM_SUB_BUCKETS;
+    ulSub = ( uint32_t ) ( xBucket - 1U ) % HISTOGRAM_SUB_BUCKETS;
+
+    return ( 1U << ulShift ) + ( ulSub << ( ulShift - HISTOGRAM_SUB_BITS ) );
+}
+
+static uint32_t prvCopyHistogram( _Atomic uint32_t * pulSource,
+                                  uint32_t * pulCounts,
+                                  size_t xBuckets )
+{
+    uint32_t ulTotal = 0;
+    size_t xBucket;
+
+    for( xBucket = 0; xBucket < xBuckets; xBucket++ )
+    {
+        pulCounts[ xBucket ] = atomic_load_explicit( &pulSource[ xBucket ], memory_order_relaxed );
+        ulTotal += pulCounts[ xBucket ];
+    }
+
+    return ulTotal;
+}
+
+static uint32_t prvPercentile( const uint32_t * pulCounts,
+                               uint32_t ulTotal,
+                               uint32_t ulPercent )
+{
+    uint64_t ullRank = ( ( uint64_t ) ulTotal * ulPercent + 99U ) / 100U;
+    uint64_t ullSeen = 0;
+    size_t xBucket;
+
+    if( ulTotal == 0U )
+    {
+        return 0;
+    }
+
+    for( xBucket = 0; xBucket < MQTT_AGENT_HISTOGRAM_BUCKETS - 1U; xBucket++ )
+    {
+        ullSeen += pulCounts[ xBucket ];
+
+        if( ullSeen >= ullRank )
+        {
+            return prvBucketLow( xBucket + 1U );
+        }
+    }
+
+    return prvBucketLow( MQTT_AGENT_HISTOGRAM_BUCKETS - 1U );
+}
+
+static void prvAppend( TextBuffer_t * pxWriter,
+                           const char * pcFormat,
+                           ... )
+{
+    va_list xArgs;
+    int lWritten;
+
+    if( pxWriter->xOverflow == true )
+    {
+        return;
+    }
+
+    va_start( xArgs, pcFormat );
+    lWritten = vsnprintf( pxWriter->pcBuffer + pxWriter->xLength,
+                          pxWriter->xSize - pxWriter->xLength,
+                          pcFormat,
+                          xArgs );
+    va_end( xArgs );
+
+    if( ( lWritten < 0 ) || ( ( size_t ) lWritten >= pxWriter->xSize - pxWriter->xLength ) )
+    {
+        pxWriter->xOverflow = true;
+        return;
+    }
+
+    pxWriter->xLength += ( size_t ) lWritten;
+}
+
+static void prvJsonHistogram( TextBuffer_t * pxWriter,
+                              const char * pcName,
+                              _Atomic uint32_t * pulSource )
+{
+    uint32_t ulCounts[ MQTT_AGENT_HISTOGRAM_BUCKETS ];
+    uint32_t ulTotal = prvCopyHistogram( pulSource, ulCounts, MQTT_AGENT_HISTOGRAM_BUCKETS );
+    const char * pcSeparator = "";
+    size_t xBucket;
+
+    prvAppend( pxWriter,
+                   "\"%s\":{\"n\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p90\":%" PRIu32 ",\"p99\":%" PRIu32 ",\"b\":[",
+                   pcName,
+                   ulTotal,
+                   prvPercentile( ulCounts, ulTotal, 50 ),
+                   prvPercentile( ulCounts, ulTotal, 90 ),
+                   prvPercentile( ulCounts, ulTotal, 99 ) );
+
+    for( xBucket = 0; xBucket < MQTT_AGENT_HISTOGRAM_BUCKETS; xBucket++ )
+    {
+        if( ulCounts[ xBucket ] != 0U )
+        {
+            prvAppend( pxWriter, "%s[%" PRIu32 ",%" PRIu32 "]", pcSeparator, prvBucketLow( xBucket ), ulCounts[ xBucket ] );
+            pcSeparator = ",";
+        }
+    }
+
+    prvAppend( pxWriter, "]}" );
+}
+
+static void prvPrintHistogram( const char * pcName,
+                               const char * pcStage,
+                               const char * pcUnit,
+                               _Atomic uint32_t * pulSource )
+{
+    uint32_t ulCounts[ MQTT_AGENT_HISTOGRAM_BUCKETS ];
+    uint32_t ulTotal = prvCopyHistogram( pulSource, ulCounts, MQTT_AGENT_HISTOGRAM_BUCKETS );
+    char cBuckets[ 256 ];
+    TextBuffer_t xBuckets = { .pcBuffer = cBuckets, .xSize = sizeof( cBuckets ) };
+    size_t xBucket;
+
+    if( ulTotal == 0U )
+    {
+        return;
+    }
+
+    cBuckets[ 0 ] = '\0';
+
+    for( xBucket = 0; xBucket < MQTT_AGENT_HISTOGRAM_BUCKETS; xBucket++ )
+    {
+        if( ulCounts[ xBucket ] != 0U )
+        {
+            prvAppend( &xBuckets, " %" PRIu32 ":%" PRIu32, prvBucketLow( xBucket ), ulCounts[ xBucket ] );
+        }
+    }
+
+    ESP_LOGI( TAG,
+              "%-11s %-6s n %-6" PRIu32 " p50 %-8" PRIu32 " p90 %-8" PRIu32 " p99 %-8" PRIu32 " %s |%s%s",
+              pcName,
+              pcStage,
+              ulTotal,
+              prvPercentile( ulCounts, ulTotal, 50 ),
+              prvPercentile( ulCounts, ulTotal, 90 ),
+              prvPercentile( ulCounts, ulTotal, 99 ),
+              pcUnit,
+              cBuckets,
+              ( xBuckets.xOverflow == true ) ? " ..." : "" );
+}
+
+/* Public function definitions ************************************************/
+
+uint32_t ulMqttAgentCommandLogNextId( void )
+{
+    uint32_t ulId = atomic_fetch_add_explicit( &ulNextId, 1U, memory_order_relaxed );
+
+    if( ulId == 0U )
+    {
+        ulId = atomic_fetch_add_explicit( &ulNextId, 1U, memory_order_relaxed );
+    }
+
+    return ulId;
+}
+
+uint32_t ulMqttAgentCommandLogEnqueue( MqttAgentCommandType_t xType )
+{
+    uint32_t ulId = ulMqttAgentCommandLogNextId();
+    CommandLogSlot_t * pxSlot = &xCommandLog[ ulId & COMMAND_LOG_MASK ];
+    size_t xStamp;
+
+    atomic_store_explicit( &pxSlot->ulId, 0U, memory_order_relaxed );
+    atomic_thread_fence( memory_order_release );
+
+    atomic_store_explicit( &pxSlot->ulType, ( uint32_t ) xType, memory_order_relaxed );
+    atomic_store_explicit( &pxSlot->ulStatus, ( uint32_t ) MQTTSuccess, memory_order_relaxed );
+
+    for( xStamp = eStampDequeue; xStamp < eStampCount; xStamp++ )
+    {
+        atomic_store_explicit( &pxSlot->ulStampUs[ xStamp ], 0U, memory_order_relaxed );
+    }
+
+    atomic_store_explicit( &pxSlot->ulStampUs[ eStampEnqueue ], prvNowUs(), memory_order_relaxed );
+
+    atomic_store_explicit( &pxSlot->ulId, ulId, memory_order_release );
+
+    return ulId;
+}
+
+void vMqttAgentCommandLogDequeued( uint32_t ulId )
+{
+    atomic_store_explicit( &ulAgentCommandId, ulId, memory_order_relaxed );
+    ( void ) prvStamp( ulId, eStampDequeue );
+}
+
+void vMqttAgentCommandLogQueueDepth( uint32_t ulWaiting )
+{
+    if( ulWaiting == 0U )
+    {
+        return;
+    }
+
+    if( ulWaiting > configMQTT_AGENT_COMMAND_QUEUE_LENGTH )
+    {
+        ulWaiting = configMQTT_AGENT_COMMAND_QUEUE_LENGTH;
+    }
+
+    atomic_fetch_add_explicit( &ulQueueDepthCounts[ ulWaiting - 1U ], 1U, memory_order_relaxed );
+}
+
+void vMqttAgentCommandLogSendDone( void )
+{
+    ( void ) prvStamp( atomic_load_explicit( &ulAgentCommandId, memory_order_relaxed ), eStampSend );
+}
+
+void vMqttAgentCommandLogAcked( uint32_t ulId,
+                                MQTTStatus_t xStatus )
+{
+    uint32_t ulExpectedId = ulId;
+
+    /* Writes after the ack (e.g. PUBACKs of the same process loop) are not
+     * part of this command. */
+    ( void ) atomic_compare_exchange_strong( &ulAgentCommandId, &ulExpectedId, 0U );
+
+    if( prvStamp( ulId, eStampAck ) == true )
+    {
+        atomic_store_explicit( &xCommandLog[ ulId & COMMAND_LOG_MASK ].ulStatus, ( uint32_t ) xStatus, memory_order_relaxed );
+    }
+}
+
+void vMqttAgentCommandLogDone( uint32_t ulId,
+                               MQTTStatus_t xStatus )
+{
+    MqttAgentCommandRecord_t xRecord;
+    _Atomic uint32_t( *pulStages )[ MQTT_AGENT_HISTOGRAM_BUCKETS ];
+
+    if( ( ulId == 0U ) ||
+        ( atomic_load_explicit( &xCommandLog[ ulId & COMMAND_LOG_MASK ].ulId, memory_order_acquire ) != ulId ) )
+    {
+        return;
+    }
+
+    atomic_store_explicit( &xCommandLog[ ulId & COMMAND_LOG_MASK ].ulStatus, ( uint32_t ) xStatus, memory_order_relaxed );
+
+    if( ( prvStamp( ulId, eStampDone ) == false ) || ( prvReadRecord( ulId, &xRecord ) == false ) )
+    {
+        return;
+    }
+
+    ESP_LOGD( TAG,
+              "Command %" PRIu32 " (%s) %s: queue %" PRIu32 " us, send %" PRIu32 " us, broker %" PRIu32 " us, ack %" PRIu32 " us.",
+              ulId,
+              pcCommandNames[ xRecord.xType ],
+              MQTT_Status_strerror( xStatus ),
+              ( xRecord.ulDequeueUs != 0U ) ? xRecord.ulDequeueUs - xRecord.ulEnqueueUs : 0U,
+              ( xRecord.ulSendUs != 0U ) ? xRecord.ulSendUs - xRecord.ulDequeueUs : 0U,
+              ( xRecord.ulAckUs != 0U ) && ( xRecord.ulSendUs != 0U ) ? xRecord.ulAckUs - xRecord.ulSendUs : 0U,
+              ( xRecord.ulAckUs != 0U ) ? xRecord.ulDoneUs - xRecord.ulAckUs : 0U );
+
+    /* Failed commands would mix timeouts and local errors into the
+     * latencies. */
+    if( ( xStatus != MQTTSuccess ) || ( xRecord.ulDequeueUs == 0U ) ||
+        ( xRecord.ulSendUs == 0U ) || ( xRecord.ulAckUs == 0U ) )
+    {
+        return;
+    }
+
+    pulStages = ulLatencyCounts[ xRecord.xType ];
+    atomic_fetch_add_explicit( &pulStages[ eMqttAgentStageQueue ][ prvBucket( xRecord.ulDequeueUs - xRecord.ulEnqueueUs ) ], 1U, memory_order_relaxed );
+    atomic_fetch_add_explicit( &pulStages[ eMqttAgentStageSend ][ prvBucket( xRecord.ulSendUs - xRecord.ulDequeueUs ) ], 1U, memory_order_relaxed );
+    atomic_fetch_add_explicit( &pulStages[ eMqttAgentStageBroker ][ prvBucket( xRecord.ulAckUs - xRecord.ulSendUs ) ], 1U, memory_order_relaxed );
+    atomic_fetch_add_explicit( &pulStages[ eMqttAgentStageAck ][ prvBucket( xRecord.ulDoneUs - xRecord.ulAckUs ) ], 1U, memory_order_relaxed );
+}
+
+void vMqttAgentCommandLogPublishSize( MqttAgentPublishDirection_t xDirection,
+                                      size_t xBytes )
+{
+    if( xDirection < eMqttAgentPublishDirectionCount )
+    {
+        atomic_fetch_add_explicit( &ulPublishSizeCounts[ xDirection ][ prvBucket( ( uint32_t ) xBytes ) ], 1U, memory_order_relaxed );
+    }
+}
+
+size_t xMqttAgentCommandLogSnapshot( MqttAgentCommandRecord_t * pxRecords,
+                                     size_t xMaxRecords )
+{
+    uint32_t ulNewestId = atomic_load_explicit( &ulNextId, memory_order_relaxed ) - 1U;
+    size_t xCount = 0;
+    uint32_t ulIndex;
+
+    for( ulIndex = 0; ( ulIndex < configMQTT_AGENT_COMMAND_LOG_SIZE ) && ( xCount < xMaxRecords ); ulIndex++ )
+    {
+        if( prvReadRecord( ulNewestId - ulIndex, &pxRecords[ xCount ] ) == true )
+        {
+            xCount++;
+        }
+    }
+
+    return xCount;
+}
+
+size_t xMqttAgentCommandLogJson( char * pcBuffer,
+                                 size_t xBufferSize )
+{
+    TextBuffer_t xWriter = { .pcBuffer = pcBuffer, .xSize = xBufferSize };
+    uint32_t ulDepthCounts[ configMQTT_AGENT_COMMAND_QUEUE_LENGTH ];
+    size_t xType;
+    size_t xIndex;
+
+    prvAppend( &xWriter, "{\"latencyUs\":{" );
+
+    for( xType = 0; xType < eMqttAgentCommandTypeCount; xType++ )
+    {
+        prvAppend( &xWriter, "%s\"%s\":{", ( xType != 0U ) ? "," : "", pcCommandNames[ xType ] );
+
+        for( xIndex = 0; xIndex < eMqttAgentStageCount; xIndex++ )
+        {
+            prvAppend( &xWriter, ( xIndex != 0U ) ? "," : "" );
+            prvJsonHistogram( &xWriter, pcStageNames[ xIndex ], ulLatencyCounts[ xType ][ xIndex ] );
+        }
+
+        prvAppend( &xWriter, "}" );
+    }
+
+    prvAppend( &xWriter, "},\"publishBytes\":{" );
+
+    for( xIndex = 0; xIndex < eMqttAgentPublishDirectionCount; xIndex++ )
+    {
+        prvAppend( &xWriter, ( xIndex != 0U ) ? "," : "" );
+        prvJsonHistogram( &xWriter, pcDirectionNames[ xIndex ], ulPublishSizeCounts[ xIndex ] );
+    }
+
+    prvCopyHistogram( ulQueueDepthCounts, ulDepthCounts, configMQTT_AGENT_COMMAND_QUEUE_LENGTH );
+    prvAppend( &xWriter,
+                   "},\"networkBuffer\":%u,\"queueLength\":%u,\"queueDepth\":[",
+                   ( unsigned ) configMQTT_AGENT_NETWORK_BUFFER_SIZE,
+                   ( unsigned ) configMQTT_AGENT_COMMAND_QUEUE_LENGTH );
+
+    for( xIndex = 0; xIndex < configMQTT_AGENT_COMMAND_QUEUE_LENGTH; xIndex++ )
+    {
+        prvAppend( &xWriter, "%s%" PRIu32, ( xIndex != 0U ) ? "," : "", ulDepthCounts[ xIndex ] );
+    }
+
+    prvAppend( &xWriter, "]}" );
+
+    return ( xWriter.xOverflow == true ) ? 0U : xWriter.xLength;
+}
+
+void vMqttAgentCommandLogPrint( void )
+{
+    uint32_t ulDepthCounts[ configMQTT_AGENT_COMMAND_QUEUE_LENGTH ];
+    char cDepths[ 8 * configMQTT_AGENT_COMMAND_QUEUE_LENGTH + 1 ];
+    TextBuffer_t xDepths = { .pcBuffer = cDepths, .xSize = sizeof( cDepths ) };
+    size_t xType;
+    size_t xIndex;
+
+    for( xType = 0; xType < eMqttAgentCommandTypeCount; xType++ )
+    {
+        for( xIndex = 0; xIndex < eMqttAgentStageCount; xIndex++ )
+        {
+            prvPrintHistogram( pcCommandNames[ xType ], pcStageNames[ xIndex ], "us", ulLatencyCounts[ xType ][ xIndex ] );
+        }
+    }
+
+    for( xIndex = 0; xIndex < eMqttAgentPublishDirectionCount; xIndex++ )
+    {
+        prvPrintHistogram( "bytes", pcDirectionNames[ xIndex ], "B ", ulPublishSizeCounts[ xIndex ] );
+    }
+
+    cDepths[ 0 ] = '\0';
+    prvCopyHistogram( ulQueueDepthCounts, ulDepthCounts, configMQTT_AGENT_COMMAND_QUEUE_LENGTH );
+
+    for( xIndex = 0; xIndex < configMQTT_AGENT_COMMAND_QUEUE_LENGTH; xIndex++ )
+    {
+        prvAppend( &xDepths, " %" PRIu32, ulDepthCounts[ xIndex ] );
+    }
+
+    ESP_LOGI( TAG,
+              "queue depth 1..%u:%s (network buffer %u bytes)",
+              ( unsigned ) configMQTT_AGENT_COMMAND_QUEUE_LENGTH,
+              cDepths,
+              ( unsigned ) configMQTT_AGENT_NETWORK_BUFFER_SIZE );
+}
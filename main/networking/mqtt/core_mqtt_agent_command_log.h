@@ -0,0 +1,220 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Message ids, per-command timing and latency histograms for the
+ * coreMQTT-Agent commands.
+ *
+ * Every command started through core_mqtt_agent_futures.h gets an id from a
+ * single atomic counter and a record in a fixed ring indexed by that id. The
+ * record holds five timestamps:
+ *  - enqueue: the caller handed the command to the agent queue,
+ *  - dequeue: the agent task took it from the queue,
+ *  - send: the last socket write of the agent task for it returned,
+ *  - ack: the broker acknowledged it (for QoS 0 publishes: it was sent),
+ *  - done: the future completed and its waiters were woken.
+ *
+ * When a command is done, the four intervals between these timestamps are
+ * added to the histograms of its command type:
+ *  - queue: waiting in the command queue,
+ *  - send: writing the packet to the TLS connection,
+ *  - broker: until the ack arrived (broker and network round trip),
+ *  - ack: processing the ack up to the completion of the future.
+ * The agent task also adds the number of commands waiting in the queue each
+ * time it takes one, and both directions add the size of every publish.
+ *
+ * Histograms are log-linear with fixed buckets: everything below 64 in the
+ * first bucket, then 4 buckets per power of two up to 2^24 (16.7 s or
+ * 16 MB), larger values in the last bucket. They count since boot.
+ *
+ * Writers and readers never take a lock or allocate. The ring keeps the last
+ * configMQTT_AGENT_COMMAND_LOG_SIZE commands; a command still pending after
+ * that many newer ones loses its record and is not counted.
+ */
+
+#ifndef CORE_MQTT_AGENT_COMMAND_LOG_H
+#define CORE_MQTT_AGENT_COMMAND_LOG_H
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* coreMQTT library include. */
+#include "core_mqtt.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Number of buckets of a latency or size histogram.
+ */
+#define MQTT_AGENT_HISTOGRAM_BUCKETS    73
+
+/**
+ * @brief Command types kept in the log.
+ */
+typedef enum MqttAgentCommandType
+{
+    eMqttAgentCommandPublish = 0,
+    eMqttAgentCommandSubscribe,
+    eMqttAgentCommandUnsubscribe,
+    eMqttAgentCommandTypeCount
+} MqttAgentCommandType_t;
+
+/**
+ * @brief Intervals of a command with a latency histogram each.
+ */
+typedef enum MqttAgentCommandStage
+{
+    eMqttAgentStageQueue = 0,
+    eMqttAgentStageSend,
+    eMqttAgentStageBroker,
+    eMqttAgentStageAck,
+    eMqttAgentStageCount
+} MqttAgentCommandStage_t;
+
+/**
+ * @brief Directions of the publish size histograms.
+ */
+typedef enum MqttAgentPublishDirection
+{
+    eMqttAgentPublishOutgoing = 0,
+    eMqttAgentPublishIncoming,
+    eMqttAgentPublishDirectionCount
+} MqttAgentPublishDirection_t;
+
+/**
+ * @brief Copy of one log record. Times are the low 32 bits of
+ * TimestampMonoUs(), a time that was not reached is 0.
+ */
+typedef struct MqttAgentCommandRecord
+{
+    uint32_t ulId;
+    MqttAgentCommandType_t xType;
+    MQTTStatus_t xStatus;
+    uint32_t ulEnqueueUs;
+    uint32_t ulDequeueUs;
+    uint32_t ulSendUs;
+    uint32_t ulAckUs;
+    uint32_t ulDoneUs;
+} MqttAgentCommandRecord_t;
+
+/**
+ * @brief Returns the next message id. Ids are never 0 and unique until the
+ * counter wraps. Safe to call from any task.
+ */
+uint32_t ulMqttAgentCommandLogNextId( void );
+
+/**
+ * @brief Takes a new id and starts its record with the enqueue time.
+ *
+ * @return The id of the command.
+ */
+uint32_t ulMqttAgentCommandLogEnqueue( MqttAgentCommandType_t xType );
+
+/**
+ * @brief Called by the agent task for every command it takes from the queue.
+ * Stores the dequeue time and attributes the following socket writes to the
+ * command.
+ *
+ * @param[in] ulId Id of the command, 0 for commands without a record. 0 also
+ * stops attributing socket writes.
+ */
+void vMqttAgentCommandLogDequeued( uint32_t ulId );
+
+/**
+ * @brief Adds the number of commands in the queue, including the one just
+ * taken, to the queue depth histogram. Called by the agent task.
+ */
+void vMqttAgentCommandLogQueueDepth( uint32_t ulWaiting );
+
+/**
+ * @brief Stores the send time of the command the agent task works on, if
+ * any. Called after each successful socket write of the agent task.
+ */
+void vMqttAgentCommandLogSendDone( void );
+
+/**
+ * @brief Stores the ack time and the result of the command.
+ */
+void vMqttAgentCommandLogAcked( uint32_t ulId,
+                                MQTTStatus_t xStatus );
+
+/**
+ * @brief Stores the completion time and the result, and adds the intervals of
+ * a successful command to the histograms.
+ */
+void vMqttAgentCommandLogDone( uint32_t ulId,
+                               MQTTStatus_t xStatus );
+
+/**
+ * @brief Adds the topic and payload length of a publish to the size
+ * histogram of its direction.
+ */
+void vMqttAgentCommandLogPublishSize( MqttAgentPublishDirection_t xDirection,
+                                      size_t xBytes );
+
+/**
+ * @brief Copies the completed records, newest first. Records overwritten
+ * while they are copied are skipped.
+ *
+ * @param[out] pxRecords Destination.
+ * @param[in] xMaxRecords Size of pxRecords.
+ *
+ * @return Number of records copied.
+ */
+size_t xMqttAgentCommandLogSnapshot( MqttAgentCommandRecord_t * pxRecords,
+                                     size_t xMaxRecords );
+
+/**
+ * @brief Writes the histograms as a JSON object, starting with '{'.
+ *
+ * Latencies in microseconds, sizes in bytes. Each histogram has "n", the
+ * percentiles "p50", "p90" and "p99" as upper bucket bounds, and "b", the
+ * non-empty buckets as [lower bound, count] pairs. "queueDepth" lists the
+ * counts for 1 to the queue length.
+ *
+ * @return Length without the terminating zero, 0 if pcBuffer is too small.
+ */
+size_t xMqttAgentCommandLogJson( char * pcBuffer,
+                                 size_t xBufferSize );
+
+/**
+ * @brief Logs the histograms, one line each, for reading them over serial.
+ */
+void vMqttAgentCommandLogPrint( void );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* CORE_MQTT_AGENT_COMMAND_LOG_H */
@@ -0,0 +1,600 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/* Includes *******************************************************************/
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+
+/* ESP-IDF includes. */
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* Subscription manager include. */
+#include "subscription_manager.h"
+
+/* Configurations include. */
+#include "core_mqtt_agent_manager_config.h"
+
+/* Command log include. */
+#include "core_mqtt_agent_command_log.h"
+
+/* Public functions include. */
+#include "core_mqtt_agent_futures.h"
+
+//LUDO Includes
+#include "extras/Scheduler.h"
+
+/* Preprocessor definitions ***************************************************/
+
+/* One completion bit per future, an event group holds 24 usable bits. */
+#if ( configMQTT_AGENT_FUTURE_POOL_SIZE < 1 ) || ( configMQTT_AGENT_FUTURE_POOL_SIZE > 24 )
+    #error "configMQTT_AGENT_FUTURE_POOL_SIZE must be between 1 and 24."
+#endif
+
+#define FUTURE_DONE_BIT( pxFuture )    ( ( EventBits_t ) 1 << ( ( pxFuture ) - xFuturePool ) )
+
+/* Struct definitions *********************************************************/
+
+/**
+ * @brief A pool entry. Passed to coreMQTT-Agent as the command context, so
+ * everything the agent reads until completion lives here.
+ */
+struct MqttAgentFuture
+{
+    bool xInUse;
+    bool xDone;
+    bool xReleased;
+    bool xCallbackPending; /* Completed, callback not yet run by the dispatcher. */
+    MqttAgentCommandType_t xCommand;
+    uint32_t ulId; /* Message id from the command log. */
+    MQTTStatus_t xReturnStatus;
+
+    MQTTPublishInfo_t xPublishInfo;
+    MQTTSubscribeInfo_t xSubscribeInfo;
+    MQTTAgentSubscribeArgs_t xSubscribeArgs;
+
+    IncomingPubCallback_t pxIncomingCallback;
+    void * pvIncomingContext;
+
+    MqttAgentFutureCallback_t pxCallback;
+    void * pvCallbackContext;
+};
+
+/* Global variables ***********************************************************/
+
+/**
+ * @brief Logging tag for ESP-IDF logging functions.
+ */
+static const char * TAG = "core_mqtt_agent_futures";
+
+/**
+ * @brief Global MQTT Agent context, owned by the coreMQTT-Agent manager.
+ */
+extern MQTTAgentContext_t xGlobalMqttAgentContext;
+
+/**
+ * @brief The future pool.
+ */
+static struct MqttAgentFuture xFuturePool[ configMQTT_AGENT_FUTURE_POOL_SIZE ];
+
+/**
+ * @brief Protects the state flags of the pool entries. Only held for a few
+ * assignments, also by the agent task.
+ */
+static SemaphoreHandle_t xFutureMutex;
+
+/**
+ * @brief Counts the free pool entries, lets callers block for one.
+ */
+static SemaphoreHandle_t xFreeFutures;
+
+/**
+ * @brief Completion bit of each pool entry, see FUTURE_DONE_BIT().
+ */
+static EventGroupHandle_t xFutureEventGroup;
+
+/**
+ * @brief Runs the completion callbacks on the scheduler worker.
+ */
+static SchedulerJob * pxDispatchJob;
+
+/* Static function declarations ***********************************************/
+
+/**
+ * @brief Takes a free entry from the pool.
+ *
+ * @return The entry, or NULL if none became free within ulBlockTimeMs.
+ */
+static MqttAgentFutureHandle_t prvAcquireFuture( MqttAgentCommandType_t xCommand,
+                                                 uint32_t ulBlockTimeMs,
+                                                 MqttAgentFutureCallback_t pxCallback,
+                                                 void * pvContext );
+
+/**
+ * @brief Returns the entry to the pool. Must be called with xFutureMutex held.
+ */
+static void prvFreeFuture( MqttAgentFutureHandle_t xFuture );
+
+/**
+ * @brief Marks the future completed, wakes the waiters and hands the callback
+ * to the dispatcher.
+ */
+static void prvCompleteFuture( MqttAgentFutureHandle_t xFuture,
+                               MQTTStatus_t xStatus );
+
+/**
+ * @brief Passed into MQTTAgent_Publish(), MQTTAgent_Subscribe() and
+ * MQTTAgent_Unsubscribe() as the callback to execute when the broker ACKs the
+ * command (or when it was sent in the case of QoS 0). Runs in the agent task.
+ *
+ * @param[in] pxCommandContext The future of the command.
+ * @param[in] pxReturnInfo The result of the command.
+ */
+static void prvFutureCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                      MQTTAgentReturnInfo_t * pxReturnInfo );
+
+/**
+ * @brief Scheduler job running the callbacks of completed futures.
+ */
+static void prvDispatchJob( void * pvArg );
+
+/* Static function definitions ************************************************/
+
+static MqttAgentFutureHandle_t prvAcquireFuture( MqttAgentCommandType_t xCommand,
+                                                 uint32_t ulBlockTimeMs,
+                                                 MqttAgentFutureCallback_t pxCallback,
+                                                 void * pvContext )
+{
+    MqttAgentFutureHandle_t xFuture = NULL;
+    size_t xIndex;
+
+    configASSERT( xFutureMutex != NULL );
+
+    if( xSemaphoreTake( xFreeFutures, pdMS_TO_TICKS( ulBlockTimeMs ) ) != pdTRUE )
+    {
+        ESP_LOGE( TAG,
+                  "No free future within %" PRIu32 " ms.",
+                  ulBlockTimeMs );
+        return NULL;
+    }
+
+    xSemaphoreTake( xFutureMutex, portMAX_DELAY );
+
+    for( xIndex = 0; xIndex < configMQTT_AGENT_FUTURE_POOL_SIZE; xIndex++ )
+    {
+        if( xFuturePool[ xIndex ].xInUse == false )
+        {
+            xFuture = &xFuturePool[ xIndex ];
+            memset( xFuture, 0x00, sizeof( *xFuture ) );
+            xFuture->xInUse = true;
+            xFuture->xCommand = xCommand;
+            xFuture->pxCallback = pxCallback;
+            xFuture->pvCallbackContext = pvContext;
+            xEventGroupClearBits( xFutureEventGroup, FUTURE_DONE_BIT( xFuture ) );
+            break;
+        }
+    }
+
+    xSemaphoreGive( xFutureMutex );
+
+    /* The counting semaphore guarantees a free entry. */
+    configASSERT( xFuture != NULL );
+
+    /* Before the command is enqueued, the agent task stamps the record. */
+    xFuture->ulId = ulMqttAgentCommandLogEnqueue( xCommand );
+
+    return xFuture;
+}
+
+static void prvFreeFuture( MqttAgentFutureHandle_t xFuture )
+{
+    xFuture->xInUse = false;
+    xSemaphoreGive( xFreeFutures );
+}
+
+static void prvCompleteFuture( MqttAgentFutureHandle_t xFuture,
+                               MQTTStatus_t xStatus )
+{
+    bool xDispatch = false;
+    uint32_t ulId = xFuture->ulId;
+
+    xSemaphoreTake( xFutureMutex, portMAX_DELAY );
+
+    xFuture->xReturnStatus = xStatus;
+    xFuture->xDone = true;
+
+    /* Set while the mutex is held, a released entry can otherwise be taken
+     * again before its bit is set. */
+    xEventGroupSetBits( xFutureEventGroup, FUTURE_DONE_BIT( xFuture ) );
+
+    if( xFuture->pxCallback != NULL )
+    {
+        xFuture->xCallbackPending = true;
+        xDispatch = true;
+    }
+    else if( xFuture->xReleased == true )
+    {
+        prvFreeFuture( xFuture );
+    }
+
+    xSemaphoreGive( xFutureMutex );
+
+    /* The entry may already be taken again, use the id read above. */
+    vMqttAgentCommandLogDone( ulId, xStatus );
+
+    if( xDispatch == true )
+    {
+        SchedulerTrigger( pxDispatchJob );
+    }
+}
+
+static void prvFutureCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                      MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    MqttAgentFutureHandle_t xFuture = ( MqttAgentFutureHandle_t ) pxCommandContext;
+    MQTTSubscribeInfo_t * pxSubscribeInfo = &( xFuture->xSubscribeInfo );
+
+    vMqttAgentCommandLogAcked( xFuture->ulId, pxReturnInfo->returnCode );
+
+    if( pxReturnInfo->returnCode == MQTTSuccess )
+    {
+        if( ( xFuture->xCommand == eMqttAgentCommandSubscribe ) && ( xFuture->pxIncomingCallback != NULL ) )
+        {
+            /* Add subscription so that incoming publishes are routed to the
+             * application callback. */
+            if( addSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
+                                 pxSubscribeInfo->pTopicFilter,
+                                 pxSubscribeInfo->topicFilterLength,
+                                 xFuture->pxIncomingCallback,
+                                 xFuture->pvIncomingContext ) == false )
+            {
+                ESP_LOGE( TAG,
+                          "Failed to register an incoming publish callback for topic %.*s.",
+                          pxSubscribeInfo->topicFilterLength,
+                          pxSubscribeInfo->pTopicFilter );
+            }
+        }
+        else if( xFuture->xCommand == eMqttAgentCommandUnsubscribe )
+        {
+            /* Remove subscription from subscription manager. */
+            removeSubscription( ( SubscriptionElement_t * ) xGlobalMqttAgentContext.pIncomingCallbackContext,
+                                pxSubscribeInfo->pTopicFilter,
+                                pxSubscribeInfo->topicFilterLength );
+        }
+    }
+
+    prvCompleteFuture( xFuture, pxReturnInfo->returnCode );
+}
+
+static void prvDispatchJob( void * pvArg )
+{
+    size_t xIndex;
+
+    ( void ) pvArg;
+
+    for( xIndex = 0; xIndex < configMQTT_AGENT_FUTURE_POOL_SIZE; xIndex++ )
+    {
+        MqttAgentFutureHandle_t xFuture = &xFuturePool[ xIndex ];
+        MqttAgentFutureCallback_t pxCallback = NULL;
+
+        xSemaphoreTake( xFutureMutex, portMAX_DELAY );
+
+        if( ( xFuture->xInUse == true ) && ( xFuture->xCallbackPending == true ) )
+        {
+            pxCallback = xFuture->pxCallback;
+        }
+
+        xSemaphoreGive( xFutureMutex );
+
+        if( pxCallback == NULL )
+        {
+            continue;
+        }
+
+        /* Called without the mutex, the callback may start new commands. */
+        pxCallback( xFuture, xFuture->xReturnStatus, xFuture->pvCallbackContext );
+
+        xSemaphoreTake( xFutureMutex, portMAX_DELAY );
+        xFuture->xCallbackPending = false;
+
+        if( xFuture->xReleased == true )
+        {
+            prvFreeFuture( xFuture );
+        }
+
+        xSemaphoreGive( xFutureMutex );
+    }
+}
+
+/* Public function definitions ************************************************/
+
+BaseType_t xMqttAgentFuturesInit( void )
+{
+    if( xFutureMutex != NULL )
+    {
+        return pdPASS;
+    }
+
+    xFutureEventGroup = xEventGroupCreate();
+    xFreeFutures = xSemaphoreCreateCounting( configMQTT_AGENT_FUTURE_POOL_SIZE,
+                                             configMQTT_AGENT_FUTURE_POOL_SIZE );
+    pxDispatchJob = SchedulerAddJob( "mqttFutures", prvDispatchJob, NULL );
+
+    if( ( xFutureEventGroup == NULL ) || ( xFreeFutures == NULL ) || ( pxDispatchJob == NULL ) )
+    {
+        ESP_LOGE( TAG,
+                  "Failed to create the future pool." );
+        return pdFAIL;
+    }
+
+    /* Created last, it marks the pool as ready. */
+    xFutureMutex = xSemaphoreCreateMutex();
+
+    return ( xFutureMutex != NULL ) ? pdPASS : pdFAIL;
+}
+
+MqttAgentFutureHandle_t xMqttAgentFuturePublish( const MQTTPublishInfo_t * pxPublishInfo,
+                                                 uint32_t ulBlockTimeMs,
+                                                 MqttAgentFutureCallback_t pxCallback,
+                                                 void * pvContext )
+{
+    MqttAgentFutureHandle_t xFuture;
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    MQTTStatus_t xCommandAdded;
+
+    configASSERT( pxPublishInfo != NULL );
+
+    xFuture = prvAcquireFuture( eMqttAgentCommandPublish, ulBlockTimeMs, pxCallback, pvContext );
+
+    if( xFuture == NULL )
+    {
+        return NULL;
+    }
+
+    xFuture->xPublishInfo = *pxPublishInfo;
+    vMqttAgentCommandLogPublishSize( eMqttAgentPublishOutgoing,
+                                     pxPublishInfo->topicNameLength + pxPublishInfo->payloadLength );
+
+    xCommandParams.blockTimeMs = ulBlockTimeMs;
+    xCommandParams.cmdCompleteCallback = prvFutureCommandCallback;
+    xCommandParams.pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) xFuture;
+
+    xCommandAdded = MQTTAgent_Publish( &xGlobalMqttAgentContext,
+                                       &( xFuture->xPublishInfo ),
+                                       &xCommandParams );
+
+    if( xCommandAdded != MQTTSuccess )
+    {
+        ESP_LOGE( TAG,
+                  "Failed to enqueue publish command %" PRIu32 ". Error code=%s",
+                  xFuture->ulId,
+                  MQTT_Status_strerror( xCommandAdded ) );
+        prvCompleteFuture( xFuture, xCommandAdded );
+    }
+
+    return xFuture;
+}
+
+MqttAgentFutureHandle_t xMqttAgentFutureSubscribe( const char * pcTopicFilter,
+                                                   uint16_t usTopicFilterLength,
+                                                   MQTTQoS_t xQoS,
+                                                   IncomingPubCallback_t pxIncomingCallback,
+                                                   void * pvIncomingContext,
+                                                   uint32_t ulBlockTimeMs,
+                                                   MqttAgentFutureCallback_t pxCallback,
+                                                   void * pvContext )
+{
+    MqttAgentFutureHandle_t xFuture;
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    MQTTStatus_t xCommandAdded;
+
+    configASSERT( ( pcTopicFilter != NULL ) && ( usTopicFilterLength > 0 ) );
+
+    xFuture = prvAcquireFuture( eMqttAgentCommandSubscribe, ulBlockTimeMs, pxCallback, pvContext );
+
+    if( xFuture == NULL )
+    {
+        return NULL;
+    }
+
+    xFuture->xSubscribeInfo.qos = xQoS;
+    xFuture->xSubscribeInfo.pTopicFilter = pcTopicFilter;
+    xFuture->xSubscribeInfo.topicFilterLength = usTopicFilterLength;
+    xFuture->xSubscribeArgs.pSubscribeInfo = &( xFuture->xSubscribeInfo );
+    xFuture->xSubscribeArgs.numSubscriptions = 1;
+    xFuture->pxIncomingCallback = pxIncomingCallback;
+    xFuture->pvIncomingContext = pvIncomingContext;
+
+    xCommandParams.blockTimeMs = ulBlockTimeMs;
+    xCommandParams.cmdCompleteCallback = prvFutureCommandCallback;
+    xCommandParams.pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) xFuture;
+
+    xCommandAdded = MQTTAgent_Subscribe( &xGlobalMqttAgentContext,
+                                         &( xFuture->xSubscribeArgs ),
+                                         &xCommandParams );
+
+    if( xCommandAdded != MQTTSuccess )
+    {
+        ESP_LOGE( TAG,
+                  "Failed to enqueue subscribe command %" PRIu32 ". Error code=%s",
+                  xFuture->ulId,
+                  MQTT_Status_strerror( xCommandAdded ) );
+        prvCompleteFuture( xFuture, xCommandAdded );
+    }
+
+    return xFuture;
+}
+
+MqttAgentFutureHandle_t xMqttAgentFutureUnsubscribe( const char * pcTopicFilter,
+                                                     uint16_t usTopicFilterLength,
+                                                     MQTTQoS_t xQoS,
+                                                     uint32_t ulBlockTimeMs,
+                                                     MqttAgentFutureCallback_t pxCallback,
+                                                     void * pvContext )
+{
+    MqttAgentFutureHandle_t xFuture;
+    MQTTAgentCommandInfo_t xCommandParams = { 0 };
+    MQTTStatus_t xCommandAdded;
+
+    configASSERT( ( pcTopicFilter != NULL ) && ( usTopicFilterLength > 0 ) );
+
+    xFuture = prvAcquireFuture( eMqttAgentCommandUnsubscribe, ulBlockTimeMs, pxCallback, pvContext );
+
+    if( xFuture == NULL )
+    {
+        return NULL;
+    }
+
+    xFuture->xSubscribeInfo.qos = xQoS;
+    xFuture->xSubscribeInfo.pTopicFilter = pcTopicFilter;
+    xFuture->xSubscribeInfo.topicFilterLength = usTopicFilterLength;
+    xFuture->xSubscribeArgs.pSubscribeInfo = &( xFuture->xSubscribeInfo );
+    xFuture->xSubscribeArgs.numSubscriptions = 1;
+
+    xCommandParams.blockTimeMs = ulBlockTimeMs;
+    xCommandParams.cmdCompleteCallback = prvFutureCommandCallback;
+    xCommandParams.pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) xFuture;
+
+    xCommandAdded = MQTTAgent_Unsubscribe( &xGlobalMqttAgentContext,
+                                           &( xFuture->xSubscribeArgs ),
+                                           &xCommandParams );
+
+    if( xCommandAdded != MQTTSuccess )
+    {
+        ESP_LOGE( TAG,
+                  "Failed to enqueue unsubscribe command %" PRIu32 ". Error code=%s",
+                  xFuture->ulId,
+                  MQTT_Status_strerror( xCommandAdded ) );
+        prvCompleteFuture( xFuture, xCommandAdded );
+    }
+
+    return xFuture;
+}
+
+BaseType_t xMqttAgentFutureWait( MqttAgentFutureHandle_t xFuture,
+                                 TickType_t xTicksToWait,
+                                 MQTTStatus_t * pxStatus )
+{
+    EventBits_t xBits;
+
+    if( xFuture == NULL )
+    {
+        return pdFALSE;
+    }
+
+    /* Not cleared on exit, so every waiter and later polls see it. */
+    xBits = xEventGroupWaitBits( xFutureEventGroup,
+                                 FUTURE_DONE_BIT( xFuture ),
+                                 pdFALSE,
+                                 pdTRUE,
+                                 xTicksToWait );
+
+    if( ( xBits & FUTURE_DONE_BIT( xFuture ) ) == 0 )
+    {
+        return pdFALSE;
+    }
+
+    if( pxStatus != NULL )
+    {
+        *pxStatus = xFuture->xReturnStatus;
+    }
+
+    return pdTRUE;
+}
+
+BaseType_t xMqttAgentFuturePoll( MqttAgentFutureHandle_t xFuture,
+                                 MQTTStatus_t * pxStatus )
+{
+    return xMqttAgentFutureWait( xFuture, 0, pxStatus );
+}
+
+void vMqttAgentFutureRelease( MqttAgentFutureHandle_t xFuture )
+{
+    if( xFuture == NULL )
+    {
+        return;
+    }
+
+    xSemaphoreTake( xFutureMutex, portMAX_DELAY );
+
+    configASSERT( ( xFuture->xInUse == true ) && ( xFuture->xReleased == false ) );
+    xFuture->xReleased = true;
+
+    if( ( xFuture->xDone == true ) && ( xFuture->xCallbackPending == false ) )
+    {
+        prvFreeFuture( xFuture );
+    }
+
+    xSemaphoreGive( xFutureMutex );
+}
+
+MQTTStatus_t xMqttAgentFutureGet( MqttAgentFutureHandle_t xFuture,
+                                  TickType_t xTicksToWait )
+{
+    MQTTStatus_t xStatus = MQTTRecvFailed;
+
+    if( xFuture == NULL )
+    {
+        return MQTTNoMemory;
+    }
+
+    ( void ) xMqttAgentFutureWait( xFuture, xTicksToWait, &xStatus );
+    vMqttAgentFutureRelease( xFuture );
+
+    return xStatus;
+}
+
+uint32_t ulMqttAgentFutureId( MqttAgentFutureHandle_t xFuture )
+{
+    return ( xFuture != NULL ) ? xFuture->ulId : 0U;
+}
+
+void vMqttAgentFuturesCommandReceived( const MQTTAgentCommand_t * pxCommand )
+{
+    uint32_t ulId = 0;
+
+    /* Commands of the manager itself (connect, process loop, resubscribe)
+     * carry other callbacks and have no record. */
+    if( ( pxCommand != NULL ) && ( pxCommand->pCommandCompleteCallback == prvFutureCommandCallback ) )
+    {
+        ulId = ( ( MqttAgentFutureHandle_t ) pxCommand->pCmdContext )->ulId;
+    }
+
+    vMqttAgentCommandLogDequeued( ulId );
+}
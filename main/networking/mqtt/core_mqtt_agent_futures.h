@@ -0,0 +1,197 @@
+/*
+ * ESP32-C3 Featured FreeRTOS IoT Integration V202204.00
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/*
+ * Shared asynchronous client for the coreMQTT-Agent commands used by the demos.
+ *
+ * Every publish, subscribe and unsubscribe takes a future from a static pool
+ * and returns it right after the command is enqueued. The future owns the
+ * command context and the publish/subscribe arguments, so they stay valid
+ * until the agent task completes the command, no matter whether the caller is
+ * still waiting. A future can be waited on with a timeout, polled, or given a
+ * completion callback that runs on the shared scheduler worker. Several
+ * commands may be in flight from a single task.
+ *
+ * Each command gets a message id and a timing record in the command log,
+ * see core_mqtt_agent_command_log.h.
+ *
+ * The topic, topic filter and payload are not copied. They must stay valid
+ * until the future completes, topic filters of subscriptions for as long as
+ * the subscription exists.
+ */
+
+#ifndef CORE_MQTT_AGENT_FUTURES_H
+#define CORE_MQTT_AGENT_FUTURES_H
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+
+/* coreMQTT library include. */
+#include "core_mqtt.h"
+
+/* coreMQTT-Agent include. */
+#include "core_mqtt_agent.h"
+
+/* Subscription manager include. */
+#include "subscription_manager.h"
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        extern "C" {
+    #endif
+/* *INDENT-ON* */
+
+/**
+ * @brief Handle of a pending or completed coreMQTT-Agent command.
+ */
+typedef struct MqttAgentFuture * MqttAgentFutureHandle_t;
+
+/**
+ * @brief Completion callback, runs on the scheduler worker after the agent
+ * completed the command.
+ *
+ * @param[in] xFuture The completed future. Still valid until it is released.
+ * @param[in] xStatus Result of the command.
+ * @param[in] pvContext Context given when the command was started.
+ */
+typedef void (* MqttAgentFutureCallback_t )( MqttAgentFutureHandle_t xFuture,
+                                             MQTTStatus_t xStatus,
+                                             void * pvContext );
+
+/**
+ * @brief Creates the future pool and the dispatcher job. Called by the
+ * coreMQTT-Agent manager on start.
+ *
+ * @return pdPASS if successful, pdFAIL otherwise.
+ */
+BaseType_t xMqttAgentFuturesInit( void );
+
+/**
+ * @brief Enqueues a PUBLISH.
+ *
+ * @param[in] pxPublishInfo Publish to send. Copied, but the topic and payload
+ * it points to must stay valid until the future completes.
+ * @param[in] ulBlockTimeMs Time to wait for a free future and for space in the
+ * agent's command queue.
+ * @param[in] pxCallback Optional completion callback, may be NULL.
+ * @param[in] pvContext Context passed to pxCallback.
+ *
+ * @return The future, or NULL if no future became free within ulBlockTimeMs.
+ * A command that could not be enqueued returns a future that is already
+ * completed with the error.
+ */
+MqttAgentFutureHandle_t xMqttAgentFuturePublish( const MQTTPublishInfo_t * pxPublishInfo,
+                                                 uint32_t ulBlockTimeMs,
+                                                 MqttAgentFutureCallback_t pxCallback,
+                                                 void * pvContext );
+
+/**
+ * @brief Enqueues a SUBSCRIBE for one topic filter. Once acknowledged, incoming
+ * publishes on the filter are routed to pxIncomingCallback through the
+ * subscription manager.
+ *
+ * @param[in] pxIncomingCallback Called for incoming publishes, NULL if the
+ * publishes are handled elsewhere (e.g. by the OTA agent).
+ * @param[in] pvIncomingContext Context passed to pxIncomingCallback.
+ *
+ * See xMqttAgentFuturePublish() for the remaining parameters.
+ */
+MqttAgentFutureHandle_t xMqttAgentFutureSubscribe( const char * pcTopicFilter,
+                                                   uint16_t usTopicFilterLength,
+                                                   MQTTQoS_t xQoS,
+                                                   IncomingPubCallback_t pxIncomingCallback,
+                                                   void * pvIncomingContext,
+                                                   uint32_t ulBlockTimeMs,
+                                                   MqttAgentFutureCallback_t pxCallback,
+                                                   void * pvContext );
+
+/**
+ * @brief Enqueues an UNSUBSCRIBE for one topic filter and removes it from the
+ * subscription manager once acknowledged.
+ *
+ * See xMqttAgentFuturePublish() for the parameters.
+ */
+MqttAgentFutureHandle_t xMqttAgentFutureUnsubscribe( const char * pcTopicFilter,
+                                                     uint16_t usTopicFilterLength,
+                                                     MQTTQoS_t xQoS,
+                                                     uint32_t ulBlockTimeMs,
+                                                     MqttAgentFutureCallback_t pxCallback,
+                                                     void * pvContext );
+
+/**
+ * @brief Waits for the future to complete. Any number of tasks may wait on
+ * the same future. A timeout does not cancel the command.
+ *
+ * @param[out] pxStatus Result of the command if completed, may be NULL.
+ *
+ * @return pdTRUE if the future completed, pdFALSE on timeout or NULL handle.
+ */
+BaseType_t xMqttAgentFutureWait( MqttAgentFutureHandle_t xFuture,
+                                 TickType_t xTicksToWait,
+                                 MQTTStatus_t * pxStatus );
+
+/**
+ * @brief Same as xMqttAgentFutureWait() without blocking.
+ */
+BaseType_t xMqttAgentFuturePoll( MqttAgentFutureHandle_t xFuture,
+                                 MQTTStatus_t * pxStatus );
+
+/**
+ * @brief Gives the future back to the pool. A pending future returns once the
+ * agent completed it and its callback ran. The handle must not be used after.
+ */
+void vMqttAgentFutureRelease( MqttAgentFutureHandle_t xFuture );
+
+/**
+ * @brief Waits for the future and releases it.
+ *
+ * @return Result of the command, MQTTNoMemory for a NULL handle and
+ * MQTTRecvFailed if it did not complete within xTicksToWait.
+ */
+MQTTStatus_t xMqttAgentFutureGet( MqttAgentFutureHandle_t xFuture,
+                                  TickType_t xTicksToWait );
+
+/**
+ * @brief Message id of the command, see core_mqtt_agent_command_log.h.
+ *
+ * @return The id, 0 for a NULL handle.
+ */
+uint32_t ulMqttAgentFutureId( MqttAgentFutureHandle_t xFuture );
+
+/**
+ * @brief Tells the command log which command the agent task works on. Called
+ * by the coreMQTT-Agent manager in the agent task for every command it takes
+ * from the command queue, and with NULL when the command loop ends.
+ */
+void vMqttAgentFuturesCommandReceived( const MQTTAgentCommand_t * pxCommand );
+
+/* *INDENT-OFF* */
+    #ifdef __cplusplus
+        } /* extern "C" */
+    #endif
+/* *INDENT-ON* */
+
+#endif /* CORE_MQTT_AGENT_FUTURES_H */
@@ -27,6 +27,8 @@
 /* Includes *******************************************************************/
 
 /* Standard includes. */
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -70,6 +72,12 @@
 /* Public functions include. */
 #include "core_mqtt_agent_manager.h"
 
+/* Command futures include. */
+#include "core_mqtt_agent_futures.h"
+
+/* Command log include. */
+#include "core_mqtt_agent_command_log.h"
+
 /* Configurations include. */
 #include "core_mqtt_agent_manager_config.h"
 
@@ -80,7 +88,9 @@
 
 //LUDO RTOS Includes
 #include "extras/ledStrip.h"
-#include "extras/NFC.h"
+#include "extras/Timestamp.h"
+#include "extras/BootProfile.h"
+#include "extras/Metrics.h"
 #include "lan.h"
 
 /* Preprocessor definitions ***************************************************/
@@ -92,10 +102,7 @@
 #define CORE_MQTT_AGENT_DISCONNECTED_BIT    ( 1 << 3 )
 
 /* Timing definitions */
-#define MILLISECONDS_PER_SECOND             ( 1000U )
-#define MILLISECONDS_PER_TICK   \
-    ( MILLISECONDS_PER_SECOND / \
-      configTICK_RATE_HZ )
+#define MICROSECONDS_PER_MILLISECOND        ( 1000 )
 
 #define MUTEX_IS_OWNED( xHandle )    ( xTaskGetCurrentTaskHandle() == xSemaphoreGetMutexHolder( xHandle ) )
 
@@ -155,6 +162,19 @@ static NetworkContext_t * pxNetworkContext;
  */
 static EventGroupHandle_t xNetworkEventGroup;
 
+/**
+ * @brief Set by xCoreMqttAgentManagerRestartConnection() before it queues a
+ * disconnect, so the agent task reconnects instead of ending.
+ */
+static atomic_bool xRestartRequested = false;
+
+/**
+ * @brief Broker connections after the first one and failed connection
+ * attempts, uploaded by extras/Metrics.c.
+ */
+METRIC_COUNTER( xReconnectsMetric, "mqtt.reconnects" );
+METRIC_COUNTER( xConnectFailuresMetric, "mqtt.connectFailures" );
+
 /* Static function declarations ***********************************************/
 
 /**
@@ -164,6 +184,35 @@ static EventGroupHandle_t xNetworkEventGroup;
  */
 static uint32_t prvGetTimeMs( void );
 
+/**
+ * @brief Receive function of the agent's message interface. Takes the next
+ * command from the command queue and hands it and the queue depth to the
+ * command log. Runs in the agent task right before the command is processed.
+ *
+ * @param[in] pxMsgCtx The command queue.
+ * @param[out] ppxReceivedCommand The received command.
+ * @param[in] ulBlockTimeMs Time to wait for a command.
+ *
+ * @return true if a command was received.
+ */
+static bool prvMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
+                               MQTTAgentCommand_t ** ppxReceivedCommand,
+                               uint32_t ulBlockTimeMs );
+
+/**
+ * @brief Send function of the transport interface. Stamps the send time of
+ * the command the agent task works on in the command log.
+ *
+ * @param[in] pxNetworkContext The network context.
+ * @param[in] pvBuffer Data to send.
+ * @param[in] xBytesToSend Length of pvBuffer.
+ *
+ * @return Bytes sent, negative on error.
+ */
+static int32_t prvTransportSend( NetworkContext_t * pxNetworkContext,
+                                 const void * pvBuffer,
+                                 size_t xBytesToSend );
+
 /**
  * @brief Fan out the incoming publishes to the callbacks registered by different
  * tasks. If there are no callbacks registered for the incoming publish, it will be
@@ -209,8 +258,8 @@ static MQTTStatus_t prvHandleResubscribe( void );
  * @brief Task used to run the MQTT agent.
  *
  * This task calls MQTTAgent_CommandLoop() in a loop, until MQTTAgent_Terminate()
- * is called. If an error occurs in the command loop, then it will reconnect the
- * TCP and MQTT connections.
+ * is called. If an error occurs in the command loop or a restart was requested,
+ * then it will reconnect the TCP and MQTT connections.
  *
  * @param[in] pvParameters Parameters as passed at the time of task creation. Not
  * used in this example.
@@ -340,14 +389,12 @@ static inline BaseType_t xUnlockSubList( void )
 
 static uint32_t prvGetTimeMs( void )
 {
-    TickType_t xTickCount = 0;
     uint32_t ulTimeMs = 0UL;
 
-    /* Get the current tick count. */
-    xTickCount = xTaskGetTickCount();
-
-    /* Convert the ticks to milliseconds. */
-    ulTimeMs = ( uint32_t ) xTickCount * MILLISECONDS_PER_TICK;
+    /* Take the 64-bit monotonic time instead of the tick count, so the
+     * resolution does not depend on configTICK_RATE_HZ. Truncating to 32 bits
+     * wraps cleanly, coreMQTT only uses differences of these values. */
+    ulTimeMs = ( uint32_t ) ( TimestampMonoUs() / MICROSECONDS_PER_MILLISECOND );
 
     /* Reduce ulGlobalEntryTimeMs from obtained time so as to always return the
      * elapsed time in the application. */
@@ -356,6 +403,36 @@ static uint32_t prvGetTimeMs( void )
     return ulTimeMs;
 }
 
+static bool prvMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
+                               MQTTAgentCommand_t ** ppxReceivedCommand,
+                               uint32_t ulBlockTimeMs )
+{
+    bool xReceived = Agent_MessageReceive( pxMsgCtx, ppxReceivedCommand, ulBlockTimeMs );
+
+    if( xReceived == true )
+    {
+        /* Including the command just taken. */
+        vMqttAgentCommandLogQueueDepth( ( uint32_t ) uxQueueMessagesWaiting( xCommandQueue.queue ) + 1U );
+        vMqttAgentFuturesCommandReceived( *ppxReceivedCommand );
+    }
+
+    return xReceived;
+}
+
+static int32_t prvTransportSend( NetworkContext_t * pxNetworkContext,
+                                 const void * pvBuffer,
+                                 size_t xBytesToSend )
+{
+    int32_t lBytesSent = espTlsTransportSend( pxNetworkContext, pvBuffer, xBytesToSend );
+
+    if( lBytesSent > 0 )
+    {
+        vMqttAgentCommandLogSendDone();
+    }
+
+    return lBytesSent;
+}
+
 static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
                                         uint16_t packetId,
                                         MQTTPublishInfo_t * pxPublishInfo )
@@ -365,6 +442,10 @@ static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
 
     ( void ) packetId;
 
+    /* Incoming publishes have to fit into the network buffer. */
+    vMqttAgentCommandLogPublishSize( eMqttAgentPublishIncoming,
+                                     pxPublishInfo->topicNameLength + pxPublishInfo->payloadLength );
+
     /* Fan out the incoming publishes to the callbacks registered using
      * subscription manager. */
     xPublishHandled = handleIncomingPublishes( ( SubscriptionElement_t * ) pMqttAgentContext->pIncomingCallbackContext,
@@ -507,6 +588,7 @@ static MQTTStatus_t prvHandleResubscribe( void )
 static void prvMQTTAgentTask( void * pvParameters )
 {
     MQTTStatus_t xMQTTStatus = MQTTSuccess;
+    bool xRestart = false;
 
     ( void ) pvParameters;
 
@@ -523,9 +605,18 @@ static void prvMQTTAgentTask( void * pvParameters )
          * clean up and reconnect however the application writer prefers. */
         xMQTTStatus = MQTTAgent_CommandLoop( &xGlobalMqttAgentContext );
 
+        /* A command interrupted by the disconnect is not acked anymore, the
+         * writes of the reconnect must not count as its send time. */
+        vMqttAgentFuturesCommandReceived( NULL );
+
         /* Success is returned for disconnect or termination. The socket should
-         * be disconnected. */
-        if( xMQTTStatus == MQTTSuccess )
+         * be disconnected. A disconnect queued for a restart is handled like an
+         * error, only once the command loop has returned may the connection
+         * task close the TLS session. After an error the flag stays set until
+         * the queued disconnect was processed. */
+        xRestart = ( xMQTTStatus == MQTTSuccess ) && atomic_exchange( &xRestartRequested, false );
+
+        if( ( xMQTTStatus == MQTTSuccess ) && !xRestart )
         {
             ESP_LOGI( TAG, "MQTT Disconnect from broker." );
             RgbLedETHConnected();
@@ -539,7 +630,7 @@ static void prvMQTTAgentTask( void * pvParameters )
                                 CORE_MQTT_AGENT_DISCONNECTED_BIT );
             xCoreMqttAgentManagerPost( CORE_MQTT_AGENT_DISCONNECTED_EVENT );
         }
-    } while( xMQTTStatus != MQTTSuccess );
+    } while( ( xMQTTStatus != MQTTSuccess ) || xRestart );
 }
 
 static BaseType_t prvStartCoreMqttAgent( void )
@@ -571,7 +662,7 @@ static MQTTStatus_t prvCoreMqttAgentInit( NetworkContext_t * pxNetworkContext )
     {
         .pMsgCtx        = NULL,
         .send           = Agent_MessageSend,
-        .recv           = Agent_MessageReceive,
+        .recv           = prvMessageReceive,
         .getCommand     = Agent_GetCommand,
         .releaseCommand = Agent_ReleaseCommand
     };
@@ -590,7 +681,7 @@ static MQTTStatus_t prvCoreMqttAgentInit( NetworkContext_t * pxNetworkContext )
 
     /* Fill in Transport Interface send and receive function pointers. */
     xTransport.pNetworkContext = pxNetworkContext;
-    xTransport.send = espTlsTransportSend;
+    xTransport.send = prvTransportSend;
     xTransport.recv = espTlsTransportRecv;
 
     vTlsSetConnectTimeout( 3000 );
@@ -769,6 +860,7 @@ static void prvCoreMqttAgentConnectionTask( void * pvParameters )
 
             if( eMqttRet != MQTTSuccess )
             {
+                MetricAdd( &xConnectFailuresMetric, 1 );
                 xTlsDisconnect( pxNetworkContext );
                 xBackoffRet = prvBackoffForRetry( &xReconnectParams );
             }
@@ -776,6 +868,11 @@ static void prvCoreMqttAgentConnectionTask( void * pvParameters )
 
         if( eMqttRet == MQTTSuccess )
         {
+            if( !xCleanSession )
+            {
+                MetricAdd( &xReconnectsMetric, 1 );
+            }
+
             xCleanSession = false;
             /* Flag that an MQTT connection has been established. */
             xEventGroupClearBits( xNetworkEventGroup,
@@ -911,12 +1008,13 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
         case CORE_MQTT_AGENT_CONNECTED_EVENT:
             ESP_LOGI( TAG,
                       "coreMQTT-Agent connected." );
+            BootProfileMark( BOOT_STAGE_MQTT_CONNECTED );
             break;
 
         case CORE_MQTT_AGENT_DISCONNECTED_EVENT:
+            /* The NFC readers keep running, scans are held until the access
+             * channel is back. */
             RgbLedETHConnected();
-            DestroyNFC();
-            
             ESP_LOGI( TAG,
                       "coreMQTT-Agent disconnected." );
             /* Notify networking tasks of TLS and MQTT disconnection. */
@@ -944,6 +1042,36 @@ static void prvCoreMqttAgentEventHandler( void * pvHandlerArg,
 
 /* Public function definitions ************************************************/
 
+BaseType_t xCoreMqttAgentManagerRestartConnection( void )
+{
+    MQTTAgentCommandInfo_t xCommandInfo = { 0 };
+
+    if( ( xEventGroupGetBits( xNetworkEventGroup ) & CORE_MQTT_AGENT_CONNECTED_BIT ) == 0 )
+    {
+        return pdFAIL;
+    }
+
+    /* A restart already on its way is not queued twice. */
+    if( atomic_exchange( &xRestartRequested, true ) )
+    {
+        return pdPASS;
+    }
+
+    ESP_LOGW( TAG, "Restarting MQTT connection." );
+
+    /* The agent task still uses the TLS session, so it is stopped first. It
+     * ends its command loop on the disconnect and signals the disconnection,
+     * then the connection task closes the session, which frees its buffers,
+     * and reconnects. */
+    if( MQTTAgent_Disconnect( &xGlobalMqttAgentContext, &xCommandInfo ) != MQTTSuccess )
+    {
+        atomic_store( &xRestartRequested, false );
+        return pdFAIL;
+    }
+
+    return pdPASS;
+}
+
 BaseType_t xCoreMqttAgentManagerPost( int32_t lEventId )
 {
     esp_err_t xEspErrRet;
@@ -1041,6 +1169,14 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
 
             xRet = pdFAIL;
         }
+        else if( !bUseWifi && EthHasIp() )
+        {
+            /* Ethernet is brought up in parallel with the rest of the startup,
+             * so the IP may have been assigned before the handler existed. */
+            ESP_LOGI( TAG, "ETH already connected." );
+            xEventGroupSetBits( xNetworkEventGroup,
+                                WIFI_CONNECTED_BIT );
+        }
     }
 
     if( xRet != pdFAIL )
@@ -1091,6 +1227,23 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn )
         }
     }
 
+    if( xRet != pdFAIL )
+    {
+        MetricRegister( &xReconnectsMetric );
+        MetricRegister( &xConnectFailuresMetric );
+
+        /* The demos send their commands through the shared future pool. */
+        xRet = xMqttAgentFuturesInit();
+
+        if( xRet != pdPASS )
+        {
+            ESP_LOGE( TAG,
+                      "Failed to initialize coreMQTT-Agent futures." );
+
+            xRet = pdFAIL;
+        }
+    }
+
     if( xRet != pdFAIL )
     {
         /* Start coreMQTT-Agent. */
@@ -68,6 +68,21 @@ BaseType_t xCoreMqttAgentManagerStart( NetworkContext_t * pxNetworkContextIn );
  */
 BaseType_t xCoreMqttAgentManagerPost( int32_t lEventId );
 
+/**
+ * @brief Tears down the TLS and MQTT connection and lets the connection task
+ * establish a fresh one.
+ *
+ * Used for in-place recovery, e.g. when heap is running low, instead of
+ * restarting the whole device.
+ *
+ * The agent task is stopped with a disconnect command before the connection
+ * task closes the TLS session.
+ *
+ * @return pdPASS if a restart was triggered, pdFAIL if not connected or the
+ * command could not be queued.
+ */
+BaseType_t xCoreMqttAgentManagerRestartConnection( void );
+
 /* *INDENT-OFF* */
     #ifdef __cplusplus
         } /* extern "C" */
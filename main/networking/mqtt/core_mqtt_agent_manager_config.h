@@ -106,6 +106,18 @@
  */
 #define configMQTT_AGENT_TASK_PRIORITY                  ( CONFIG_GRI_MQTT_AGENT_TASK_PRIORITY )
 
+/**
+ * @brief The number of coreMQTT-Agent commands that can be in flight at the
+ * same time through core_mqtt_agent_futures.h.
+ */
+#define configMQTT_AGENT_FUTURE_POOL_SIZE               ( CONFIG_GRI_MQTT_AGENT_FUTURE_POOL_SIZE )
+
+/**
+ * @brief The number of commands kept in the per-command timing log of
+ * core_mqtt_agent_command_log.h. Must be a power of two.
+ */
+#define configMQTT_AGENT_COMMAND_LOG_SIZE               ( CONFIG_GRI_MQTT_AGENT_COMMAND_LOG_SIZE )
+
 /* *INDENT-OFF* */
     #ifdef __cplusplus
         } /* extern "C" */
@@ -39,6 +39,7 @@
 
 //Include LED Strip to change color
 #include "extras/ledStrip.h"
+#include "extras/BootProfile.h"
 
 static const char * TAG = "app_wifi";
 static const int WIFI_CONNECTED_EVENT = BIT0;
@@ -145,6 +146,7 @@ static void event_handler( void * arg,
     else if( ( event_base == IP_EVENT ) && ( event_id == IP_EVENT_STA_GOT_IP ) )
     {
         RgbLedETHConnected();
+        BootProfileMark( BOOT_STAGE_NETWORK_UP );
         ip_event_got_ip_t * event = ( ip_event_got_ip_t * ) event_data;
         ESP_LOGI( TAG, "Connected with IP Address:" IPSTR, IP2STR( &event->ip_info.ip ) );
         /* Signal main application to continue execution */
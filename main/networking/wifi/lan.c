@@ -31,6 +31,7 @@
 
 #include "lan.h"
 #include "extras/ledStrip.h"
+#include "extras/BootProfile.h"
 //#include "sntpTime.h"
 
 static const char *TAG = "Ethernet";
@@ -47,6 +48,9 @@ static eth_connect_event_callback_t EthConnectedEvent_cb;
 //Boolean to show if its connectet
 bool b_is_eth_connected = true;
 
+//Set once an IP was assigned, the MQTT manager may start after that event
+static volatile bool b_eth_has_ip = false;
+
 uint8_t mac_addr[6] = {0};
 
 /** Event handler for Ethernet events */
@@ -67,6 +71,7 @@ static void eth_event_handler(void *arg, esp_event_base_t event_base,
     case ETHERNET_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "Ethernet Link Down");
         b_is_eth_connected = false;
+        b_eth_has_ip = false;
         RgbLedETHAppStarted();
         break;
     case ETHERNET_EVENT_START:
@@ -96,6 +101,8 @@ static void got_ip_event_handler(void *arg, esp_event_base_t event_base,
 
 
     b_is_eth_connected = true;
+    b_eth_has_ip = true;
+    BootProfileMark(BOOT_STAGE_NETWORK_UP);
     if(EthConnectedEvent_cb)
     {
         EthCallCallback();
@@ -173,7 +180,8 @@ void start_ethernet(void)
         ESP_ERROR_CHECK(esp_eth_start(eth_handles[i]));
     }
 
-    vWaitOnETHConnected();
+    // Nicht auf den Link warten, Autonegotiation und DHCP laufen parallel zum restlichen Start
+    BootProfileMark(BOOT_STAGE_ETH_STARTED);
 }
 
 bool bIsConnected()
@@ -181,6 +189,11 @@ bool bIsConnected()
     return b_is_eth_connected;
 }
 
+bool EthHasIp(void)
+{
+    return b_eth_has_ip;
+}
+
 void vWaitOnETHConnected(void)
 {
     xEventGroupWaitBits( eth_event_group, ETH_CONNECTED_EVENT, false, true, portMAX_DELAY );
@@ -20,11 +20,14 @@ extern bool bUseWifi;
 //Callback typedef
 typedef void (*eth_connect_event_callback_t)(void);
 
-//Starts ethernet connection
+//Starts ethernet connection, returns without waiting for the link
 void start_ethernet(void);
 
 bool bIsConnected();
 
+//True while the interface has an IP address
+bool EthHasIp(void);
+
 //Sets the callback function
 void EthSetCallback(eth_connect_event_callback_t cb);
 
@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""
+Builds the image for the "allowlist" data partition read by
+extras/AllowList.c.
+
+Layout (little endian):
+    0   u32  magic "ALST"
+    4   u16  format version (1)
+    6   u16  record size (5)
+    8   u32  record count
+    12  u32  serial, should grow with every list that is rolled out
+    16  u32  CRC32 of all records (zlib.crc32)
+    20  12 bytes reserved (0)
+    32  records: 5-byte UIDs, big endian, sorted ascending, no duplicates
+
+Input is a text file with one UID per line, as 10 hex digits like the
+"uid" field of the access request (convert_uid_to_string()). Empty lines
+and lines starting with # are skipped, anything after the first comma is
+ignored so CSV exports can be used directly.
+
+Build an image and flash it:
+    gen_allowlist.py build badges.csv --serial 42 -o allowlist.bin
+    parttool.py --partition-name allowlist write_partition --input allowlist.bin
+
+Estimate lookup cost against list size (flash reads per lookup for the
+interpolation + binary search used on the device):
+    gen_allowlist.py bench
+
+Build a delta message for device/allowlist/<mac>/sync from the list the
+device reported (version from its status) to the new one (see
+extras/AllowListSync.h for the message layout):
+    gen_allowlist.py delta old.csv new.csv --from 42 --to 43 -o delta.bin
+
+Compare bytes sent for delta sync and full resync at typical churn:
+    gen_allowlist.py churn
+"""
+
+import argparse
+import random
+import struct
+import sys
+import zlib
+
+MAGIC = 0x54534C41
+FORMAT_VERSION = 1
+RECORD_SIZE = 5
+HEADER = struct.Struct("<IHHIII12x")
+UID_MAX = (1 << 40) - 1
+
+# Must match the size of the allowlist entry in partitions.csv
+DEFAULT_PARTITION_SIZE = 0xA0000
+
+# Must match INTERPOLATION_STEPS in extras/AllowList.c
+INTERPOLATION_STEPS = 4
+
+# Sync messages, must match extras/AllowListSync.c
+DELTA_MAGIC = 0x54444C41
+DELTA_HEADER = struct.Struct("<IIIHH")
+BLOCK_HEADER_SIZE = 12
+BLOCK_SIZE = 4096
+OFFER_SIZE = 12
+# Status / block request JSON sent by the device, roughly
+STATUS_SIZE = 300
+REQUEST_SIZE = 90
+# Default of CONFIG_ALLOWLIST_OVERLAY_MAX_ENTRIES
+DEFAULT_OVERLAY_MAX = 512
+# Keeps a delta well below the MQTT network buffer of the device
+MAX_DELTA_RECORDS = 1600
+
+
+def read_uids(path):
+    uids = set()
+    with open(path, "r", encoding="utf-8") as f:
+        for number, line in enumerate(f, 1):
+            text = line.split(",", 1)[0].strip()
+            if not text or text.startswith("#"):
+                continue
+            try:
+                uid = int(text, 16)
+            except ValueError:
+                sys.exit("%s:%d: not a hex UID: %r" % (path, number, text))
+            if len(text) > 10 or uid > UID_MAX:
+                sys.exit("%s:%d: UID longer than 40 bits: %r" % (path, number, text))
+            uids.add(uid)
+    return sorted(uids)
+
+
+def build_image(uids, serial):
+    records = b"".join(uid.to_bytes(RECORD_SIZE, "big") for uid in uids)
+    header = HEADER.pack(MAGIC, FORMAT_VERSION, RECORD_SIZE, len(uids), serial,
+                         zlib.crc32(records) & 0xFFFFFFFF)
+    return header + records
+
+
+def search(keys, uid):
+    """Same algorithm as Search() in AllowList.c, returns (found, flash reads)."""
+    lo, hi = 0, len(keys) - 1
+    low_key, high_key = 0, UID_MAX + 1
+    reads = 0
+    step = 0
+    while lo <= hi:
+        if step < INTERPOLATION_STEPS:
+            offset = ((uid - low_key) * (hi - lo + 1)) // (high_key - low_key)
+            mid = lo + min(offset, hi - lo)
+        else:
+            mid = lo + (hi - lo) // 2
+        step += 1
+        reads += 1
+        key = keys[mid]
+        if key == uid:
+            return True, reads
+        if key < uid:
+            lo, low_key = mid + 1, key
+        else:
+            if mid == 0:
+                return False, reads
+            hi, high_key = mid - 1, key
+    return False, reads
+
+
+def bench(args):
+    rng = random.Random(args.seed)
+    capacity = (args.partition_size - HEADER.size) // RECORD_SIZE
+    sizes = [s for s in (1000, 10000, 50000, 100000, capacity) if s <= capacity]
+
+    print("%8s %10s %10s %10s" % ("entries", "avg reads", "max reads", "binary"))
+    for size in sizes:
+        keys = sorted(rng.sample(range(UID_MAX + 1), size))
+        queries = [(rng.choice(keys), True) for _ in range(args.lookups // 2)]
+        queries += [(rng.randint(0, UID_MAX), False) for _ in range(args.lookups // 2)]
+        reads = []
+        for uid, listed in queries:
+            found, count = search(keys, uid)
+            if listed and not found:
+                sys.exit("search missed an entry, algorithm out of sync")
+            reads.append(count)
+        print("%8d %10.1f %10d %10d" % (size, sum(reads) / len(reads), max(reads),
+                                        size.bit_length()))
+
+
+def build_delta(old, new, from_version, to_version):
+    old, new = set(old), set(new)
+    adds = sorted(new - old)
+    removes = sorted(old - new)
+    if len(adds) + len(removes) > MAX_DELTA_RECORDS:
+        return None
+    return (DELTA_HEADER.pack(DELTA_MAGIC, from_version, to_version, len(adds), len(removes)) +
+            b"".join(uid.to_bytes(RECORD_SIZE, "big") for uid in adds + removes))
+
+
+def full_resync_bytes(count):
+    """Device to cloud and back for one full resync of count UIDs."""
+    length = HEADER.size + count * RECORD_SIZE
+    blocks = (length + BLOCK_SIZE - 1) // BLOCK_SIZE
+    return OFFER_SIZE + length + blocks * (BLOCK_HEADER_SIZE + REQUEST_SIZE) + STATUS_SIZE
+
+
+def delta(args):
+    old = read_uids(args.old)
+    new = read_uids(args.new)
+    message = build_delta(old, new, args.from_version, args.to_version)
+    if message is None:
+        sys.exit("delta has more than %d changes, send a full resync instead" % MAX_DELTA_RECORDS)
+
+    with open(args.output, "wb") as f:
+        f.write(message)
+    print("%s: version %d -> %d, %d bytes (full image %d bytes)" % (
+        args.output, args.from_version, args.to_version, len(message), HEADER.size + len(new) * RECORD_SIZE))
+
+
+def churn(args):
+    """Bytes per day for daily deltas against a full resync, both directions."""
+    print("%8s %8s %12s %12s %14s" % ("entries", "changes", "delta bytes", "full bytes", "days to resync"))
+    for size in (1000, 10000, 100000):
+        full = full_resync_bytes(size)
+        for rate in (0.001, 0.01):
+            changes = max(1, int(size * rate))
+            # Half adds, half removes, each change ends up in the overlay
+            message = DELTA_HEADER.size + changes * RECORD_SIZE + STATUS_SIZE
+            days = args.overlay // max(1, changes // 2)
+            print("%8d %8d %12d %12d %14s" % (size, changes, message, full, days if days else "every"))
+
+
+def build(args):
+    uids = read_uids(args.input)
+    capacity = (args.partition_size - HEADER.size) // RECORD_SIZE
+    if len(uids) > capacity:
+        sys.exit("%d UIDs do not fit, the partition holds %d" % (len(uids), capacity))
+
+    image = build_image(uids, args.serial)
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print("%s: %d UIDs, serial %d, %d of %d bytes" % (args.output, len(uids), args.serial,
+                                                     len(image), args.partition_size))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--partition-size", type=lambda s: int(s, 0), default=DEFAULT_PARTITION_SIZE)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    p = commands.add_parser("build", help="build a partition image from a UID list")
+    p.add_argument("input")
+    p.add_argument("--serial", type=int, required=True)
+    p.add_argument("-o", "--output", default="allowlist.bin")
+    p.set_defaults(func=build)
+
+    p = commands.add_parser("bench", help="flash reads per lookup against list size")
+    p.add_argument("--lookups", type=int, default=2000)
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=bench)
+
+    p = commands.add_parser("delta", help="delta message between two UID lists")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("--from", dest="from_version", type=int, required=True)
+    p.add_argument("--to", dest="to_version", type=int, required=True)
+    p.add_argument("-o", "--output", default="delta.bin")
+    p.set_defaults(func=delta)
+
+    p = commands.add_parser("churn", help="delta sync against full resync for typical churn")
+    p.add_argument("--overlay", type=int, default=DEFAULT_OVERLAY_MAX)
+    p.set_defaults(func=churn)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+Generates the flash-resident LED ring tables used by extras/ledStrip.c.
+
+All animations are emitted as per-frame, per-pixel intensity keyframes
+(0..255), together with a gamma correction LUT. At runtime the renderer
+only indexes these tables, scales the state color by the intensity and
+looks the result up in the gamma LUT.
+
+Invoked from main/CMakeLists.txt at build time with the configured ring
+length (CONFIG_LED_STRIP_LEN).
+"""
+
+import argparse
+import math
+import os
+
+GAMMA = 2.6
+PULSE_FRAMES = 64
+SPINNER_TAIL_DIVISOR = 3
+
+
+def gamma_lut():
+    return [int(round(math.pow(i / 255.0, GAMMA) * 255.0)) for i in range(256)]
+
+
+def waterfall(ring_len):
+    """Fill the ring pixel by pixel, then clear it pixel by pixel."""
+    frames = []
+    for step in range(2 * ring_len):
+        frame = []
+        for i in range(ring_len):
+            lit = (i <= step) if step < ring_len else (i + ring_len > step)
+            frame.append(255 if lit else 0)
+        frames.append(frame)
+    return frames
+
+
+def pulse():
+    """Whole-ring breathing, one intensity per frame (raised cosine)."""
+    return [int(round((1.0 - math.cos(2.0 * math.pi * f / PULSE_FRAMES)) * 127.5))
+            for f in range(PULSE_FRAMES)]
+
+
+def spinner(ring_len):
+    """A comet head running around the ring with a fading tail."""
+    tail = max(2, ring_len // SPINNER_TAIL_DIVISOR)
+    frames = []
+    for head in range(ring_len):
+        frame = [0] * ring_len
+        for t in range(tail):
+            frame[(head - t) % ring_len] = int(round(255.0 * (tail - t) / tail))
+        frames.append(frame)
+    return frames
+
+
+def fmt_row(values, indent):
+    lines = []
+    for start in range(0, len(values), 16):
+        chunk = ", ".join("%3d" % v for v in values[start:start + 16])
+        lines.append(indent + chunk + ",")
+    return "\n".join(lines)
+
+
+def fmt_frames(frames, indent):
+    return "\n".join("%s{ %s }," % (indent, ", ".join("%3d" % v for v in frame))
+                     for frame in frames)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--ring-len", type=int, required=True)
+    parser.add_argument("--output-dir", required=True)
+    args = parser.parse_args()
+
+    n = args.ring_len
+    wf = waterfall(n)
+    sp = spinner(n)
+    pl = pulse()
+
+    header = """/* Generated by main/tools/gen_led_tables.py - do not edit. */
+#ifndef LED_TABLES_H
+#define LED_TABLES_H
+
+#include <stdint.h>
+
+#define LED_TABLES_RING_LEN          %d
+#define LED_WATERFALL_FRAMES         %d
+#define LED_PULSE_FRAMES             %d
+#define LED_SPINNER_FRAMES           %d
+
+extern const uint8_t led_gamma8[256];
+extern const uint8_t led_waterfall[LED_WATERFALL_FRAMES][LED_TABLES_RING_LEN];
+extern const uint8_t led_pulse[LED_PULSE_FRAMES];
+extern const uint8_t led_spinner[LED_SPINNER_FRAMES][LED_TABLES_RING_LEN];
+
+#endif /* LED_TABLES_H */
+""" % (n, len(wf), len(pl), len(sp))
+
+    source = """/* Generated by main/tools/gen_led_tables.py - do not edit. */
+#include "led_tables.h"
+
+const uint8_t led_gamma8[256] = {
+%s
+};
+
+const uint8_t led_waterfall[LED_WATERFALL_FRAMES][LED_TABLES_RING_LEN] = {
+%s
+};
+
+const uint8_t led_pulse[LED_PULSE_FRAMES] = {
+%s
+};
+
+const uint8_t led_spinner[LED_SPINNER_FRAMES][LED_TABLES_RING_LEN] = {
+%s
+};
+""" % (fmt_row(gamma_lut(), "    "), fmt_frames(wf, "    "),
+       fmt_row(pl, "    "), fmt_frames(sp, "    "))
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    for name, text in (("led_tables.h", header), ("led_tables.c", source)):
+        path = os.path.join(args.output_dir, name)
+        # Only rewrite on change so unrelated rebuilds stay incremental
+        if os.path.exists(path):
+            with open(path) as f:
+                if f.read() == text:
+                    continue
+        with open(path, "w") as f:
+            f.write(text)
+
+
+if __name__ == "__main__":
+    main()
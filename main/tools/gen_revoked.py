@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""
+Builds the Bloom filter of revoked UIDs read by extras/RevokedFilter.c.
+It is published as is to device/settings/<mac>/revoked.
+
+Layout (little endian):
+    0   u32  magic "RVBF"
+    4   u16  format version (1)
+    6   u8   number of hash functions
+    7   u8   reserved (0)
+    8   u32  number of bits, multiple of 8
+    12  u32  number of UIDs in the filter
+    16  u32  serial, must change with every filter, 0 = no filter
+    20  u32  CRC32 of the bits (zlib.crc32)
+    24  bits, bit i is bit (i % 8) of byte i / 8
+
+Input is the same UID list format as gen_allowlist.py.
+
+The device reports its budget as "revokedMaxBytes" in the settings request.
+The filter is sized for the wanted false positive rate and capped at that
+budget; the resulting rate is printed:
+    gen_revoked.py build revoked.csv --serial 7 --fp-rate 0.01 --max-bytes 2048
+
+A false positive denies an unknown UID without asking the cloud. UIDs on
+the local allow-list are never denied by the filter.
+
+Measure false positive rate and query throughput against filter size:
+    gen_revoked.py bench
+"""
+
+import argparse
+import math
+import random
+import struct
+import sys
+import time
+import zlib
+
+from gen_allowlist import read_uids, UID_MAX
+
+MAGIC = 0x46425652
+FORMAT_VERSION = 1
+HEADER = struct.Struct("<IHBBIIII")
+MASK32 = 0xFFFFFFFF
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+# Must match FILTER_MAX_HASHES and the default of CONFIG_NFC_REVOKED_FILTER_MAX_BYTES
+MAX_HASHES = 16
+DEFAULT_MAX_BYTES = 2048
+
+
+def hash_uid(uid):
+    """splitmix64, same as HashUid() in RevokedFilter.c."""
+    z = (uid + 0x9E3779B97F4A7C15) & MASK64
+    z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & MASK64
+    z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & MASK64
+    return z ^ (z >> 31)
+
+
+def bit_positions(uid, bit_count, hash_count):
+    h = hash_uid(uid)
+    h1 = h & MASK32
+    h2 = (h >> 32) | 1
+    return [(((h1 + i * h2) & MASK32) * bit_count) >> 32 for i in range(hash_count)]
+
+
+def size_filter(count, fp_rate, max_bytes):
+    """Bits and hash functions for count UIDs, capped at max_bytes."""
+    if count == 0:
+        return 0, 0
+    bits = math.ceil(-count * math.log(fp_rate) / (math.log(2) ** 2))
+    bits = min((bits + 7) // 8 * 8, max_bytes * 8)
+    hashes = max(1, min(MAX_HASHES, round(bits / count * math.log(2))))
+    return bits, hashes
+
+
+def expected_fp_rate(count, bit_count, hash_count):
+    if count == 0 or bit_count == 0:
+        return 0.0
+    return (1 - math.exp(-hash_count * count / bit_count)) ** hash_count
+
+
+class Filter:
+    def __init__(self, uids, fp_rate, max_bytes):
+        self.count = len(uids)
+        self.bit_count, self.hash_count = size_filter(self.count, fp_rate, max_bytes)
+        self.bits = bytearray(self.bit_count // 8)
+        for uid in uids:
+            for bit in bit_positions(uid, self.bit_count, self.hash_count):
+                self.bits[bit >> 3] |= 1 << (bit & 7)
+
+    def __contains__(self, uid):
+        if self.bit_count == 0:
+            return False
+        return all(self.bits[bit >> 3] & (1 << (bit & 7))
+                   for bit in bit_positions(uid, self.bit_count, self.hash_count))
+
+    def image(self, serial):
+        header = HEADER.pack(MAGIC, FORMAT_VERSION, self.hash_count, 0, self.bit_count, self.count,
+                             serial, zlib.crc32(self.bits) & MASK32)
+        return header + bytes(self.bits)
+
+
+def build(args):
+    uids = read_uids(args.input)
+    if args.serial == 0:
+        sys.exit("serial 0 means no filter on the device")
+
+    f = Filter(uids, args.fp_rate, args.max_bytes)
+    with open(args.output, "wb") as out:
+        out.write(f.image(args.serial))
+
+    rate = expected_fp_rate(f.count, f.bit_count, f.hash_count)
+    print("%s: %d UIDs, serial %d, %d bytes, %d hashes, expected false positives %.3f %%" % (
+        args.output, f.count, args.serial, f.bit_count // 8, f.hash_count, rate * 100))
+    if rate > args.fp_rate * 1.05:
+        print("warning: budget of %d bytes too small for %.3f %%" % (args.max_bytes, args.fp_rate * 100))
+
+
+def bench(args):
+    rng = random.Random(args.seed)
+
+    print("%8s %8s %8s %7s %11s %11s %12s" % ("revoked", "fp goal", "bytes", "hashes", "expected",
+                                             "measured", "queries/s"))
+    for count in (100, 1000, 5000):
+        for fp_rate in (0.01, 0.001):
+            revoked = set(rng.sample(range(UID_MAX + 1), count))
+            f = Filter(sorted(revoked), fp_rate, args.max_bytes)
+
+            queries = [rng.randint(0, UID_MAX) for _ in range(args.queries)]
+            queries = [uid for uid in queries if uid not in revoked]
+
+            start = time.perf_counter()
+            hits = sum(1 for uid in queries if uid in f)
+            took = time.perf_counter() - start
+
+            if not all(uid in f for uid in revoked):
+                sys.exit("revoked UID missing, filter broken")
+            print("%8d %7.2f%% %8d %7d %10.3f%% %10.3f%% %12.0f" % (
+                count, fp_rate * 100, f.bit_count // 8, f.hash_count,
+                expected_fp_rate(count, f.bit_count, f.hash_count) * 100,
+                hits / len(queries) * 100, len(queries) / took))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--max-bytes", type=int, default=DEFAULT_MAX_BYTES)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    p = commands.add_parser("build", help="build a filter from a UID list")
+    p.add_argument("input")
+    p.add_argument("--serial", type=int, required=True)
+    p.add_argument("--fp-rate", type=float, default=0.01)
+    p.add_argument("-o", "--output", default="revoked.bin")
+    p.set_defaults(func=build)
+
+    p = commands.add_parser("bench", help="false positive rate and query throughput")
+    p.add_argument("--queries", type=int, default=100000)
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(func=bench)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
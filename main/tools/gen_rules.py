@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""
+Builds the time-window rules read by extras/AccessRules.c. The result is
+published as is to device/settings/<mac>/rules.
+
+Layout (little endian):
+    0   u32  magic "ACRL"
+    4   u16  format version (1)
+    6   u8   number of groups
+    7   u8   reserved (0)
+    8   u32  number of UIDs
+    12  u32  serial, must change with every rule set, 0 = no rules
+    16  u32  CRC32 of everything after the header (zlib.crc32)
+    20  per group 84 bytes: 672 bits, one per quarter hour of the week in
+        local time, Monday 00:00 is bit 0, bit i is bit (i % 8) of byte i / 8
+        then per UID 6 bytes: UID (5 bytes, big endian, ascending) + group index
+
+Input is JSON, windows are "<days> HH:MM-HH:MM" in quarter hours. Days are
+Mon..Sun, ranges like Mon-Fri, lists like Mon,Wed or "daily". A window that
+ends before it starts runs past midnight into the next day:
+    {
+      "groups": {
+        "staff":    ["Mon-Fri 07:00-19:00"],
+        "cleaning": ["Mon-Fri 19:00-22:00", "Sat 06:00-10:00"],
+        "security": ["daily 18:00-06:00"]
+      },
+      "members": {"04A1B2C3D4": "staff", "0455AA0033": "security"}
+    }
+
+    gen_rules.py build rules.json --serial 3 -o rules.bin
+
+UIDs without a group are decided by the cloud as before.
+
+Check a Python model of the device algorithm (precomputed next transition,
+see NextTransition() in AccessRules.c) against a direct evaluation every 5
+minutes for every zone in extras/TimeZones.h, across both DST changes of a year:
+    gen_rules.py dstcheck
+
+This only checks the model. The C code itself is checked the same way against
+glibc localtime_r by tools/host_tests/test_access_rules_dst.c:
+    tools/host_tests/run.py access_rules
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = 0x4C524341
+FORMAT_VERSION = 1
+HEADER = struct.Struct("<IHBBIII")
+DAYS = ["mon", "tue", "wed", "thu", "fri", "sat", "sun"]
+QUARTERS_PER_DAY = 96
+WEEK_QUARTERS = 7 * QUARTERS_PER_DAY
+QUARTER_S = 900
+
+# Must match AccessRules.c and the defaults of the Kconfig options
+LOOKAHEAD_QUARTERS = 96
+MAX_GROUPS = 16
+MAX_UIDS = 512
+
+TIMEZONES_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "extras", "TimeZones.h")
+
+
+def parse_days(text):
+    text = text.lower()
+    if text == "daily":
+        return list(range(7))
+    days = []
+    for part in text.split(","):
+        if "-" in part:
+            first, last = (DAYS.index(d) for d in part.split("-"))
+            days += [(first + i) % 7 for i in range((last - first) % 7 + 1)]
+        else:
+            days.append(DAYS.index(part))
+    return days
+
+
+def parse_quarter(text):
+    hour, minute = (int(v) for v in text.split(":"))
+    if minute % 15 or not 0 <= hour * 60 + minute <= 24 * 60:
+        raise ValueError("%s is not a quarter hour" % text)
+    return (hour * 60 + minute) // 15
+
+
+def parse_window(text, bits):
+    match = re.fullmatch(r"\s*(\S+)\s+(\d\d?:\d\d)-(\d\d?:\d\d)\s*", text)
+    if not match:
+        raise ValueError("window must look like 'Mon-Fri 07:00-19:00': %r" % text)
+    start, end = parse_quarter(match.group(2)), parse_quarter(match.group(3))
+    length = (end - start) % QUARTERS_PER_DAY or QUARTERS_PER_DAY
+    for day in parse_days(match.group(1)):
+        for q in range(length):
+            bits[(day * QUARTERS_PER_DAY + start + q) % WEEK_QUARTERS] = 1
+
+
+def week_bytes(windows):
+    bits = [0] * WEEK_QUARTERS
+    for window in windows:
+        parse_window(window, bits)
+    return bytes(sum(bits[i + b] << b for b in range(8)) for i in range(0, WEEK_QUARTERS, 8))
+
+
+def build_rules(doc, serial):
+    names = list(doc["groups"])
+    if len(names) > MAX_GROUPS:
+        sys.exit("%d groups, the device holds %d" % (len(names), MAX_GROUPS))
+    weeks = b"".join(week_bytes(doc["groups"][name]) for name in names)
+
+    members = {}
+    for text, name in doc.get("members", {}).items():
+        uid = int(text, 16)
+        if len(text) > 10:
+            sys.exit("UID longer than 40 bits: %r" % text)
+        if name not in names:
+            sys.exit("UID %s: unknown group %r" % (text, name))
+        members[uid] = names.index(name)
+    if len(members) > MAX_UIDS:
+        sys.exit("%d UIDs, the device holds %d" % (len(members), MAX_UIDS))
+
+    body = weeks + b"".join(uid.to_bytes(5, "big") + bytes([group]) for uid, group in sorted(members.items()))
+    header = HEADER.pack(MAGIC, FORMAT_VERSION, len(names), 0, len(members), serial,
+                         zlib.crc32(body) & 0xFFFFFFFF)
+    return header + body, names, len(members)
+
+
+def build(args):
+    with open(args.input, "r", encoding="utf-8") as f:
+        doc = json.load(f)
+    if args.serial == 0:
+        sys.exit("serial 0 means no rules on the device")
+    try:
+        image, names, count = build_rules(doc, args.serial)
+    except ValueError as e:
+        sys.exit(str(e))
+
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print("%s: %d groups (%s), %d UIDs, serial %d, %d bytes" % (
+        args.output, len(names), ", ".join(names), count, args.serial, len(image)))
+
+
+def state_at(week, t):
+    """Same as StateAt() in AccessRules.c, Python counts tm_wday from Monday already."""
+    local = time.localtime(t)
+    quarter = local.tm_wday * QUARTERS_PER_DAY + local.tm_hour * 4 + local.tm_min // 15
+    return (week[quarter >> 3] >> (quarter & 7)) & 1
+
+
+def next_transition(week, now):
+    """Same as NextTransition() in AccessRules.c, returns (state, valid until)."""
+    state = state_at(week, now)
+    t = now - now % QUARTER_S
+    for _ in range(LOOKAHEAD_QUARTERS):
+        t += QUARTER_S
+        if state_at(week, t) != state:
+            break
+    return state, t
+
+
+def read_timezones(path):
+    zones = []
+    with open(path, "r", encoding="utf-8") as f:
+        for line in f:
+            match = re.match(r'\s*#define\s+(.+?)\s+"([^"]+)"', line)
+            if match:
+                zones.append((match.group(1), match.group(2)))
+    return zones
+
+
+def dstcheck(args):
+    # Windows around the usual change times Sunday 01:00 to 04:00, and one across
+    # midnight that does not cover them. Same as tools/host_tests/test_access_rules_dst.c
+    week = week_bytes(["Mon-Fri 07:00-19:00", "Sun 01:45-02:30", "Sun 02:45-03:15",
+                       "Fri 23:00-04:00", "daily 12:00-12:15"])
+    start = int(time.mktime((args.year, 1, 1, 0, 0, 0, 0, 0, 0)))
+    end = int(time.mktime((args.year + 1, 1, 1, 0, 0, 0, 0, 0, 0)))
+    saved = os.environ.get("TZ")
+    failed = 0
+
+    print("%-28s %-8s %8s %8s %s" % ("zone", "DST", "checks", "recalc", "result"))
+    try:
+        for name, tz in read_timezones(args.timezones):
+            os.environ["TZ"] = tz
+            time.tzset()
+
+            state, valid_until = None, 0
+            checks = recalcs = errors = 0
+            offsets = set()
+            for t in range(start, end, args.step):
+                # Scan path: cached state until valid_until, then recompute like the refresh job
+                if t >= valid_until:
+                    state, valid_until = next_transition(week, t)
+                    recalcs += 1
+                    if valid_until <= t:
+                        errors += 1
+                offsets.add(time.localtime(t).tm_gmtoff)
+                if state != state_at(week, t):
+                    errors += 1
+                checks += 1
+
+            failed += errors > 0
+            print("%-28s %-8s %8d %8d %s" % (name, "yes" if len(offsets) > 1 else "no", checks, recalcs,
+                                            "ok" if errors == 0 else "%d mismatches" % errors))
+    finally:
+        if saved is None:
+            os.environ.pop("TZ", None)
+        else:
+            os.environ["TZ"] = saved
+        time.tzset()
+
+    if failed:
+        sys.exit("%d zones failed" % failed)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    p = commands.add_parser("build", help="build rules from a JSON description")
+    p.add_argument("input")
+    p.add_argument("--serial", type=int, required=True)
+    p.add_argument("-o", "--output", default="rules.bin")
+    p.set_defaults(func=build)
+
+    p = commands.add_parser("dstcheck", help="check the transition precomputation for all zones")
+    p.add_argument("--timezones", default=TIMEZONES_H)
+    p.add_argument("--year", type=int, default=2025)
+    p.add_argument("--step", type=int, default=300, help="seconds between checked scans")
+    p.set_defaults(func=dstcheck)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
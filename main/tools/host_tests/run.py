@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+"""
+Host tests for modules under extras/ that do not need the ESP32. Each
+test_*.c includes the module source and is built with the stub headers in
+stubs/ (FreeRTOS, esp_log, esp_timer, LEDC, sdkconfig with the Kconfig
+defaults). Hardware and timer calls a module makes are defined by its test.
+
+    run.py              build and run all tests
+    run.py scheduler    only tests whose name contains "scheduler"
+
+Needs a C compiler (cc or $CC) with C11 atomics.
+"""
+
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+MAIN = os.path.normpath(os.path.join(HERE, "..", ".."))
+
+
+def build(source, output):
+    cc = os.environ.get("CC", "cc")
+    cmd = [cc, "-std=gnu11", "-Wall", "-Wextra", "-Wno-unused-function", "-Wno-unused-parameter", "-O2",
+           "-I", os.path.join(HERE, "stubs"), "-I", os.path.join(MAIN, "extras"), "-I", MAIN,
+           source, "-o", output, "-lm"]
+    return subprocess.run(cmd).returncode == 0
+
+
+def main():
+    pattern = sys.argv[1] if len(sys.argv) > 1 else ""
+    tests = [t for t in sorted(glob.glob(os.path.join(HERE, "test_*.c"))) if pattern in os.path.basename(t)]
+    failed = []
+
+    with tempfile.TemporaryDirectory() as tmp:
+        for test in tests:
+            name = os.path.splitext(os.path.basename(test))[0]
+            binary = os.path.join(tmp, name)
+            print("== %s" % name, flush=True)
+            if not build(test, binary) or subprocess.run([binary], cwd=HERE).returncode != 0:
+                failed.append(name)
+
+    print("%d of %d host tests passed" % (len(tests) - len(failed), len(tests)))
+    if failed:
+        sys.exit("failed: %s" % ", ".join(failed))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,43 @@
+/*
+ * LEDC types and calls used by extras/Piepser.c, the functions are defined
+ * by the test and record the tone on/off edges.
+ */
+#ifndef HOST_LEDC_H_
+#define HOST_LEDC_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum { LEDC_LOW_SPEED_MODE } ledc_mode_t;
+typedef enum { LEDC_TIMER_0 } ledc_timer_t;
+typedef enum { LEDC_CHANNEL_0 } ledc_channel_t;
+typedef enum { LEDC_TIMER_13_BIT = 13 } ledc_timer_bit_t;
+typedef enum { LEDC_AUTO_CLK } ledc_clk_cfg_t;
+typedef enum { LEDC_INTR_DISABLE } ledc_intr_type_t;
+
+typedef struct {
+    ledc_mode_t speed_mode;
+    ledc_timer_t timer_num;
+    ledc_timer_bit_t duty_resolution;
+    uint32_t freq_hz;
+    ledc_clk_cfg_t clk_cfg;
+} ledc_timer_config_t;
+
+typedef struct {
+    ledc_mode_t speed_mode;
+    ledc_channel_t channel;
+    ledc_timer_t timer_sel;
+    ledc_intr_type_t intr_type;
+    int gpio_num;
+    uint32_t duty;
+    int hpoint;
+} ledc_channel_config_t;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config);
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config);
+esp_err_t ledc_set_freq(ledc_mode_t mode, ledc_timer_t timer, uint32_t freqHz);
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty);
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel);
+
+#endif /* HOST_LEDC_H_ */
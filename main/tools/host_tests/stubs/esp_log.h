@@ -0,0 +1,11 @@
+#ifndef HOST_ESP_LOG_H_
+#define HOST_ESP_LOG_H_
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...)     fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)     ((void)(tag))
+#define ESP_LOGD(tag, fmt, ...)     ((void)(tag))
+
+#endif /* HOST_ESP_LOG_H_ */
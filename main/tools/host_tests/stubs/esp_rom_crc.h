@@ -0,0 +1,21 @@
+/*
+ * Bitwise CRC32 as in the ROM, esp_rom_crc32_le(0, ...) equals zlib.crc32().
+ */
+#ifndef HOST_ESP_ROM_CRC_H_
+#define HOST_ESP_ROM_CRC_H_
+
+#include <stdint.h>
+
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+#endif /* HOST_ESP_ROM_CRC_H_ */
@@ -0,0 +1,40 @@
+/*
+ * esp_timer with a clock the test sets, hostTimeUs is defined by the test.
+ * Tests of modules with one-shot timers also define the timer functions and
+ * fire the callbacks from their simulated clock.
+ */
+#ifndef HOST_ESP_TIMER_H_
+#define HOST_ESP_TIMER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+extern int64_t hostTimeUs;
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+static inline int64_t esp_timer_get_time(void)
+{
+    return hostTimeUs;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+#endif /* HOST_ESP_TIMER_H_ */
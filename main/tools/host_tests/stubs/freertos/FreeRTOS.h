@@ -0,0 +1,25 @@
+/*
+ * Minimal FreeRTOS for the host tests: single threaded, semaphores always
+ * succeed and tasks are never created.
+ */
+#ifndef HOST_FREERTOS_H_
+#define HOST_FREERTOS_H_
+
+#include <assert.h>
+#include <stdint.h>
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define pdFAIL                  0
+#define portMAX_DELAY           UINT32_MAX
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+#define configASSERT(x)         assert(x)
+
+#endif /* HOST_FREERTOS_H_ */
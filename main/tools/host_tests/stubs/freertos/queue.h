@@ -0,0 +1,67 @@
+/*
+ * Static FreeRTOS queues as a plain ring buffer, never blocks.
+ */
+#ifndef HOST_QUEUE_H_
+#define HOST_QUEUE_H_
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head;
+    UBaseType_t count;
+} StaticQueue_t;
+
+typedef StaticQueue_t *QueueHandle_t;
+
+static inline QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t *storage,
+                                               StaticQueue_t *queue)
+{
+    queue->storage = storage;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->head = 0;
+    queue->count = 0;
+    return queue;
+}
+
+static inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    (void)ticks;
+    if (queue->count == queue->length) {
+        return pdFAIL;
+    }
+    memcpy(queue->storage + ((queue->head + queue->count) % queue->length) * queue->itemSize, item, queue->itemSize);
+    queue->count++;
+    return pdPASS;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    (void)ticks;
+    if (queue->count == 0) {
+        return pdFAIL;
+    }
+    memcpy(item, queue->storage + queue->head * queue->itemSize, queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdPASS;
+}
+
+static inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+static inline BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    queue->head = 0;
+    queue->count = 0;
+    return pdPASS;
+}
+
+#endif /* HOST_QUEUE_H_ */
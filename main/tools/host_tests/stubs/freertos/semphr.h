@@ -0,0 +1,33 @@
+#ifndef HOST_SEMPHR_H_
+#define HOST_SEMPHR_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef int *SemaphoreHandle_t;
+
+static int hostSemaphore;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return &hostSemaphore;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return &hostSemaphore;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    (void)sem;
+    (void)ticks;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    (void)sem;
+    return pdTRUE;
+}
+
+#endif /* HOST_SEMPHR_H_ */
@@ -0,0 +1,13 @@
+/*
+ * Only the color type, Settings.h embeds it in the snapshot.
+ */
+#ifndef HOST_LED_STRIP_H_
+#define HOST_LED_STRIP_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint8_t r, g, b;
+} rgb_t;
+
+#endif /* HOST_LED_STRIP_H_ */
@@ -0,0 +1,56 @@
+/*
+ * No flash on the host: every namespace is missing, writes fail.
+ */
+#ifndef HOST_NVS_H_
+#define HOST_NVS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+static inline esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    (void)name;
+    (void)mode;
+    (void)handle;
+    return ESP_ERR_NOT_FOUND;
+}
+
+static inline esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+    (void)handle;
+    (void)key;
+    (void)value;
+    (void)length;
+    return ESP_ERR_NOT_FOUND;
+}
+
+static inline esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    (void)handle;
+    (void)key;
+    (void)value;
+    (void)length;
+    return ESP_ERR_NOT_FOUND;
+}
+
+static inline esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_ERR_NOT_FOUND;
+}
+
+static inline void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+#endif /* HOST_NVS_H_ */
@@ -0,0 +1,14 @@
+/*
+ * Kconfig defaults for the host tests, see Kconfig.projbuild. Only what the
+ * tested modules read.
+ */
+#ifndef HOST_SDKCONFIG_H_
+#define HOST_SDKCONFIG_H_
+
+#define CONFIG_SCHEDULER_TICK_MS        100
+#define CONFIG_SCHEDULER_MAX_JOBS       16
+#define CONFIG_SCHEDULER_SLOW_JOB_MS    2000
+#define CONFIG_ACCESS_RULES_MAX_GROUPS  16
+#define CONFIG_ACCESS_RULES_MAX_UIDS    512
+
+#endif /* HOST_SDKCONFIG_H_ */
@@ -0,0 +1,265 @@
+/*
+ * test_access_rules_dst.c
+ *
+ *  Prüft extras/AccessRules.c mit glibc localtime_r unter jeder Zone aus
+ *  extras/TimeZones.h über ein ganzes Jahr, also über beide Zeitumstellungen.
+ *  Der Refresh-Job läuft wie auf dem Gerät vor den Scans, jeder Scan über
+ *  AccessRulesCheck() muss dem Zeitfenster in Ortszeit entsprechen, direkt aus
+ *  der Fensterbeschreibung ausgewertet. Geprüft wird alle 5 Minuten und jeweils
+ *  eine Sekunde davor, so liegt jede Viertelstundengrenze zwischen zwei Scans.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "AccessRules.c"
+
+#define TIMEZONES_H     "../../extras/TimeZones.h"
+#define YEAR_START      1735689600LL    // 2025-01-01 00:00 UTC
+#define SCAN_STEP_S     300
+#define TEST_UID        0x04A1B2C3D4ULL
+
+/* Gerätefunktionen ***********************************************************/
+
+static int64_t utcUs = 0;
+
+bool TimestampHasUtc(void)
+{
+    return true;
+}
+
+int64_t TimestampUtcUs(void)
+{
+    return utcUs;
+}
+
+SchedulerJob *SchedulerAddJob(const char *name, SchedulerCallback callback, void *arg)
+{
+    (void)name;
+    (void)callback;
+    (void)arg;
+    return NULL;
+}
+
+SchedulerJob *SchedulerAddInterval(const char *name, uint32_t periodMs, uint32_t firstDelayMs,
+                                   SchedulerCallback callback, void *arg)
+{
+    (void)name;
+    (void)periodMs;
+    (void)firstDelayMs;
+    (void)callback;
+    (void)arg;
+    return NULL;
+}
+
+void SchedulerTrigger(SchedulerJob *job)
+{
+    (void)job;
+}
+
+/* Zeitfenster, wie gen_rules.py dstcheck *************************************/
+
+typedef struct {
+    uint8_t days;       // Bit 0 = Montag
+    int startMin;
+    int endMin;         // vor startMin: läuft über Mitternacht in den nächsten Tag
+} Window;
+
+#define MON_FRI     0x1F
+#define FRI         0x10
+#define SUN         0x40
+#define DAILY       0x7F
+
+// Fenster rund um die üblichen Umstellzeiten Sonntag 01:00 bis 04:00 und eins über
+// Mitternacht, das die Sonntagsfenster nicht überdeckt
+static const Window windows[] = {
+    { MON_FRI, 7 * 60, 19 * 60 },
+    { SUN, 1 * 60 + 45, 2 * 60 + 30 },
+    { SUN, 2 * 60 + 45, 3 * 60 + 15 },
+    { FRI, 23 * 60, 4 * 60 },
+    { DAILY, 12 * 60, 12 * 60 + 15 },
+};
+
+// Erwarteter Zustand zu Wochentag (0 = Montag) und Minute in Ortszeit
+static bool Expected(int day, int minute)
+{
+    int previous = (day + 6) % 7;
+
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        const Window *w = &windows[i];
+
+        if (w->startMin < w->endMin) {
+            if ((w->days >> day & 1) && minute >= w->startMin && minute < w->endMin) {
+                return true;
+            }
+        } else if (((w->days >> day & 1) && minute >= w->startMin) ||
+                   ((w->days >> previous & 1) && minute < w->endMin)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ExpectedAt(time_t t, long *offset)
+{
+    struct tm local;
+
+    localtime_r(&t, &local);
+    *offset = local.tm_gmtoff;
+    return Expected((local.tm_wday + 6) % 7, local.tm_hour * 60 + local.tm_min);
+}
+
+// Regelsatz mit einer Gruppe und einer UID, geht durch dieselbe Prüfung wie ein empfangener
+static void LoadRules(void)
+{
+    static uint8_t image[sizeof(AccessRulesHeader) + WEEK_BYTES + MEMBER_SIZE];
+    AccessRulesHeader header = {
+        .magic = RULES_MAGIC,
+        .formatVersion = RULES_FORMAT_VERSION,
+        .groupCount = 1,
+        .memberCount = 1,
+        .serial = 1,
+    };
+    uint8_t *week = image + sizeof(header);
+    uint8_t *member = week + WEEK_BYTES;
+
+    for (int q = 0; q < WEEK_QUARTERS; q++) {
+        if (Expected(q / 96, (q % 96) * 15)) {
+            week[q >> 3] |= (uint8_t)(1 << (q & 7));
+        }
+    }
+    for (int i = 0; i < 5; i++) {
+        member[i] = (uint8_t)(TEST_UID >> (8 * (4 - i)));
+    }
+    member[5] = 0;
+
+    header.crc32 = esp_rom_crc32_le(0, week, WEEK_BYTES + MEMBER_SIZE);
+    memcpy(image, &header, sizeof(header));
+
+    AccessRulesHeader checked;
+    if (!RulesValidate(image, sizeof(image), &checked)) {
+        printf("rule image rejected\n");
+        exit(1);
+    }
+    RulesPublish(image, &checked);
+}
+
+/* Zonen **********************************************************************/
+
+// Wie re.match(r'\s*#define\s+(.+?)\s+"([^"]+)"') in gen_rules.py
+static bool ParseZone(char *line, char **name, char **tz)
+{
+    char *p = line;
+    char *quote, *end;
+
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (strncmp(p, "#define", 7) != 0 || (quote = strchr(p, '"')) == NULL ||
+        (end = strchr(quote + 1, '"')) == NULL || end == quote + 1) {
+        return false;
+    }
+    p += 7;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    *name = p;
+    char *nameEnd = quote;
+    while (nameEnd > p && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t')) {
+        nameEnd--;
+    }
+    if (nameEnd == p) {
+        return false;
+    }
+    *nameEnd = '\0';
+    *end = '\0';
+    *tz = quote + 1;
+    return true;
+}
+
+// Ein Jahr in einer Zone, liefert die Zahl der Abweichungen
+static unsigned CheckZone(const char *name, const char *tz)
+{
+    unsigned checks = 0, errors = 0, recalcs = 0;
+    uint32_t slowBefore, slowAfter;
+    long firstOffset = 0, offset = 0;
+    bool dst = false;
+
+    setenv("TZ", tz, 1);
+    tzset();
+    // Vorberechnung verwerfen, die alte Zone gilt nicht mehr
+    atomic_store(&groupCache[0], 0);
+    AccessRulesGetStats(NULL, NULL, &slowBefore);
+
+    for (time_t t = YEAR_START; t < YEAR_START + 366LL * 86400; t += SCAN_STEP_S) {
+        // Der Refresh-Job läuft auf dem Gerät alle 15 s
+        uint64_t before = atomic_load(&groupCache[0]);
+        utcUs = (int64_t)(t - 15) * 1000000;
+        AccessRulesRefreshJob(NULL);
+        uint64_t after = atomic_load(&groupCache[0]);
+
+        if (after != before) {
+            recalcs++;
+            if ((time_t)((after >> 1) & CACHE_UNTIL_MASK) <= t - 15) {
+                if (errors++ < 5) {
+                    printf("  %s: refresh at %lld valid only until %lld\n", name, (long long)(t - 15),
+                           (long long)((after >> 1) & CACHE_UNTIL_MASK));
+                }
+            }
+        }
+
+        for (time_t scan = t - 1; scan <= t; scan++) {
+            bool expected = ExpectedAt(scan, &offset);
+
+            utcUs = (int64_t)scan * 1000000;
+            bool allowed = AccessRulesCheck(TEST_UID) == ACCESS_RULE_ALLOW;
+            checks++;
+            if (allowed != expected) {
+                if (errors++ < 5) {
+                    printf("  %s: %s at %lld, expected %s\n", name, allowed ? "allowed" : "denied",
+                           (long long)scan, expected ? "allowed" : "denied");
+                }
+            }
+        }
+
+        if (t == YEAR_START) {
+            firstOffset = offset;
+        } else if (offset != firstOffset) {
+            dst = true;
+        }
+    }
+
+    AccessRulesGetStats(NULL, NULL, &slowAfter);
+    printf("%-28s %-8s %8u %8u %8" PRIu32 " %s\n", name, dst ? "yes" : "no", checks, recalcs,
+           slowAfter - slowBefore, errors == 0 ? "ok" : "FAILED");
+    return errors;
+}
+
+int main(void)
+{
+    FILE *f = fopen(TIMEZONES_H, "r");
+    char line[256];
+    unsigned zones = 0, failed = 0;
+
+    if (f == NULL) {
+        printf("cannot open %s\n", TIMEZONES_H);
+        return 1;
+    }
+
+    LoadRules();
+    printf("%-28s %-8s %8s %8s %8s %s\n", "zone", "DST", "checks", "recalc", "slow", "result");
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *name, *tz;
+
+        if (!ParseZone(line, &name, &tz)) {
+            continue;
+        }
+        zones++;
+        failed += CheckZone(name, tz) > 0;
+    }
+    fclose(f);
+
+    printf("%u of %u zones failed\n", failed, zones);
+    return failed == 0 && zones > 0 ? 0 : 1;
+}
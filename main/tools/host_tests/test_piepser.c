@@ -0,0 +1,396 @@
+/*
+ * test_piepser.c
+ *
+ *  Prüft extras/Piepser.c: SoundParsePattern() mit gültigen und kaputten Mustern,
+ *  und den Sequenzer gegen eine simulierte Uhr. Jede Ton-an/aus-Flanke muss zu
+ *  freq:dauer:pause passen, auch wenn jeder Timer-Callback verspätet läuft; die
+ *  absoluten Zeitpunkte dürfen die Verspätungen nicht aufsummieren.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "Piepser.c"
+
+int64_t hostTimeUs = 0;
+
+static unsigned failures = 0;
+static unsigned checks = 0;
+
+#define CHECK(cond, ...)                                        \
+    do {                                                        \
+        checks++;                                               \
+        if (!(cond)) {                                          \
+            if (failures++ < 20) {                              \
+                printf("line %d: ", __LINE__);                  \
+                printf(__VA_ARGS__);                            \
+                printf("\n");                                   \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+/* Settings ********************************************************************/
+
+static SettingsSnapshot snapshot = { .useBuzzer = true };
+
+const SettingsSnapshot *SettingsAcquire(void)
+{
+    return &snapshot;
+}
+
+void SettingsRelease(const SettingsSnapshot *settings)
+{
+    (void)settings;
+}
+
+/* esp_timer: ein One-Shot-Timer, feuert mit einstellbarer Verspätung ********/
+
+static esp_timer_create_args_t timerArgs;
+static bool timerArmed = false;
+static int64_t timerDueUs = 0;
+static uint32_t latencySeed = 1;
+static int64_t maxLatencyUs = 0;
+static int64_t firstCallbackUs = -1;   // Start der Folge, eine stille erste Note hat keine Flanke
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    timerArgs = *args;
+    *handle = (esp_timer_handle_t)&timerArgs;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    (void)timer;
+    if (timerArmed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timerArmed = true;
+    timerDueUs = hostTimeUs + (int64_t)timeoutUs;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    (void)timer;
+    if (!timerArmed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timerArmed = false;
+    return ESP_OK;
+}
+
+// Verspätung des esp_timer Tasks, 0..maxLatencyUs
+static int64_t NextLatency(void)
+{
+    latencySeed = latencySeed * 1103515245u + 12345u;
+    return maxLatencyUs == 0 ? 0 : (int64_t)((latencySeed >> 8) % (uint32_t)(maxLatencyUs + 1));
+}
+
+// Lässt die Uhr bis endUs laufen und ruft dabei fällige Callbacks auf
+static void RunUntil(int64_t endUs)
+{
+    while (timerArmed && timerDueUs <= endUs) {
+        int64_t fireUs = timerDueUs + NextLatency();
+
+        timerArmed = false;
+        if (fireUs > hostTimeUs) {
+            hostTimeUs = fireUs;
+        }
+        if (firstCallbackUs < 0) {
+            firstCallbackUs = hostTimeUs;
+        }
+        timerArgs.callback(timerArgs.arg);
+    }
+    if (endUs > hostTimeUs) {
+        hostTimeUs = endUs;
+    }
+}
+
+/* LEDC: zeichnet die Flanken auf ********************************************/
+
+typedef struct {
+    int64_t us;
+    uint16_t freqHz;    // 0 = aus
+} Edge;
+
+static Edge edges[256];
+static int edgeCount = 0;
+static uint32_t ledcFreq = 0;
+static uint32_t ledcDuty = 0;
+static uint16_t outputHz = 0;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_freq(ledc_mode_t mode, ledc_timer_t timer, uint32_t freqHz)
+{
+    (void)mode;
+    (void)timer;
+    ledcFreq = freqHz;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty)
+{
+    (void)mode;
+    (void)channel;
+    ledcDuty = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+    (void)mode;
+    (void)channel;
+    uint16_t hz = ledcDuty > 0 ? (uint16_t)ledcFreq : 0;
+
+    // Nur echte Wechsel zählen, ein erneutes Ausschalten ist keine Flanke
+    if (hz != outputHz && edgeCount < (int)(sizeof(edges) / sizeof(edges[0]))) {
+        edges[edgeCount].us = hostTimeUs;
+        edges[edgeCount].freqHz = hz;
+        edgeCount++;
+    }
+    outputHz = hz;
+    return ESP_OK;
+}
+
+/* Erwartete Flanken **********************************************************/
+
+// Flanken einer Tonfolge ab startUs, wie sie ein pünktlicher Sequenzer erzeugt
+static int ExpectedEdges(const SoundSequence *seq, int64_t startUs, uint16_t fromHz, Edge *out, int64_t *endUs)
+{
+    int count = 0;
+    int64_t t = startUs;
+    uint16_t hz = fromHz;
+
+    for (int i = 0; i < seq->count; i++) {
+        const SoundTone *tone = &seq->tones[i];
+
+        if (tone->freqHz != hz) {
+            out[count].us = t;
+            out[count].freqHz = tone->freqHz;
+            count++;
+            hz = tone->freqHz;
+        }
+        t += (int64_t)tone->durationMs * 1000;
+        // Der Pausenschritt schaltet immer aus, auch bei Pause 0
+        if (hz != 0) {
+            out[count].us = t;
+            out[count].freqHz = 0;
+            count++;
+            hz = 0;
+        }
+        t += (int64_t)tone->gapMs * 1000;
+    }
+    *endUs = t;
+    return count;
+}
+
+static void CompareEdges(const char *name, const Edge *expected, int expectedCount, int64_t toleranceUs)
+{
+    CHECK(edgeCount == expectedCount, "%s: %d edges, expected %d", name, edgeCount, expectedCount);
+
+    for (int i = 0; i < edgeCount && i < expectedCount; i++) {
+        int64_t diff = edges[i].us - expected[i].us;
+
+        CHECK(edges[i].freqHz == expected[i].freqHz, "%s: edge %d is %u Hz, expected %u Hz",
+              name, i, edges[i].freqHz, expected[i].freqHz);
+        CHECK(diff >= -toleranceUs && diff <= toleranceUs,
+              "%s: edge %d at %" PRId64 " us, expected %" PRId64 " us", name, i, edges[i].us, expected[i].us);
+    }
+}
+
+static void Reset(void)
+{
+    SoundCancel();
+    RunUntil(hostTimeUs + 1000 * 1000);
+    edgeCount = 0;
+    hostTimeUs += 1000 * 1000;
+}
+
+static SoundSequence Parse(const char *pattern)
+{
+    SoundSequence seq = { 0 };
+
+    CHECK(SoundParsePattern(pattern, strlen(pattern), &seq), "\"%s\" rejected", pattern);
+    return seq;
+}
+
+/* Tests **********************************************************************/
+
+static void TestParse(void)
+{
+    SoundSequence seq = { 0 };
+
+    seq = Parse("2000:100:50,1000:200:0,0:80:20");
+    CHECK(seq.count == 3, "count %u", seq.count);
+    CHECK(seq.tones[0].freqHz == 2000 && seq.tones[0].durationMs == 100 && seq.tones[0].gapMs == 50, "tone 0");
+    CHECK(seq.tones[1].freqHz == 1000 && seq.tones[1].durationMs == 200 && seq.tones[1].gapMs == 0, "tone 1");
+    CHECK(seq.tones[2].freqHz == 0 && seq.tones[2].durationMs == 80 && seq.tones[2].gapMs == 20, "tone 2");
+
+    seq = Parse("65535:65535:65535");
+    CHECK(seq.count == 1 && seq.tones[0].freqHz == 65535 && seq.tones[0].gapMs == 65535, "max values");
+
+    seq = Parse("1:1:1,2:2:2,3:3:3,4:4:4,5:5:5,6:6:6,7:7:7,8:8:8");
+    CHECK(seq.count == SOUND_MAX_TONES, "count %u", seq.count);
+
+    static const char *invalid[] = {
+        "",
+        "2000",
+        "2000:100",
+        "2000:100:",
+        "2000:100:50:",
+        ":100:50",
+        "2000::50",
+        "2000:100:50x",
+        "2000:100:50;1000:100:0",
+        "2000:100:50,,1000:100:0",
+        "65536:100:50",
+        "2000:-1:50",
+        "abc:100:50",
+        "1:1:1,2:2:2,3:3:3,4:4:4,5:5:5,6:6:6,7:7:7,8:8:8,9:9:9",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        SoundSequence untouched = { .count = 99 };
+
+        CHECK(!SoundParsePattern(invalid[i], strlen(invalid[i]), &untouched), "\"%s\" accepted", invalid[i]);
+        CHECK(untouched.count == 99, "\"%s\" wrote the output", invalid[i]);
+    }
+
+    // Die Länge begrenzt, nicht die Null-Terminierung: eine abgeschnittene Zahl ist ungültig
+    const char *payload = "2000:100:50,1000:200:0";
+    CHECK(SoundParsePattern(payload, 11, &seq) && seq.count == 1, "prefix of one tone");
+    CHECK(!SoundParsePattern(payload, 10, &seq), "cut in the last number accepted");
+    CHECK(!SoundParsePattern(payload, 20, &seq), "cut in the second tone accepted");
+}
+
+// Eine Folge, ohne und mit Verspätung der Callbacks; die Abweichung jeder Flanke
+// bleibt unter einer Verspätung, egal wie viele Schritte davor lagen
+static void TestTiming(const char *pattern, int64_t latencyUs)
+{
+    SoundSequence seq = Parse(pattern);
+    Edge expected[64];
+    int64_t endUs;
+    char name[96];
+
+    Reset();
+    maxLatencyUs = latencyUs;
+    snprintf(name, sizeof(name), "\"%s\" latency %" PRId64 " us", pattern, latencyUs);
+
+    firstCallbackUs = -1;
+    CHECK(SoundPlay(&seq, false), "%s: not played", name);
+    RunUntil(hostTimeUs + 60LL * 1000 * 1000);
+
+    // Der erste Callback legt den Startpunkt fest, alles danach ist relativ dazu
+    int count = ExpectedEdges(&seq, firstCallbackUs, 0, expected, &endUs);
+
+    CompareEdges(name, expected, count, latencyUs);
+    CHECK(!active && !timerArmed, "%s: sequencer still running", name);
+    maxLatencyUs = 0;
+}
+
+// Zwei Folgen ohne Vorrang: die zweite beginnt genau nach der Pause der ersten,
+// auch wenn sie mitten in der ersten eingereiht wird (früher Kick)
+static void TestChaining(void)
+{
+    SoundSequence first = Parse("2000:100:50,1500:100:30");
+    SoundSequence second = Parse("3000:60:0,0:40:0,3000:60:10");
+    Edge expected[32];
+    int64_t firstEndUs, endUs;
+
+    Reset();
+    CHECK(SoundPlay(&first, false), "first not played");
+    RunUntil(hostTimeUs + 20 * 1000);
+    int64_t startUs = edges[0].us;
+
+    RunUntil(startUs + 120 * 1000);
+    CHECK(SoundPlay(&second, false), "second not played");
+    RunUntil(hostTimeUs + 10LL * 1000 * 1000);
+
+    int count = ExpectedEdges(&first, startUs, 0, expected, &firstEndUs);
+    count += ExpectedEdges(&second, firstEndUs, 0, expected + count, &endUs);
+    CompareEdges("chained", expected, count, 0);
+}
+
+// Vorrang: die laufende Folge endet sofort, die neue beginnt ohne Wartezeit
+static void TestPreempt(void)
+{
+    SoundSequence scan = Parse("2000:500:500,2000:500:500");
+    SoundSequence access = Parse("1000:200:0");
+    SoundSequence queued = Parse("500:100:0");
+    Edge expected[8];
+    int64_t endUs;
+
+    Reset();
+    CHECK(SoundPlay(&scan, false), "scan not played");
+    CHECK(SoundPlay(&queued, false), "second scan not queued");
+    RunUntil(hostTimeUs + 250 * 1000);
+    CHECK(edgeCount == 1 && edges[0].freqHz == 2000, "scan tone not on");
+
+    int64_t preemptUs = hostTimeUs;
+    CHECK(SoundPlay(&access, true), "access not played");
+    RunUntil(hostTimeUs + 10LL * 1000 * 1000);
+
+    // Der Abbruch schaltet die 2000 Hz aus, die neue Folge beginnt im selben Callback.
+    // Die eingereihte Folge ist verworfen.
+    expected[0].us = edges[0].us;
+    expected[0].freqHz = 2000;
+    expected[1].us = preemptUs;
+    expected[1].freqHz = 0;
+    int count = 2 + ExpectedEdges(&access, preemptUs, 0, expected + 2, &endUs);
+    CompareEdges("preempt", expected, count, 0);
+}
+
+// Summer in den Settings aus: nichts wird eingereiht
+static void TestBuzzerDisabled(void)
+{
+    SoundSequence seq = Parse("2000:100:0");
+
+    Reset();
+    snapshot.useBuzzer = false;
+    CHECK(!SoundPlay(&seq, false), "played with buzzer off");
+    RunUntil(hostTimeUs + 1000 * 1000);
+    CHECK(edgeCount == 0, "%d edges with buzzer off", edgeCount);
+    snapshot.useBuzzer = true;
+}
+
+int main(void)
+{
+    static const char *patterns[] = {
+        "2000:100:50",
+        "2000:100:50,1000:200:0,0:80:20,3000:40:60",
+        "4000:30:30,4000:30:30,4000:30:30,4000:30:30,4000:30:30,4000:30:30,4000:30:30,4000:30:30",
+        "1000:0:0,2000:50:0,3000:50:0,0:0:100,500:10:10",
+        "0:100:0,2500:10:10",
+    };
+    // Höchstens so lang wie der kürzeste Schritt, sonst fällt der nächste Zeitpunkt
+    // schon in den verspäteten Callback
+    static const int64_t latencies[] = { 0, 1000, 9000 };
+
+    StartSound();
+    hostTimeUs = 1000 * 1000;
+
+    TestParse();
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        for (size_t l = 0; l < sizeof(latencies) / sizeof(latencies[0]); l++) {
+            for (int run = 0; run < 20; run++) {
+                TestTiming(patterns[p], latencies[l]);
+            }
+        }
+    }
+    TestChaining();
+    TestPreempt();
+    TestBuzzerDisabled();
+
+    printf("%u of %u checks failed\n", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/*
+ * test_scheduler_wheel.c
+ *
+ *  Prüft die Einsortierung in das Timer-Rad von extras/Scheduler.c: Verzögerungen
+ *  rund um jede Ebenengrenze, bei allen Phasen des aktuellen Ticks, müssen genau
+ *  zum Ablauf feuern und nicht eine Runde zu spät.
+ */
+#include <stdio.h>
+
+#include "Scheduler.c"
+
+int64_t hostTimeUs = 0;
+
+void MetricRegister(Metric *metric)
+{
+    (void)metric;
+}
+
+static SchedulerJob job;
+static unsigned failures = 0;
+static unsigned checks = 0;
+
+// Nächster Tick, an dem der Worker den Slot des Jobs bearbeitet, wie in SchedulerAdvance()
+static uint32_t NextVisit(const SchedulerJob *j)
+{
+    if (j->level == 0) {
+        return currentTick + ((j->slot - currentTick) & WHEEL_MASK);
+    }
+
+    int shift = j->level * WHEEL_BITS;
+    uint32_t ahead = (j->slot - (currentTick >> shift)) & WHEEL_MASK;
+    // Der Slot des aktuellen Ticks ist schon aufgelöst und kommt erst nach einer Runde wieder
+    if (ahead == 0) {
+        ahead = WHEEL_SLOTS;
+    }
+    return ((currentTick >> shift) + ahead) << shift;
+}
+
+// Dreht das Rad von Besuch zu Besuch, bis der Job auf Ebene 0 fällig ist
+static uint32_t FireTick(SchedulerJob *j)
+{
+    for (;;) {
+        currentTick = NextVisit(j);
+        if (j->level == 0) {
+            WheelRemove(j);
+            return currentTick;
+        }
+        WheelCascade(j->level, j->slot);
+    }
+}
+
+static void CheckDelay(uint32_t now, uint32_t delta)
+{
+    checks++;
+    currentTick = now;
+    job.expires = now + delta;
+    WheelInsert(&job);
+
+    uint32_t scheduled = job.expires - now;
+    uint32_t fired = FireTick(&job) - now;
+    // Gekürzt wird nur auf die Reichweite des Rads
+    uint32_t wanted = delta < WHEEL_MAX_TICKS ? delta : WHEEL_MAX_TICKS;
+
+    if (fired != wanted || scheduled != wanted) {
+        if (failures++ < 10) {
+            printf("now %" PRIu32 " delay %" PRIu32 ": scheduled %" PRIu32 ", fired after %" PRIu32 "\n",
+                   now, delta, scheduled, fired);
+        }
+    }
+}
+
+int main(void)
+{
+    // Auf eine Runde der obersten Ebene ausgerichtet, die letzte Basis läuft über 2^32
+    static const uint32_t bases[] = { 0, 0x12000000, 0xFF000000 };
+
+    memset(&job, 0, sizeof(job));
+    job.type = JOB_INTERVAL;
+    job.name = "test";
+
+    for (size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); b++) {
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            uint32_t boundary = 1UL << (level * WHEEL_BITS);
+            // Ebene 1 und 2 mit jeder Phase, Ebene 3 mit einer Primzahl als Schritt,
+            // damit alle unteren Bits vorkommen
+            uint32_t step = level < WHEEL_LEVELS - 1 ? 1 : 61;
+
+            for (uint32_t phase = 0; phase < boundary; phase += step) {
+                for (uint32_t delta = boundary - 70; delta <= boundary + 70; delta++) {
+                    CheckDelay(bases[b] + phase, delta);
+                }
+            }
+        }
+
+        // Längste Verzögerung und darüber hinaus, wird auf das Rad gekürzt
+        for (uint32_t phase = 0; phase < (1UL << 18); phase += 61) {
+            for (uint32_t delta = WHEEL_MAX_TICKS - 3; delta < WHEEL_MAX_TICKS; delta++) {
+                CheckDelay(bases[b] + phase, delta);
+            }
+            CheckDelay(bases[b] + phase, WHEEL_MAX_TICKS);
+            CheckDelay(bases[b] + phase, WHEEL_MAX_TICKS + 100);
+        }
+    }
+
+    printf("%u of %u delays fired late or early\n", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+#!/usr/bin/env python3
+"""
+CBOR messages on device/access/<mac>/ and device/settings/<mac>/, see
+extras/CborMessages.h. The device offers "wireFormats":"json,cbor" with the
+settings request. It sends access requests as CBOR once the settings
+contain "wireFormat":"cbor" and reads CBOR or JSON on both topics.
+
+Access request, map with integer keys:
+    1 MAC (6 byte string), 2 UID (5 byte string, big endian), 3 readerId,
+    4 boot, 5 monoUs, 6 ts (ms UTC, 0 before the first time sync), 7 local,
+    8 req
+Access response: {1: true, 2: req} or {"access": true, "req": req}. The
+device keeps one standing subscription on the response topic and drops
+answers whose req does not match the outstanding request. Answers without
+req are accepted.
+Settings: the keys of the JSON document with CBOR numbers and booleans
+instead of strings.
+
+Convert a JSON settings document for device/settings/<mac>/response:
+    wire_format.py settings settings.json -o settings.cbor
+
+Decode a captured message (hex or file) to check what the cloud sent:
+    wire_format.py decode a70146...
+
+Payload bytes of each message in both formats:
+    wire_format.py sizes
+
+Encode/decode time per message. Both sides use pure Python codecs so the
+numbers compare the formats, not the C extension of the json module:
+    wire_format.py bench
+"""
+
+import argparse
+import json
+import json.decoder
+import json.encoder
+import json.scanner
+import struct
+import sys
+import time
+
+# Must match extras/CborMessages.c
+ACCESS_KEYS = ["mac", "uid", "readerId", "boot", "monoUs", "ts", "local", "req"]
+ACCESS_KEY_GRANTED = 1
+ACCESS_KEY_RESPONSE_REQ = 2
+MAC_BYTES = 6
+UID_BYTES = 5
+
+BOOL_FIELDS = {"useWifi", "useNfcReader", "useBuzzer", "useRgbLed"}
+INT_FIELDS = {"beepOnScan", "beepOnValidScan", "beepOnInvalidScan",
+              "nfcPollMaxIdleMs", "nfcBusinessStart", "nfcBusinessEnd"}
+
+# Same document as "How the json have to look.md"
+EXAMPLE_SETTINGS = {
+    "useWifi": "false",
+    "useNfcReader": "true",
+    "useRgbLed": "true",
+    "useBuzzer": "true",
+    "beepOnScan": "300",
+    "beepOnValidScan": "500",
+    "beepOnInvalidScan": "6000",
+    "colorOnScan": "0000FF",
+    "colorOnValidScan": "00FF00",
+    "colorOnInvalidScan": "FF0000",
+    "patternOnScan": "300:80:40,300:80:0",
+    "patternOnValidScan": "500:150:50,1000:300:0",
+    "patternOnInvalidScan": "6000:500:0",
+    "nfcPollMaxIdleMs": "1000",
+    "nfcBusinessStart": "7",
+    "nfcBusinessEnd": "18",
+    "wireFormat": "cbor",
+}
+
+
+def cbor_head(major, value):
+    """Shortest head like tinycbor."""
+    if value < 24:
+        return bytes([major << 5 | value])
+    for info, fmt in ((24, ">B"), (25, ">H"), (26, ">I"), (27, ">Q")):
+        if value < 1 << (8 * struct.calcsize(fmt)):
+            return bytes([major << 5 | info]) + struct.pack(fmt, value)
+    raise ValueError("integer too large: %d" % value)
+
+
+def cbor_encode(value):
+    if value is None:
+        return b"\xf6"
+    if value is True or value is False:
+        return b"\xf5" if value else b"\xf4"
+    if isinstance(value, int):
+        return cbor_head(0, value) if value >= 0 else cbor_head(1, -1 - value)
+    if isinstance(value, (bytes, bytearray)):
+        return cbor_head(2, len(value)) + bytes(value)
+    if isinstance(value, str):
+        data = value.encode("utf-8")
+        return cbor_head(3, len(data)) + data
+    if isinstance(value, dict):
+        return cbor_head(5, len(value)) + b"".join(cbor_encode(k) + cbor_encode(v) for k, v in value.items())
+    raise TypeError("cannot encode %r" % type(value))
+
+
+def cbor_decode(data, pos=0):
+    """Returns (value, next position). Definite lengths only, like the cloud and device use."""
+    head = data[pos]
+    major, info = head >> 5, head & 0x1F
+    pos += 1
+    if major == 7:
+        simple = {20: False, 21: True, 22: None}
+        if info not in simple:
+            raise ValueError("unsupported simple value %d" % info)
+        return simple[info], pos
+    if info < 24:
+        arg = info
+    elif info <= 27:
+        size = 1 << (info - 24)
+        arg = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    else:
+        raise ValueError("indefinite length not supported")
+
+    if major == 0:
+        return arg, pos
+    if major == 1:
+        return -1 - arg, pos
+    if major in (2, 3):
+        chunk = data[pos:pos + arg]
+        if len(chunk) != arg:
+            raise ValueError("truncated string")
+        return (bytes(chunk) if major == 2 else chunk.decode("utf-8")), pos + arg
+    if major == 5:
+        result = {}
+        for _ in range(arg):
+            key, pos = cbor_decode(data, pos)
+            result[key], pos = cbor_decode(data, pos)
+        return result, pos
+    raise ValueError("unsupported major type %d" % major)
+
+
+def cbor_loads(data):
+    value, pos = cbor_decode(data)
+    if pos != len(data):
+        raise ValueError("%d trailing bytes" % (len(data) - pos))
+    return value
+
+
+def access_request_json(mac, uid, reader_id, boot, mono_us, ts_ms, local, req):
+    """Same text as JsonAccessString() in Json.c."""
+    return ('{"macAddrHex":"%s","uid":"%010X","readerId":%u,"boot":%u,"monoUs":%d,"ts":%d,"local":%s,"req":%u}' % (
+        mac, uid, reader_id, boot, mono_us, ts_ms, "true" if local else "false", req)).encode()
+
+
+def access_request_cbor(mac, uid, reader_id, boot, mono_us, ts_ms, local, req):
+    """Same bytes as CborAccessRequest() in CborMessages.c."""
+    values = [bytes.fromhex(mac), uid.to_bytes(UID_BYTES, "big"), reader_id, boot, mono_us, ts_ms, local, req]
+    return cbor_encode({i + 1: v for i, v in enumerate(values)})
+
+
+def settings_to_native(doc):
+    """String numbers and booleans of the JSON document as CBOR values."""
+    native = {}
+    for key, value in doc.items():
+        if key in BOOL_FIELDS and isinstance(value, str):
+            value = value == "true"
+        elif key in INT_FIELDS and isinstance(value, str):
+            value = int(value)
+        native[key] = value
+    return native
+
+
+def example_messages():
+    request = ("AABBCCDDEEFF", 0x04A1B2C3D4, 1, 1234, 86400123456, 1760000000123, False, 4711)
+    return [
+        ("access request", access_request_json(*request), access_request_cbor(*request)),
+        ("access response", b'{"access":true,"req":4711}',
+         cbor_encode({ACCESS_KEY_GRANTED: True, ACCESS_KEY_RESPONSE_REQ: 4711})),
+        ("settings", json.dumps(EXAMPLE_SETTINGS, separators=(",", ":")).encode(),
+         cbor_encode(settings_to_native(EXAMPLE_SETTINGS))),
+    ]
+
+
+def settings(args):
+    with open(args.input, "r", encoding="utf-8") as f:
+        doc = json.load(f)
+    unknown = set(doc) - BOOL_FIELDS - INT_FIELDS - set(EXAMPLE_SETTINGS)
+    if unknown:
+        print("warning: ignored by the device: %s" % ", ".join(sorted(unknown)))
+
+    data = cbor_encode(settings_to_native(doc))
+    with open(args.output, "wb") as f:
+        f.write(data)
+    print("%s: %d bytes, JSON %d bytes" % (args.output, len(data),
+                                            len(json.dumps(doc, separators=(",", ":")).encode())))
+
+
+def decode(args):
+    try:
+        data = bytes.fromhex(args.input)
+    except ValueError:
+        with open(args.input, "rb") as f:
+            data = f.read()
+    value = cbor_loads(data)
+    if isinstance(value, dict) and set(value) == set(range(1, len(ACCESS_KEYS) + 1)):
+        value = {ACCESS_KEYS[k - 1]: v.hex().upper() if isinstance(v, bytes) else v for k, v in value.items()}
+    print(value)
+
+
+def sizes(args):
+    print("%-16s %6s %6s %7s" % ("message", "JSON", "CBOR", "saved"))
+    for name, as_json, as_cbor in example_messages():
+        print("%-16s %6d %6d %6.0f%%" % (name, len(as_json), len(as_cbor),
+                                        (1 - len(as_cbor) / len(as_json)) * 100))
+
+
+class PyJSONDecoder(json.JSONDecoder):
+    """json without the C scanner, for a fair comparison with the Python CBOR codec."""
+
+    def __init__(self):
+        super().__init__()
+        self.parse_string = json.decoder.py_scanstring
+        self.scan_once = json.scanner.py_make_scanner(self)
+
+
+def py_json_dumps(value):
+    saved = json.encoder.c_make_encoder, json.encoder.encode_basestring_ascii
+    json.encoder.c_make_encoder = None
+    json.encoder.encode_basestring_ascii = json.encoder.py_encode_basestring_ascii
+    try:
+        return json.JSONEncoder(separators=(",", ":")).encode(value)
+    finally:
+        json.encoder.c_make_encoder, json.encoder.encode_basestring_ascii = saved
+
+
+def timed(func, count):
+    start = time.perf_counter()
+    for _ in range(count):
+        func()
+    return (time.perf_counter() - start) / count * 1e6
+
+
+def bench(args):
+    decoder = PyJSONDecoder()
+
+    print("%-16s %10s %10s %10s %10s" % ("message", "JSON enc", "CBOR enc", "JSON dec", "CBOR dec"))
+    for name, as_json, as_cbor in example_messages():
+        doc = json.loads(as_json)
+        native = cbor_loads(as_cbor)
+        text = as_json.decode()
+        if cbor_encode(native) != as_cbor:
+            sys.exit("%s: CBOR round trip failed" % name)
+
+        print("%-16s %8.2fus %8.2fus %8.2fus %8.2fus" % (
+            name,
+            timed(lambda: py_json_dumps(doc), args.count),
+            timed(lambda: cbor_encode(native), args.count),
+            timed(lambda: decoder.decode(text), args.count),
+            timed(lambda: cbor_loads(as_cbor), args.count)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    p = commands.add_parser("settings", help="convert a JSON settings document to CBOR")
+    p.add_argument("input")
+    p.add_argument("-o", "--output", default="settings.cbor")
+    p.set_defaults(func=settings)
+
+    p = commands.add_parser("decode", help="print a CBOR message given as hex or file")
+    p.add_argument("input")
+    p.set_defaults(func=decode)
+
+    p = commands.add_parser("sizes", help="payload bytes in JSON and CBOR")
+    p.set_defaults(func=sizes)
+
+    p = commands.add_parser("bench", help="encode/decode time in JSON and CBOR")
+    p.add_argument("--count", type=int, default=20000)
+    p.set_defaults(func=bench)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()